@@ -0,0 +1,206 @@
+//
+//  CBConcurrencyLimiter.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBConcurrencyLimiter.h"
+
+static const double CBConcurrencyLimiterInitialLimit = 4;
+static const double CBConcurrencyLimiterLatencyWeight = 0.2;
+
+@interface CBConcurrencyLimiterToken : NSObject
+
+@property (nonatomic, copy) void (^granted)(void);
+@property (nonatomic) NSDate *grantedDate;
+@property (nonatomic) NSDate *responseDate;
+
+@end
+
+@implementation CBConcurrencyLimiterToken
+
+@end
+
+@implementation CBConcurrencyLimiter
+{
+    double _limit;
+    int _inFlightCount;
+    NSMutableArray *_waiters;
+    NSTimeInterval _latency;
+    NSTimeInterval _minLatency;
+    NSDate *_lastDecreaseDate;
+}
+
++ (CBConcurrencyLimiter *)limiterForDomain:(NSString *)domain
+{
+    static NSMutableDictionary *limiters = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        limiters = [NSMutableDictionary dictionary];
+    });
+
+    NSString *key = domain ? domain : @"";
+    @synchronized(limiters) {
+        CBConcurrencyLimiter *limiter = limiters[key];
+        if (limiter == nil) {
+            limiter = [self new];
+            limiters[key] = limiter;
+        }
+        return limiter;
+    }
+}
+
+- (CBConcurrencyLimiter *)init
+{
+    if (self = [super init]) {
+        _minLimit = 1;
+        _maxLimit = 16;
+        _latencyTolerance = 2.0;
+        _limit = CBConcurrencyLimiterInitialLimit;
+        _waiters = [NSMutableArray array];
+    }
+
+    return self;
+}
+
+- (int)currentLimit
+{
+    @synchronized(self) {
+        return (int)_limit;
+    }
+}
+
+- (int)inFlightCount
+{
+    @synchronized(self) {
+        return _inFlightCount;
+    }
+}
+
+- (int)waitingCount
+{
+    @synchronized(self) {
+        return (int)_waiters.count;
+    }
+}
+
+- (NSTimeInterval)latency
+{
+    @synchronized(self) {
+        return _latency;
+    }
+}
+
+- (id)acquire:(void (^)(void))granted
+{
+    CBConcurrencyLimiterToken *token = [CBConcurrencyLimiterToken new];
+    token.granted = granted;
+
+    @synchronized(self) {
+        [_waiters addObject:token];
+    }
+    [self grantWaiters];
+
+    return token;
+}
+
+- (void)didReceiveResponse:(id)token
+{
+    CBConcurrencyLimiterToken *limiterToken = token;
+
+    @synchronized(self) {
+        if (limiterToken.grantedDate && limiterToken.responseDate == nil) {
+            limiterToken.responseDate = [NSDate date];
+        }
+    }
+}
+
+- (void)finish:(id)token statusCode:(NSInteger)statusCode
+{
+    CBConcurrencyLimiterToken *limiterToken = token;
+
+    @synchronized(self) {
+        if (limiterToken.grantedDate == nil) {
+            // cancelled while waiting; it never held a slot
+            [_waiters removeObjectIdenticalTo:limiterToken];
+            return;
+        }
+
+        BOOL saturated = _inFlightCount >= (int)_limit;
+        _inFlightCount--;
+
+        // from the start of the connection to the response, not including the transfer of the body
+        NSDate *responseDate = limiterToken.responseDate ? limiterToken.responseDate : [NSDate date];
+        NSTimeInterval latency = [responseDate timeIntervalSinceDate:limiterToken.grantedDate];
+        limiterToken.grantedDate = nil;
+
+        if (statusCode == 429 || statusCode == 503) {
+            [self decrease:0.5];
+        }
+        else if (statusCode >= 200 && statusCode < 300) {
+            _latency = _latency > 0 ? _latency + (latency - _latency) * CBConcurrencyLimiterLatencyWeight : latency;
+            // let the baseline drift up slowly, so that it follows a server that has become slower for good
+            _minLatency = _minLatency > 0 ? MIN(latency, _minLatency * 1.01) : latency;
+
+            if (_latency > _minLatency * self.latencyTolerance) {
+                [self decrease:0.9];
+            }
+            else if (saturated) {
+                // one slot per round trip
+                _limit = MIN(_limit + 1.0 / _limit, self.maxLimit);
+            }
+        }
+    }
+    [self grantWaiters];
+}
+
+#pragma mark - private
+
+- (void)decrease:(double)factor
+{
+    // responses of requests sent before the last decrease don't reflect it yet
+    NSTimeInterval window = _latency > 0 ? _latency : 1;
+    if (_lastDecreaseDate && -[_lastDecreaseDate timeIntervalSinceNow] < window) {
+        return;
+    }
+
+    _limit = MAX(_limit * factor, self.minLimit);
+    _lastDecreaseDate = [NSDate date];
+    [CBLog sdkLogVerbose:@"concurrency limit decreased to %d", (int)_limit];
+}
+
+- (void)grantWaiters
+{
+    NSMutableArray *granted = [NSMutableArray array];
+
+    @synchronized(self) {
+        while (_waiters.count > 0 && _inFlightCount < MAX((int)_limit, self.minLimit)) {
+            CBConcurrencyLimiterToken *token = _waiters[0];
+            [_waiters removeObjectAtIndex:0];
+            token.grantedDate = [NSDate date];
+            _inFlightCount++;
+            [granted addObject:token];
+        }
+    }
+
+    // run outside of the lock, the blocks may start operations
+    for (CBConcurrencyLimiterToken *token in granted) {
+        if (token.granted) {
+            token.granted();
+        }
+    }
+}
+
+@end
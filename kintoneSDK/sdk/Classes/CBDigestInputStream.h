@@ -0,0 +1,32 @@
+//
+//  CBDigestInputStream.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+// An input stream that reads a file or data and computes the SHA-256 of its content as the bytes are read,
+// so that a file sent as a request body is hashed without a second pass over it.
+// Opening the stream again starts over from the first byte, as a copied multipart body reads its parts again.
+@interface CBDigestInputStream : NSInputStream
+
+// lowercase hexadecimal SHA-256 of the file once it has been read to the end, otherwise nil
+@property (nonatomic, readonly) NSString *digest;
+
+- (CBDigestInputStream *)initWithFileURL:(NSURL *)fileURL;
+- (CBDigestInputStream *)initWithData:(NSData *)data;
+
+@end
@@ -0,0 +1,141 @@
+//
+//  CBDigestInputStream.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBDigestInputStream.h"
+
+#import <CommonCrypto/CommonDigest.h>
+
+#import "NSString+Utility.h"
+
+@implementation CBDigestInputStream
+{
+    NSURL *_fileURL;
+    NSData *_data;
+    NSInputStream *_inputStream;
+    CC_SHA256_CTX _context;
+    __weak id<NSStreamDelegate> _delegate;
+}
+
+- (CBDigestInputStream *)initWithFileURL:(NSURL *)fileURL
+{
+    assert([fileURL isFileURL]);
+
+    if (self = [super init]) {
+        _fileURL = fileURL;
+    }
+
+    return self;
+}
+
+- (CBDigestInputStream *)initWithData:(NSData *)data
+{
+    assert(data != nil);
+
+    if (self = [super init]) {
+        _data = data;
+    }
+
+    return self;
+}
+
+#pragma mark - NSStream
+
+- (void)open
+{
+    [_inputStream close];
+    _inputStream = _data ? [NSInputStream inputStreamWithData:_data] : [NSInputStream inputStreamWithURL:_fileURL];
+    _digest = nil;
+    CC_SHA256_Init(&_context);
+
+    [_inputStream open];
+}
+
+- (void)close
+{
+    // only a file read to the end has a digest; a body cut short does not
+    if (_digest == nil && [_inputStream streamStatus] == NSStreamStatusAtEnd) {
+        unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+        CC_SHA256_Final(digest, &_context);
+        _digest = [NSString hexStringWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+    }
+
+    [_inputStream close];
+}
+
+- (NSStreamStatus)streamStatus
+{
+    return _inputStream ? [_inputStream streamStatus] : NSStreamStatusNotOpen;
+}
+
+- (NSError *)streamError
+{
+    return [_inputStream streamError];
+}
+
+- (id<NSStreamDelegate>)delegate
+{
+    return _delegate;
+}
+
+- (void)setDelegate:(id<NSStreamDelegate>)delegate
+{
+    _delegate = delegate;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+    // read synchronously by the multipart body, no run loop source is needed
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+}
+
+- (id)propertyForKey:(NSString *)key
+{
+    return [_inputStream propertyForKey:key];
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key
+{
+    return NO;
+}
+
+#pragma mark - NSInputStream
+
+- (BOOL)hasBytesAvailable
+{
+    return [_inputStream hasBytesAvailable];
+}
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)length
+{
+    NSInteger bytesRead = [_inputStream read:buffer maxLength:length];
+    if (bytesRead > 0) {
+        CC_SHA256_Update(&_context, buffer, (CC_LONG)bytesRead);
+    }
+
+    return bytesRead;
+}
+
+- (BOOL)getBuffer:(uint8_t **)buffer length:(NSUInteger *)length
+{
+    return NO;
+}
+
+@end
@@ -0,0 +1,32 @@
+//
+//  CBJSONStreamParser.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef void (^CBJSONStreamParserElementBlock)(id JSON);
+
+// An output stream that decodes the object elements of one top-level array (e.g. "records") as the bytes are written,
+// passing each element to the element block on the writing thread as soon as its closing brace is seen.
+// Everything outside that array is kept as the "envelope" and returned for NSStreamDataWrittenToMemoryStreamKey,
+// with the array left empty, so that error responses and the remaining keys can still be parsed as a whole.
+// An element that fails to parse stops the stream; the caller has to check streamError once the response is complete.
+@interface CBJSONStreamParser : NSOutputStream
+
+- (CBJSONStreamParser *)initWithArrayKey:(NSString *)arrayKey element:(CBJSONStreamParserElementBlock)element;
+
+@end
@@ -0,0 +1,254 @@
+//
+//  CBJSONStreamParser.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBJSONStreamParser.h"
+
+typedef enum CBJSONStreamParserMode : NSUInteger {
+    CBJSONStreamParserEnvelopeMode = 0,  // bytes outside of the array
+    CBJSONStreamParserArrayMode,         // separators between the elements, dropped
+    CBJSONStreamParserElementMode        // bytes of the current element
+} CBJSONStreamParserMode;
+
+@implementation CBJSONStreamParser
+{
+    NSString *_arrayKey;
+    CBJSONStreamParserElementBlock _element;
+
+    NSStreamStatus _streamStatus;
+    NSError *_streamError;
+    __weak id<NSStreamDelegate> _delegate;
+
+    CBJSONStreamParserMode _mode;
+    NSUInteger _depth;
+    BOOL _inString;
+    BOOL _escaped;
+    BOOL _arrayDone;
+    NSMutableData *_keyBuffer;      // the last string seen directly in the top-level object
+    NSMutableData *_elementBuffer;
+    NSMutableData *_envelope;
+}
+
+- (CBJSONStreamParser *)initWithArrayKey:(NSString *)arrayKey element:(CBJSONStreamParserElementBlock)element
+{
+    assert(arrayKey != nil);
+
+    if (self = [super init]) {
+        _arrayKey = [arrayKey copy];
+        _element = element;
+        _streamStatus = NSStreamStatusNotOpen;
+        _mode = CBJSONStreamParserEnvelopeMode;
+        _depth = 0;
+        _keyBuffer = [NSMutableData data];
+        _elementBuffer = [NSMutableData data];
+        _envelope = [NSMutableData data];
+    }
+
+    return self;
+}
+
+#pragma mark - NSStream
+
+- (void)open
+{
+    _streamStatus = NSStreamStatusOpen;
+}
+
+- (void)close
+{
+    _streamStatus = NSStreamStatusClosed;
+}
+
+- (NSStreamStatus)streamStatus
+{
+    return _streamStatus;
+}
+
+- (NSError *)streamError
+{
+    return _streamError;
+}
+
+- (id<NSStreamDelegate>)delegate
+{
+    return _delegate;
+}
+
+- (void)setDelegate:(id<NSStreamDelegate>)delegate
+{
+    _delegate = delegate;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+    // writes are synchronous, no run loop source is needed
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+}
+
+- (id)propertyForKey:(NSString *)key
+{
+    if ([key isEqualToString:NSStreamDataWrittenToMemoryStreamKey]) {
+        return [_envelope copy];
+    }
+
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key
+{
+    return NO;
+}
+
+#pragma mark - NSOutputStream
+
+- (BOOL)hasSpaceAvailable
+{
+    return _streamStatus == NSStreamStatusOpen;
+}
+
+- (NSInteger)write:(const uint8_t *)buffer maxLength:(NSUInteger)length
+{
+    if (_streamStatus != NSStreamStatusOpen) {
+        return -1;
+    }
+
+    // bytes in [start, i) belong to the current mode
+    NSUInteger start = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t c = buffer[i];
+
+        if (_inString) {
+            if (_escaped) {
+                _escaped = NO;
+            }
+            else if (c == '\\') {
+                _escaped = YES;
+            }
+            else if (c == '"') {
+                _inString = NO;
+            }
+            else if (_depth == 1) {
+                [_keyBuffer appendBytes:&c length:1];
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '"':
+                _inString = YES;
+                if (_depth == 1) {
+                    [_keyBuffer setLength:0];
+                }
+                break;
+
+            case '{':
+            case '[':
+                if (_mode == CBJSONStreamParserArrayMode && _depth == 2 && c == '{') {
+                    // an element starts
+                    [self appendBytes:buffer + start length:i - start];
+                    start = i;
+                    _mode = CBJSONStreamParserElementMode;
+                }
+                else if (_mode == CBJSONStreamParserEnvelopeMode && _depth == 1 && c == '[' && !_arrayDone && [self isArrayKey]) {
+                    // the array starts; keep "[" in the envelope and drop its contents
+                    [self appendBytes:buffer + start length:i + 1 - start];
+                    start = i + 1;
+                    _mode = CBJSONStreamParserArrayMode;
+                }
+                _depth++;
+                break;
+
+            case '}':
+            case ']':
+                _depth--;
+                if (_mode == CBJSONStreamParserElementMode && _depth == 2) {
+                    // the element ends
+                    [self appendBytes:buffer + start length:i + 1 - start];
+                    start = i + 1;
+                    if (![self emitElement]) {
+                        // stop at the first malformed element, the rest of the response is not trusted
+                        return -1;
+                    }
+                    _mode = CBJSONStreamParserArrayMode;
+                }
+                else if (_mode == CBJSONStreamParserArrayMode && _depth == 1) {
+                    // the array ends; keep "]" in the envelope
+                    start = i;
+                    _mode = CBJSONStreamParserEnvelopeMode;
+                    _arrayDone = YES;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+    [self appendBytes:buffer + start length:length - start];
+
+    return length;
+}
+
+#pragma mark - private
+
+- (BOOL)isArrayKey
+{
+    NSString *key = [[NSString alloc] initWithData:_keyBuffer encoding:NSUTF8StringEncoding];
+    return [key isEqualToString:_arrayKey];
+}
+
+- (void)appendBytes:(const uint8_t *)bytes length:(NSUInteger)length
+{
+    if (length == 0) {
+        return;
+    }
+
+    switch (_mode) {
+        case CBJSONStreamParserEnvelopeMode:
+            [_envelope appendBytes:bytes length:length];
+            break;
+        case CBJSONStreamParserElementMode:
+            [_elementBuffer appendBytes:bytes length:length];
+            break;
+        default:
+            break;
+    }
+}
+
+- (BOOL)emitElement
+{
+    NSError *error = nil;
+    id JSON = [NSJSONSerialization JSONObjectWithData:_elementBuffer options:0 error:&error];
+    // reuse the buffer, so memory stays bounded by the largest element
+    [_elementBuffer setLength:0];
+
+    if (JSON == nil) {
+        [CBLog sdkLogError:@"failed to parse a JSON element: %@", error];
+        _streamError = error;
+        _streamStatus = NSStreamStatusError;
+        return NO;
+    }
+
+    if (_element) {
+        _element(JSON);
+    }
+    return YES;
+}
+
+@end
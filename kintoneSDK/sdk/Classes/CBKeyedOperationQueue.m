@@ -0,0 +1,252 @@
+//
+//  CBKeyedOperationQueue.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBKeyedOperationQueue.h"
+
+@interface CBKeyedOperationQueue ()
+
+- (NSArray *)operationsForKey:(id<NSCopying>)key;
+- (void)cancelAllOperationsForKey:(id<NSCopying>)key;
+
+@end
+
+// the queue returned by queueForKey:; it only forwards its operations to the keyed queue
+@interface CBKeyedOperationQueueKeyQueue : NSOperationQueue
+
+@property (nonatomic) CBKeyedOperationQueue *keyedQueue;
+@property (nonatomic, copy) id<NSCopying> key;
+@property (nonatomic, copy) id<NSCopying> parentKey;
+
+@end
+
+@implementation CBKeyedOperationQueueKeyQueue
+
+- (void)addOperation:(NSOperation *)operation
+{
+    [self.keyedQueue addOperation:operation key:self.key parentKey:self.parentKey];
+}
+
+- (void)addOperations:(NSArray *)operations waitUntilFinished:(BOOL)wait
+{
+    for (NSOperation *operation in operations) {
+        [self addOperation:operation];
+    }
+
+    if (wait) {
+        for (NSOperation *operation in operations) {
+            [operation waitUntilFinished];
+        }
+    }
+}
+
+- (void)addOperationWithBlock:(void (^)(void))block
+{
+    [self addOperation:[NSBlockOperation blockOperationWithBlock:block]];
+}
+
+- (NSArray *)operations
+{
+    return [self.keyedQueue operationsForKey:self.key];
+}
+
+- (NSUInteger)operationCount
+{
+    return [self operations].count;
+}
+
+- (void)cancelAllOperations
+{
+    [self.keyedQueue cancelAllOperationsForKey:self.key];
+}
+
+- (NSInteger)maxConcurrentOperationCount
+{
+    // the operations of one key run one at a time
+    return 1;
+}
+
+- (void)waitUntilAllOperationsAreFinished
+{
+    for (NSOperation *operation in [self operations]) {
+        [operation waitUntilFinished];
+    }
+}
+
+@end
+
+@implementation CBKeyedOperationQueue
+{
+    NSMutableDictionary *_lastOperations;   // key -> the operation added last
+    NSMutableDictionary *_keyOperations;    // key -> unfinished operations in order
+    NSMutableDictionary *_childKeys;        // parent key -> child keys with unfinished operations
+    NSMutableDictionary *_parentKeys;       // child key -> parent key
+    NSOperationQueue *_markerQueue;
+}
+
++ (CBKeyedOperationQueue *)sharedQueue
+{
+    static CBKeyedOperationQueue *sharedInstance = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [self new];
+        sharedInstance.name = @"CBKeyedOperationQueue.shared";
+    });
+
+    return sharedInstance;
+}
+
+- (CBKeyedOperationQueue *)init
+{
+    if (self = [super init]) {
+        _lastOperations = [NSMutableDictionary dictionary];
+        _keyOperations = [NSMutableDictionary dictionary];
+        _childKeys = [NSMutableDictionary dictionary];
+        _parentKeys = [NSMutableDictionary dictionary];
+        _markerQueue = [NSOperationQueue new];
+        _markerQueue.name = @"CBKeyedOperationQueue.marker";
+    }
+
+    return self;
+}
+
+- (void)addOperation:(NSOperation *)operation key:(id<NSCopying>)key
+{
+    [self addOperation:operation key:key parentKey:nil];
+}
+
+- (void)addOperation:(NSOperation *)operation key:(id<NSCopying>)key parentKey:(id<NSCopying>)parentKey
+{
+    assert(key != nil);
+
+    NSMutableArray *dependencies = [NSMutableArray array];
+    @synchronized(self) {
+        if (_lastOperations[key] != nil) {
+            [dependencies addObject:_lastOperations[key]];
+        }
+        _lastOperations[key] = operation;
+
+        NSMutableArray *operations = _keyOperations[key];
+        if (operations == nil) {
+            operations = [NSMutableArray array];
+            _keyOperations[key] = operations;
+        }
+        [operations addObject:operation];
+
+        if (parentKey != nil) {
+            // a child waits for the parent's operations added before it
+            if (_lastOperations[parentKey] != nil) {
+                [dependencies addObject:_lastOperations[parentKey]];
+            }
+            NSMutableSet *childKeys = _childKeys[parentKey];
+            if (childKeys == nil) {
+                childKeys = [NSMutableSet set];
+                _childKeys[parentKey] = childKeys;
+            }
+            [childKeys addObject:key];
+            _parentKeys[key] = parentKey;
+        }
+        else {
+            // and the parent waits for the children's operations added before it
+            for (id childKey in _childKeys[key]) {
+                NSOperation *last = _lastOperations[childKey];
+                if (last != nil) {
+                    [dependencies addObject:last];
+                }
+            }
+        }
+    }
+
+    // a cancelled operation ignores its dependencies and finishes at once, so the next one runs next
+    for (NSOperation *dependency in dependencies) {
+        [operation addDependency:dependency];
+    }
+
+    // a marker that depends on the operation tells when it has finished, without touching its completion block
+    NSOperation *marker = [NSBlockOperation blockOperationWithBlock:^{
+        [self operationDidFinish:operation dependencies:dependencies key:key];
+    }];
+    [marker addDependency:operation];
+    [_markerQueue addOperation:marker];
+
+    [super addOperation:operation];
+}
+
+- (NSOperationQueue *)queueForKey:(id<NSCopying>)key
+{
+    return [self queueForKey:key parentKey:nil];
+}
+
+- (NSOperationQueue *)queueForKey:(id<NSCopying>)key parentKey:(id<NSCopying>)parentKey
+{
+    assert(key != nil);
+
+    CBKeyedOperationQueueKeyQueue *queue = [CBKeyedOperationQueueKeyQueue new];
+    queue.keyedQueue = self;
+    queue.key = key;
+    queue.parentKey = parentKey;
+    queue.name = [NSString stringWithFormat:@"%@.%@", self.name ?: @"CBKeyedOperationQueue", key];
+
+    return queue;
+}
+
+#pragma mark - private
+
+- (NSArray *)operationsForKey:(id<NSCopying>)key
+{
+    @synchronized(self) {
+        return [_keyOperations[key] copy] ?: @[];
+    }
+}
+
+- (void)cancelAllOperationsForKey:(id<NSCopying>)key
+{
+    for (NSOperation *operation in [self operationsForKey:key]) {
+        [operation cancel];
+    }
+}
+
+- (void)operationDidFinish:(NSOperation *)operation dependencies:(NSArray *)dependencies key:(id<NSCopying>)key
+{
+    // finished operations must not keep the whole chain of their predecessors alive
+    for (NSOperation *dependency in dependencies) {
+        [operation removeDependency:dependency];
+    }
+
+    @synchronized(self) {
+        if (_lastOperations[key] == operation) {
+            [_lastOperations removeObjectForKey:key];
+        }
+
+        NSMutableArray *operations = _keyOperations[key];
+        [operations removeObjectIdenticalTo:operation];
+        if (operations.count == 0) {
+            [_keyOperations removeObjectForKey:key];
+
+            id parentKey = _parentKeys[key];
+            if (parentKey != nil) {
+                [_parentKeys removeObjectForKey:key];
+                [_childKeys[parentKey] removeObject:key];
+                if ([_childKeys[parentKey] count] == 0) {
+                    [_childKeys removeObjectForKey:parentKey];
+                }
+            }
+        }
+    }
+}
+
+@end
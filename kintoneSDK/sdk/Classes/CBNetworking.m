@@ -18,60 +18,441 @@
 
 #import "CBNetworking.h"
 
+#import "CBConcurrencyLimiter.h"
 #import "CBCredential.h"
+#import "CBError.h"
+#import "CBJSONStreamParser.h"
+#import "CBOperationQueue.h"
+#import "CBPartialFileOutputStream.h"
+#import "CBPipe.h"
+#import "CBRequestHandle.h"
+#import "CBRetryPolicy.h"
 
 #import "AFNetworking.h"
 
-@implementation CBNetworking
+// called for every failed attempt; returns YES if the request has been scheduled to be sent again
+typedef BOOL (^CBNetworkingRetryBlock)(NSHTTPURLResponse *response, NSError *error);
 
-+ (void)sendRequestForJSONResponse:(NSURLRequest *)request
-                        credential:(CBCredential *)credential
-                           success:(CBNetworkingSuccessBlockForJSONResponse)success
-                           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                             queue:(NSOperationQueue *)queue
+// ranges are not made smaller than this, so that small files are not split into many requests
+static const unsigned long long CBNetworkingMinimumRangeLength = 1024 * 1024;
+
+@interface CBNetworkingRange : NSObject
+
+@property (nonatomic) unsigned long long offset;    // the next byte to receive
+@property (nonatomic) unsigned long long end;       // the last byte of the range
+@property (nonatomic) int retryCount;
+@property (nonatomic) NSDate *startDate;
+
+@end
+
+@implementation CBNetworkingRange
+
+@end
+
+@interface CBNetworkingRangedDownload : NSObject
+
+@property (nonatomic) NSURLRequest *request;
+@property (nonatomic) CBCredential *credential;
+@property (nonatomic) CBRetryPolicy *retryPolicy;
+@property (nonatomic) unsigned long long length;
+@property (nonatomic) NSURL *partialFileURL;       // where a fallback to a single stream resumes
+@property (nonatomic) NSURL *rangesFileURL;        // the ranges are written into their own file, which cannot be resumed
+@property (nonatomic) NSURL *destinationURL;
+@property (nonatomic) CBRequestHandle *handle;
+@property (nonatomic, copy) CBNetworkingSuccessBlockForHTTPResponse success;
+@property (nonatomic, copy) CBNetworkingFailureBlockForHTTPResponse failure;
+@property (nonatomic, copy) CBNetworkingDownloadProgressBlock download;
+@property (nonatomic) NSOperationQueue *queue;
+@property (nonatomic) NSArray *ranges;
+@property (nonatomic) NSMutableSet *attempts;       // handles of the range requests in flight
+@property (nonatomic) unsigned long long receivedLength;
+@property (nonatomic) BOOL probing;                 // the first range tells whether the server honours ranges
+@property (nonatomic) BOOL singleStream;            // the server sent the whole file for the first range
+@property (nonatomic) BOOL done;
+
+@end
+
+@implementation CBNetworkingRangedDownload
+
+@end
+
+// holds the place of a request in a serial queue until its last attempt has completed,
+// so that a retry is not sent after the requests queued behind the first attempt
+@interface CBNetworkingRequestOperation : NSOperation
+
+@property (nonatomic) CBRequestHandle *handle;
+@property (nonatomic, copy) void (^sendBlock)(void);
+
+- (void)finish;
+
+@end
+
+@implementation CBNetworkingRequestOperation
 {
-    // wrap blocks for logging and creating error object
-    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
-        [[AFNetworkActivityIndicatorManager sharedManager] decrementActivityCount];
+    BOOL _executing;
+    BOOL _finished;
+}
 
-        [self log:request response:response responseObject:JSON];
+- (BOOL)isConcurrent
+{
+    return YES;
+}
 
-        if (success) {
+- (BOOL)isExecuting
+{
+    @synchronized(self) {
+        return _executing;
+    }
+}
+
+- (BOOL)isFinished
+{
+    @synchronized(self) {
+        return _finished;
+    }
+}
+
+- (void)start
+{
+    [self willChangeValueForKey:@"isExecuting"];
+    @synchronized(self) {
+        _executing = YES;
+    }
+    [self didChangeValueForKey:@"isExecuting"];
+
+    // a cancelled request still runs its failure block, which finishes the handle and this operation
+    if (self.isCancelled) {
+        [self.handle cancel];
+    }
+    [self.handle addCompletionObserver:^(CBRequestHandle *handle) {
+        [self finish];
+    }];
+    self.sendBlock();
+    self.sendBlock = nil;
+}
+
+- (void)cancel
+{
+    [super cancel];
+    [self.handle cancel];
+}
+
+- (void)finish
+{
+    @synchronized(self) {
+        if (_finished || !_executing) {
+            return;
+        }
+    }
+
+    [self willChangeValueForKey:@"isExecuting"];
+    [self willChangeValueForKey:@"isFinished"];
+    @synchronized(self) {
+        _executing = NO;
+        _finished = YES;
+    }
+    [self didChangeValueForKey:@"isFinished"];
+    [self didChangeValueForKey:@"isExecuting"];
+}
+
+@end
+
+// a slot of the concurrency limiter, requested when the operation is started by its queue
+// rather than when it is added, so that the time spent behind other operations is not counted
+@interface CBNetworkingPermit : NSObject
+
+- (CBNetworkingPermit *)initWithLimiter:(CBConcurrencyLimiter *)limiter;
+- (void)acquire:(void (^)(void))start;
+- (void)cancel;
+- (void)didReceiveResponse;
+- (void)finish:(NSInteger)statusCode;
+
+@end
+
+@implementation CBNetworkingPermit
+{
+    CBConcurrencyLimiter *_limiter;
+    id _token;
+    void (^_start)(void);
+    BOOL _finished;
+    NSInteger _statusCode;
+}
+
+- (CBNetworkingPermit *)initWithLimiter:(CBConcurrencyLimiter *)limiter
+{
+    if (self = [super init]) {
+        _limiter = limiter;
+    }
+
+    return self;
+}
+
+- (void)acquire:(void (^)(void))start
+{
+    @synchronized(self) {
+        _start = [start copy];
+    }
+
+    // the permit may be granted, and the request finished, before the token is returned
+    id token = [_limiter acquire:^{
+        [self runStart];
+    }];
+    BOOL finished;
+    @synchronized(self) {
+        _token = token;
+        finished = _finished;
+    }
+    if (finished) {
+        [_limiter finish:token statusCode:_statusCode];
+    }
+}
+
+- (void)cancel
+{
+    // a cancelled operation still has to be started to finish; it gives back a permit it is waiting for
+    BOOL waiting;
+    @synchronized(self) {
+        waiting = _start != nil;
+    }
+    if (waiting) {
+        [self finish:0];
+        [self runStart];
+    }
+}
+
+- (void)didReceiveResponse
+{
+    id token;
+    @synchronized(self) {
+        token = _token;
+    }
+    if (token) {
+        [_limiter didReceiveResponse:token];
+    }
+}
+
+- (void)finish:(NSInteger)statusCode
+{
+    id token;
+    @synchronized(self) {
+        if (_finished) {
+            return;
+        }
+        _finished = YES;
+        _statusCode = statusCode;
+        token = _token;
+    }
+    if (token) {
+        [_limiter finish:token statusCode:statusCode];
+    }
+}
+
+#pragma mark - private
+
+- (void)runStart
+{
+    void (^start)(void);
+    @synchronized(self) {
+        start = _start;
+        _start = nil;
+    }
+    if (start) {
+        start();
+    }
+}
+
+@end
+
+@interface CBNetworkingHTTPRequestOperation : AFHTTPRequestOperation
+
+@property (nonatomic) CBNetworkingPermit *permit;
+
+@end
+
+@implementation CBNetworkingHTTPRequestOperation
+
+- (void)start
+{
+    if (self.permit == nil || self.isCancelled) {
+        [super start];
+        return;
+    }
+    [self.permit acquire:^{
+        [super start];
+    }];
+}
+
+- (void)cancel
+{
+    [super cancel];
+    [self.permit cancel];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    [self.permit didReceiveResponse];
+    [super connection:connection didReceiveResponse:response];
+}
+
+@end
+
+@interface CBNetworkingJSONRequestOperation : AFJSONRequestOperation
+
+@property (nonatomic) CBNetworkingPermit *permit;
+
+@end
+
+@implementation CBNetworkingJSONRequestOperation
+
+- (void)start
+{
+    if (self.permit == nil || self.isCancelled) {
+        [super start];
+        return;
+    }
+    [self.permit acquire:^{
+        [super start];
+    }];
+}
+
+- (void)cancel
+{
+    [super cancel];
+    [self.permit cancel];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    [self.permit didReceiveResponse];
+    [super connection:connection didReceiveResponse:response];
+}
+
+@end
+
+@implementation CBNetworking
+
++ (CBRequestHandle *)sendRequestForJSONResponse:(NSURLRequest *)request
+                                     credential:(CBCredential *)credential
+                                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                          queue:(NSOperationQueue *)queue
+{
+    return [self sendRequestForJSONResponse:request credential:credential retryPolicy:nil success:success failure:failure queue:queue];
+}
+
++ (CBRequestHandle *)sendRequestForJSONResponse:(NSURLRequest *)request
+                                     credential:(CBCredential *)credential
+                                    retryPolicy:(CBRetryPolicy *)retryPolicy
+                                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                          queue:(NSOperationQueue *)queue
+{
+    CBRequestHandle *handle = [CBRequestHandle new];
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        if (handle.isCancelled) {
+            // cancelled after the response arrived
+            if (failure) {
+                failure(request, response, [CBRequestHandle cancelledError], nil);
+            }
+        }
+        else if (success) {
             success(request, response, JSON);
         }
+        [handle finish];
+    };
+    CBNetworkingFailureBlockForJSONResponse failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        if (failure) {
+            failure(request, response, error, JSON);
+        }
+        [handle finish];
     };
-    void (^failureBlock)(NSURLRequest *, NSHTTPURLResponse *, NSError *, id) = ^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON) {
-        [[AFNetworkActivityIndicatorManager sharedManager] decrementActivityCount];
 
-        [self log:request response:response responseObject:JSON];
+    // attach identical GETs to the request already in flight
+    NSString *coalescingKey = [self coalescingKey:request credential:credential queue:queue];
+    if (coalescingKey) {
+        CBRequestHandle *sharedHandle = [CBRequestHandle new];
+        if (![self addWaiter:coalescingKey request:request success:successBlock failure:failureBlock handle:handle sharedHandle:sharedHandle]) {
+            [CBLog sdkLogVerbose:@"coalesced request: %@", request.URL];
+            return handle;
+        }
 
-        if (failure) {
-            CBError *cbError = nil;
-        
-            if ([response statusCode] == 401) {
-                // basic authentication error (status code: 401)
-                cbError = [CBError errorWithFormat:@"CBErrorFailBasicAuthentication"];
+        successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+            for (NSArray *waiter in [self removeWaiters:coalescingKey sharedHandle:sharedHandle]) {
+                ((CBNetworkingSuccessBlockForJSONResponse)waiter[0])(request, response, JSON);
             }
-            else if ([JSON isKindOfClass:[NSDictionary class]]) {
-                // kintone or Slash error
-                id errorCode = JSON[@"code"];
-                id recoverySuggestion = JSON[@"message"];
-                if (errorCode != nil && recoverySuggestion != nil) {
-                    cbError = [CBError errorWithCode:errorCode description:nil failureReason:nil recoverySuggestion:recoverySuggestion];
+            [sharedHandle finish];
+        };
+        failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+            for (NSArray *waiter in [self removeWaiters:coalescingKey sharedHandle:sharedHandle]) {
+                ((CBNetworkingFailureBlockForJSONResponse)waiter[1])(request, response, error, JSON);
+            }
+            [sharedHandle finish];
+        };
+
+        [self enqueueRequestForJSONResponse:request credential:credential retryPolicy:retryPolicy handle:sharedHandle success:successBlock failure:failureBlock queue:queue];
+        return handle;
+    }
+
+    [self enqueueRequestForJSONResponse:request credential:credential retryPolicy:retryPolicy handle:handle success:successBlock failure:failureBlock queue:queue];
+    return handle;
+}
+
++ (CBRequestHandle *)sendRequestForJSONStreamResponse:(NSURLRequest *)request
+                                           credential:(CBCredential *)credential
+                                             arrayKey:(NSString *)arrayKey
+                                              element:(CBNetworkingElementBlockForJSONResponse)element
+                                              success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                              failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                                queue:(NSOperationQueue *)queue
+{
+    CBRequestHandle *handle = [CBRequestHandle new];
+
+    // elements are decoded on the network thread and handed to the main thread, like the other blocks
+    CBJSONStreamParserElementBlock elementBlock = ^(id JSON) {
+        if (element) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (!handle.isCancelled) {
+                    element(JSON);
                 }
+            });
+        }
+    };
+
+    CBJSONStreamParser *parser = [[CBJSONStreamParser alloc] initWithArrayKey:arrayKey element:elementBlock];
+    CBNetworkingPermit *permit = [[CBNetworkingPermit alloc] initWithLimiter:[CBConcurrencyLimiter limiterForDomain:credential.domain]];
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [permit finish:response.statusCode];
+        if (handle.isCancelled) {
+            if (failure) {
+                failure(request, response, [CBRequestHandle cancelledError], nil);
             }
-            
-            // NSError
-            if (cbError == nil) {
-                cbError = [CBError errorWithNSError:error];
+        }
+        else if (parser.streamError) {
+            // AFNetworking ignores the result of the write, so a malformed element has to be reported here
+            if (failure) {
+                failure(request, response, [CBError errorWithNSError:parser.streamError], nil);
             }
-        
-            failure(request, response, cbError, JSON);
         }
+        else if (success) {
+            success(request, response, JSON);
+        }
+        [handle finish];
+    };
+    CBNetworkingFailureBlockForJSONResponse failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        if (failure) {
+            failure(request, response, error, JSON);
+        }
+        [handle finish];
+    };
+    CBNetworkingRetryBlock retryBlock = ^BOOL(NSHTTPURLResponse *response, NSError *error) {
+        [permit finish:response.statusCode];
+        return NO;
     };
-    
-    AFJSONRequestOperation *operation = [AFJSONRequestOperation JSONRequestOperationWithRequest:request success:successBlock failure:failureBlock];
-    [self setOptimizedBlocks:operation credential:credential];
+
+    CBNetworkingJSONRequestOperation *operation = [self JSONRequestOperation:request credential:credential success:successBlock failure:failureBlock retry:retryBlock];
+    operation.outputStream = parser;
+    operation.permit = permit;
+    [handle addOperation:operation];
 
     // start the network activity indicator in the status bar
     [[AFNetworkActivityIndicatorManager sharedManager] setEnabled:YES];
@@ -79,32 +460,45 @@
 
     // send request
     [queue addOperation:operation];
+
+    return handle;
 }
 
-+ (void)sendRequestForDownload:(NSURLRequest *)request
-                    credential:(CBCredential *)credential
-                       success:(CBNetworkingSuccessBlockForHTTPResponse)success
-                       failure:(CBNetworkingFailureBlockForHTTPResponse)failure
-                      download:(CBNetworkingDownloadProgressBlock)download
-                        output:(NSOutputStream *)output
-                         queue:(NSOperationQueue *)queue
++ (CBRequestHandle *)sendRequestForDownload:(NSURLRequest *)request
+                                 credential:(CBCredential *)credential
+                                    success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                    failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                   download:(CBNetworkingDownloadProgressBlock)download
+                                     output:(NSOutputStream *)output
+                                      queue:(NSOperationQueue *)queue
 {
+    CBRequestHandle *handle = [CBRequestHandle new];
+    CBNetworkingPermit *permit = [[CBNetworkingPermit alloc] initWithLimiter:[CBConcurrencyLimiter limiterForDomain:credential.domain]];
+
     // wrap blocks for logging and creating error object
     void (^successBlock)(AFHTTPRequestOperation *, id) = ^(AFHTTPRequestOperation *operation, id responseObject) {
         [[AFNetworkActivityIndicatorManager sharedManager] decrementActivityCount];
+        [permit finish:operation.response.statusCode];
 
         [self log:operation.request response:operation.response responseObject:nil];
 
-        if (success) {
+        if (handle.isCancelled) {
+            if (failure) {
+                failure(operation.request, operation.response, [CBRequestHandle cancelledError]);
+            }
+        }
+        else if (success) {
             success(operation.request, operation.response, responseObject);
         }
+        [handle finish];
     };
     void (^failureBlock)(AFHTTPRequestOperation *, NSError *) = ^(AFHTTPRequestOperation *operation, NSError *error) {
         [[AFNetworkActivityIndicatorManager sharedManager] decrementActivityCount];
+        [permit finish:operation.response.statusCode];
         
         id responseObject = nil;
         id responseJSON = nil;
-        if ([operation.responseData length] > 0 && [operation isFinished]) {
+        if ([operation.responseData length] > 0 && [operation isFinished] && ![operation isCancelled]) {
             if (operation.responseString) {
                 NSData *data = [operation.responseString dataUsingEncoding:NSUTF8StringEncoding];
                 
@@ -147,15 +541,32 @@
             
             failure(operation.request, operation.response, cbError);
         }
+        [handle finish];
     };
     
-    AFHTTPRequestOperation *operation = [[AFHTTPRequestOperation alloc] initWithRequest:request];
+    CBNetworkingHTTPRequestOperation *operation = [[CBNetworkingHTTPRequestOperation alloc] initWithRequest:request];
     operation.outputStream = output;
+    if ([output isKindOfClass:[CBPartialFileOutputStream class]]) {
+        // the partial file decides from the response where the body goes
+        __weak AFHTTPRequestOperation *weakOperation = operation;
+        ((CBPartialFileOutputStream *)output).responseBlock = ^NSHTTPURLResponse *{
+            return weakOperation.response;
+        };
+    }
+    else if ([output isKindOfClass:[CBPipeOutputStream class]]) {
+        // only the body of a successful response goes into the pipe
+        __weak AFHTTPRequestOperation *weakOperation = operation;
+        ((CBPipeOutputStream *)output).responseBlock = ^NSHTTPURLResponse *{
+            return weakOperation.response;
+        };
+    }
     [self setOptimizedBlocks:operation credential:credential];
     [operation setCompletionBlockWithSuccess:successBlock failure:failureBlock];
     if (download) {
         [operation setDownloadProgressBlock:download];
     }
+    operation.permit = permit;
+    [handle addOperation:operation];
     
     // start the network activity indicator in the status bar
     [[AFNetworkActivityIndicatorManager sharedManager] setEnabled:YES];
@@ -163,6 +574,747 @@
     
     // send request
     [queue addOperation:operation];
+
+    return handle;
+}
+
++ (CBRequestHandle *)sendRequestForResumableDownload:(NSURLRequest *)request
+                                          credential:(CBCredential *)credential
+                                         retryPolicy:(CBRetryPolicy *)retryPolicy
+                                      partialFileURL:(NSURL *)partialFileURL
+                                      destinationURL:(NSURL *)destinationURL
+                                             success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                             failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                            download:(CBNetworkingDownloadProgressBlock)download
+                                               queue:(NSOperationQueue *)queue
+{
+    assert([partialFileURL isFileURL] && [destinationURL isFileURL]);
+
+    CBRequestHandle *handle = [CBRequestHandle new];
+    partialFileURL = [self claimPartialFileURL:partialFileURL handle:handle];
+    [self sendRequestForResumableDownload:request credential:credential retryPolicy:retryPolicy retryCount:0 startDate:[NSDate date] partialFileURL:partialFileURL destinationURL:destinationURL handle:handle success:success failure:failure download:download queue:queue];
+
+    return handle;
+}
+
++ (CBRequestHandle *)sendRequestForRangedDownload:(NSURLRequest *)request
+                                       credential:(CBCredential *)credential
+                                      retryPolicy:(CBRetryPolicy *)retryPolicy
+                                           length:(unsigned long long)length
+                                       rangeCount:(NSUInteger)rangeCount
+                                   partialFileURL:(NSURL *)partialFileURL
+                                   destinationURL:(NSURL *)destinationURL
+                                          success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                          failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                         download:(CBNetworkingDownloadProgressBlock)download
+                                            queue:(NSOperationQueue *)queue
+{
+    assert([partialFileURL isFileURL] && [destinationURL isFileURL]);
+
+    unsigned long long count = MIN((unsigned long long)rangeCount, (length + CBNetworkingMinimumRangeLength - 1) / CBNetworkingMinimumRangeLength);
+    if (count <= 1) {
+        return [self sendRequestForResumableDownload:request credential:credential retryPolicy:retryPolicy partialFileURL:partialFileURL destinationURL:destinationURL success:success failure:failure download:download queue:queue];
+    }
+
+    // the ranges are written at their offsets into a file of the final size, beside the partial file of a resumable download
+    CBRequestHandle *handle = [CBRequestHandle new];
+    NSURL *rangesFileURL = [self claimPartialFileURL:[partialFileURL URLByAppendingPathExtension:@"ranges"] handle:handle];
+    [self removePartialFileURL:rangesFileURL];
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtURL:[rangesFileURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    [fileManager createFileAtPath:[rangesFileURL path] contents:nil attributes:nil];
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:rangesFileURL error:nil];
+    [fileHandle truncateFileAtOffset:length];
+    [fileHandle closeFile];
+
+    CBNetworkingRangedDownload *rangedDownload = [CBNetworkingRangedDownload new];
+    rangedDownload.request = request;
+    rangedDownload.credential = credential;
+    rangedDownload.retryPolicy = retryPolicy;
+    rangedDownload.length = length;
+    rangedDownload.partialFileURL = partialFileURL;
+    rangedDownload.rangesFileURL = rangesFileURL;
+    rangedDownload.destinationURL = destinationURL;
+    rangedDownload.handle = handle;
+    rangedDownload.success = success;
+    rangedDownload.failure = failure;
+    rangedDownload.download = download;
+    rangedDownload.queue = queue;
+    rangedDownload.attempts = [NSMutableSet set];
+    rangedDownload.probing = YES;
+
+    NSMutableArray *ranges = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    unsigned long long rangeLength = (length + count - 1) / count;
+    for (unsigned long long offset = 0; offset < length; offset += rangeLength) {
+        CBNetworkingRange *range = [CBNetworkingRange new];
+        range.offset = offset;
+        range.end = MIN(offset + rangeLength, length) - 1;
+        range.startDate = [NSDate date];
+        [ranges addObject:range];
+    }
+    rangedDownload.ranges = ranges;
+
+    // the other ranges are requested once the response to the first one shows that the server honours ranges
+    [self sendRange:ranges[0] rangedDownload:rangedDownload];
+
+    return rangedDownload.handle;
+}
+
++ (void)enqueueRequestForJSONResponse:(NSURLRequest *)request
+                           credential:(CBCredential *)credential
+                          retryPolicy:(CBRetryPolicy *)retryPolicy
+                               handle:(CBRequestHandle *)handle
+                              success:(CBNetworkingSuccessBlockForJSONResponse)success
+                              failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                queue:(NSOperationQueue *)queue
+{
+    NSDate *startDate = [NSDate date];
+    if (queue.maxConcurrentOperationCount != 1) {
+        [self sendRequestForJSONResponse:request credential:credential retryPolicy:retryPolicy retryCount:0 startDate:startDate handle:handle success:success failure:failure queue:queue];
+        return;
+    }
+
+    // the attempts run beside the serial queue while this operation keeps the place of the request in it
+    CBNetworkingRequestOperation *operation = [CBNetworkingRequestOperation new];
+    operation.handle = handle;
+    operation.sendBlock = ^{
+        [self sendRequestForJSONResponse:request credential:credential retryPolicy:retryPolicy retryCount:0 startDate:startDate handle:handle success:success failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
+    };
+    [handle addOperation:operation];
+    [queue addOperation:operation];
+}
+
++ (void)sendRequestForJSONResponse:(NSURLRequest *)request
+                        credential:(CBCredential *)credential
+                       retryPolicy:(CBRetryPolicy *)retryPolicy
+                        retryCount:(int)retryCount
+                         startDate:(NSDate *)startDate
+                            handle:(CBRequestHandle *)handle
+                           success:(CBNetworkingSuccessBlockForJSONResponse)success
+                           failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                             queue:(NSOperationQueue *)queue
+{
+    CBNetworkingPermit *permit = [[CBNetworkingPermit alloc] initWithLimiter:[CBConcurrencyLimiter limiterForDomain:credential.domain]];
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [permit finish:response.statusCode];
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+    BOOL retryable = retryPolicy && [retryPolicy isRetryableRequest:request];
+    CBNetworkingRetryBlock retryBlock = ^BOOL(NSHTTPURLResponse *response, NSError *error) {
+        [permit finish:response.statusCode];
+        if (!retryable) {
+            return NO;
+        }
+
+        NSTimeInterval delay = [retryPolicy delayForRequest:request response:response error:error retryCount:retryCount + 1 startDate:startDate];
+        if (delay < 0) {
+            return NO;
+        }
+
+        [retryPolicy didRetryRequest:request retryCount:retryCount + 1 delay:delay error:error];
+        [handle didRetryWithDelay:delay];
+
+        // send again on the same queue, keeping the original start date for the deadline;
+        // if the handle has been cancelled meanwhile, the new operation is cancelled as it is added
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [self sendRequestForJSONResponse:request credential:credential retryPolicy:retryPolicy retryCount:retryCount + 1 startDate:startDate handle:handle success:success failure:failure queue:queue];
+        });
+        return YES;
+    };
+
+    CBNetworkingJSONRequestOperation *operation = [self JSONRequestOperation:request credential:credential success:successBlock failure:failure retry:retryBlock];
+    operation.permit = permit;
+    [handle addOperation:operation];
+
+    // start the network activity indicator in the status bar
+    [[AFNetworkActivityIndicatorManager sharedManager] setEnabled:YES];
+    [[AFNetworkActivityIndicatorManager sharedManager] incrementActivityCount];
+
+    // send request
+    [queue addOperation:operation];
+}
+
++ (void)sendRequestForResumableDownload:(NSURLRequest *)request
+                             credential:(CBCredential *)credential
+                            retryPolicy:(CBRetryPolicy *)retryPolicy
+                             retryCount:(int)retryCount
+                              startDate:(NSDate *)startDate
+                         partialFileURL:(NSURL *)partialFileURL
+                         destinationURL:(NSURL *)destinationURL
+                                 handle:(CBRequestHandle *)handle
+                                success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                               download:(CBNetworkingDownloadProgressBlock)download
+                                  queue:(NSOperationQueue *)queue
+{
+    NSURL *metadataURL = [self metadataURLForPartialFileURL:partialFileURL];
+    NSDictionary *metadata = [CBPartialFileOutputStream metadataAtURL:metadataURL];
+    unsigned long long offset = 0;
+    if (metadata != nil) {
+        offset = [[[NSFileManager defaultManager] attributesOfItemAtPath:[partialFileURL path] error:nil] fileSize];
+    }
+
+    // a previous download received the whole file but did not get to rename it
+    long long totalLength = [metadata[CBPartialFileTotalLengthKey] longLongValue];
+    if (metadata != nil && totalLength > 0 && offset == (unsigned long long)totalLength) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self finishResumableDownload:request response:nil partialFileURL:partialFileURL destinationURL:destinationURL handle:handle success:success failure:failure];
+        });
+        return;
+    }
+
+    NSMutableURLRequest *rangeRequest = [request mutableCopy];
+    if (offset > 0) {
+        [rangeRequest setValue:[NSString stringWithFormat:@"bytes=%llu-", offset] forHTTPHeaderField:@"Range"];
+        if (metadata[CBPartialFileValidatorKey] != nil) {
+            // the server sends the whole file instead if it has changed
+            [rangeRequest setValue:metadata[CBPartialFileValidatorKey] forHTTPHeaderField:@"If-Range"];
+        }
+    }
+    CBPartialFileOutputStream *output = [[CBPartialFileOutputStream alloc] initWithFileURL:partialFileURL metadataURL:metadataURL offset:offset];
+
+    // report the progress of the whole file rather than of the range
+    CBNetworkingDownloadProgressBlock progressBlock = nil;
+    if (download) {
+        progressBlock = ^(NSUInteger bytesRead, long long totalBytesRead, long long totalBytesExpectedToRead) {
+            long long expected = output.totalLength >= 0 ? output.totalLength : totalBytesExpectedToRead;
+            download(bytesRead, output.startOffset + totalBytesRead, expected);
+        };
+    }
+
+    void (^resend)(int, NSDate *) = ^(int count, NSDate *date) {
+        [self sendRequestForResumableDownload:request credential:credential retryPolicy:retryPolicy retryCount:count startDate:date partialFileURL:partialFileURL destinationURL:destinationURL handle:handle success:success failure:failure download:download queue:queue];
+    };
+    CBNetworkingFailureBlockForHTTPResponse failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error) {
+        if (handle.isCancelled) {
+            if (failure) {
+                failure(request, response, [CBRequestHandle cancelledError]);
+            }
+            [handle finish];
+            return;
+        }
+
+        if (response.statusCode == 416 && offset > 0) {
+            // the partial file no longer matches the file on the server; start over from the first byte
+            [self removePartialFileURL:partialFileURL];
+            resend(retryCount, startDate);
+            return;
+        }
+
+        // bytes received by this attempt start the retry count and the deadline over
+        int count = output.bytesWritten > 0 ? 0 : retryCount;
+        NSDate *date = output.bytesWritten > 0 ? [NSDate date] : startDate;
+
+        // CBError only keeps the code of a network error
+        NSError *cause = response.statusCode == 0 ? [NSError errorWithDomain:NSURLErrorDomain code:[error.cbErrorCode integerValue] userInfo:nil] : error;
+        NSTimeInterval delay = retryPolicy ? [retryPolicy delayForRequest:request response:response error:cause retryCount:count + 1 startDate:date] : -1;
+        if (delay >= 0 && output.streamError == nil) {
+            [retryPolicy didRetryRequest:request retryCount:count + 1 delay:delay error:cause];
+            [handle didRetryWithDelay:delay];
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+                resend(count + 1, date);
+            });
+            return;
+        }
+
+        if (failure) {
+            failure(request, response, error);
+        }
+        [handle finish];
+    };
+    CBNetworkingSuccessBlockForHTTPResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+        if (handle.isCancelled) {
+            failureBlock(request, response, [CBRequestHandle cancelledError]);
+            return;
+        }
+
+        if (output.streamError != nil) {
+            failureBlock(request, response, [CBError errorWithNSError:output.streamError]);
+            return;
+        }
+
+        if (!output.writesToFile && offset > 0) {
+            // a range that does not start where the partial file ends; start over from the first byte
+            [self removePartialFileURL:partialFileURL];
+            resend(retryCount, startDate);
+            return;
+        }
+
+        unsigned long long size = [[[NSFileManager defaultManager] attributesOfItemAtPath:[partialFileURL path] error:nil] fileSize];
+        if (output.totalLength >= 0 && size != (unsigned long long)output.totalLength) {
+            // the connection was closed before the whole body arrived
+            NSError *lost = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil];
+            failureBlock(request, nil, [CBError errorWithNSError:lost]);
+            return;
+        }
+
+        [self finishResumableDownload:request response:response partialFileURL:partialFileURL destinationURL:destinationURL handle:handle success:success failure:failure];
+    };
+
+    // the handle of each attempt is a child, so that cancelling the download cancels the attempt in flight
+    [handle addChild:[self sendRequestForDownload:rangeRequest credential:credential success:successBlock failure:failureBlock download:progressBlock output:output queue:queue]];
+}
+
++ (void)finishResumableDownload:(NSURLRequest *)request
+                       response:(NSHTTPURLResponse *)response
+                 partialFileURL:(NSURL *)partialFileURL
+                 destinationURL:(NSURL *)destinationURL
+                         handle:(CBRequestHandle *)handle
+                        success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                        failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtURL:[destinationURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (![fileManager fileExistsAtPath:[partialFileURL path]]) {
+        // an empty body never opens the file
+        [fileManager createFileAtPath:[partialFileURL path] contents:nil attributes:nil];
+    }
+
+    // rename(2) replaces the destination atomically, readers never see a half-written file
+    if (rename([[partialFileURL path] fileSystemRepresentation], [[destinationURL path] fileSystemRepresentation]) != 0) {
+        NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        if (failure) {
+            failure(request, response, [CBError errorWithNSError:error]);
+        }
+        [handle finish];
+        return;
+    }
+    [fileManager removeItemAtURL:[self metadataURLForPartialFileURL:partialFileURL] error:nil];
+
+    if (handle.isCancelled) {
+        if (failure) {
+            failure(request, response, [CBRequestHandle cancelledError]);
+        }
+    }
+    else if (success) {
+        success(request, response, destinationURL);
+    }
+    [handle finish];
+}
+
++ (void)sendRange:(CBNetworkingRange *)range rangedDownload:(CBNetworkingRangedDownload *)rangedDownload
+{
+    NSMutableURLRequest *rangeRequest = [rangedDownload.request mutableCopy];
+    [rangeRequest setValue:[NSString stringWithFormat:@"bytes=%llu-%llu", range.offset, range.end] forHTTPHeaderField:@"Range"];
+    CBPartialFileOutputStream *output = [[CBPartialFileOutputStream alloc] initWithFileURL:rangedDownload.rangesFileURL rangeOffset:range.offset];
+
+    if (rangedDownload.probing && range == rangedDownload.ranges[0]) {
+        output.openBlock = ^(NSHTTPURLResponse *response) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self rangedDownload:rangedDownload didOpenProbe:output response:response];
+            });
+        };
+    }
+
+    CBNetworkingDownloadProgressBlock progressBlock = ^(NSUInteger bytesRead, long long totalBytesRead, long long totalBytesExpectedToRead) {
+        if (!output.writesToFile || rangedDownload.done) {
+            return;
+        }
+        rangedDownload.receivedLength += bytesRead;
+        if (rangedDownload.download) {
+            rangedDownload.download(bytesRead, rangedDownload.receivedLength, rangedDownload.length);
+        }
+    };
+
+    __block CBRequestHandle *attempt = nil;
+    CBNetworkingFailureBlockForHTTPResponse failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error) {
+        [rangedDownload.attempts removeObject:attempt];
+        attempt = nil;
+        [self rangedDownload:rangedDownload retryRange:range output:output response:response error:error];
+    };
+    CBNetworkingSuccessBlockForHTTPResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+        [rangedDownload.attempts removeObject:attempt];
+        attempt = nil;
+        if (rangedDownload.done) {
+            return;
+        }
+
+        if (rangedDownload.handle.isCancelled) {
+            [self rangedDownload:rangedDownload failWithResponse:response error:[CBRequestHandle cancelledError]];
+        }
+        else if (output.streamError != nil) {
+            [self rangedDownload:rangedDownload failWithResponse:response error:[CBError errorWithNSError:output.streamError]];
+        }
+        else if (!output.writesToFile) {
+            // neither the range nor the whole file
+            [self fallBackToSingleStream:rangedDownload];
+        }
+        else if (rangedDownload.singleStream ? (output.totalLength >= 0 && output.bytesWritten < (unsigned long long)output.totalLength)
+                                              : (range.offset + output.bytesWritten <= range.end)) {
+            // the connection was closed before the whole range arrived
+            NSError *lost = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil];
+            [self rangedDownload:rangedDownload retryRange:range output:output response:nil error:[CBError errorWithNSError:lost]];
+        }
+        else {
+            range.offset = rangedDownload.singleStream ? rangedDownload.length : range.end + 1;
+            [self rangedDownloadDidFinishRange:rangedDownload response:response];
+        }
+    };
+
+    attempt = [self sendRequestForDownload:rangeRequest credential:rangedDownload.credential success:successBlock failure:failureBlock download:progressBlock output:output queue:rangedDownload.queue];
+    [rangedDownload.attempts addObject:attempt];
+    [rangedDownload.handle addChild:attempt];
+}
+
++ (void)rangedDownload:(CBNetworkingRangedDownload *)rangedDownload didOpenProbe:(CBPartialFileOutputStream *)output response:(NSHTTPURLResponse *)response
+{
+    if (rangedDownload.done || !rangedDownload.probing || !output.writesToFile) {
+        // an error response is retried as the probe
+        return;
+    }
+    rangedDownload.probing = NO;
+
+    if (response.statusCode != 206) {
+        // the server ignored the range; the whole file comes in this single response
+        rangedDownload.singleStream = YES;
+        return;
+    }
+
+    if (output.totalLength >= 0 && (unsigned long long)output.totalLength != rangedDownload.length) {
+        // the size of the file on the server differs from the expected one; the ranges would not fit
+        [self fallBackToSingleStream:rangedDownload];
+        return;
+    }
+
+    for (NSUInteger i = 1; i < rangedDownload.ranges.count; i++) {
+        [self sendRange:rangedDownload.ranges[i] rangedDownload:rangedDownload];
+    }
+}
+
++ (void)rangedDownload:(CBNetworkingRangedDownload *)rangedDownload
+            retryRange:(CBNetworkingRange *)range
+                output:(CBPartialFileOutputStream *)output
+              response:(NSHTTPURLResponse *)response
+                 error:(CBError *)error
+{
+    if (rangedDownload.done) {
+        return;
+    }
+    if (rangedDownload.handle.isCancelled) {
+        [self rangedDownload:rangedDownload failWithResponse:response error:[CBRequestHandle cancelledError]];
+        return;
+    }
+
+    if (rangedDownload.singleStream) {
+        // a server that ignores ranges cannot resume either; the whole file is requested again
+        rangedDownload.receivedLength -= output.bytesWritten;
+    }
+    else if (output.writesToFile) {
+        range.offset += output.bytesWritten;
+    }
+
+    // bytes received by this attempt start the retry count and the deadline over
+    if (output.bytesWritten > 0) {
+        range.retryCount = 0;
+        range.startDate = [NSDate date];
+    }
+
+    // CBError only keeps the code of a network error
+    NSError *cause = response.statusCode == 0 ? [NSError errorWithDomain:NSURLErrorDomain code:[error.cbErrorCode integerValue] userInfo:nil] : error;
+    CBRetryPolicy *retryPolicy = rangedDownload.retryPolicy;
+    NSTimeInterval delay = retryPolicy ? [retryPolicy delayForRequest:rangedDownload.request response:response error:cause retryCount:range.retryCount + 1 startDate:range.startDate] : -1;
+    if (delay < 0 || output.streamError != nil) {
+        [self rangedDownload:rangedDownload failWithResponse:response error:error];
+        return;
+    }
+
+    range.retryCount++;
+    [retryPolicy didRetryRequest:rangedDownload.request retryCount:range.retryCount delay:delay error:cause];
+    [rangedDownload.handle didRetryWithDelay:delay];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        if (!rangedDownload.done) {
+            [self sendRange:range rangedDownload:rangedDownload];
+        }
+    });
+}
+
++ (void)rangedDownloadDidFinishRange:(CBNetworkingRangedDownload *)rangedDownload response:(NSHTTPURLResponse *)response
+{
+    if (!rangedDownload.singleStream) {
+        for (CBNetworkingRange *range in rangedDownload.ranges) {
+            if (range.offset <= range.end) {
+                return;
+            }
+        }
+    }
+    rangedDownload.done = YES;
+
+    unsigned long long size = [[[NSFileManager defaultManager] attributesOfItemAtPath:[rangedDownload.rangesFileURL path] error:nil] fileSize];
+    if (size != rangedDownload.length) {
+        [self removePartialFileURL:rangedDownload.rangesFileURL];
+        NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:nil];
+        if (rangedDownload.failure) {
+            rangedDownload.failure(rangedDownload.request, response, [CBError errorWithNSError:error]);
+        }
+        [rangedDownload.handle finish];
+        return;
+    }
+
+    [self finishResumableDownload:rangedDownload.request response:response partialFileURL:rangedDownload.rangesFileURL destinationURL:rangedDownload.destinationURL handle:rangedDownload.handle success:rangedDownload.success failure:rangedDownload.failure];
+}
+
++ (void)rangedDownload:(CBNetworkingRangedDownload *)rangedDownload failWithResponse:(NSHTTPURLResponse *)response error:(CBError *)error
+{
+    rangedDownload.done = YES;
+    for (CBRequestHandle *attempt in [rangedDownload.attempts allObjects]) {
+        [attempt cancel];
+    }
+
+    // the ranges received so far are not kept; a file with holes cannot be resumed
+    [self removePartialFileURL:rangedDownload.rangesFileURL];
+
+    if (rangedDownload.failure) {
+        rangedDownload.failure(rangedDownload.request, response, error);
+    }
+    [rangedDownload.handle finish];
+}
+
++ (void)fallBackToSingleStream:(CBNetworkingRangedDownload *)rangedDownload
+{
+    rangedDownload.done = YES;
+    for (CBRequestHandle *attempt in [rangedDownload.attempts allObjects]) {
+        [attempt cancel];
+    }
+    [self removePartialFileURL:rangedDownload.rangesFileURL];
+
+    CBRequestHandle *handle = rangedDownload.handle;
+    CBNetworkingSuccessBlockForHTTPResponse success = rangedDownload.success;
+    CBNetworkingFailureBlockForHTTPResponse failure = rangedDownload.failure;
+    CBRequestHandle *single = [self sendRequestForResumableDownload:rangedDownload.request
+                                                         credential:rangedDownload.credential
+                                                        retryPolicy:rangedDownload.retryPolicy
+                                                     partialFileURL:rangedDownload.partialFileURL
+                                                     destinationURL:rangedDownload.destinationURL
+                                                            success:^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+                                                                if (success) {
+                                                                    success(request, response, responseObject);
+                                                                }
+                                                                [handle finish];
+                                                            }
+                                                            failure:^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error) {
+                                                                if (failure) {
+                                                                    failure(request, response, error);
+                                                                }
+                                                                [handle finish];
+                                                            }
+                                                           download:rangedDownload.download
+                                                              queue:rangedDownload.queue];
+    [handle addChild:single];
+}
+
+static NSMutableSet *claimedPartialFilePaths()
+{
+    static NSMutableSet *set = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        set = [NSMutableSet set];
+    });
+
+    return set;
+}
+
++ (NSURL *)claimPartialFileURL:(NSURL *)partialFileURL handle:(CBRequestHandle *)handle
+{
+    // a concurrent download of the same file gets a partial file of its own, removed when it completes;
+    // only the first one keeps its partial file for a later resume
+    NSURL *claimedURL = partialFileURL;
+    BOOL own = NO;
+    @synchronized(claimedPartialFilePaths()) {
+        if ([claimedPartialFilePaths() containsObject:[partialFileURL path]]) {
+            claimedURL = [partialFileURL URLByAppendingPathExtension:[[NSProcessInfo processInfo] globallyUniqueString]];
+            own = YES;
+        }
+        [claimedPartialFilePaths() addObject:[claimedURL path]];
+    }
+
+    [handle addCompletionObserver:^(CBRequestHandle *handle) {
+        @synchronized(claimedPartialFilePaths()) {
+            [claimedPartialFilePaths() removeObject:[claimedURL path]];
+        }
+        if (own) {
+            [self removePartialFileURL:claimedURL];
+        }
+    }];
+
+    return claimedURL;
+}
+
++ (NSURL *)metadataURLForPartialFileURL:(NSURL *)partialFileURL
+{
+    return [partialFileURL URLByAppendingPathExtension:@"plist"];
+}
+
++ (void)removePartialFileURL:(NSURL *)partialFileURL
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager removeItemAtURL:partialFileURL error:nil];
+    [fileManager removeItemAtURL:[self metadataURLForPartialFileURL:partialFileURL] error:nil];
+}
+
+static NSMutableDictionary *waitingRequests()
+{
+    static NSMutableDictionary *dict = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        dict = [NSMutableDictionary dictionary];
+    });
+
+    return dict;
+}
+
++ (NSString *)coalescingKey:(NSURLRequest *)request credential:(CBCredential *)credential queue:(NSOperationQueue *)queue
+{
+    // only idempotent requests without a body can share a response
+    if (![request.HTTPMethod isEqualToString:@"GET"] || request.HTTPBody != nil || request.HTTPBodyStream != nil) {
+        return nil;
+    }
+
+    // a serial or keyed queue orders the GET after the writes queued before it; an earlier response could be stale
+    if (queue.maxConcurrentOperationCount == 1) {
+        return nil;
+    }
+
+    return [NSString stringWithFormat:@"%@ %@ %@@%@", request.HTTPMethod, request.URL.absoluteString, credential.user, credential.domain];
+}
+
++ (BOOL)addWaiter:(NSString *)key
+          request:(NSURLRequest *)request
+          success:(CBNetworkingSuccessBlockForJSONResponse)success
+          failure:(CBNetworkingFailureBlockForJSONResponse)failure
+           handle:(CBRequestHandle *)handle
+     sharedHandle:(CBRequestHandle *)sharedHandle
+{
+    NSArray *waiter = @[[success copy], [failure copy], handle, request];
+
+    // returns YES for the first waiter, which sends the request with the shared handle
+    BOOL first = NO;
+    @synchronized(waitingRequests()) {
+        NSDictionary *entry = waitingRequests()[key];
+        if (entry == nil) {
+            entry = @{@"handle" : sharedHandle, @"waiters" : [NSMutableArray array]};
+            waitingRequests()[key] = entry;
+            first = YES;
+        }
+        [entry[@"waiters"] addObject:waiter];
+    }
+
+    [handle addCancellationHandler:^{
+        [self cancelWaiter:key handle:handle];
+    }];
+
+    return first;
+}
+
++ (void)cancelWaiter:(NSString *)key handle:(CBRequestHandle *)handle
+{
+    NSArray *cancelledWaiter = nil;
+    CBRequestHandle *sharedHandle = nil;
+
+    @synchronized(waitingRequests()) {
+        NSDictionary *entry = waitingRequests()[key];
+        for (NSArray *waiter in entry[@"waiters"]) {
+            if (waiter[2] == handle) {
+                cancelledWaiter = waiter;
+                break;
+            }
+        }
+        if (cancelledWaiter == nil) {
+            // the response has already been handed out
+            return;
+        }
+
+        [entry[@"waiters"] removeObjectIdenticalTo:cancelledWaiter];
+        if ([entry[@"waiters"] count] == 0) {
+            sharedHandle = entry[@"handle"];
+            [waitingRequests() removeObjectForKey:key];
+        }
+    }
+
+    // the request itself goes away with the last waiter
+    [sharedHandle cancel];
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        ((CBNetworkingFailureBlockForJSONResponse)cancelledWaiter[1])(cancelledWaiter[3], nil, [CBRequestHandle cancelledError], nil);
+    });
+}
+
++ (NSArray *)removeWaiters:(NSString *)key sharedHandle:(CBRequestHandle *)sharedHandle
+{
+    @synchronized(waitingRequests()) {
+        // the key may have been taken over by a new request after all waiters of this one cancelled
+        NSDictionary *entry = waitingRequests()[key];
+        if (entry[@"handle"] != sharedHandle) {
+            return nil;
+        }
+
+        [waitingRequests() removeObjectForKey:key];
+        return entry[@"waiters"];
+    }
+}
+
++ (CBNetworkingJSONRequestOperation *)JSONRequestOperation:(NSURLRequest *)request
+                                      credential:(CBCredential *)credential
+                                         success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                         failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                           retry:(CBNetworkingRetryBlock)retry
+{
+    // wrap blocks for logging and creating error object
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [[AFNetworkActivityIndicatorManager sharedManager] decrementActivityCount];
+
+        [self log:request response:response responseObject:JSON];
+
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+    void (^failureBlock)(NSURLRequest *, NSHTTPURLResponse *, NSError *, id) = ^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON) {
+        [[AFNetworkActivityIndicatorManager sharedManager] decrementActivityCount];
+
+        [self log:request response:response responseObject:JSON];
+
+        if (retry && retry(response, error)) {
+            return;
+        }
+
+        if (failure) {
+            CBError *cbError = nil;
+        
+            if ([response statusCode] == 401) {
+                // basic authentication error (status code: 401)
+                cbError = [CBError errorWithFormat:@"CBErrorFailBasicAuthentication"];
+            }
+            else if ([JSON isKindOfClass:[NSDictionary class]]) {
+                // kintone or Slash error
+                id errorCode = JSON[@"code"];
+                id recoverySuggestion = JSON[@"message"];
+                if (errorCode != nil && recoverySuggestion != nil) {
+                    cbError = [CBError errorWithCode:errorCode description:nil failureReason:nil recoverySuggestion:recoverySuggestion];
+                }
+            }
+            
+            // NSError
+            if (cbError == nil) {
+                cbError = [CBError errorWithNSError:error];
+            }
+        
+            failure(request, response, cbError, JSON);
+        }
+    };
+    
+    CBNetworkingJSONRequestOperation *operation = [[CBNetworkingJSONRequestOperation alloc] initWithRequest:request];
+    [operation setCompletionBlockWithSuccess:^(AFHTTPRequestOperation *operation, id responseObject) {
+        successBlock(operation.request, operation.response, responseObject);
+    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
+        // don't decode the partial data of a cancelled request
+        id JSON = [operation isCancelled] ? nil : [(AFJSONRequestOperation *)operation responseJSON];
+        failureBlock(operation.request, operation.response, error, JSON);
+    }];
+    [self setOptimizedBlocks:operation credential:credential];
+
+    return operation;
 }
 
 + (void)setOptimizedBlocks:(AFURLConnectionOperation *)operation credential:(CBCredential *)credential
@@ -186,7 +1338,11 @@
     
     // set credential
     [operation setAuthenticationChallengeBlock:^(NSURLConnection *connection, NSURLAuthenticationChallenge *challenge) {
-        if ([challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodHTTPBasic]) {
+        if (credential == nil) {
+            // a request to a server other than kintone, e.g. a local server in tests
+            [challenge.sender continueWithoutCredentialForAuthenticationChallenge:challenge];
+        }
+        else if ([challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodHTTPBasic]) {
             // basic authentication
             [challenge.sender useCredential:[credential basicAuthCredential:nil] forAuthenticationChallenge:challenge];
         }
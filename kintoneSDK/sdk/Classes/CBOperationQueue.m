@@ -18,8 +18,36 @@
 
 #import "CBOperationQueue.h"
 
+static const NSUInteger CBOperationQueueLaneCount = 4;
+
+@interface CBOperationQueueLaneEntry : NSObject
+
+@property (nonatomic) CBOperationQueueLane lane;
+@property (nonatomic) NSDate *enqueuedDate;
+@property (nonatomic) NSOperation *permit;
+@property (nonatomic) BOOL ready;
+@property (nonatomic) BOOL running;
+
+@end
+
+@implementation CBOperationQueueLaneEntry
+
+@end
+
+@interface CBOperationQueue ()
+
+@property (nonatomic, readwrite) CBOperationQueueLane lane;
+@property (nonatomic) BOOL laned;
+
+@end
+
 @implementation CBOperationQueue
 
+static NSInteger maxConcurrentLaneOperationCount = 6;
+static NSTimeInterval laneAgingInterval = 2.0;
+static NSInteger runningLaneOperationCount = 0;
+static BOOL laneAgingScheduled = NO;
+
 + (CBOperationQueue *)sharedConcurrentQueue
 {
     static CBOperationQueue *sharedInstance = nil;
@@ -43,4 +71,237 @@
     return sharedInstance;
 }
 
++ (CBOperationQueue *)sharedQueueForLane:(CBOperationQueueLane)lane
+{
+    assert(lane < CBOperationQueueLaneCount);
+
+    static NSArray *sharedInstances = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSArray *names = @[@"interactive", @"default", @"background", @"bulk"];
+        NSMutableArray *queues = [NSMutableArray arrayWithCapacity:CBOperationQueueLaneCount];
+        for (NSUInteger i = 0; i < CBOperationQueueLaneCount; i++) {
+            CBOperationQueue *queue = [self new];
+            queue.lane = (CBOperationQueueLane)i;
+            queue.laned = YES;
+            queue.name = [NSString stringWithFormat:@"CBOperationQueue.%@", names[i]];
+            [queues addObject:queue];
+        }
+        sharedInstances = queues;
+    });
+
+    return sharedInstances[lane];
+}
+
++ (NSInteger)maxConcurrentLaneOperationCount
+{
+    @synchronized([CBOperationQueue class]) {
+        return maxConcurrentLaneOperationCount;
+    }
+}
+
++ (void)setMaxConcurrentLaneOperationCount:(NSInteger)count
+{
+    assert(count >= CBOperationQueueLaneCount);
+
+    @synchronized([CBOperationQueue class]) {
+        maxConcurrentLaneOperationCount = count;
+    }
+    [self scheduleLaneOperations];
+}
+
++ (NSTimeInterval)laneAgingInterval
+{
+    @synchronized([CBOperationQueue class]) {
+        return laneAgingInterval;
+    }
+}
+
++ (void)setLaneAgingInterval:(NSTimeInterval)interval
+{
+    assert(interval > 0);
+
+    @synchronized([CBOperationQueue class]) {
+        laneAgingInterval = interval;
+    }
+}
+
+#pragma mark - NSOperationQueue
+
+- (void)addOperation:(NSOperation *)operation
+{
+    if (self.laned) {
+        [CBOperationQueue enqueueLaneOperation:operation lane:self.lane];
+    }
+
+    [super addOperation:operation];
+}
+
+- (void)addOperations:(NSArray *)operations waitUntilFinished:(BOOL)wait
+{
+    // route through addOperation: so that every operation gets a lane
+    for (NSOperation *operation in operations) {
+        [self addOperation:operation];
+    }
+
+    if (wait) {
+        for (NSOperation *operation in operations) {
+            [operation waitUntilFinished];
+        }
+    }
+}
+
+- (void)addOperationWithBlock:(void (^)(void))block
+{
+    [self addOperation:[NSBlockOperation blockOperationWithBlock:block]];
+}
+
+#pragma mark - private
+
+static NSMutableArray *waitingLaneEntries()
+{
+    static NSMutableArray *entries = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        entries = [NSMutableArray array];
+    });
+
+    return entries;
+}
+
+static NSOperationQueue *laneMarkerQueue()
+{
+    static NSOperationQueue *queue = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = [NSOperationQueue new];
+        queue.name = @"CBOperationQueue.marker";
+    });
+
+    return queue;
+}
+
++ (void)enqueueLaneOperation:(NSOperation *)operation lane:(CBOperationQueueLane)lane
+{
+    CBOperationQueueLaneEntry *entry = [CBOperationQueueLaneEntry new];
+    entry.lane = lane;
+    entry.enqueuedDate = [NSDate date];
+
+    // an operation still waiting on others, e.g. the previous one of the same key, gets no slot until they have finished
+    NSArray *dependencies = operation.dependencies;
+    entry.ready = dependencies.count == 0;
+    if (!entry.ready) {
+        NSOperation *readyMarker = [NSBlockOperation blockOperationWithBlock:^{
+            [self laneOperationDidBecomeReady:entry];
+        }];
+        for (NSOperation *dependency in dependencies) {
+            [readyMarker addDependency:dependency];
+        }
+        [laneMarkerQueue() addOperation:readyMarker];
+    }
+
+    // the operation stays in its queue, waiting on a permit, so that it can still be cancelled there;
+    // a marker that depends on it tells when it has finished, without touching its completion block
+    entry.permit = [NSBlockOperation blockOperationWithBlock:^{}];
+    [operation addDependency:entry.permit];
+
+    NSOperation *marker = [NSBlockOperation blockOperationWithBlock:^{
+        [self laneOperationDidFinish:entry];
+    }];
+    [marker addDependency:operation];
+    [laneMarkerQueue() addOperation:marker];
+
+    @synchronized([CBOperationQueue class]) {
+        [waitingLaneEntries() addObject:entry];
+    }
+    [self scheduleLaneOperations];
+}
+
++ (void)laneOperationDidBecomeReady:(CBOperationQueueLaneEntry *)entry
+{
+    @synchronized([CBOperationQueue class]) {
+        entry.ready = YES;
+    }
+    [self scheduleLaneOperations];
+}
+
++ (void)laneOperationDidFinish:(CBOperationQueueLaneEntry *)entry
+{
+    @synchronized([CBOperationQueue class]) {
+        if (entry.running) {
+            runningLaneOperationCount--;
+            entry.running = NO;
+        }
+        else {
+            // cancelled while waiting
+            [waitingLaneEntries() removeObjectIdenticalTo:entry];
+        }
+        entry.permit = nil;
+    }
+    [self scheduleLaneOperations];
+}
+
++ (void)scheduleLaneOperations
+{
+    NSMutableArray *permits = [NSMutableArray array];
+    BOOL scheduleAging = NO;
+    NSTimeInterval agingInterval;
+
+    @synchronized([CBOperationQueue class]) {
+        NSMutableArray *entries = waitingLaneEntries();
+        NSDate *now = [NSDate date];
+        agingInterval = laneAgingInterval;
+
+        while (entries.count > 0) {
+            // the highest effective lane wins, the oldest one within a lane
+            CBOperationQueueLaneEntry *best = nil;
+            NSInteger bestLane = NSIntegerMax;
+            for (CBOperationQueueLaneEntry *entry in entries) {
+                if (!entry.ready) {
+                    continue;
+                }
+                // aging stops at the default lane, so that the last slot is always left to interactive operations
+                NSInteger aged = (NSInteger)([now timeIntervalSinceDate:entry.enqueuedDate] / agingInterval);
+                NSInteger lane = MAX((NSInteger)entry.lane - aged, MIN((NSInteger)entry.lane, (NSInteger)CBOperationQueueLaneDefault));
+                if (lane < bestLane) {
+                    best = entry;
+                    bestLane = lane;
+                }
+            }
+            if (best == nil) {
+                break;
+            }
+
+            // each lane leaves one slot per lane above it
+            if (runningLaneOperationCount >= MAX(maxConcurrentLaneOperationCount - bestLane, 1)) {
+                break;
+            }
+
+            [entries removeObjectIdenticalTo:best];
+            best.running = YES;
+            runningLaneOperationCount++;
+            [permits addObject:best.permit];
+        }
+
+        // waiting operations age without any other operation finishing
+        if (entries.count > 0 && !laneAgingScheduled) {
+            laneAgingScheduled = YES;
+            scheduleAging = YES;
+        }
+    }
+
+    for (NSOperation *permit in permits) {
+        [permit start];
+    }
+
+    if (scheduleAging) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(agingInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            @synchronized([CBOperationQueue class]) {
+                laneAgingScheduled = NO;
+            }
+            [self scheduleLaneOperations];
+        });
+    }
+}
+
 @end
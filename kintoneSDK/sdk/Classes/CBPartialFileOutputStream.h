@@ -0,0 +1,63 @@
+//
+//  CBPartialFileOutputStream.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NSHTTPURLResponse *(^CBPartialFileOutputStreamResponseBlock)(void);
+typedef void (^CBPartialFileOutputStreamOpenBlock)(NSHTTPURLResponse *response);
+
+// the keys of the metadata
+extern NSString * const CBPartialFileTotalLengthKey;
+extern NSString * const CBPartialFileValidatorKey;
+
+// An output stream that writes the body of a (possibly ranged) download into a partial file on disk.
+// It is opened once the response has arrived and decides from it where the body goes:
+// a 206 whose range starts at the offset is appended, a 200 replaces the file from the first byte,
+// other successful responses are dropped, and an error response is kept in memory and returned for
+// NSStreamDataWrittenToMemoryStreamKey, so that it can be parsed.
+// The total length and validator of the file are saved to the metadata file as soon as the body starts.
+// A stream for one range of a preallocated file writes a 206 at the offset of the range without truncating the file;
+// only the stream of the first range accepts a 200, which then replaces the whole file.
+@interface CBPartialFileOutputStream : NSOutputStream
+
+// returns the response of the operation writing into the stream
+@property (nonatomic, copy) CBPartialFileOutputStreamResponseBlock responseBlock;
+
+// called on the network thread once the stream has been opened for a response
+@property (nonatomic, copy) CBPartialFileOutputStreamOpenBlock openBlock;
+
+// YES if the body of the response is written into the file
+@property (nonatomic, readonly) BOOL writesToFile;
+
+// the position in the file where the body of the response starts
+@property (nonatomic, readonly) unsigned long long startOffset;
+
+// the length of the whole file, or -1 if the response did not tell
+@property (nonatomic, readonly) long long totalLength;
+
+// the number of bytes written into the file by this stream
+@property (nonatomic, readonly) unsigned long long bytesWritten;
+
+- (CBPartialFileOutputStream *)initWithFileURL:(NSURL *)fileURL metadataURL:(NSURL *)metadataURL offset:(unsigned long long)offset;
+
+- (CBPartialFileOutputStream *)initWithFileURL:(NSURL *)fileURL rangeOffset:(unsigned long long)offset;
+
+// the metadata saved by a previous stream, or nil
++ (NSDictionary *)metadataAtURL:(NSURL *)metadataURL;
+
+@end
@@ -0,0 +1,284 @@
+//
+//  CBPartialFileOutputStream.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBPartialFileOutputStream.h"
+
+NSString * const CBPartialFileTotalLengthKey = @"totalLength";
+NSString * const CBPartialFileValidatorKey = @"validator";
+
+@implementation CBPartialFileOutputStream
+{
+    NSURL *_fileURL;
+    NSURL *_metadataURL;            // nil for a range of a preallocated file
+    unsigned long long _offset;
+
+    NSStreamStatus _streamStatus;
+    NSError *_streamError;
+    __weak id<NSStreamDelegate> _delegate;
+
+    NSFileHandle *_fileHandle;
+    NSMutableData *_memory;         // the body of an error response
+    BOOL _discards;                 // a successful response that does not belong in the file
+}
+
++ (NSDictionary *)metadataAtURL:(NSURL *)metadataURL
+{
+    NSDictionary *metadata = [NSDictionary dictionaryWithContentsOfURL:metadataURL];
+    if (![metadata[CBPartialFileTotalLengthKey] isKindOfClass:[NSNumber class]]) {
+        return nil;
+    }
+
+    return metadata;
+}
+
+- (CBPartialFileOutputStream *)initWithFileURL:(NSURL *)fileURL metadataURL:(NSURL *)metadataURL offset:(unsigned long long)offset
+{
+    assert([fileURL isFileURL] && [metadataURL isFileURL]);
+
+    if (self = [super init]) {
+        _fileURL = fileURL;
+        _metadataURL = metadataURL;
+        _offset = offset;
+        _streamStatus = NSStreamStatusNotOpen;
+        _totalLength = -1;
+        _memory = [NSMutableData data];
+    }
+
+    return self;
+}
+
+- (CBPartialFileOutputStream *)initWithFileURL:(NSURL *)fileURL rangeOffset:(unsigned long long)offset
+{
+    assert([fileURL isFileURL]);
+
+    if (self = [super init]) {
+        _fileURL = fileURL;
+        _metadataURL = nil;
+        _offset = offset;
+        _streamStatus = NSStreamStatusNotOpen;
+        _totalLength = -1;
+        _memory = [NSMutableData data];
+    }
+
+    return self;
+}
+
+#pragma mark - NSStream
+
+- (void)open
+{
+    NSHTTPURLResponse *response = self.responseBlock ? self.responseBlock() : nil;
+
+    // a redirect or a multipart response opens the stream again; start over from the latest response
+    [_fileHandle closeFile];
+    _fileHandle = nil;
+    _writesToFile = NO;
+    _startOffset = 0;
+    _bytesWritten = 0;
+    _discards = NO;
+    [_memory setLength:0];
+
+    unsigned long long start = 0;
+    BOOL truncate = (_metadataURL != nil);
+    if (response.statusCode == 206) {
+        long long rangeStart = -1;
+        [self parseContentRange:[response allHeaderFields][@"Content-Range"] start:&rangeStart total:&_totalLength];
+        _writesToFile = (rangeStart == (long long)_offset);
+        _discards = !_writesToFile;
+        start = _offset;
+    }
+    else if (response.statusCode == 200 && (_metadataURL != nil || _offset == 0)) {
+        // the server ignored the range, or the validator did not match; the whole file follows
+        _totalLength = response.expectedContentLength >= 0 ? response.expectedContentLength : -1;
+        _writesToFile = YES;
+        truncate = YES;
+    }
+    else if (response.statusCode >= 200 && response.statusCode < 300) {
+        // e.g. the whole file in answer to a later range; it may be large and is of no use
+        _discards = YES;
+    }
+
+    if (_writesToFile) {
+        _startOffset = start;
+        if (![self openFileAtOffset:start truncate:truncate]) {
+            _writesToFile = NO;
+            _streamStatus = NSStreamStatusError;
+            return;
+        }
+        if (_metadataURL != nil) {
+            [self saveMetadata:response];
+        }
+    }
+
+    _streamStatus = NSStreamStatusOpen;
+
+    if (self.openBlock) {
+        self.openBlock(response);
+    }
+}
+
+- (void)close
+{
+    [_fileHandle synchronizeFile];
+    [_fileHandle closeFile];
+    _fileHandle = nil;
+
+    if (_streamStatus != NSStreamStatusError) {
+        _streamStatus = NSStreamStatusClosed;
+    }
+}
+
+- (NSStreamStatus)streamStatus
+{
+    return _streamStatus;
+}
+
+- (NSError *)streamError
+{
+    return _streamError;
+}
+
+- (id<NSStreamDelegate>)delegate
+{
+    return _delegate;
+}
+
+- (void)setDelegate:(id<NSStreamDelegate>)delegate
+{
+    _delegate = delegate;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+    // writes are synchronous, no run loop source is needed
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+}
+
+- (id)propertyForKey:(NSString *)key
+{
+    if ([key isEqualToString:NSStreamDataWrittenToMemoryStreamKey]) {
+        return [_memory copy];
+    }
+
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key
+{
+    return NO;
+}
+
+#pragma mark - NSOutputStream
+
+- (BOOL)hasSpaceAvailable
+{
+    return _streamStatus == NSStreamStatusOpen;
+}
+
+- (NSInteger)write:(const uint8_t *)buffer maxLength:(NSUInteger)length
+{
+    if (_streamStatus != NSStreamStatusOpen) {
+        return -1;
+    }
+
+    if (!_writesToFile) {
+        if (!_discards) {
+            [_memory appendBytes:buffer length:length];
+        }
+        return length;
+    }
+
+    @try {
+        [_fileHandle writeData:[NSData dataWithBytesNoCopy:(void *)buffer length:length freeWhenDone:NO]];
+    }
+    @catch (NSException *exception) {
+        // e.g. the disk is full; the bytes written so far stay in the file
+        _streamError = [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:@{NSLocalizedDescriptionKey : [exception reason] ?: @""}];
+        _streamStatus = NSStreamStatusError;
+        return -1;
+    }
+
+    _bytesWritten += length;
+    return length;
+}
+
+#pragma mark - private
+
+- (BOOL)openFileAtOffset:(unsigned long long)offset truncate:(BOOL)truncate
+{
+    NSString *path = [_fileURL path];
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (![fileManager fileExistsAtPath:path]) {
+        [fileManager createFileAtPath:path contents:nil attributes:nil];
+    }
+
+    NSError * __autoreleasing error = nil;
+    _fileHandle = [NSFileHandle fileHandleForWritingToURL:_fileURL error:&error];
+    if (_fileHandle == nil) {
+        _streamError = error;
+        return NO;
+    }
+
+    if (truncate) {
+        [_fileHandle truncateFileAtOffset:offset];
+    }
+    else {
+        [_fileHandle seekToFileOffset:offset];
+    }
+    return YES;
+}
+
+- (void)saveMetadata:(NSHTTPURLResponse *)response
+{
+    NSDictionary *headers = [response allHeaderFields];
+    NSString *validator = headers[@"ETag"] ?: headers[@"Last-Modified"];
+
+    NSMutableDictionary *metadata = [NSMutableDictionary dictionary];
+    metadata[CBPartialFileTotalLengthKey] = @(_totalLength);
+    if (validator != nil) {
+        metadata[CBPartialFileValidatorKey] = validator;
+    }
+
+    [metadata writeToURL:_metadataURL atomically:YES];
+}
+
+// Content-Range: bytes <start>-<end>/<total or *>
+- (void)parseContentRange:(NSString *)contentRange start:(long long *)start total:(long long *)total
+{
+    *start = -1;
+    *total = -1;
+
+    NSScanner *scanner = [NSScanner scannerWithString:contentRange ?: @""];
+    long long first, last, length;
+    if (![scanner scanString:@"bytes" intoString:nil] || ![scanner scanLongLong:&first] ||
+        ![scanner scanString:@"-" intoString:nil] || ![scanner scanLongLong:&last] ||
+        ![scanner scanString:@"/" intoString:nil]) {
+        return;
+    }
+
+    *start = first;
+    if ([scanner scanLongLong:&length]) {
+        *total = length;
+    }
+}
+
+@end
@@ -0,0 +1,63 @@
+//
+//  CBPipe.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NSHTTPURLResponse *(^CBPipeResponseBlock)(void);
+
+// Carries exactly length bytes from the body of a download to the body of an upload without blocking either side.
+// The read end is one half of a bound stream pair (CFStreamCreateBoundPair), to be the HTTPBodyStream of the upload;
+// it gives prefix, the length bytes and suffix, e.g. the boundaries of a multipart body, and CFNetwork reads it
+// on run loop events. The write end never waits either: AFNetworking drops the bytes an output stream does not take,
+// so bytes the upload has not taken yet are held in memory up to the capacity, and in a temporary file beyond it.
+// Closing the writer before length bytes, writing more than length bytes, or closeWithError: ends the pipe
+// with an error and closes the read end early.
+@interface CBPipe : NSObject
+
+@property (nonatomic, readonly) unsigned long long length;
+
+// the first error that ended the pipe, or nil
+@property (nonatomic, readonly) NSError *error;
+
+// the read end; its length, the Content-Length of the upload, is that of prefix and suffix plus length
+@property (nonatomic, readonly) NSInputStream *inputStream;
+@property (nonatomic, readonly) unsigned long long inputLength;
+
+- (CBPipe *)initWithCapacity:(NSUInteger)capacity length:(unsigned long long)length prefix:(NSData *)prefix suffix:(NSData *)suffix;
+
+// called by CBPipeOutputStream on the thread of the download; the bytes move on in the run loop of that thread
+- (void)scheduleInRunLoop:(NSRunLoop *)runLoop;
+- (NSInteger)write:(const uint8_t *)buffer maxLength:(NSUInteger)length;
+
+- (void)closeWriting;
+- (void)closeWithError:(NSError *)error;
+
+@end
+
+// The writing end of a pipe, to be the output stream of a download.
+// It is opened once the response has arrived; only the body of a successful response goes into the pipe.
+// The body of an error response is kept in memory and returned for NSStreamDataWrittenToMemoryStreamKey,
+// so that it can be parsed, and ends the pipe with an error.
+@interface CBPipeOutputStream : NSOutputStream
+
+// returns the response of the operation writing into the stream
+@property (nonatomic, copy) CBPipeResponseBlock responseBlock;
+
+- (CBPipeOutputStream *)initWithPipe:(CBPipe *)pipe;
+
+@end
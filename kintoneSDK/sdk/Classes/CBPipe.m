@@ -0,0 +1,423 @@
+//
+//  CBPipe.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBPipe.h"
+
+@interface CBPipe ()
+
+- (void)flush;
+
+@end
+
+// delivered in the run loop of the download when the upload has taken bytes out of the bound pair
+static void CBPipeWriteStreamCallback(CFWriteStreamRef stream, CFStreamEventType type, void *info)
+{
+    CBPipe *pipe = (__bridge CBPipe *)info;
+    if (type == kCFStreamEventErrorOccurred) {
+        // the upload has closed the read end
+        [pipe closeWithError:nil];
+        return;
+    }
+
+    [pipe flush];
+}
+
+@implementation CBPipe
+{
+    NSLock *_lock;                      // guards the state and the write stream, used from both threads
+    NSUInteger _capacity;
+    CFWriteStreamRef _writeStream;
+    CFRunLoopRef _runLoop;              // where _writeStream is scheduled, NULL until the download opens
+    BOOL _writeStreamClosed;
+    NSMutableData *_pending;            // bytes the upload has not taken yet, from _pendingOffset
+    NSUInteger _pendingOffset;
+    NSString *_spillPath;               // the bytes after _pending once it holds the capacity
+    NSFileHandle *_spillHandle;
+    unsigned long long _spillOffset;    // the first byte not yet moved into _pending
+    unsigned long long _spillLength;
+    NSData *_suffix;
+    unsigned long long _bytesWritten;
+    BOOL _writerClosed;
+}
+
+@synthesize error = _error;
+
+- (CBPipe *)initWithCapacity:(NSUInteger)capacity length:(unsigned long long)length prefix:(NSData *)prefix suffix:(NSData *)suffix
+{
+    assert(capacity > 0);
+
+    if (self = [super init]) {
+        _length = length;
+        _inputLength = prefix.length + length + suffix.length;
+        _lock = [NSLock new];
+        _capacity = capacity;
+        _runLoop = NULL;
+        _writeStreamClosed = NO;
+        _pending = prefix ? [prefix mutableCopy] : [NSMutableData data];
+        _pendingOffset = 0;
+        _spillOffset = 0;
+        _spillLength = 0;
+        _suffix = suffix ?: [NSData data];
+        _bytesWritten = 0;
+        _writerClosed = NO;
+
+        CFReadStreamRef readStream = NULL;
+        CFWriteStreamRef writeStream = NULL;
+        CFStreamCreateBoundPair(kCFAllocatorDefault, &readStream, &writeStream, (CFIndex)capacity);
+        _inputStream = CFBridgingRelease(readStream);
+        _writeStream = writeStream;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    // a scheduled write stream holds the pipe, so it has been closed by now
+    CFRelease(_writeStream);
+    [self removeSpillFile];
+}
+
+- (NSError *)error
+{
+    [_lock lock];
+    NSError *error = _error;
+    [_lock unlock];
+
+    return error;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)runLoop
+{
+    [_lock lock];
+    if (_runLoop == NULL && !_writeStreamClosed) {
+        _runLoop = (CFRunLoopRef)CFRetain([runLoop getCFRunLoop]);
+
+        // the stream holds the pipe until it is closed
+        CFStreamClientContext context = {0, (__bridge void *)self, CFRetain, CFRelease, NULL};
+        CFWriteStreamSetClient(_writeStream, kCFStreamEventCanAcceptBytes | kCFStreamEventErrorOccurred, CBPipeWriteStreamCallback, &context);
+        CFWriteStreamScheduleWithRunLoop(_writeStream, _runLoop, kCFRunLoopCommonModes);
+        CFWriteStreamOpen(_writeStream);
+    }
+    [_lock unlock];
+
+    // the prefix can go before the first byte of the download
+    [self flush];
+}
+
+- (NSInteger)write:(const uint8_t *)buffer maxLength:(NSUInteger)length
+{
+    [_lock lock];
+    if (_error == nil && (_writerClosed || _bytesWritten + length > _length)) {
+        _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:EFBIG userInfo:nil];
+    }
+    BOOL failed = (_error != nil) || ![self appendBytes:buffer length:length];
+    if (!failed) {
+        _bytesWritten += length;
+    }
+    [_lock unlock];
+
+    if (failed) {
+        [self closeWriteStream];
+        return -1;
+    }
+
+    // never waits; what the upload cannot take now is sent from the callback of the write stream
+    [self flush];
+    return length;
+}
+
+- (void)closeWriting
+{
+    [_lock lock];
+    if (!_writerClosed) {
+        _writerClosed = YES;
+        if (_error == nil && _bytesWritten != _length) {
+            // the download ended before the whole content
+            _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:EPIPE userInfo:nil];
+        }
+        if (_error == nil) {
+            [self appendBytes:[_suffix bytes] length:[_suffix length]];
+        }
+    }
+    BOOL failed = (_error != nil);
+    [_lock unlock];
+
+    if (failed) {
+        [self closeWriteStream];
+    }
+    else {
+        [self flush];
+    }
+}
+
+- (void)closeWithError:(NSError *)error
+{
+    [_lock lock];
+    if (_error == nil) {
+        _error = error ?: [NSError errorWithDomain:NSPOSIXErrorDomain code:ECANCELED userInfo:nil];
+    }
+    [_lock unlock];
+
+    [self closeWriteStream];
+}
+
+#pragma mark - private
+
+- (void)flush
+{
+    BOOL broken = NO;
+    [_lock lock];
+    while (!_writeStreamClosed && _runLoop != NULL && CFWriteStreamCanAcceptBytes(_writeStream)) {
+        if (_pendingOffset == [_pending length] && ![self refillPending]) {
+            break;
+        }
+
+        CFIndex written = CFWriteStreamWrite(_writeStream, (const UInt8 *)[_pending bytes] + _pendingOffset, (CFIndex)([_pending length] - _pendingOffset));
+        if (written < 0) {
+            broken = YES;
+            break;
+        }
+        _pendingOffset += written;
+    }
+    BOOL done = (_writerClosed && _error == nil && _pendingOffset == [_pending length] && _spillOffset == _spillLength);
+    [_lock unlock];
+
+    if (broken) {
+        [self closeWithError:nil];
+    }
+    else if (done) {
+        // the read end gives EOF once the upload has taken the suffix
+        [self closeWriteStream];
+    }
+}
+
+- (void)closeWriteStream
+{
+    BOOL closing = NO;
+    [_lock lock];
+    if (!_writeStreamClosed) {
+        _writeStreamClosed = YES;
+        closing = YES;
+        if (_runLoop != NULL) {
+            CFWriteStreamUnscheduleFromRunLoop(_writeStream, _runLoop, kCFRunLoopCommonModes);
+            CFRelease(_runLoop);
+            _runLoop = NULL;
+        }
+        CFWriteStreamClose(_writeStream);
+        [self removeSpillFile];
+    }
+    [_lock unlock];
+
+    if (closing) {
+        // releases the pipe held by the stream, outside of the lock
+        CFWriteStreamSetClient(_writeStream, kCFStreamEventNone, NULL, NULL);
+    }
+}
+
+// called with _lock locked; bytes go to the end of the memory, or of the file once it holds some
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length
+{
+    if (_pendingOffset > 0) {
+        [_pending replaceBytesInRange:NSMakeRange(0, _pendingOffset) withBytes:NULL length:0];
+        _pendingOffset = 0;
+    }
+
+    NSUInteger inMemory = 0;
+    if (_spillOffset == _spillLength && [_pending length] < _capacity) {
+        inMemory = MIN(length, _capacity - [_pending length]);
+        [_pending appendBytes:bytes length:inMemory];
+    }
+    if (inMemory == length) {
+        return YES;
+    }
+
+    if (_spillHandle == nil) {
+        _spillPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+        [[NSFileManager defaultManager] createFileAtPath:_spillPath contents:nil attributes:nil];
+        _spillHandle = [NSFileHandle fileHandleForUpdatingAtPath:_spillPath];
+        if (_spillHandle == nil) {
+            _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil];
+            return NO;
+        }
+    }
+    [_spillHandle seekToFileOffset:_spillLength];
+    [_spillHandle writeData:[NSData dataWithBytesNoCopy:(void *)((const uint8_t *)bytes + inMemory) length:length - inMemory freeWhenDone:NO]];
+    _spillLength += length - inMemory;
+
+    return YES;
+}
+
+// called with _lock locked when the memory has been taken; NO when there is nothing more to send
+- (BOOL)refillPending
+{
+    [_pending setLength:0];
+    _pendingOffset = 0;
+    if (_spillOffset == _spillLength) {
+        return NO;
+    }
+
+    [_spillHandle seekToFileOffset:_spillOffset];
+    NSData *data = [_spillHandle readDataOfLength:(NSUInteger)MIN((unsigned long long)_capacity, _spillLength - _spillOffset)];
+    [_pending appendData:data];
+    _spillOffset += [data length];
+    if (_spillOffset == _spillLength) {
+        // the file is written from its beginning again
+        [_spillHandle truncateFileAtOffset:0];
+        _spillOffset = 0;
+        _spillLength = 0;
+    }
+
+    return [data length] > 0;
+}
+
+- (void)removeSpillFile
+{
+    if (_spillHandle == nil) {
+        return;
+    }
+
+    [_spillHandle closeFile];
+    _spillHandle = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:_spillPath error:nil];
+}
+
+@end
+
+@implementation CBPipeOutputStream
+{
+    CBPipe *_pipe;
+    NSStreamStatus _streamStatus;
+    __weak id<NSStreamDelegate> _delegate;
+    NSMutableData *_memory;         // the body of an error response
+    BOOL _writesToPipe;
+}
+
+- (CBPipeOutputStream *)initWithPipe:(CBPipe *)pipe
+{
+    assert(pipe != nil);
+
+    if (self = [super init]) {
+        _pipe = pipe;
+        _streamStatus = NSStreamStatusNotOpen;
+        _memory = [NSMutableData data];
+        _writesToPipe = NO;
+    }
+
+    return self;
+}
+
+#pragma mark - NSStream
+
+- (void)open
+{
+    NSHTTPURLResponse *response = self.responseBlock ? self.responseBlock() : nil;
+
+    // a redirect opens the stream again; the body of the final response counts
+    [_memory setLength:0];
+    _writesToPipe = (response.statusCode >= 200 && response.statusCode < 300);
+    if (!_writesToPipe && response.statusCode >= 400) {
+        [_pipe closeWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:EPIPE userInfo:nil]];
+    }
+
+    _streamStatus = NSStreamStatusOpen;
+}
+
+- (void)close
+{
+    if (_writesToPipe) {
+        [_pipe closeWriting];
+    }
+
+    if (_streamStatus != NSStreamStatusError) {
+        _streamStatus = NSStreamStatusClosed;
+    }
+}
+
+- (NSStreamStatus)streamStatus
+{
+    return _streamStatus;
+}
+
+- (NSError *)streamError
+{
+    return _streamStatus == NSStreamStatusError ? _pipe.error : nil;
+}
+
+- (id<NSStreamDelegate>)delegate
+{
+    return _delegate;
+}
+
+- (void)setDelegate:(id<NSStreamDelegate>)delegate
+{
+    _delegate = delegate;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+    // the pipe sends the bytes the upload could not take yet from this run loop, in all modes
+    [_pipe scheduleInRunLoop:aRunLoop];
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode
+{
+}
+
+- (id)propertyForKey:(NSString *)key
+{
+    if ([key isEqualToString:NSStreamDataWrittenToMemoryStreamKey]) {
+        return [_memory copy];
+    }
+
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key
+{
+    return NO;
+}
+
+#pragma mark - NSOutputStream
+
+- (BOOL)hasSpaceAvailable
+{
+    return _streamStatus == NSStreamStatusOpen;
+}
+
+- (NSInteger)write:(const uint8_t *)buffer maxLength:(NSUInteger)length
+{
+    if (_streamStatus != NSStreamStatusOpen) {
+        return -1;
+    }
+
+    if (!_writesToPipe) {
+        [_memory appendBytes:buffer length:length];
+        return length;
+    }
+
+    // returns at once, the bytes are held until the upload takes them
+    NSInteger written = [_pipe write:buffer maxLength:length];
+    if (written < 0) {
+        _streamStatus = NSStreamStatusError;
+    }
+
+    return written;
+}
+
+@end
@@ -0,0 +1,252 @@
+//
+//  CBRequestHandle.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBRequestHandle.h"
+
+#import "CBError.h"
+
+@implementation CBRequestHandle
+{
+    BOOL _cancelled;
+    BOOL _finished;
+    NSOperationQueuePriority _priority;
+    int _retryCount;
+    NSTimeInterval _retryDelay;
+    NSDate *_startDate;
+    NSDate *_finishDate;
+    __weak CBRequestHandle *_parent;  // retries of a child count for the parent too
+    NSHashTable *_operations;         // finished operations are released by their queue
+    NSMutableArray *_children;
+    NSMutableArray *_cancellationHandlers;
+    NSMutableArray *_completionObservers;
+}
+
++ (CBError *)cancelledError
+{
+    return [CBError errorWithNSError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+}
+
+- (CBRequestHandle *)init
+{
+    if (self = [super init]) {
+        _priority = NSOperationQueuePriorityNormal;
+        _startDate = [NSDate date];
+        _operations = [NSHashTable weakObjectsHashTable];
+        _children = [NSMutableArray array];
+        _cancellationHandlers = [NSMutableArray array];
+        _completionObservers = [NSMutableArray array];
+    }
+
+    return self;
+}
+
+- (BOOL)isCancelled
+{
+    @synchronized(self) {
+        return _cancelled;
+    }
+}
+
+- (BOOL)isFinished
+{
+    @synchronized(self) {
+        return _finished;
+    }
+}
+
+- (int)retryCount
+{
+    @synchronized(self) {
+        return _retryCount;
+    }
+}
+
+- (NSTimeInterval)retryDelay
+{
+    @synchronized(self) {
+        return _retryDelay;
+    }
+}
+
+- (NSTimeInterval)latency
+{
+    @synchronized(self) {
+        return [(_finishDate ? _finishDate : [NSDate date]) timeIntervalSinceDate:_startDate];
+    }
+}
+
+- (NSOperationQueuePriority)priority
+{
+    @synchronized(self) {
+        return _priority;
+    }
+}
+
+- (void)setPriority:(NSOperationQueuePriority)priority
+{
+    NSArray *operations;
+    NSArray *children;
+    @synchronized(self) {
+        _priority = priority;
+        operations = [_operations allObjects];
+        children = [_children copy];
+    }
+
+    for (NSOperation *operation in operations) {
+        operation.queuePriority = priority;
+    }
+    for (CBRequestHandle *child in children) {
+        child.priority = priority;
+    }
+}
+
+- (void)cancel
+{
+    NSArray *operations;
+    NSArray *children;
+    NSArray *handlers;
+    @synchronized(self) {
+        if (_cancelled || _finished) {
+            return;
+        }
+        _cancelled = YES;
+        operations = [_operations allObjects];
+        children = [_children copy];
+        handlers = [_cancellationHandlers copy];
+        [_cancellationHandlers removeAllObjects];
+    }
+
+    // the failure blocks run with the cancelled error and finish the handle
+    for (NSOperation *operation in operations) {
+        [operation cancel];
+    }
+    for (CBRequestHandle *child in children) {
+        [child cancel];
+    }
+    for (void (^handler)(void) in handlers) {
+        handler();
+    }
+}
+
+- (void)addCompletionObserver:(CBRequestHandleCompletionBlock)observer
+{
+    if (observer == nil) {
+        return;
+    }
+
+    @synchronized(self) {
+        if (!_finished) {
+            [_completionObservers addObject:[observer copy]];
+            return;
+        }
+    }
+
+    observer(self);
+}
+
+- (void)addOperation:(NSOperation *)operation
+{
+    BOOL cancelled;
+    @synchronized(self) {
+        cancelled = _cancelled;
+        operation.queuePriority = _priority;
+        [_operations addObject:operation];
+    }
+
+    if (cancelled) {
+        [operation cancel];
+    }
+}
+
+- (void)addChild:(CBRequestHandle *)child
+{
+    if (child == nil) {
+        return;
+    }
+
+    BOOL cancelled;
+    @synchronized(self) {
+        cancelled = _cancelled;
+        child.priority = _priority;
+        if (!_finished) {
+            [_children addObject:child];
+        }
+    }
+    [child setParent:self];
+
+    if (cancelled) {
+        [child cancel];
+    }
+}
+
+- (void)addCancellationHandler:(void (^)(void))handler
+{
+    @synchronized(self) {
+        if (!_cancelled) {
+            [_cancellationHandlers addObject:[handler copy]];
+            return;
+        }
+    }
+
+    handler();
+}
+
+- (void)didRetryWithDelay:(NSTimeInterval)delay
+{
+    CBRequestHandle *parent;
+    @synchronized(self) {
+        _retryCount++;
+        _retryDelay += delay;
+        parent = _parent;
+    }
+
+    [parent didRetryWithDelay:delay];
+}
+
+- (void)finish
+{
+    NSArray *observers;
+    @synchronized(self) {
+        if (_finished) {
+            return;
+        }
+        _finished = YES;
+        _finishDate = [NSDate date];
+        observers = [_completionObservers copy];
+
+        // break retain cycles between the handle and the blocks of the request
+        [_completionObservers removeAllObjects];
+        [_cancellationHandlers removeAllObjects];
+        [_children removeAllObjects];
+    }
+
+    for (CBRequestHandleCompletionBlock observer in observers) {
+        observer(self);
+    }
+}
+
+#pragma mark - private
+
+- (void)setParent:(CBRequestHandle *)parent
+{
+    @synchronized(self) {
+        _parent = parent;
+    }
+}
+
+@end
@@ -0,0 +1,194 @@
+//
+//  CBRetryPolicy.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "CBRetryPolicy.h"
+
+@implementation CBRetryPolicy
+{
+    int _totalRetryCount;
+    NSTimeInterval _totalDelay;
+}
+
+- (CBRetryPolicy *)init
+{
+    if (self = [super init]) {
+        _maxRetryCount = 3;
+        _baseDelay = 0.5;
+        _maxDelay = 30;
+        _deadline = 60;
+
+        NSMutableIndexSet *statusCodes = [NSMutableIndexSet indexSet];
+        [statusCodes addIndex:429];
+        [statusCodes addIndex:500];
+        [statusCodes addIndexesInRange:NSMakeRange(502, 3)];
+        _retryableStatusCodes = statusCodes;
+    }
+
+    return self;
+}
+
+- (int)totalRetryCount
+{
+    @synchronized(self) {
+        return _totalRetryCount;
+    }
+}
+
+- (NSTimeInterval)totalDelay
+{
+    @synchronized(self) {
+        return _totalDelay;
+    }
+}
+
+- (BOOL)isRetryableRequest:(NSURLRequest *)request
+{
+    NSString *method = request.HTTPMethod;
+
+    if ([method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"] || [method isEqualToString:@"DELETE"]) {
+        return YES;
+    }
+
+    if ([method isEqualToString:@"PUT"] && request.HTTPBody != nil) {
+        // a PUT is only safe to repeat if the server rejects the second attempt as a revision conflict
+        id JSON = [NSJSONSerialization JSONObjectWithData:request.HTTPBody options:0 error:nil];
+        if (![JSON isKindOfClass:[NSDictionary class]]) {
+            return NO;
+        }
+
+        NSArray *records = JSON[@"records"];
+        if ([records isKindOfClass:[NSArray class]]) {
+            for (id record in records) {
+                if (![record isKindOfClass:[NSDictionary class]] || ![self hasRevision:record]) {
+                    return NO;
+                }
+            }
+            return records.count > 0;
+        }
+
+        return [self hasRevision:JSON];
+    }
+
+    // POST creates a resource on each attempt
+    return NO;
+}
+
+- (NSTimeInterval)delayForRequest:(NSURLRequest *)request
+                         response:(NSHTTPURLResponse *)response
+                            error:(NSError *)error
+                       retryCount:(int)retryCount
+                        startDate:(NSDate *)startDate
+{
+    if (retryCount > self.maxRetryCount || ![self isRetryableRequest:request]) {
+        return -1;
+    }
+
+    if (response != nil && response.statusCode != 0) {
+        if (![self.retryableStatusCodes containsIndex:response.statusCode]) {
+            return -1;
+        }
+    }
+    else if (![self isTransientError:error]) {
+        return -1;
+    }
+
+    NSTimeInterval delay = [self retryAfter:response];
+    if (delay < 0) {
+        // full jitter: a random delay up to the capped exponential backoff
+        NSTimeInterval backoff = MIN(self.maxDelay, self.baseDelay * pow(2, retryCount - 1));
+        delay = backoff * ((double)arc4random() / UINT32_MAX);
+    }
+
+    NSTimeInterval elapsed = startDate ? -[startDate timeIntervalSinceNow] : 0;
+    if (elapsed + delay > self.deadline) {
+        return -1;
+    }
+
+    return delay;
+}
+
+- (void)didRetryRequest:(NSURLRequest *)request retryCount:(int)retryCount delay:(NSTimeInterval)delay error:(NSError *)error
+{
+    @synchronized(self) {
+        _totalRetryCount++;
+        _totalDelay += delay;
+    }
+
+    [CBLog sdkLogInfo:@"retry %d after %.2fs: %@ %@ (%@)", retryCount, delay, request.HTTPMethod, request.URL, error.localizedDescription];
+
+    if (self.retryBlock) {
+        self.retryBlock(request, retryCount, delay, error);
+    }
+}
+
+#pragma mark - private
+
+- (BOOL)hasRevision:(NSDictionary *)JSON
+{
+    // -1 disables the revision check on the server
+    id revision = JSON[@"revision"];
+    return revision != nil && revision != [NSNull null] && [revision intValue] != -1;
+}
+
+- (BOOL)isTransientError:(NSError *)error
+{
+    if (![error.domain isEqualToString:NSURLErrorDomain]) {
+        return NO;
+    }
+
+    switch (error.code) {
+        case NSURLErrorTimedOut:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorNetworkConnectionLost:
+        case NSURLErrorDNSLookupFailed:
+        case NSURLErrorNotConnectedToInternet:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+- (NSTimeInterval)retryAfter:(NSHTTPURLResponse *)response
+{
+    NSString *value = response.allHeaderFields[@"Retry-After"];
+    if (value.length == 0) {
+        return -1;
+    }
+
+    // delta-seconds
+    NSScanner *scanner = [NSScanner scannerWithString:value];
+    double seconds;
+    if ([scanner scanDouble:&seconds] && [scanner isAtEnd]) {
+        return MAX(seconds, 0);
+    }
+
+    // HTTP-date
+    NSDateFormatter *formatter = [NSDateFormatter new];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+    formatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss zzz";
+    NSDate *date = [formatter dateFromString:value];
+    if (date) {
+        return MAX([date timeIntervalSinceNow], 0);
+    }
+
+    return -1;
+}
+
+@end
@@ -19,18 +19,31 @@
 #import "KintoneAPI.h"
 
 #import "CBCredential.h"
+#import "CBDigestInputStream.h"
+#import "CBError.h"
 #import "CBOperationQueue.h"
+#import "CBPipe.h"
+#import "CBRequestHandle.h"
+#import "KintoneAPIPath.h"
 #import "KintoneApplication.h"
+#import "KintoneBulkRequest.h"
+#import "KintoneChunkedRequest.h"
 #import "KintoneField.h"
 #import "KintoneFile.h"
+#import "KintoneFileCache.h"
 #import "KintoneRecord.h"
+#import "KintoneRecordCursor.h"
+#import "KintoneRecordPartitionedCursor.h"
+#import "KintoneRecordStore.h"
 #import "KintoneSite.h"
+#import "KintoneUploadCache.h"
 
 #import "AFNetworking.h"
 #import "GTMBase64.h"
 #import "GTMNSString+URLArguments.h"
+#import "NSString+Utility.h"
 
-#define KINTONE_API_PATH(file)  [[NSString alloc] initWithFormat:@"%@%@", API_BASEPATH, (file)]
+#define KINTONE_BULK_REQUEST_LIMIT 100
 
 @interface KintoneAPI ()
 @property (nonatomic, weak, readwrite) KintoneApplication *kintoneApplication;
@@ -41,7 +54,10 @@
     NSString *_cybozuAuthorization;
 }
 
-static NSString * const API_BASEPATH = @"/k/v1/";
+static const int KintoneAPIDefaultMaxConcurrentBulkRequests = 4;
+static const int KintoneAPIDefaultMaxConcurrentFileUploads = 4;
+static const NSUInteger KintoneAPIFileCopyBufferCapacity = 1024 * 1024;
+static const NSUInteger KintoneAPIRecordStoreBatchSize = 100;
 
 @synthesize userAgent = _userAgent;
 
@@ -51,6 +67,8 @@ static NSString * const API_BASEPATH = @"/k/v1/";
 
     if (self = [super init]) {
         self.kintoneApplication = newKintoneApplication;
+        self.maxConcurrentBulkRequests = KintoneAPIDefaultMaxConcurrentBulkRequests;
+        self.maxConcurrentFileUploads = KintoneAPIDefaultMaxConcurrentFileUploads;
     }
     
     return self;
@@ -101,6 +119,27 @@ static NSString * const API_BASEPATH = @"/k/v1/";
     return _cybozuAuthorization;
 }
 
+- (NSOperationQueue *)requestQueue:(NSOperationQueue *)queue
+{
+    // reads and uploads run in parallel when no queue is given
+    return queue ?: [CBOperationQueue sharedConcurrentQueue];
+}
+
+- (NSOperationQueue *)mutationQueue:(NSOperationQueue *)queue recordId:(int)recordId
+{
+    // writes are kept in order when no queue is given; the record queues and the app queue wait for each other
+    return queue ?: (recordId > 0 ? [self.kintoneApplication queueForRecord:recordId] : self.kintoneApplication.defaultQueue);
+}
+
+- (NSURL *)partialFileURLForFileKey:(NSString *)fileKey
+{
+    // Caches/kintone/downloads/<domain>/<user>/<file key>.part
+    NSString *directory = [self.kintoneApplication.kintoneSite cacheDirectoryPath:@"downloads"];
+    NSString *fileName = [[fileKey gtm_stringByEscapingForURLArgument] stringByAppendingPathExtension:@"part"];
+
+    return [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:fileName]];
+}
+
 - (NSMutableURLRequest *)createRequest:(NSString *)path requestMethod:(NSString *)requestMethod
 {
     NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@%@", self.kintoneApplication.kintoneSite.cbCredential.domain, path]];
@@ -122,41 +161,98 @@ static NSString * const API_BASEPATH = @"/k/v1/";
     return request;
 }
 
-- (NSMutableURLRequest *)createFileUploadRequest:(NSData *)fileData fileName:(NSString *)fileName contentType:(NSString *)contentType
+- (NSMutableURLRequest *)createFileUploadRequest:(NSData *)fileData
+                                        fileName:(NSString *)fileName
+                                     contentType:(NSString *)contentType
+                                     inputStream:(CBDigestInputStream * __autoreleasing *)inputStream
+{
+    // the part reads from the data itself, so mapped data stays mapped and is not copied, and is hashed on the way
+    CBDigestInputStream *stream = [[CBDigestInputStream alloc] initWithData:fileData];
+    *inputStream = stream;
+    return [self createFileUploadRequestWithBody:^(id<AFMultipartFormData> formData) {
+        [formData appendPartWithInputStream:stream name:@"file" fileName:fileName length:[fileData length] mimeType:contentType];
+    }];
+}
+
+- (NSMutableURLRequest *)createFileUploadRequestWithFileURL:(NSURL *)fileURL
+                                                    fileName:(NSString *)fileName
+                                                 contentType:(NSString *)contentType
+                                                 inputStream:(CBDigestInputStream * __autoreleasing *)inputStream
+                                                       error:(NSError * __autoreleasing *)error
+{
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:[fileURL path] error:error];
+    if (attributes == nil) {
+        return nil;
+    }
+
+    // the part is read from the file while the body stream is sent, and hashed on the way
+    CBDigestInputStream *stream = [[CBDigestInputStream alloc] initWithFileURL:fileURL];
+    *inputStream = stream;
+    return [self createFileUploadRequestWithBody:^(id<AFMultipartFormData> formData) {
+        [formData appendPartWithInputStream:stream name:@"file" fileName:fileName length:[attributes fileSize] mimeType:contentType];
+    }];
+}
+
+- (NSMutableURLRequest *)createFileUploadRequestWithBody:(void (^)(id<AFMultipartFormData> formData))block
 {
     NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@", self.kintoneApplication.kintoneSite.cbCredential.domain]];
     AFHTTPClient *httpClient = [[AFHTTPClient alloc] initWithBaseURL:url];
     NSMutableURLRequest *request = [httpClient multipartFormRequestWithMethod:@"POST"
                                                                          path:KINTONE_API_PATH(@"file.json")
                                                                    parameters:nil
-                                                    constructingBodyWithBlock:^(id<AFMultipartFormData> formData) {
-                                                        [formData appendPartWithFileData:fileData name:@"file" fileName:fileName mimeType:contentType];
-                                                    }];
+                                                    constructingBodyWithBlock:block];
     [request setValue:[self cybozuAuthorization] forHTTPHeaderField:@"X-Cybozu-Authorization"];
     [request setValue:[self userAgent] forHTTPHeaderField:@"User-Agent"];
     
     return request;
 }
 
-- (void)form:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue
+- (NSMutableURLRequest *)createFileUploadRequestWithFile:(KintoneFile *)file pipe:(CBPipe * __autoreleasing *)pipe
+{
+    // the multipart body is framed here rather than by AFNetworking, whose body stream can only read its parts synchronously
+    NSString *boundary = [NSString stringWithFormat:@"Boundary+%@", [[NSProcessInfo processInfo] globallyUniqueString]];
+    NSString *prefix = [NSString stringWithFormat:@"--%@\r\nContent-Disposition: form-data; name=\"file\"; filename=\"%@\"\r\nContent-Type: %@\r\n\r\n",
+                        boundary, file.name, file.contentType ?: @"application/octet-stream"];
+    NSString *suffix = [NSString stringWithFormat:@"\r\n--%@--\r\n", boundary];
+    CBPipe *newPipe = [[CBPipe alloc] initWithCapacity:KintoneAPIFileCopyBufferCapacity
+                                                length:file.size
+                                                prefix:[prefix dataUsingEncoding:NSUTF8StringEncoding]
+                                                suffix:[suffix dataUsingEncoding:NSUTF8StringEncoding]];
+    *pipe = newPipe;
+
+    NSMutableURLRequest *request = [self createRequest:KINTONE_API_PATH(@"file.json") requestMethod:@"POST"];
+    [request setValue:[NSString stringWithFormat:@"multipart/form-data; boundary=%@", boundary] forHTTPHeaderField:@"Content-Type"];
+    [request setValue:[NSString stringWithFormat:@"%llu", newPipe.inputLength] forHTTPHeaderField:@"Content-Length"];
+    [request setHTTPBodyStream:newPipe.inputStream];
+
+    return request;
+}
+
+- (CBRequestHandle *)form:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue
 {
     NSString *path = KINTONE_API_PATH(@"form.json");
     NSURLRequest *request = [self createRequest:[[NSString alloc] initWithFormat:@"%@?app=%d", path, self.kintoneApplication.appId] requestMethod:@"GET"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:success failure:failure queue:[self requestQueue:queue]];
 }
 
-- (void)record:(int)recordId success:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)record:(int)recordId success:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue
 {
     NSString *path = KINTONE_API_PATH(@"record.json");
     NSURLRequest *request = [self createRequest:[NSString stringWithFormat:@"%@?app=%d&id=%d", path, self.kintoneApplication.appId, recordId]  requestMethod:@"GET"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self storeRecords:success partial:NO] failure:failure queue:[self requestQueue:queue]];
 }
 
-- (void)records:(NSArray *)fields
-          query:(NSString *)query
-        success:(CBNetworkingSuccessBlockForJSONResponse)success
-        failure:(CBNetworkingFailureBlockForJSONResponse)failure
-          queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)records:(NSArray *)fields
+                       query:(NSString *)query
+                     success:(CBNetworkingSuccessBlockForJSONResponse)success
+                     failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                       queue:(NSOperationQueue *)queue
+{
+    NSURLRequest *request = [self createRecordsRequest:fields query:query];
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self storeRecords:success partial:fields.count > 0] failure:failure queue:[self requestQueue:queue]];
+}
+
+- (NSURLRequest *)createRecordsRequest:(NSArray *)fields query:(NSString *)query
 {
     NSMutableString *params = [NSMutableString stringWithFormat:@"app=%d", self.kintoneApplication.appId];
     for (int i = 0; i < fields.count; i++) {
@@ -168,15 +264,14 @@ static NSString * const API_BASEPATH = @"/k/v1/";
     }
 
     NSString *path = KINTONE_API_PATH(@"records.json");
-    NSURLRequest *request = [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, params] requestMethod:@"GET"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    return [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, params] requestMethod:@"GET"];
 }
 
-- (void)recordsWithFields:(NSArray *)fields
-                    query:(NSString *)query
-                  success:(CBNetworkingSuccessBlockForJSONResponse)success
-                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                    queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)recordsWithFields:(NSArray *)fields
+                                 query:(NSString *)query
+                               success:(CBNetworkingSuccessBlockForJSONResponse)success
+                               failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                 queue:(NSOperationQueue *)queue
 {
     NSMutableArray *fieldCodeArray = [NSMutableArray arrayWithCapacity:fields.count];
     for (id value in fields) {
@@ -186,22 +281,81 @@ static NSString * const API_BASEPATH = @"/k/v1/";
         [fieldCodeArray addObject:field.code];
     }
     
-    [self records:fieldCodeArray query:query success:success failure:failure queue:queue];
+    return [self records:fieldCodeArray query:query success:success failure:failure queue:queue];
 }
 
-- (void)recordsWithFields:(NSArray *)fields
-             kintoneQuery:(KintoneQuery *)query
-                  success:(CBNetworkingSuccessBlockForJSONResponse)success
-                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                    queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)recordsWithFields:(NSArray *)fields
+                          kintoneQuery:(KintoneQuery *)query
+                               success:(CBNetworkingSuccessBlockForJSONResponse)success
+                               failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                 queue:(NSOperationQueue *)queue
 {
-    [self recordsWithFields:fields query:query.kintoneQuery success:success failure:failure queue:queue];
+    return [self recordsWithFields:fields query:query.kintoneQuery success:success failure:failure queue:queue];
 }
 
-- (void)insert:(NSDictionary *)fieldJSON
-       success:(CBNetworkingSuccessBlockForJSONResponse)success
-       failure:(CBNetworkingFailureBlockForJSONResponse)failure
-         queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)recordsWithFields:(NSArray *)fields
+                          kintoneQuery:(KintoneQuery *)query
+                                record:(KintoneAPIRecordBlock)record
+                               success:(CBNetworkingSuccessBlockForJSONResponse)success
+                               failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                 queue:(NSOperationQueue *)queue
+{
+    NSMutableArray *fieldCodeArray = [NSMutableArray arrayWithCapacity:fields.count];
+    for (id value in fields) {
+        assert([value isKindOfClass:[KintoneField class]]);
+        
+        KintoneField *field = (KintoneField *)value;
+        [fieldCodeArray addObject:field.code];
+    }
+
+    // records are stored in batches as they arrive; the blocks run on the main thread
+    KintoneRecordStore *recordStore = self.kintoneApplication.recordStore;
+    BOOL partial = fieldCodeArray.count > 0;
+    NSMutableArray *received = [NSMutableArray arrayWithCapacity:KintoneAPIRecordStoreBatchSize];
+    CBNetworkingElementBlockForJSONResponse element = ^(id JSON) {
+        if ([JSON isKindOfClass:[NSDictionary class]]) {
+            [received addObject:JSON];
+            if (received.count >= KintoneAPIRecordStoreBatchSize) {
+                [recordStore storeRecordDictionaries:received partial:partial];
+                [received removeAllObjects];
+            }
+        }
+        if (record) {
+            record([KintoneRecord kintoneRecordFromDictionary:JSON]);
+        }
+    };
+    CBNetworkingSuccessBlockForJSONResponse streamSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [recordStore storeRecordDictionaries:received partial:partial];
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+    CBNetworkingFailureBlockForJSONResponse streamFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        // the records received before the failure are complete
+        [recordStore storeRecordDictionaries:received partial:partial];
+        if (failure) {
+            failure(request, response, error, JSON);
+        }
+    };
+
+    NSURLRequest *request = [self createRecordsRequest:fieldCodeArray query:query.kintoneQuery];
+    return [CBNetworking sendRequestForJSONStreamResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential arrayKey:@"records" element:element success:streamSuccess failure:streamFailure queue:[self requestQueue:queue]];
+}
+
+- (KintoneRecordCursor *)recordCursorWithFields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query
+{
+    return [[KintoneRecordCursor alloc] initWithKintoneAPI:self fields:fields kintoneQuery:query];
+}
+
+- (KintoneRecordPartitionedCursor *)recordPartitionedCursorWithFields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query
+{
+    return [[KintoneRecordPartitionedCursor alloc] initWithKintoneAPI:self fields:fields kintoneQuery:query];
+}
+
+- (CBRequestHandle *)insert:(NSDictionary *)fieldJSON
+                    success:(CBNetworkingSuccessBlockForJSONResponse)success
+                    failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                      queue:(NSOperationQueue *)queue
 {
 #warning TODO: validate required fields
 
@@ -210,13 +364,14 @@ static NSString * const API_BASEPATH = @"/k/v1/";
                            @"record" : fieldJSON};
     
     NSURLRequest *request = [self createRequestWithJSON:json path:path requestMethod:@"POST"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    NSSet *fileKeys = [self fileKeysInJSON:fieldJSON];
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self consumeFileKeys:fileKeys success:success] failure:[self consumeFileKeys:fileKeys failure:failure] queue:[self mutationQueue:queue recordId:0]];
 }
 
-- (void)insertWithRecord:(KintoneRecord *)record
-                 success:(CBNetworkingSuccessBlockForJSONResponse)success
-                 failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                   queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)insertWithRecord:(KintoneRecord *)record
+                              success:(CBNetworkingSuccessBlockForJSONResponse)success
+                              failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                queue:(NSOperationQueue *)queue
 {
     NSMutableDictionary *json = [NSMutableDictionary dictionaryWithCapacity:record.fields.count];
     for (id key in record.fields.keyEnumerator) {
@@ -224,28 +379,33 @@ static NSString * const API_BASEPATH = @"/k/v1/";
         [json addEntriesFromDictionary:field.json];
     }
 
-    [self insert:json success:success failure:failure queue:queue];
+    return [self insert:json success:success failure:failure queue:queue];
 }
 
-- (void)bulkInsert:(NSArray *)fieldJSON
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)bulkInsert:(NSArray *)fieldJSON
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue
 {
-    NSString *path = KINTONE_API_PATH(@"records.json");
-    NSDictionary *json = @{@"app"     : @(self.kintoneApplication.appId),
-                           @"records" : fieldJSON};
-    
 #warning TODO: validate required fields
     
-    NSURLRequest *request = [self createRequestWithJSON:json path:path requestMethod:@"POST"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    KintoneChunkedRequestSendBlock send = ^(NSArray *chunk, CBNetworkingSuccessBlockForJSONResponse chunkSuccess, CBNetworkingFailureBlockForJSONResponse chunkFailure) {
+        NSString *path = KINTONE_API_PATH(@"records.json");
+        NSDictionary *json = @{@"app"     : @(self.kintoneApplication.appId),
+                               @"records" : chunk};
+        
+        NSURLRequest *request = [self createRequestWithJSON:json path:path requestMethod:@"POST"];
+        NSSet *fileKeys = [self fileKeysInJSON:chunk];
+        return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self consumeFileKeys:fileKeys success:chunkSuccess] failure:[self consumeFileKeys:fileKeys failure:chunkFailure] queue:[self mutationQueue:queue recordId:0]];
+    };
+    
+    return [self sendBulkRequest:fieldJSON send:send success:success failure:failure];
 }
 
-- (void)bulkInsertWithRecords:(NSArray *)records
-                      success:(CBNetworkingSuccessBlockForJSONResponse)success
-                      failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                        queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)bulkInsertWithRecords:(NSArray *)records
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue
 {
     NSMutableArray *json = [NSMutableArray arrayWithCapacity:records.count];
     for (id value in records) {
@@ -261,14 +421,14 @@ static NSString * const API_BASEPATH = @"/k/v1/";
         [json addObject:fieldDict];
     }
 
-    [self bulkInsert:json success:success failure:failure queue:queue];
+    return [self bulkInsert:json success:success failure:failure queue:queue];
 }
 
-- (void)update:(int)recordId
-     fieldJSON:(NSDictionary *)fieldJSON
-       success:(CBNetworkingSuccessBlockForJSONResponse)success
-       failure:(CBNetworkingFailureBlockForJSONResponse)failure
-         queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)update:(int)recordId
+                  fieldJSON:(NSDictionary *)fieldJSON
+                    success:(CBNetworkingSuccessBlockForJSONResponse)success
+                    failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                      queue:(NSOperationQueue *)queue
 {
     NSString *path = KINTONE_API_PATH(@"record.json");
     NSDictionary *json = @{@"app"    : @(self.kintoneApplication.appId),
@@ -278,14 +438,15 @@ static NSString * const API_BASEPATH = @"/k/v1/";
 #warning TODO: validate required fields
     
     NSURLRequest *request = [self createRequestWithJSON:json path:path requestMethod:@"PUT"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    NSSet *fileKeys = [self fileKeysInJSON:fieldJSON];
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self consumeFileKeys:fileKeys success:[self removeStoredRecords:@[@(recordId)] success:success]] failure:[self consumeFileKeys:fileKeys failure:failure] queue:[self mutationQueue:queue recordId:recordId]];
 }
 
-- (void)update:(int)recordId
-        record:(KintoneRecord *)record
-       success:(CBNetworkingSuccessBlockForJSONResponse)success
-       failure:(CBNetworkingFailureBlockForJSONResponse)failure
-         queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)update:(int)recordId
+                     record:(KintoneRecord *)record
+                    success:(CBNetworkingSuccessBlockForJSONResponse)success
+                    failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                      queue:(NSOperationQueue *)queue
 {
     NSMutableDictionary *json = [NSMutableDictionary dictionaryWithCapacity:record.fields.count];
     for (id key in record.fields.keyEnumerator) {
@@ -296,28 +457,84 @@ static NSString * const API_BASEPATH = @"/k/v1/";
         [json addEntriesFromDictionary:field.json];
     }
     
-    [self update:recordId fieldJSON:json success:success failure:failure queue:queue];
+    return [self update:recordId fieldJSON:json success:success failure:failure queue:queue];
 }
 
-- (void)bulkUpdate:(NSArray *)fieldJSON
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)saveRecord:(KintoneRecord *)record
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue
+{
+    NSMutableArray *files = [NSMutableArray array];
+    [self collectFilesToUpload:record files:files];
+
+    KintoneChunkedRequestSendBlock send = ^(NSArray *chunk, CBNetworkingSuccessBlockForJSONResponse chunkSuccess, CBNetworkingFailureBlockForJSONResponse chunkFailure) {
+        KintoneFile *file = chunk[0];
+        CBNetworkingSuccessBlockForJSONResponse uploaded = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+            [file setFileKeyWithJSONDictionary:JSON];
+            chunkSuccess(request, response, JSON);
+        };
+        return [self fileUploadWithFile:file success:uploaded failure:chunkFailure queue:queue];
+    };
+
+    CBRequestHandle *handle = [CBRequestHandle new];
+    CBNetworkingSuccessBlockForJSONResponse saveSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        if (success) {
+            success(request, response, JSON);
+        }
+        [handle finish];
+    };
+    CBNetworkingFailureBlockForJSONResponse saveFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        if (failure) {
+            failure(request, response, error, JSON);
+        }
+        [handle finish];
+    };
+
+    CBNetworkingSuccessBlockForJSONResponse uploadsSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        if (handle.isCancelled) {
+            saveFailure(nil, nil, [CBRequestHandle cancelledError], nil);
+            return;
+        }
+
+        // sent as soon as the last upload has completed
+        if (record.recordNumber != nil) {
+            [handle addChild:[self update:[record.recordNumber.value intValue] record:record success:saveSuccess failure:saveFailure queue:queue]];
+        }
+        else {
+            [handle addChild:[self insertWithRecord:record success:saveSuccess failure:saveFailure queue:queue]];
+        }
+    };
+
+    KintoneChunkedRequest *uploads = [[KintoneChunkedRequest alloc] initWithItems:files chunkSize:1 maxConcurrentChunks:self.maxConcurrentFileUploads];
+    [handle addChild:[uploads send:send success:uploadsSuccess failure:saveFailure]];
+    return handle;
+}
+
+- (CBRequestHandle *)bulkUpdate:(NSArray *)fieldJSON
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue
 {
-    NSString *path = KINTONE_API_PATH(@"records.json");
-    NSDictionary *json = @{@"app"     : @(self.kintoneApplication.appId),
-                           @"records" : fieldJSON};
-    
 #warning TODO: validate required fields
     
-    NSURLRequest *request = [self createRequestWithJSON:json path:path requestMethod:@"PUT"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    KintoneChunkedRequestSendBlock send = ^(NSArray *chunk, CBNetworkingSuccessBlockForJSONResponse chunkSuccess, CBNetworkingFailureBlockForJSONResponse chunkFailure) {
+        NSString *path = KINTONE_API_PATH(@"records.json");
+        NSDictionary *json = @{@"app"     : @(self.kintoneApplication.appId),
+                               @"records" : chunk};
+        
+        NSURLRequest *request = [self createRequestWithJSON:json path:path requestMethod:@"PUT"];
+        NSSet *fileKeys = [self fileKeysInJSON:chunk];
+        return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self consumeFileKeys:fileKeys success:[self removeStoredRecords:[chunk valueForKey:@"id"] success:chunkSuccess]] failure:[self consumeFileKeys:fileKeys failure:chunkFailure] queue:[self mutationQueue:queue recordId:0]];
+    };
+    
+    return [self sendBulkRequest:fieldJSON send:send success:success failure:failure];
 }
 
-- (void)bulkUpdateWithRecords:(NSArray *)records
-                      success:(CBNetworkingSuccessBlockForJSONResponse)success
-                      failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                        queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)bulkUpdateWithRecords:(NSArray *)records
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue
 {
     NSMutableArray *json = [NSMutableArray arrayWithCapacity:records.count];
     for (id value in records) {
@@ -339,31 +556,49 @@ static NSString * const API_BASEPATH = @"/k/v1/";
         [json addObject:recordDict];
     }
 
-    [self bulkUpdate:json success:success failure:failure queue:queue];
+    return [self bulkUpdate:json success:success failure:failure queue:queue];
 }
 
-- (void)bulkDelete:(NSArray *)recordIds
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)bulkDelete:(NSArray *)recordIds
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue
 {
-    NSMutableString *params = [NSMutableString stringWithFormat:@"app=%d", self.kintoneApplication.appId];
-    for (int i = 0; i < recordIds.count; i++) {
-        assert([recordIds[i] isKindOfClass:[NSNumber class]]);
+    KintoneChunkedRequestSendBlock send = ^(NSArray *chunk, CBNetworkingSuccessBlockForJSONResponse chunkSuccess, CBNetworkingFailureBlockForJSONResponse chunkFailure) {
+        NSMutableString *params = [NSMutableString stringWithFormat:@"app=%d", self.kintoneApplication.appId];
+        for (int i = 0; i < chunk.count; i++) {
+            assert([chunk[i] isKindOfClass:[NSNumber class]]);
+            
+            NSNumber *recordId = (NSNumber *)chunk[i];
+            [params appendFormat:@"&%@=%d", [NSString stringWithFormat:@"ids[%d]", i], [recordId intValue]];
+        }
         
-        NSNumber *recordId = (NSNumber *)recordIds[i];
-        [params appendFormat:@"&%@=%d", [NSString stringWithFormat:@"ids[%d]", i], [recordId intValue]];
+        NSString *path = KINTONE_API_PATH(@"records.json");
+        NSURLRequest *request = [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, params] requestMethod:@"DELETE"];
+        return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self removeStoredRecords:chunk success:chunkSuccess] failure:chunkFailure queue:[self mutationQueue:queue recordId:0]];
+    };
+    
+    return [self sendBulkRequest:recordIds send:send success:success failure:failure];
+}
+
+- (CBRequestHandle *)sendBulkRequest:(NSArray *)items
+                                send:(KintoneChunkedRequestSendBlock)send
+                             success:(CBNetworkingSuccessBlockForJSONResponse)success
+                             failure:(CBNetworkingFailureBlockForJSONResponse)failure
+{
+    if (items.count <= KINTONE_BULK_REQUEST_LIMIT) {
+        return send(items, success, failure);
     }
     
-    NSString *path = KINTONE_API_PATH(@"records.json");
-    NSURLRequest *request = [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, params] requestMethod:@"DELETE"];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    // the server rejects more than KINTONE_BULK_REQUEST_LIMIT records per request
+    KintoneChunkedRequest *chunkedRequest = [[KintoneChunkedRequest alloc] initWithItems:items chunkSize:KINTONE_BULK_REQUEST_LIMIT maxConcurrentChunks:self.maxConcurrentBulkRequests];
+    return [chunkedRequest send:send success:success failure:failure];
 }
 
-- (void)bulkDeleteWithRecords:(NSArray *)records
-                      success:(CBNetworkingSuccessBlockForJSONResponse)success
-                      failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                        queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)bulkDeleteWithRecords:(NSArray *)records
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue
 {
     NSMutableArray *recordIds = [NSMutableArray arrayWithCapacity:records.count];
     for (id value in records) {
@@ -373,46 +608,692 @@ static NSString * const API_BASEPATH = @"/k/v1/";
         [recordIds addObject:record.recordNumber.value];
     }
     
-    [self bulkDelete:recordIds success:success failure:failure queue:queue];
+    return [self bulkDelete:recordIds success:success failure:failure queue:queue];
 }
 
-- (void)fileDownload:(NSString *)fileKey
-             success:(CBNetworkingSuccessBlockForHTTPResponse)success
-             failure:(CBNetworkingFailureBlockForHTTPResponse)failure
-            download:(CBNetworkingDownloadProgressBlock)download
-              output:(NSOutputStream *)output
-               queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)bulkRequest:(NSArray *)requests
+                         success:(CBNetworkingSuccessBlockForJSONResponse)success
+                         failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                           queue:(NSOperationQueue *)queue
 {
+    NSString *path = KINTONE_API_PATH(@"bulkRequest.json");
+    NSDictionary *json = @{@"requests" : requests};
+    
+    NSURLRequest *request = [self createRequestWithJSON:json path:path requestMethod:@"POST"];
+    CBNetworkingSuccessBlockForJSONResponse bulkSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [self removeStoredRecordsChangedByRequests:requests];
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+    NSSet *fileKeys = [self fileKeysInJSON:requests];
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:[self consumeFileKeys:fileKeys success:bulkSuccess] failure:[self consumeFileKeys:fileKeys failure:failure] queue:[self mutationQueue:queue recordId:0]];
+}
+
+- (KintoneBulkRequest *)bulkRequest
+{
+    return [[KintoneBulkRequest alloc] initWithKintoneAPI:self];
+}
+
+- (CBRequestHandle *)fileDownload:(NSString *)fileKey
+                          success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                          failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                         download:(CBNetworkingDownloadProgressBlock)download
+                           output:(NSOutputStream *)output
+                            queue:(NSOperationQueue *)queue
+{
+    CBRequestHandle *cached = [self cachedFileDownload:fileKey write:^id(NSURL *cachedURL, NSError * __autoreleasing *error) {
+        return [self writeFileAtURL:cachedURL toStream:output error:error];
+    } success:success failure:failure];
+    if (cached != nil) {
+        return cached;
+    }
+
+    NSString *path = KINTONE_API_PATH(@"file.json");
+    NSString *param = [NSString stringWithFormat:@"fileKey=%@", fileKey];
+
+    NSURLRequest *request = [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, param] requestMethod:@"GET"];
+    return [CBNetworking sendRequestForDownload:request
+                                     credential:self.kintoneApplication.kintoneSite.cbCredential
+                                        success:success
+                                        failure:failure
+                                       download:download
+                                         output:output
+                                          queue:[self requestQueue:queue]];
+}
+
+- (CBRequestHandle *)fileDownload:(NSString *)fileKey
+                            toURL:(NSURL *)destinationURL
+                          success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                          failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                         download:(CBNetworkingDownloadProgressBlock)download
+                            queue:(NSOperationQueue *)queue
+{
+    CBRequestHandle *cached = [self cachedFileDownload:fileKey write:^id(NSURL *cachedURL, NSError * __autoreleasing *error) {
+        return [self writeFileAtURL:cachedURL toURL:destinationURL error:error];
+    } success:success failure:failure];
+    if (cached != nil) {
+        return cached;
+    }
+
     NSString *path = KINTONE_API_PATH(@"file.json");
     NSString *param = [NSString stringWithFormat:@"fileKey=%@", fileKey];
 
     NSURLRequest *request = [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, param] requestMethod:@"GET"];
-    [CBNetworking sendRequestForDownload:request
-                              credential:self.kintoneApplication.kintoneSite.cbCredential
-                                 success:success
-                                 failure:failure
-                                download:download
-                                  output:output
-                                   queue:queue];
+    return [CBNetworking sendRequestForResumableDownload:request
+                                              credential:self.kintoneApplication.kintoneSite.cbCredential
+                                             retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy
+                                          partialFileURL:[self partialFileURLForFileKey:fileKey]
+                                          destinationURL:destinationURL
+                                                 success:success
+                                                 failure:failure
+                                                download:download
+                                                   queue:[self requestQueue:queue]];
+}
+
+- (CBRequestHandle *)fileDownloadWithFile:(KintoneFile *)file
+                                    toURL:(NSURL *)destinationURL
+                               rangeCount:(NSUInteger)rangeCount
+                                  success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                  failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                 download:(CBNetworkingDownloadProgressBlock)download
+                                    queue:(NSOperationQueue *)queue
+{
+    if (file.size <= 0 || [self.kintoneApplication.kintoneSite.fileCache fileURLForFileKey:file.fileKey] != nil) {
+        // the size is needed to split the file; a cached file is copied without a request
+        return [self fileDownload:file.fileKey toURL:destinationURL success:success failure:failure download:download queue:queue];
+    }
+
+    NSString *path = KINTONE_API_PATH(@"file.json");
+    NSString *param = [NSString stringWithFormat:@"fileKey=%@", file.fileKey];
+
+    NSURLRequest *request = [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, param] requestMethod:@"GET"];
+    return [CBNetworking sendRequestForRangedDownload:request
+                                           credential:self.kintoneApplication.kintoneSite.cbCredential
+                                          retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy
+                                               length:file.size
+                                           rangeCount:rangeCount
+                                       partialFileURL:[self partialFileURLForFileKey:file.fileKey]
+                                       destinationURL:destinationURL
+                                              success:success
+                                              failure:failure
+                                             download:download
+                                                queue:[self requestQueue:queue]];
+}
+
+- (CBRequestHandle *)fileDownloadWithCache:(NSString *)fileKey
+                                   success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                   failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                  download:(CBNetworkingDownloadProgressBlock)download
+                                     queue:(NSOperationQueue *)queue
+{
+    CBRequestHandle *cached = [self cachedFileDownload:fileKey write:nil success:success failure:failure];
+    if (cached != nil) {
+        return cached;
+    }
+
+    // downloaded inside the cache directory, so that it can be moved into the cache
+    KintoneFileCache *fileCache = self.kintoneApplication.kintoneSite.fileCache;
+    NSString *fileName = [fileKey gtm_stringByEscapingForURLArgument];
+    NSURL *downloadURL = [[fileCache.directoryURL URLByAppendingPathComponent:@"incoming"] URLByAppendingPathComponent:fileName];
+
+    CBRequestHandle *handle = [CBRequestHandle new];
+    CBNetworkingSuccessBlockForHTTPResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+        // hashing a large file takes a while
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            CBError* __autoreleasing error = nil;
+            NSURL *fileURL = [fileCache storeFileAtURL:downloadURL fileKey:fileKey error:&error];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (handle.isCancelled) {
+                    if (failure) {
+                        failure(request, response, [CBRequestHandle cancelledError]);
+                    }
+                }
+                else if (fileURL == nil) {
+                    if (failure) {
+                        failure(request, response, error);
+                    }
+                }
+                else if (success) {
+                    success(request, response, fileURL);
+                }
+                [handle finish];
+            });
+        });
+    };
+    CBNetworkingFailureBlockForHTTPResponse failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error) {
+        if (failure) {
+            failure(request, response, error);
+        }
+        [handle finish];
+    };
+
+    [handle addChild:[self fileDownload:fileKey toURL:downloadURL success:successBlock failure:failureBlock download:download queue:queue]];
+    return handle;
+}
+
+- (CBRequestHandle *)cachedFileDownload:(NSString *)fileKey
+                                  write:(id (^)(NSURL *cachedURL, NSError * __autoreleasing *error))write
+                                success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+{
+    NSURL *cachedURL = [self.kintoneApplication.kintoneSite.fileCache fileURLForFileKey:fileKey];
+    if (cachedURL == nil) {
+        return nil;
+    }
+
+    // no request is sent; the blocks still run later on the main thread, as for a download
+    CBRequestHandle *handle = [CBRequestHandle new];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSError * __autoreleasing error = nil;
+        id responseObject = write ? write(cachedURL, &error) : cachedURL;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (handle.isCancelled) {
+                if (failure) {
+                    failure(nil, nil, [CBRequestHandle cancelledError]);
+                }
+            }
+            else if (responseObject == nil) {
+                if (failure) {
+                    failure(nil, nil, [CBError errorWithNSError:error]);
+                }
+            }
+            else if (success) {
+                success(nil, nil, responseObject);
+            }
+            [handle finish];
+        });
+    });
+
+    return handle;
+}
+
+- (id)writeFileAtURL:(NSURL *)fileURL toStream:(NSOutputStream *)output error:(NSError * __autoreleasing *)error
+{
+    NSInputStream *input = [NSInputStream inputStreamWithURL:fileURL];
+    [input open];
+    [output open];
+
+    uint8_t buffer[64 * 1024];
+    NSInteger length;
+    while ((length = [input read:buffer maxLength:sizeof(buffer)]) > 0) {
+        NSInteger written = 0;
+        while (written < length) {
+            NSInteger result = [output write:buffer + written maxLength:length - written];
+            if (result <= 0) {
+                *error = [output streamError];
+                [input close];
+                [output close];
+                return nil;
+            }
+            written += result;
+        }
+    }
+
+    [input close];
+    [output close];
+    if (length < 0) {
+        *error = [input streamError];
+        return nil;
+    }
+
+    // like the response object of a download, the data written to a memory stream
+    return [output propertyForKey:NSStreamDataWrittenToMemoryStreamKey] ?: fileURL;
+}
+
+- (id)writeFileAtURL:(NSURL *)fileURL toURL:(NSURL *)destinationURL error:(NSError * __autoreleasing *)error
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSURL *temporaryURL = [destinationURL URLByAppendingPathExtension:@"download"];
+    [fileManager removeItemAtURL:temporaryURL error:nil];
+    [fileManager createDirectoryAtURL:[destinationURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (![fileManager copyItemAtURL:fileURL toURL:temporaryURL error:error]) {
+        return nil;
+    }
+
+    // replaced atomically, as by a download
+    if (rename([[temporaryURL path] fileSystemRepresentation], [[destinationURL path] fileSystemRepresentation]) != 0) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        [fileManager removeItemAtURL:temporaryURL error:nil];
+        return nil;
+    }
+
+    return destinationURL;
+}
+
+- (CBRequestHandle *)fileUpload:(NSData *)fileData
+                       fileName:(NSString *)fileName
+                    contentType:(NSString *)contentType
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue
+{
+    KintoneUploadCache *uploadCache = self.kintoneApplication.kintoneSite.uploadCache;
+    CBRequestHandle *uploaded = [self uploadedFileKey:[uploadCache fileKeyForData:fileData] success:success failure:failure];
+    if (uploaded != nil) {
+        return uploaded;
+    }
+
+    CBDigestInputStream * __autoreleasing inputStream = nil;
+    NSURLRequest *request = [self createFileUploadRequest:fileData fileName:fileName contentType:contentType inputStream:&inputStream];
+
+    CBDigestInputStream *stream = inputStream;
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        // the digest was computed while the body was sent
+        [self rememberUploadedFileKey:JSON hash:stream.digest fileURL:nil data:fileData];
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:successBlock failure:failure queue:[self requestQueue:queue]];
 }
 
-- (void)fileUpload:(NSData *)fileData
-          fileName:(NSString *)fileName
-       contentType:(NSString *)contentType
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)fileUploadWithFileURL:(NSURL *)fileURL
+                                  fileName:(NSString *)fileName
+                               contentType:(NSString *)contentType
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue
 {
-    NSURLRequest *request = [self createFileUploadRequest:fileData fileName:fileName contentType:contentType];
-    [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential success:success failure:failure queue:queue];
+    assert([fileURL isFileURL]);
+
+    KintoneUploadCache *uploadCache = self.kintoneApplication.kintoneSite.uploadCache;
+    CBRequestHandle *uploaded = [self uploadedFileKey:[uploadCache fileKeyForFileAtURL:fileURL] success:success failure:failure];
+    if (uploaded != nil) {
+        return uploaded;
+    }
+
+    NSError * __autoreleasing error = nil;
+    CBDigestInputStream * __autoreleasing inputStream = nil;
+    NSURLRequest *request = [self createFileUploadRequestWithFileURL:fileURL
+                                                            fileName:fileName ? fileName : [fileURL lastPathComponent]
+                                                         contentType:contentType
+                                                         inputStream:&inputStream
+                                                               error:&error];
+    if (request == nil) {
+        // the file cannot be read; fail like a request that could not be sent
+        CBRequestHandle *handle = [CBRequestHandle new];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (failure) {
+                failure(nil, nil, [CBError errorWithNSError:error], nil);
+            }
+            [handle finish];
+        });
+        return handle;
+    }
+
+    CBDigestInputStream *stream = inputStream;
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        // the digest was computed while the body was sent
+        [self rememberUploadedFileKey:JSON hash:stream.digest fileURL:fileURL data:nil];
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+
+    return [CBNetworking sendRequestForJSONResponse:request credential:self.kintoneApplication.kintoneSite.cbCredential retryPolicy:self.kintoneApplication.kintoneSite.retryPolicy success:successBlock failure:failure queue:[self requestQueue:queue]];
+}
+
+- (CBRequestHandle *)fileUploadWithFile:(KintoneFile *)file
+                                success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                  queue:(NSOperationQueue *)queue
+{
+    if (file.fileURL != nil) {
+        return [self fileUploadWithFileURL:file.fileURL fileName:file.name contentType:file.contentType success:success failure:failure queue:queue];
+    }
+
+    return [self fileUpload:file.data fileName:file.name contentType:file.contentType success:success failure:failure queue:queue];
+}
+
+- (CBRequestHandle *)fileCopyWithFile:(KintoneFile *)file
+                         toKintoneAPI:(KintoneAPI *)destination
+                              success:(CBNetworkingSuccessBlockForJSONResponse)success
+                              failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                queue:(NSOperationQueue *)queue
+{
+    assert(file.fileKey != nil);
+
+    KintoneAPI *target = destination ?: self;
+    NSOperationQueue *copyQueue = queue ?: [CBOperationQueue sharedConcurrentQueue];
+    if (file.size <= 0 || copyQueue.maxConcurrentOperationCount == 1) {
+        // the upload needs the length up front, and must run beside the download
+        return [self fileCopyThroughDisk:file toKintoneAPI:target success:success failure:failure queue:queue];
+    }
+
+    // the upload reads the content from the pipe as the download writes it
+    CBPipe *pipe = nil;
+    NSURLRequest *uploadRequest = [target createFileUploadRequestWithFile:file pipe:&pipe];
+    CBRequestHandle *handle = [CBRequestHandle new];
+    [handle addCancellationHandler:^{
+        // the upload must not wait for content that is not coming
+        [pipe closeWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+    }];
+
+    __block int remaining = 2;
+    __block NSDictionary *downloadFailed = nil;     // request, response and error of the failed download
+    __block NSDictionary *uploadFailed = nil;       // request, response, error and JSON of the failed upload
+    __block NSDictionary *uploaded = nil;           // request, response and JSON of the upload
+    __block BOOL stopping = NO;                     // one side failed, the other has been cancelled
+    __block CBRequestHandle *downloadHandle = nil;
+    __block CBRequestHandle *uploadHandle = nil;
+
+    NSDictionary *(^result)(NSURLRequest *, NSHTTPURLResponse *, CBError *, id) = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        NSMutableDictionary *result = [NSMutableDictionary dictionary];
+        [result setValue:request forKey:@"request"];
+        [result setValue:response forKey:@"response"];
+        [result setValue:error forKey:@"error"];
+        [result setValue:JSON forKey:@"JSON"];
+        return result;
+    };
+    void (^complete)(void) = ^{
+        if (--remaining > 0) {
+            return;
+        }
+        downloadHandle = nil;
+        uploadHandle = nil;
+
+        // a failed download also fails the upload; its error tells what went wrong
+        NSDictionary *failed = downloadFailed ?: uploadFailed;
+        if (failed != nil) {
+            if (failure) {
+                failure(failed[@"request"], failed[@"response"], failed[@"error"], failed[@"JSON"]);
+            }
+        }
+        else if (success) {
+            success(uploaded[@"request"], uploaded[@"response"], uploaded[@"JSON"]);
+        }
+        [handle finish];
+    };
+
+    CBNetworkingSuccessBlockForHTTPResponse downloadSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+        if (!stopping && pipe.error != nil) {
+            // e.g. the content was not as long as the size of the file
+            downloadFailed = result(request, response, [CBError errorWithNSError:pipe.error], nil);
+            stopping = YES;
+            [uploadHandle cancel];
+        }
+        complete();
+    };
+    CBNetworkingFailureBlockForHTTPResponse downloadFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error) {
+        if (!stopping) {
+            downloadFailed = result(request, response, error, nil);
+            stopping = YES;
+            [pipe closeWithError:nil];
+            [uploadHandle cancel];
+        }
+        complete();
+    };
+    CBNetworkingSuccessBlockForJSONResponse uploadSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        uploaded = result(request, response, nil, JSON);
+        complete();
+    };
+    CBNetworkingFailureBlockForJSONResponse uploadFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        if (!stopping && pipe.error == nil) {
+            // otherwise the pipe was ended on the download side, whose failure follows
+            uploadFailed = result(request, response, error, JSON);
+            stopping = YES;
+            [pipe closeWithError:nil];
+            [downloadHandle cancel];
+        }
+        complete();
+    };
+
+    NSString *path = KINTONE_API_PATH(@"file.json");
+    NSString *param = [NSString stringWithFormat:@"fileKey=%@", file.fileKey];
+    NSURLRequest *downloadRequest = [self createRequest:[[NSString alloc] initWithFormat:@"%@?%@", path, param] requestMethod:@"GET"];
+    CBPipeOutputStream *output = [[CBPipeOutputStream alloc] initWithPipe:pipe];
+
+    // neither can be retried, the content passes through only once
+    downloadHandle = [CBNetworking sendRequestForDownload:downloadRequest
+                                               credential:self.kintoneApplication.kintoneSite.cbCredential
+                                                  success:downloadSuccess
+                                                  failure:downloadFailure
+                                                 download:nil
+                                                   output:output
+                                                    queue:copyQueue];
+    uploadHandle = [CBNetworking sendRequestForJSONResponse:uploadRequest
+                                                 credential:target.kintoneApplication.kintoneSite.cbCredential
+                                                retryPolicy:nil
+                                                    success:uploadSuccess
+                                                    failure:uploadFailure
+                                                      queue:copyQueue];
+    [handle addChild:downloadHandle];
+    [handle addChild:uploadHandle];
+
+    return handle;
+}
+
+- (CBRequestHandle *)fileCopyThroughDisk:(KintoneFile *)file
+                            toKintoneAPI:(KintoneAPI *)destination
+                                 success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                 failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                   queue:(NSOperationQueue *)queue
+{
+    // Caches/kintone/copies/<unique name>; the memory use stays constant, but the upload waits for the whole download
+    NSString *cachesPath = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES)[0];
+    NSString *name = [[NSProcessInfo processInfo] globallyUniqueString];
+    NSURL *temporaryURL = [NSURL fileURLWithPath:[[cachesPath stringByAppendingPathComponent:@"kintone/copies"] stringByAppendingPathComponent:name]];
+
+    CBRequestHandle *handle = [CBRequestHandle new];
+    CBNetworkingSuccessBlockForJSONResponse uploadSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [[NSFileManager defaultManager] removeItemAtURL:temporaryURL error:nil];
+        if (success) {
+            success(request, response, JSON);
+        }
+        [handle finish];
+    };
+    CBNetworkingFailureBlockForJSONResponse uploadFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        [[NSFileManager defaultManager] removeItemAtURL:temporaryURL error:nil];
+        if (failure) {
+            failure(request, response, error, JSON);
+        }
+        [handle finish];
+    };
+    CBNetworkingSuccessBlockForHTTPResponse downloadSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+        if (handle.isCancelled) {
+            uploadFailure(request, response, [CBRequestHandle cancelledError], nil);
+            return;
+        }
+        [handle addChild:[destination fileUploadWithFileURL:temporaryURL fileName:file.name contentType:file.contentType success:uploadSuccess failure:uploadFailure queue:queue]];
+    };
+    CBNetworkingFailureBlockForHTTPResponse downloadFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error) {
+        uploadFailure(request, response, error, nil);
+    };
+
+    [handle addChild:[self fileDownload:file.fileKey toURL:temporaryURL success:downloadSuccess failure:downloadFailure download:nil queue:queue]];
+    return handle;
+}
+
+- (void)collectFilesToUpload:(KintoneRecord *)record files:(NSMutableArray *)files
+{
+    for (KintoneField *field in record.fields.objectEnumerator) {
+        if (field.type == KintoneFileFieldType) {
+            for (KintoneFile *file in (NSArray *)field.value) {
+                // files added but not uploaded yet; the others already have a fileKey
+                if ([file isKindOfClass:[KintoneFile class]] && !file.deleted && [NSString isNilOrEmpty:file.fileKey] &&
+                    (file.data != nil || file.fileURL != nil)) {
+                    [files addObject:file];
+                }
+            }
+        }
+        else if (field.type == KintoneSubtableFieldType) {
+            for (KintoneRecord *row in (NSArray *)field.value) {
+                [self collectFilesToUpload:row files:files];
+            }
+        }
+    }
 }
 
-- (void)fileUploadWithFile:(KintoneFile *)file
-                   success:(CBNetworkingSuccessBlockForJSONResponse)success
-                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                     queue:(NSOperationQueue *)queue
+- (CBRequestHandle *)uploadedFileKey:(NSString *)fileKey
+                             success:(CBNetworkingSuccessBlockForJSONResponse)success
+                             failure:(CBNetworkingFailureBlockForJSONResponse)failure
 {
-    [self fileUpload:file.data fileName:file.name contentType:file.contentType success:success failure:failure queue:queue];
+    if (fileKey == nil) {
+        return nil;
+    }
+
+    // the same content was uploaded a short while ago; answer as file.json would, later on the main thread
+    CBRequestHandle *handle = [CBRequestHandle new];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (handle.isCancelled) {
+            if (failure) {
+                failure(nil, nil, [CBRequestHandle cancelledError], nil);
+            }
+        }
+        else if (success) {
+            success(nil, nil, @{@"fileKey" : fileKey});
+        }
+        [handle finish];
+    });
+
+    return handle;
+}
+
+- (void)rememberUploadedFileKey:(id)JSON hash:(NSString *)hash fileURL:(NSURL *)fileURL data:(NSData *)data
+{
+    NSString *fileKey = [JSON isKindOfClass:[NSDictionary class]] ? JSON[@"fileKey"] : nil;
+    if (![fileKey isKindOfClass:[NSString class]] || hash == nil) {
+        return;
+    }
+
+    KintoneUploadCache *uploadCache = self.kintoneApplication.kintoneSite.uploadCache;
+    if (data != nil) {
+        [uploadCache setFileKey:fileKey forHash:hash data:data];
+    }
+    else {
+        [uploadCache setFileKey:fileKey forHash:hash fileURL:fileURL];
+    }
+}
+
+- (NSSet *)fileKeysInJSON:(id)json
+{
+    NSMutableSet *fileKeys = [NSMutableSet set];
+    [self collectFileKeys:json fileKeys:fileKeys];
+
+    return fileKeys;
+}
+
+- (void)collectFileKeys:(id)json fileKeys:(NSMutableSet *)fileKeys
+{
+    // file fields, also in subtable rows and bulk request payloads, have {"fileKey": ...} values
+    if ([json isKindOfClass:[NSDictionary class]]) {
+        [(NSDictionary *)json enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if ([key isEqual:@"fileKey"] && [value isKindOfClass:[NSString class]]) {
+                [fileKeys addObject:value];
+            }
+            else {
+                [self collectFileKeys:value fileKeys:fileKeys];
+            }
+        }];
+    }
+    else if ([json isKindOfClass:[NSArray class]]) {
+        for (id value in (NSArray *)json) {
+            [self collectFileKeys:value fileKeys:fileKeys];
+        }
+    }
+}
+
+- (CBNetworkingSuccessBlockForJSONResponse)consumeFileKeys:(NSSet *)fileKeys success:(CBNetworkingSuccessBlockForJSONResponse)success
+{
+    if (fileKeys.count == 0) {
+        return success;
+    }
+
+    return ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        // kintone consumes a fileKey when it is attached; the next upload of the same content needs a new one
+        KintoneUploadCache *uploadCache = self.kintoneApplication.kintoneSite.uploadCache;
+        for (NSString *fileKey in fileKeys) {
+            [uploadCache removeFileKey:fileKey];
+        }
+
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+}
+
+- (CBNetworkingFailureBlockForJSONResponse)consumeFileKeys:(NSSet *)fileKeys failure:(CBNetworkingFailureBlockForJSONResponse)failure
+{
+    if (fileKeys.count == 0) {
+        return failure;
+    }
+
+    return ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        // a rejected request body may be a fileKey that has expired or been attached already
+        if (response.statusCode == 400) {
+            KintoneUploadCache *uploadCache = self.kintoneApplication.kintoneSite.uploadCache;
+            for (NSString *fileKey in fileKeys) {
+                [uploadCache removeFileKey:fileKey];
+            }
+        }
+
+        if (failure) {
+            failure(request, response, error, JSON);
+        }
+    };
+}
+
+- (CBNetworkingSuccessBlockForJSONResponse)storeRecords:(CBNetworkingSuccessBlockForJSONResponse)success partial:(BOOL)partial
+{
+    return ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        // record.json has a record, records.json an array of them
+        id records = [JSON isKindOfClass:[NSDictionary class]] ? (JSON[@"records"] ?: JSON[@"record"]) : nil;
+        if ([records isKindOfClass:[NSDictionary class]]) {
+            records = @[records];
+        }
+        if ([records isKindOfClass:[NSArray class]]) {
+            [self.kintoneApplication.recordStore storeRecordDictionaries:records partial:partial];
+        }
+
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+}
+
+- (CBNetworkingSuccessBlockForJSONResponse)removeStoredRecords:(NSArray *)recordIds success:(CBNetworkingSuccessBlockForJSONResponse)success
+{
+    return ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        // the stored records are stale; they are stored again when read
+        [self.kintoneApplication.recordStore removeRecordsWithIds:recordIds];
+
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+}
+
+- (void)removeStoredRecordsChangedByRequests:(NSArray *)requests
+{
+    for (NSDictionary *request in requests) {
+        NSString *method = request[@"method"];
+        NSDictionary *payload = request[@"payload"];
+        if (!([method isEqualToString:@"PUT"] || [method isEqualToString:@"DELETE"]) || ![payload isKindOfClass:[NSDictionary class]] || payload[@"app"] == nil) {
+            continue;
+        }
+
+        // record.json and record/status.json have an id, records.json ids or records with ids
+        NSMutableArray *recordIds = [NSMutableArray array];
+        if (payload[@"id"]) {
+            [recordIds addObject:payload[@"id"]];
+        }
+        if ([payload[@"ids"] isKindOfClass:[NSArray class]]) {
+            [recordIds addObjectsFromArray:payload[@"ids"]];
+        }
+        if ([payload[@"records"] isKindOfClass:[NSArray class]]) {
+            for (NSDictionary *record in payload[@"records"]) {
+                if ([record isKindOfClass:[NSDictionary class]] && record[@"id"]) {
+                    [recordIds addObject:record[@"id"]];
+                }
+            }
+        }
+
+        // a bulk request may change the records of other apps of the same domain
+        KintoneApplication *kintoneApplication = [self.kintoneApplication.kintoneSite kintoneApplication:[payload[@"app"] intValue]];
+        [kintoneApplication.recordStore removeRecordsWithIds:recordIds];
+    }
 }
 
 @end
@@ -0,0 +1,24 @@
+//
+//  KintoneAPIPath.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+// Path prefix of the kintone REST API, shared by the requests of KintoneAPI and the payloads of KintoneBulkRequest.
+static NSString * const API_BASEPATH = @"/k/v1/";
+
+#define KINTONE_API_PATH(file)  [[NSString alloc] initWithFormat:@"%@%@", API_BASEPATH, (file)]
@@ -18,7 +18,12 @@
 
 #import "KintoneApplication.h"
 
+#import "CBCredential.h"
+#import "CBKeyedOperationQueue.h"
 #import "KintoneAPI.h"
+#import "KintoneFormCache.h"
+#import "KintoneRecordStore.h"
+#import "KintoneRecordSync.h"
 #import "KintoneSite.h"
 
 @interface KintoneApplication ()
@@ -34,6 +39,10 @@
 @synthesize appId;
 @synthesize kintoneSite;
 @synthesize kintoneAPI = _kintoneAPI;
+@synthesize formCache = _formCache;
+@synthesize recordStore = _recordStore;
+@synthesize recordSync = _recordSync;
+@synthesize defaultQueue = _defaultQueue;
 
 - (KintoneApplication *)initWithAppId:(int)newAppId kintoneSite:(KintoneSite *)newKintoneSite
 {
@@ -43,6 +52,10 @@
         self.appId = newAppId;
         self.kintoneSite = newKintoneSite;
         _kintoneAPI = nil;
+        _formCache = nil;
+        _recordStore = nil;
+        _recordSync = nil;
+        _defaultQueue = nil;
     }
     
     return self;
@@ -57,4 +70,54 @@
     return _kintoneAPI;
 }
 
+- (KintoneFormCache *)formCache
+{
+    if (_formCache == nil) {
+        _formCache = [[KintoneFormCache alloc] initWithKintoneApplication:self];
+    }
+    
+    return _formCache;
+}
+
+- (KintoneRecordStore *)recordStore
+{
+    if (_recordStore == nil) {
+        _recordStore = [[KintoneRecordStore alloc] initWithKintoneApplication:self];
+    }
+
+    return _recordStore;
+}
+
+- (KintoneRecordSync *)recordSync
+{
+    if (_recordSync == nil) {
+        _recordSync = [[KintoneRecordSync alloc] initWithKintoneApplication:self];
+    }
+
+    return _recordSync;
+}
+
+- (NSOperationQueue *)defaultQueue
+{
+    if (_defaultQueue == nil) {
+        _defaultQueue = [[CBKeyedOperationQueue sharedQueue] queueForKey:[self queueKey]];
+    }
+
+    return _defaultQueue;
+}
+
+- (NSOperationQueue *)queueForRecord:(int)recordId
+{
+    // a record's operations also wait for the app's operations added before them, and the other way round
+    NSString *key = [NSString stringWithFormat:@"%@/%d", [self queueKey], recordId];
+    return [[CBKeyedOperationQueue sharedQueue] queueForKey:key parentKey:[self queueKey]];
+}
+
+#pragma mark - private
+
+- (NSString *)queueKey
+{
+    return [NSString stringWithFormat:@"%@/%d", self.kintoneSite.cbCredential.domain, self.appId];
+}
+
 @end
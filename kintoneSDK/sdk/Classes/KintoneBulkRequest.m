@@ -0,0 +1,180 @@
+//
+//  KintoneBulkRequest.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneBulkRequest.h"
+
+#import "KintoneAPI.h"
+#import "KintoneAPIPath.h"
+#import "KintoneField.h"
+#import "KintoneRecord.h"
+
+@interface KintoneBulkRequest ()
+@property (nonatomic, readwrite) KintoneAPI *kintoneAPI;
+@end
+
+@implementation KintoneBulkRequest
+{
+    NSMutableArray *_requests;
+    NSMutableArray *_completions;  // KintoneBulkRequestCompletionBlock or NSNull per request
+}
+
+static const int KintoneBulkRequestMaxRequests = 20;
+
+- (KintoneBulkRequest *)initWithKintoneAPI:(KintoneAPI *)kintoneAPI
+{
+    assert(kintoneAPI != nil);
+
+    if (self = [super init]) {
+        self.kintoneAPI = kintoneAPI;
+        _requests = [NSMutableArray arrayWithCapacity:KintoneBulkRequestMaxRequests];
+        _completions = [NSMutableArray arrayWithCapacity:KintoneBulkRequestMaxRequests];
+    }
+
+    return self;
+}
+
+- (int)count
+{
+    return (int)_requests.count;
+}
+
+- (void)addRequest:(NSString *)method api:(NSString *)api payload:(NSDictionary *)payload completion:(KintoneBulkRequestCompletionBlock)completion
+{
+    assert(method != nil && api != nil && payload != nil);
+    NSAssert(_requests.count < KintoneBulkRequestMaxRequests, @"too many requests: %d", self.count + 1);
+
+    [_requests addObject:@{@"method"  : method,
+                           @"api"     : api,
+                           @"payload" : payload}];
+    [_completions addObject:completion ? [completion copy] : [NSNull null]];
+}
+
+- (void)insert:(NSDictionary *)fieldJSON app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion
+{
+    NSDictionary *payload = @{@"app"    : @(appId),
+                              @"record" : fieldJSON};
+
+    [self addRequest:@"POST" api:KINTONE_API_PATH(@"record.json") payload:payload completion:completion];
+}
+
+- (void)insertWithRecord:(KintoneRecord *)record app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion
+{
+    NSMutableDictionary *json = [NSMutableDictionary dictionaryWithCapacity:record.fields.count];
+    for (id key in record.fields.keyEnumerator) {
+        KintoneField *field = (KintoneField *)record.fields[key];
+        [json addEntriesFromDictionary:field.json];
+    }
+
+    [self insert:json app:appId completion:completion];
+}
+
+- (void)update:(int)recordId fieldJSON:(NSDictionary *)fieldJSON app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion
+{
+    NSDictionary *payload = @{@"app"    : @(appId),
+                              @"id"     : @(recordId),
+                              @"record" : fieldJSON};
+
+    [self addRequest:@"PUT" api:KINTONE_API_PATH(@"record.json") payload:payload completion:completion];
+}
+
+- (void)update:(int)recordId record:(KintoneRecord *)record app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion
+{
+    NSMutableDictionary *json = [NSMutableDictionary dictionaryWithCapacity:record.fields.count];
+    for (id key in record.fields.keyEnumerator) {
+        KintoneField *field = (KintoneField *)record.fields[key];
+        if (field.type == KintoneRecordNumberFieldType) {
+            continue;
+        }
+        [json addEntriesFromDictionary:field.json];
+    }
+
+    [self update:recordId fieldJSON:json app:appId completion:completion];
+}
+
+- (void)updateStatus:(int)recordId action:(NSString *)action assignee:(NSString *)assignee app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion
+{
+    assert(action != nil);
+
+    NSMutableDictionary *payload = [NSMutableDictionary dictionaryWithDictionary:@{@"app"    : @(appId),
+                                                                                   @"id"     : @(recordId),
+                                                                                   @"action" : action}];
+    if (assignee) {
+        payload[@"assignee"] = assignee;
+    }
+
+    [self addRequest:@"PUT" api:KINTONE_API_PATH(@"record/status.json") payload:payload completion:completion];
+}
+
+- (void)bulkDelete:(NSArray *)recordIds app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion
+{
+    for (id recordId in recordIds) {
+        assert([recordId isKindOfClass:[NSNumber class]]);
+    }
+
+    NSDictionary *payload = @{@"app" : @(appId),
+                              @"ids" : recordIds};
+
+    [self addRequest:@"DELETE" api:KINTONE_API_PATH(@"records.json") payload:payload completion:completion];
+}
+
+- (CBRequestHandle *)send:(CBNetworkingSuccessBlockForJSONResponse)success
+                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                    queue:(NSOperationQueue *)queue
+{
+    NSAssert(_requests.count > 0 && _requests.count <= KintoneBulkRequestMaxRequests, @"invalid number of requests: %d", self.count);
+
+    NSArray *completions = [_completions copy];
+
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        NSArray *results = JSON[@"results"];
+        for (NSUInteger i = 0; i < completions.count; i++) {
+            if (completions[i] != [NSNull null]) {
+                KintoneBulkRequestCompletionBlock completion = completions[i];
+                completion(i < results.count ? results[i] : nil, nil);
+            }
+        }
+
+        if (success) {
+            success(request, response, JSON);
+        }
+    };
+    CBNetworkingFailureBlockForJSONResponse failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        // the failed request has its own error, the others were rolled back
+        NSArray *results = [JSON isKindOfClass:[NSDictionary class]] ? JSON[@"results"] : nil;
+        for (NSUInteger i = 0; i < completions.count; i++) {
+            id result = i < results.count ? results[i] : nil;
+            CBError *resultError = error;
+            if ([result isKindOfClass:[NSDictionary class]] && result[@"code"] != nil && result[@"message"] != nil) {
+                resultError = [CBError errorWithCode:result[@"code"] description:nil failureReason:nil recoverySuggestion:result[@"message"]];
+            }
+
+            if (completions[i] != [NSNull null]) {
+                KintoneBulkRequestCompletionBlock completion = completions[i];
+                completion(result, resultError);
+            }
+        }
+
+        if (failure) {
+            failure(request, response, error, JSON);
+        }
+    };
+
+    return [self.kintoneAPI bulkRequest:[_requests copy] success:successBlock failure:failureBlock queue:queue];
+}
+
+@end
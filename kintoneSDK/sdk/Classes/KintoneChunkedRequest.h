@@ -0,0 +1,37 @@
+//
+//  KintoneChunkedRequest.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "CBNetworking.h"
+
+@class CBRequestHandle;
+
+typedef CBRequestHandle *(^KintoneChunkedRequestSendBlock)(NSArray *chunk, CBNetworkingSuccessBlockForJSONResponse success, CBNetworkingFailureBlockForJSONResponse failure);
+
+// Splits items into chunks and sends them with at most maxConcurrentChunks requests in flight.
+// Array values of the chunk responses (ids, revisions, ...) are concatenated in input order;
+// the slots of a failed chunk are filled with NSNull and the chunk is reported in "errors" of the failure JSON.
+// Cancelling the returned handle cancels the chunks in flight and fails the ones not sent yet.
+@interface KintoneChunkedRequest : NSObject
+
+- (KintoneChunkedRequest *)initWithItems:(NSArray *)items chunkSize:(NSUInteger)chunkSize maxConcurrentChunks:(NSUInteger)maxConcurrentChunks;
+- (CBRequestHandle *)send:(KintoneChunkedRequestSendBlock)send
+                  success:(CBNetworkingSuccessBlockForJSONResponse)success
+                  failure:(CBNetworkingFailureBlockForJSONResponse)failure;
+
+@end
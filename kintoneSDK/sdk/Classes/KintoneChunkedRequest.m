@@ -0,0 +1,211 @@
+//
+//  KintoneChunkedRequest.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneChunkedRequest.h"
+
+#import "CBRequestHandle.h"
+
+@implementation KintoneChunkedRequest
+{
+    NSArray *_chunks;
+    NSUInteger _maxConcurrentChunks;
+
+    KintoneChunkedRequestSendBlock _send;
+    CBNetworkingSuccessBlockForJSONResponse _success;
+    CBNetworkingFailureBlockForJSONResponse _failure;
+    CBRequestHandle *_handle;
+
+    NSUInteger _nextChunk;
+    NSUInteger _inFlight;
+    NSUInteger _completedChunks;
+    NSMutableDictionary *_responses;  // chunk index -> JSON of the success response
+    NSMutableDictionary *_failures;   // chunk index -> request, response, error and JSON of the failure response
+    NSURLRequest *_lastRequest;
+    NSHTTPURLResponse *_lastResponse;
+}
+
+- (KintoneChunkedRequest *)initWithItems:(NSArray *)items chunkSize:(NSUInteger)chunkSize maxConcurrentChunks:(NSUInteger)maxConcurrentChunks
+{
+    assert(chunkSize > 0);
+    assert(maxConcurrentChunks > 0);
+
+    if (self = [super init]) {
+        NSMutableArray *chunks = [NSMutableArray arrayWithCapacity:(items.count + chunkSize - 1) / chunkSize];
+        for (NSUInteger location = 0; location < items.count; location += chunkSize) {
+            NSRange range = NSMakeRange(location, MIN(chunkSize, items.count - location));
+            [chunks addObject:[items subarrayWithRange:range]];
+        }
+        _chunks = chunks;
+        _maxConcurrentChunks = maxConcurrentChunks;
+        _responses = [NSMutableDictionary dictionaryWithCapacity:_chunks.count];
+        _failures = [NSMutableDictionary dictionary];
+        _handle = [CBRequestHandle new];
+    }
+
+    return self;
+}
+
+- (CBRequestHandle *)send:(KintoneChunkedRequestSendBlock)send
+                  success:(CBNetworkingSuccessBlockForJSONResponse)success
+                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
+{
+    assert(send != nil);
+
+    _send = send;
+    _success = success;
+    _failure = failure;
+
+    CBRequestHandle *handle = _handle;
+    if (_chunks.count == 0) {
+        [self finish];
+        return handle;
+    }
+
+    [self sendChunks];
+    return handle;
+}
+
+#pragma mark - private
+
+- (void)sendChunks
+{
+    if (_handle.isCancelled) {
+        // chunks not sent yet fail without a request
+        while (_nextChunk < _chunks.count) {
+            _failures[@(_nextChunk++)] = @{@"error" : [CBRequestHandle cancelledError]};
+            _completedChunks++;
+        }
+        if (_completedChunks == _chunks.count) {
+            [self finish];
+        }
+        return;
+    }
+
+    while (_inFlight < _maxConcurrentChunks && _nextChunk < _chunks.count) {
+        [self sendChunk:_nextChunk++];
+    }
+}
+
+- (void)sendChunk:(NSUInteger)index
+{
+    CBNetworkingSuccessBlockForJSONResponse success = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        _responses[@(index)] = [JSON isKindOfClass:[NSDictionary class]] ? JSON : @{};
+        _lastRequest = request;
+        _lastResponse = response;
+        [self didCompleteChunk];
+    };
+    CBNetworkingFailureBlockForJSONResponse failure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        NSMutableDictionary *chunkFailure = [NSMutableDictionary dictionary];
+        [chunkFailure setValue:request forKey:@"request"];
+        [chunkFailure setValue:response forKey:@"response"];
+        [chunkFailure setValue:error forKey:@"error"];
+        [chunkFailure setValue:JSON forKey:@"JSON"];
+        _failures[@(index)] = chunkFailure;
+        [self didCompleteChunk];
+    };
+
+    _inFlight++;
+    [_handle addChild:_send(_chunks[index], success, failure)];
+}
+
+- (void)didCompleteChunk
+{
+    _inFlight--;
+    _completedChunks++;
+
+    if (_completedChunks == _chunks.count) {
+        [self finish];
+        return;
+    }
+
+    [self sendChunks];
+}
+
+- (void)finish
+{
+    // per-record arrays of the responses, e.g. "ids" and "revisions"
+    NSMutableOrderedSet *keys = [NSMutableOrderedSet orderedSet];
+    for (NSDictionary *response in _responses.objectEnumerator) {
+        for (id key in response.keyEnumerator) {
+            if ([response[key] isKindOfClass:[NSArray class]]) {
+                [keys addObject:key];
+            }
+        }
+    }
+
+    NSMutableDictionary *json = [NSMutableDictionary dictionaryWithCapacity:keys.count + 1];
+    for (id key in keys) {
+        NSMutableArray *values = [NSMutableArray array];
+        for (NSUInteger i = 0; i < _chunks.count; i++) {
+            NSArray *chunkValues = _responses[@(i)][key];
+            if ([chunkValues isKindOfClass:[NSArray class]]) {
+                [values addObjectsFromArray:chunkValues];
+            }
+            else {
+                // keep the positions of the following records
+                for (NSUInteger j = 0; j < [_chunks[i] count]; j++) {
+                    [values addObject:[NSNull null]];
+                }
+            }
+        }
+        json[key] = values;
+    }
+
+    CBNetworkingSuccessBlockForJSONResponse success = _success;
+    CBNetworkingFailureBlockForJSONResponse failure = _failure;
+    NSDictionary *firstFailure = nil;
+    if (_failures.count > 0) {
+        NSMutableArray *errors = [NSMutableArray arrayWithCapacity:_failures.count];
+        NSUInteger offset = 0;
+        for (NSUInteger i = 0; i < _chunks.count; i++) {
+            NSDictionary *chunkFailure = _failures[@(i)];
+            if (chunkFailure) {
+                NSMutableDictionary *error = [NSMutableDictionary dictionaryWithDictionary:@{@"offset" : @(offset),
+                                                                                             @"count"  : @([_chunks[i] count])}];
+                [error setValue:chunkFailure[@"error"] forKey:@"error"];
+                [error setValue:chunkFailure[@"JSON"] forKey:@"JSON"];
+                [errors addObject:error];
+
+                if (firstFailure == nil) {
+                    firstFailure = chunkFailure;
+                }
+            }
+            offset += [_chunks[i] count];
+        }
+        json[@"errors"] = errors;
+    }
+
+    // break retain cycles between the request and the caller's blocks
+    CBRequestHandle *handle = _handle;
+    _send = nil;
+    _success = nil;
+    _failure = nil;
+    _handle = nil;
+
+    if (firstFailure) {
+        if (failure) {
+            failure(firstFailure[@"request"], firstFailure[@"response"], firstFailure[@"error"], json);
+        }
+    }
+    else if (success) {
+        success(_lastRequest, _lastResponse, json);
+    }
+    [handle finish];
+}
+
+@end
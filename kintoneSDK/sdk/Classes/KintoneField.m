@@ -45,6 +45,180 @@
 
 @end
 
+@interface KintoneKindOfDateField ()
+
+- (NSString *)localDateStringOfRecordValue:(id)recordValue;
+
+@end
+
+#pragma mark - query strings
+
+static NSString *quotedQueryString(NSString *string)
+{
+    // escape backslashes and double quotes in the string literal
+    NSString *escaped = [string stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"];
+    escaped = [escaped stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+    return [NSString stringWithFormat:@"\"%@\"", escaped];
+}
+
+static NSString *quotedQueryStrings(NSArray *strings)
+{
+    NSMutableArray *quoted = [NSMutableArray arrayWithCapacity:strings.count];
+    for (NSString *string in strings) {
+        [quoted addObject:quotedQueryString(string)];
+    }
+    return [NSString stringWithFormat:@"(%@)", [quoted componentsJoinedByString:@", "]];
+}
+
+#pragma mark - local evaluation of conditions
+
+static BOOL isEmptyRecordValue(id value)
+{
+    return value == nil || value == [NSNull null] ||
+           ([value isKindOfClass:[NSString class]] && [value length] == 0) ||
+           ([value isKindOfClass:[NSArray class]] && [value count] == 0);
+}
+
+static BOOL isNegativeOperator(KintoneQueryOperatorType operatorType)
+{
+    return operatorType == KintoneNotEqualQueryOperatorType ||
+           operatorType == KintoneNotInQueryOperatorType ||
+           operatorType == KintoneNotLikeQueryOperatorType;
+}
+
+static BOOL matchesComparison(KintoneQueryOperatorType operatorType, NSComparisonResult result)
+{
+    switch (operatorType) {
+        case KintoneEqualQueryOperatorType:
+            return result == NSOrderedSame;
+        case KintoneNotEqualQueryOperatorType:
+            return result != NSOrderedSame;
+        case KintoneGreaterThanQueryOperatorType:
+            return result == NSOrderedDescending;
+        case KintoneLessThanQueryOperatorType:
+            return result == NSOrderedAscending;
+        case KintoneGreaterThanOrEqualQueryOperatorType:
+            return result != NSOrderedAscending;
+        case KintoneLessThanOrEqualQueryOperatorType:
+            return result != NSOrderedDescending;
+        default:
+            return NO;
+    }
+}
+
+static NSString *stringRecordValue(id value)
+{
+    if ([value isKindOfClass:[NSString class]]) {
+        return value;
+    }
+    if ([value isKindOfClass:[NSNumber class]]) {
+        return [value stringValue];
+    }
+    if ([value isKindOfClass:[NSDictionary class]] && [value[@"code"] isKindOfClass:[NSString class]]) {
+        // user
+        return value[@"code"];
+    }
+    if ([value isKindOfClass:[KintoneFile class]]) {
+        return [(KintoneFile *)value name] ?: @"";
+    }
+    if ([value isKindOfClass:[NSArray class]]) {
+        NSMutableArray *strings = [NSMutableArray arrayWithCapacity:[value count]];
+        for (id val in value) {
+            [strings addObject:stringRecordValue(val)];
+        }
+        return [strings componentsJoinedByString:@", "];
+    }
+
+    return @"";
+}
+
+static NSDecimalNumber *decimalRecordValue(id value)
+{
+    if ([value isKindOfClass:[NSNumber class]]) {
+        return [NSDecimalNumber decimalNumberWithDecimal:[value decimalValue]];
+    }
+    if (![value isKindOfClass:[NSString class]] || [value length] == 0) {
+        return nil;
+    }
+
+    // the server returns numbers as strings
+    NSDecimalNumber *number = [NSDecimalNumber decimalNumberWithString:value locale:[NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"]];
+    return [number isEqualToNumber:[NSDecimalNumber notANumber]] ? nil : number;
+}
+
+static BOOL containsString(NSString *string, NSString *substring)
+{
+    // like is a partial match ignoring case and width
+    if (substring.length == 0) {
+        return YES;
+    }
+
+    return [string rangeOfString:substring options:NSCaseInsensitiveSearch | NSWidthInsensitiveSearch].location != NSNotFound;
+}
+
+static BOOL matchesString(KintoneQueryOperatorType operatorType, NSString *string, id value)
+{
+    switch (operatorType) {
+        case KintoneEqualQueryOperatorType:
+            return [string isEqualToString:value];
+        case KintoneNotEqualQueryOperatorType:
+            return ![string isEqualToString:value];
+        case KintoneLikeQueryOperatorType:
+            return containsString(string, value);
+        case KintoneNotLikeQueryOperatorType:
+            return !containsString(string, value);
+        case KintoneInQueryOperatorType:
+            return [value containsObject:string];
+        case KintoneNotInQueryOperatorType:
+            return ![value containsObject:string];
+        default:
+            return NO;
+    }
+}
+
+static BOOL matchesNumber(KintoneQueryOperatorType operatorType, NSDecimalNumber *number, id value)
+{
+    if (number == nil) {
+        return isNegativeOperator(operatorType);
+    }
+
+    if (operatorType == KintoneInQueryOperatorType || operatorType == KintoneNotInQueryOperatorType) {
+        BOOL found = NO;
+        for (NSNumber *val in value) {
+            if ([number compare:val] == NSOrderedSame) {
+                found = YES;
+                break;
+            }
+        }
+        return (operatorType == KintoneInQueryOperatorType) == found;
+    }
+
+    return matchesComparison(operatorType, [number compare:value]);
+}
+
+static BOOL matchesAny(KintoneQueryOperatorType operatorType, NSArray *values, NSArray *conditionValues)
+{
+    // in matches when any value is in the list, not in when none is
+    BOOL found = NO;
+    for (id val in conditionValues) {
+        if ([values containsObject:val]) {
+            found = YES;
+            break;
+        }
+    }
+
+    switch (operatorType) {
+        case KintoneEqualQueryOperatorType:
+        case KintoneInQueryOperatorType:
+            return found;
+        case KintoneNotEqualQueryOperatorType:
+        case KintoneNotInQueryOperatorType:
+            return !found;
+        default:
+            return NO;
+    }
+}
+
 @implementation KintoneField
 
 static NSString * const FIELD_TYPE_NAME_LABEL            = @"LABEL";
@@ -213,7 +387,8 @@ static NSDictionary *fieldTypeToFieldTypeName()
         case KintoneRecordNumberFieldType:
             self = [KintoneRecordNumberField new];
             if ([properties[@"value"] isKindOfClass:[NSString class]]) {
-                _value = [NSNumber numberWithInt:[properties[@"value"] intValue]];
+                // the record number may be prefixed with the app code: "APP-12"
+                _value = [NSNumber numberWithInt:[[[properties[@"value"] componentsSeparatedByString:@"-"] lastObject] intValue]];
             }
             break;
         case KintoneCreatorFieldType:
@@ -285,6 +460,33 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return nil;
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    // no condition can be made for the field type
+    return NO;
+}
+
+- (NSComparisonResult)compareRecordValue:(id)recordValue1 toRecordValue:(id)recordValue2
+{
+    id key1 = [self sortKeyOfRecordValue:recordValue1];
+    id key2 = [self sortKeyOfRecordValue:recordValue2];
+
+    // empty values first
+    if (key1 == nil || key2 == nil) {
+        if (key1 == key2) {
+            return NSOrderedSame;
+        }
+        return key1 == nil ? NSOrderedAscending : NSOrderedDescending;
+    }
+
+    return [key1 compare:key2];
+}
+
+- (id)sortKeyOfRecordValue:(id)recordValue
+{
+    return isEmptyRecordValue(recordValue) ? nil : stringRecordValue(recordValue);
+}
+
 - (BOOL)setValue:(id)value error:(CBError* __autoreleasing *)error
 {
     _value = value;
@@ -327,12 +529,12 @@ static NSDictionary *fieldTypeToFieldTypeName()
                 NSAssert([val isKindOfClass:[NSString class]], @"the value must be NSArray of NSString: %@", value);
             }
             
-            stringValue = [NSString stringWithFormat:@"(\"%@\")", [value componentsJoinedByString:@"\", \""]];
+            stringValue = quotedQueryStrings(value);
             break;
             
         default:
             NSAssert([value isKindOfClass:[NSString class]], @"the value must be NSString: %@", value);
-            stringValue = [NSString stringWithFormat:@"\"%@\"", value];
+            stringValue = quotedQueryString(value);
             break;
     }
     
@@ -341,6 +543,11 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    return matchesString(operatorType, stringRecordValue(recordValue), value);
+}
+
 - (BOOL)setValue:(id)value error:(CBError* __autoreleasing *)error
 {
     // validate value
@@ -372,13 +579,18 @@ static NSDictionary *fieldTypeToFieldTypeName()
     
     // validate value
     NSAssert([value isKindOfClass:[NSString class]], @"the value must be NSString: %@", value);
-    NSString *stringValue = [NSString stringWithFormat:@"\"%@\"", value];
+    NSString *stringValue = quotedQueryString(value);
     
     // create condition clause
     NSString *operator = [KintoneQuery operatorTypeToString:operatorType];
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    return matchesString(operatorType, stringRecordValue(recordValue), value);
+}
+
 - (BOOL)setValue:(id)value error:(CBError* __autoreleasing *)error
 {
     // validate value
@@ -438,6 +650,16 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    return matchesNumber(operatorType, decimalRecordValue(recordValue), value);
+}
+
+- (id)sortKeyOfRecordValue:(id)recordValue
+{
+    return decimalRecordValue(recordValue);
+}
+
 - (BOOL)setValue:(id)value error:(CBError* __autoreleasing *)error
 {
     // validate value
@@ -479,12 +701,12 @@ static NSDictionary *fieldTypeToFieldTypeName()
                 NSAssert([val isKindOfClass:[NSString class]], @"the value must be NSArray of NSString: %@", value);
             }
             
-            stringValue = [NSString stringWithFormat:@"(\"%@\")", [value componentsJoinedByString:@"\", \""]];
+            stringValue = quotedQueryStrings(value);
             break;
             
         default:
             NSAssert([value isKindOfClass:[NSString class]], @"the value must be NSString: %@", value);
-            stringValue = [NSString stringWithFormat:@"\"%@\"", value];
+            stringValue = quotedQueryString(value);
             break;
     }
 
@@ -493,6 +715,20 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    // check box and multi select have several options selected
+    NSArray *selected;
+    if ([recordValue isKindOfClass:[NSArray class]]) {
+        selected = recordValue;
+    }
+    else {
+        selected = isEmptyRecordValue(recordValue) ? @[] : @[stringRecordValue(recordValue)];
+    }
+
+    return matchesAny(operatorType, selected, [value isKindOfClass:[NSArray class]] ? value : @[value]);
+}
+
 - (BOOL)setValue:(id)value error:(CBError* __autoreleasing *)error
 {
     // validate value
@@ -525,13 +761,34 @@ static NSDictionary *fieldTypeToFieldTypeName()
     
     // validate value
     NSAssert([value isKindOfClass:[NSString class]], @"the value must be NSString: %@", value);
-    NSString *stringValue = [NSString stringWithFormat:@"\"%@\"", value];
+    NSString *stringValue = quotedQueryString(value);
     
     // create condition clause
     NSString *operator = [KintoneQuery operatorTypeToString:operatorType];
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    // like matches the name of any attachment
+    BOOL found = NO;
+    for (id file in [recordValue isKindOfClass:[NSArray class]] ? recordValue : @[]) {
+        if (containsString(stringRecordValue([file isKindOfClass:[NSDictionary class]] ? file[@"name"] : file), value)) {
+            found = YES;
+            break;
+        }
+    }
+
+    switch (operatorType) {
+        case KintoneLikeQueryOperatorType:
+            return found;
+        case KintoneNotLikeQueryOperatorType:
+            return !found;
+        default:
+            return NO;
+    }
+}
+
 - (BOOL)setValue:(id)value error:(CBError* __autoreleasing *)error
 {
     NSArray *array = (NSArray *)value;
@@ -615,7 +872,7 @@ static NSDictionary *fieldTypeToFieldTypeName()
         }
         else {
             // put double quote around if not reserved function "LOGINUSER()"
-            [valuesAroundDoubleQuote addObject:[NSString stringWithFormat:@"\"%@\"", val]];
+            [valuesAroundDoubleQuote addObject:quotedQueryString(val)];
         }
     }
 
@@ -626,6 +883,27 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    // creator and modifier have a single user
+    NSArray *users = [recordValue isKindOfClass:[NSArray class]] ? recordValue : (isEmptyRecordValue(recordValue) ? @[] : @[recordValue]);
+    NSMutableArray *codes = [NSMutableArray arrayWithCapacity:users.count];
+    for (id user in users) {
+        [codes addObject:stringRecordValue(user)];
+    }
+
+    // the login user is not known to the field, the query has to be resolved first
+    NSAssert(![value containsObject:@"LOGINUSER()"], @"resolve LOGINUSER() with [KintoneQuery kintoneQueryWithLoginUser:]: %@", value);
+
+    switch (operatorType) {
+        case KintoneInQueryOperatorType:
+        case KintoneNotInQueryOperatorType:
+            return matchesAny(operatorType, codes, value);
+        default:
+            return NO;
+    }
+}
+
 - (BOOL)setValue:(id)value error:(CBError* __autoreleasing *)error
 {
     // validate value
@@ -674,6 +952,41 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, value];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    if ([value isKindOfClass:[NSString class]]) {
+        // TODAY(), THIS_MONTH() and THIS_YEAR() are periods of the device time zone
+        NSString *date = [self localDateStringOfRecordValue:recordValue];
+        if (date == nil) {
+            return isNegativeOperator(operatorType);
+        }
+
+        NSString *today = [NSDate localDateStringFromDate:[NSDate date]];
+        NSString *period = today;
+        if ([@"THIS_MONTH()" isEqualToString:value]) {
+            period = [today substringToIndex:7];
+        }
+        else if ([@"THIS_YEAR()" isEqualToString:value]) {
+            period = [today substringToIndex:4];
+        }
+
+        NSComparisonResult result = [date hasPrefix:period] ? NSOrderedSame : [date compare:period];
+        return matchesComparison(operatorType, result);
+    }
+
+    id key = [self sortKeyOfRecordValue:recordValue];
+    if (key == nil) {
+        return isNegativeOperator(operatorType);
+    }
+
+    return matchesComparison(operatorType, [key compare:[self sortKeyOfRecordValue:value]]);
+}
+
+- (NSString *)localDateStringOfRecordValue:(id)recordValue
+{
+    return nil;
+}
+
 @end
 
 @implementation KintoneKindOfDatetimeField
@@ -710,6 +1023,27 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return YES;
 }
 
+- (id)sortKeyOfRecordValue:(id)recordValue
+{
+    // datetimes are compared by the minute
+    NSDate *date = [recordValue isKindOfClass:[NSString class]] ? [NSDate dateFromRFC3339:recordValue] : recordValue;
+    if (![date isKindOfClass:[NSDate class]]) {
+        return nil;
+    }
+
+    return @(floor([date timeIntervalSince1970] / 60));
+}
+
+- (NSString *)localDateStringOfRecordValue:(id)recordValue
+{
+    NSDate *date = [recordValue isKindOfClass:[NSString class]] ? [NSDate dateFromRFC3339:recordValue] : recordValue;
+    if (![date isKindOfClass:[NSDate class]]) {
+        return nil;
+    }
+
+    return [NSDate localDateStringFromDate:date];
+}
+
 @end
 
 @implementation KintoneTimeField
@@ -734,6 +1068,29 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    id time = [self sortKeyOfRecordValue:recordValue];
+    if (time == nil) {
+        return isNegativeOperator(operatorType);
+    }
+
+    return matchesComparison(operatorType, [time compare:[NSDate timeStringFromDate:value]]);
+}
+
+- (id)sortKeyOfRecordValue:(id)recordValue
+{
+    // "HH:mm" strings compare in time order
+    if ([recordValue isKindOfClass:[NSDate class]]) {
+        return [NSDate timeStringFromDate:recordValue];
+    }
+    if (![recordValue isKindOfClass:[NSString class]] || [recordValue length] < 5) {
+        return nil;
+    }
+
+    return [recordValue substringToIndex:5];
+}
+
 - (NSDictionary *)json
 {
     return @{self.code : @{@"type"  : [KintoneField fieldTypeNameForFieldType:self.type],
@@ -763,12 +1120,12 @@ static NSDictionary *fieldTypeToFieldTypeName()
                 NSAssert([val isKindOfClass:[NSString class]], @"the value must be NSArray of NSString: %@", value);
             }
             
-            stringValue = [NSString stringWithFormat:@"(\"%@\")", [value componentsJoinedByString:@"\", \""]];
+            stringValue = quotedQueryStrings(value);
             break;
             
         default:
             NSAssert([value isKindOfClass:[NSString class]], @"the value must be NSString: %@", value);
-            stringValue = [NSString stringWithFormat:@"\"%@\"", value];
+            stringValue = quotedQueryString(value);
             break;
     }
     
@@ -777,6 +1134,11 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
 }
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    return matchesString(operatorType, stringRecordValue(recordValue), value);
+}
+
 @end
 
 @implementation KintoneSingleLineTextField
@@ -795,6 +1157,15 @@ static NSDictionary *fieldTypeToFieldTypeName()
 
 @implementation KintoneRichTextField
 
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    // search the text, not the tags
+    NSString *html = stringRecordValue(recordValue);
+    NSString *text = [html stringByReplacingOccurrencesOfString:@"<[^>]*>" withString:@"" options:NSRegularExpressionSearch range:NSMakeRange(0, html.length)];
+
+    return [super matchesCondition:operatorType value:value recordValue:text];
+}
+
 @end
 
 @implementation KintoneCheckBoxField
@@ -860,6 +1231,24 @@ static NSDictionary *fieldTypeToFieldTypeName()
     return [super conditionQuery:operatorType value:stringValue];
 }
 
+- (id)sortKeyOfRecordValue:(id)recordValue
+{
+    // "yyyy-MM-dd" strings compare in date order
+    if ([recordValue isKindOfClass:[NSDate class]]) {
+        return [NSDate dateStringFromDate:recordValue];
+    }
+    if (![recordValue isKindOfClass:[NSString class]] || [recordValue length] < 10) {
+        return nil;
+    }
+
+    return [recordValue substringToIndex:10];
+}
+
+- (NSString *)localDateStringOfRecordValue:(id)recordValue
+{
+    return [self sortKeyOfRecordValue:recordValue];
+}
+
 - (NSDictionary *)json
 {
     return @{self.code : @{@"type"  : [KintoneField fieldTypeNameForFieldType:self.type],
@@ -930,7 +1319,57 @@ static NSDictionary *fieldTypeToFieldTypeName()
 
 @implementation KintoneRecordNumberField
 
-#warning TODO: validateQueryCondition
+- (NSString *)conditionQuery:(KintoneQueryOperatorType)operatorType value:(id)value
+{
+    // validate operator
+    NSAssert(operatorType == KintoneEqualQueryOperatorType ||
+             operatorType == KintoneNotEqualQueryOperatorType ||
+             operatorType == KintoneGreaterThanQueryOperatorType ||
+             operatorType == KintoneLessThanQueryOperatorType ||
+             operatorType == KintoneGreaterThanOrEqualQueryOperatorType ||
+             operatorType == KintoneLessThanOrEqualQueryOperatorType ||
+             operatorType == KintoneInQueryOperatorType ||
+             operatorType == KintoneNotInQueryOperatorType,
+             @"invalid operator: %@", [KintoneQuery operatorTypeToString:operatorType]);
+    
+    // validate value
+    NSString *stringValue;
+    switch (operatorType) {
+        case KintoneInQueryOperatorType:
+        case KintoneNotInQueryOperatorType:
+            NSAssert([value isKindOfClass:[NSArray class]], @"the value must be NSArray of NSNumber: %@", value);
+            for (id val in value) {
+                NSAssert([val isKindOfClass:[NSNumber class]], @"the value must be NSArray of NSNumber: %@", value);
+            }
+            
+            stringValue = [NSString stringWithFormat:@"(%@)", [value componentsJoinedByString:@", "]];
+            break;
+            
+        default:
+            NSAssert([value isKindOfClass:[NSNumber class]], @"the value must be NSNumber: %@", value);
+            stringValue = [value stringValue];
+            break;
+    }
+    
+    // create condition clause
+    NSString *operator = [KintoneQuery operatorTypeToString:operatorType];
+    return [NSString stringWithFormat:@"%@ %@ %@", self.code, operator, stringValue];
+}
+
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue
+{
+    return matchesNumber(operatorType, [self sortKeyOfRecordValue:recordValue], value);
+}
+
+- (id)sortKeyOfRecordValue:(id)recordValue
+{
+    // the record number may be prefixed with the app code: "APP-12"
+    if ([recordValue isKindOfClass:[NSString class]]) {
+        recordValue = [[recordValue componentsSeparatedByString:@"-"] lastObject];
+    }
+
+    return decimalRecordValue(recordValue);
+}
 
 @end
 
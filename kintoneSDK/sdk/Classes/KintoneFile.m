@@ -18,6 +18,8 @@
 
 #import "KintoneFile.h"
 
+#import "CBError.h"
+
 @implementation KintoneFile
 
 - (KintoneFile *)initWithProperties:(NSDictionary *)properties
@@ -26,7 +28,7 @@
         _contentType = properties[@"contentType"];
         _fileKey     = properties[@"fileKey"];
         _name        = properties[@"name"];
-        _size        = [properties[@"size"] intValue];
+        _size        = [properties[@"size"] longLongValue];
         _deleted     = NO;
     }
     
@@ -40,6 +42,48 @@
         _data        = data;
         _name        = name;
         _contentType = contentType;
+        _size        = (long long)[data length];
+        _fileKey     = nil;
+        _deleted     = NO;
+    }
+    
+    return self;
+}
+
+- (KintoneFile *)initWithMappedFileURL:(NSURL *)fileURL name:(NSString *)name contentType:(NSString *)contentType error:(CBError* __autoreleasing *)error
+{
+    assert([fileURL isFileURL]);
+
+    // clean pages backed by the file, instead of a copy in dirty memory
+    NSError * __autoreleasing readError = nil;
+    NSData *data = [NSData dataWithContentsOfURL:fileURL options:NSDataReadingMappedIfSafe error:&readError];
+    if (data == nil) {
+        if (error) {
+            *error = [CBError errorWithNSError:readError];
+        }
+        return nil;
+    }
+
+    if (self = [self initWithData:data name:name ? name : [fileURL lastPathComponent] contentType:contentType]) {
+        // uploads stream the file, hashing it on the way, like initWithFileURL:
+        _fileURL = fileURL;
+    }
+
+    return self;
+}
+
+- (KintoneFile *)initWithFileURL:(NSURL *)fileURL name:(NSString *)name contentType:(NSString *)contentType
+{
+    assert([fileURL isFileURL]);
+
+    if (self = [super init])
+    {
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:[fileURL path] error:nil];
+
+        _fileURL     = fileURL;
+        _name        = name ? name : [fileURL lastPathComponent];
+        _contentType = contentType;
+        _size        = [attributes[NSFileSize] longLongValue];
         _fileKey     = nil;
         _deleted     = NO;
     }
@@ -0,0 +1,342 @@
+//
+//  KintoneFileCache.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneFileCache.h"
+
+#import <CommonCrypto/CommonDigest.h>
+
+#import "CBError.h"
+#import "NSString+Utility.h"
+
+static const unsigned long long KintoneFileCacheDefaultMaxSize = 100 * 1024 * 1024;
+static const NSUInteger KintoneFileCacheHashBufferLength = 1024 * 1024;
+static const NSTimeInterval KintoneFileCacheSaveDelay = 1.0;
+
+static NSString * const KintoneFileCacheHashKey = @"hash";
+static NSString * const KintoneFileCacheSizeKey = @"size";
+static NSString * const KintoneFileCacheAccessedKey = @"accessed";
+
+@implementation KintoneFileCache
+{
+    dispatch_queue_t _queue;            // guards the index; eviction and saving run on it too
+    NSMutableDictionary *_entries;      // fileKey -> {hash, size, accessed}
+    NSMutableDictionary *_blobs;        // hash -> size; files with the same content share one blob
+    unsigned long long _currentSize;
+    BOOL _saveScheduled;
+    BOOL _evictionScheduled;
+}
+
+- (KintoneFileCache *)initWithDirectoryURL:(NSURL *)directoryURL
+{
+    assert([directoryURL isFileURL]);
+
+    if (self = [super init]) {
+        _directoryURL = directoryURL;
+        _maxSize = KintoneFileCacheDefaultMaxSize;
+        _queue = dispatch_queue_create("KintoneFileCache", DISPATCH_QUEUE_SERIAL);
+        _entries = [NSMutableDictionary dictionary];
+        _blobs = [NSMutableDictionary dictionary];
+        _currentSize = 0;
+        [self loadIndex];
+    }
+
+    return self;
+}
+
+- (unsigned long long)currentSize
+{
+    __block unsigned long long size;
+    dispatch_sync(_queue, ^{
+        size = _currentSize;
+    });
+
+    return size;
+}
+
+- (void)setMaxSize:(unsigned long long)maxSize
+{
+    dispatch_sync(_queue, ^{
+        _maxSize = maxSize;
+        [self scheduleEvictionIfNeeded];
+    });
+}
+
+- (NSURL *)fileURLForFileKey:(NSString *)fileKey
+{
+    if (fileKey == nil) {
+        return nil;
+    }
+
+    __block NSURL *fileURL = nil;
+    dispatch_sync(_queue, ^{
+        NSMutableDictionary *entry = _entries[fileKey];
+        if (entry == nil) {
+            return;
+        }
+
+        NSURL *blobURL = [self blobURLForHash:entry[KintoneFileCacheHashKey]];
+        if (![[NSFileManager defaultManager] fileExistsAtPath:[blobURL path]]) {
+            // the system may purge the Caches directory
+            [self removeEntryForFileKey:fileKey];
+            return;
+        }
+
+        entry[KintoneFileCacheAccessedKey] = [NSDate date];
+        [self scheduleSave];
+        fileURL = blobURL;
+    });
+
+    return fileURL;
+}
+
+- (NSData *)dataForFileKey:(NSString *)fileKey
+{
+    NSURL *fileURL = [self fileURLForFileKey:fileKey];
+    if (fileURL == nil) {
+        return nil;
+    }
+
+    // an evicted blob stays readable through the mapping until the data is released
+    return [NSData dataWithContentsOfURL:fileURL options:NSDataReadingMappedIfSafe error:nil];
+}
+
+- (NSURL *)storeFileAtURL:(NSURL *)fileURL fileKey:(NSString *)fileKey error:(CBError* __autoreleasing *)error
+{
+    assert([fileURL isFileURL] && fileKey != nil);
+
+    NSError * __autoreleasing fileError = nil;
+    unsigned long long size = 0;
+    NSString *hash = [self hashOfFileAtURL:fileURL size:&size error:&fileError];
+    if (hash == nil) {
+        if (error) {
+            *error = [CBError errorWithNSError:fileError];
+        }
+        return nil;
+    }
+
+    __block NSURL *blobURL = nil;
+    dispatch_sync(_queue, ^{
+        blobURL = [self blobURLForHash:hash];
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        if ([fileManager fileExistsAtPath:[blobURL path]]) {
+            // the same content is already cached under another fileKey
+            [fileManager removeItemAtURL:fileURL error:nil];
+        }
+        else {
+            [fileManager createDirectoryAtURL:[blobURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+            if (![fileManager moveItemAtURL:fileURL toURL:blobURL error:&fileError]) {
+                blobURL = nil;
+                return;
+            }
+        }
+
+        [self removeEntryForFileKey:fileKey];
+        _entries[fileKey] = [@{KintoneFileCacheHashKey : hash,
+                               KintoneFileCacheSizeKey : @(size),
+                               KintoneFileCacheAccessedKey : [NSDate date]} mutableCopy];
+        if (_blobs[hash] == nil) {
+            _blobs[hash] = @(size);
+            _currentSize += size;
+        }
+
+        [self scheduleSave];
+        [self scheduleEvictionIfNeeded];
+    });
+
+    if (blobURL == nil && error) {
+        *error = [CBError errorWithNSError:fileError];
+    }
+
+    return blobURL;
+}
+
+- (NSURL *)storeData:(NSData *)data fileKey:(NSString *)fileKey error:(CBError* __autoreleasing *)error
+{
+    assert(data != nil && fileKey != nil);
+
+    NSURL *incomingURL = [self incomingURL];
+    NSError * __autoreleasing fileError = nil;
+    [[NSFileManager defaultManager] createDirectoryAtURL:[incomingURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (![data writeToURL:incomingURL options:NSDataWritingAtomic error:&fileError]) {
+        if (error) {
+            *error = [CBError errorWithNSError:fileError];
+        }
+        return nil;
+    }
+
+    return [self storeFileAtURL:incomingURL fileKey:fileKey error:error];
+}
+
+- (void)removeFileForFileKey:(NSString *)fileKey
+{
+    if (fileKey == nil) {
+        return;
+    }
+
+    dispatch_sync(_queue, ^{
+        [self removeEntryForFileKey:fileKey];
+        [self scheduleSave];
+    });
+}
+
+- (void)removeAllFiles
+{
+    dispatch_sync(_queue, ^{
+        [_entries removeAllObjects];
+        [_blobs removeAllObjects];
+        _currentSize = 0;
+        [[NSFileManager defaultManager] removeItemAtURL:self.directoryURL error:nil];
+    });
+}
+
+#pragma mark - private
+
+- (NSURL *)incomingURL
+{
+    // files are moved into the cache, so they are written inside its directory, on the same volume
+    NSString *name = [[NSProcessInfo processInfo] globallyUniqueString];
+    return [[self.directoryURL URLByAppendingPathComponent:@"incoming"] URLByAppendingPathComponent:name];
+}
+
+- (NSURL *)indexURL
+{
+    return [self.directoryURL URLByAppendingPathComponent:@"index.plist"];
+}
+
+- (NSURL *)blobURLForHash:(NSString *)hash
+{
+    // objects/<first 2 digits>/<hash>, so that no directory grows too large
+    NSURL *objectsURL = [self.directoryURL URLByAppendingPathComponent:@"objects"];
+    return [[objectsURL URLByAppendingPathComponent:[hash substringToIndex:2]] URLByAppendingPathComponent:hash];
+}
+
+- (NSString *)hashOfFileAtURL:(NSURL *)fileURL size:(unsigned long long *)size error:(NSError * __autoreleasing *)error
+{
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingFromURL:fileURL error:error];
+    if (fileHandle == nil) {
+        return nil;
+    }
+
+    // read in chunks, the file may be larger than the memory available
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    *size = 0;
+    while (YES) {
+        @autoreleasepool {
+            NSData *data = [fileHandle readDataOfLength:KintoneFileCacheHashBufferLength];
+            if ([data length] == 0) {
+                break;
+            }
+            CC_SHA256_Update(&context, [data bytes], (CC_LONG)[data length]);
+            *size += [data length];
+        }
+    }
+    [fileHandle closeFile];
+
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &context);
+
+    return [NSString hexStringWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
+
+// called on _queue
+- (void)removeEntryForFileKey:(NSString *)fileKey
+{
+    NSDictionary *entry = _entries[fileKey];
+    if (entry == nil) {
+        return;
+    }
+    [_entries removeObjectForKey:fileKey];
+
+    NSString *hash = entry[KintoneFileCacheHashKey];
+    for (NSDictionary *other in [_entries allValues]) {
+        if ([other[KintoneFileCacheHashKey] isEqualToString:hash]) {
+            // the content is still cached under another fileKey
+            return;
+        }
+    }
+
+    _currentSize -= [_blobs[hash] unsignedLongLongValue];
+    [_blobs removeObjectForKey:hash];
+    [[NSFileManager defaultManager] removeItemAtURL:[self blobURLForHash:hash] error:nil];
+}
+
+// called on _queue
+- (void)scheduleEvictionIfNeeded
+{
+    if (_currentSize <= _maxSize || _evictionScheduled) {
+        return;
+    }
+    _evictionScheduled = YES;
+
+    dispatch_async(_queue, ^{
+        _evictionScheduled = NO;
+
+        // least recently used first
+        NSArray *fileKeys = [_entries keysSortedByValueUsingComparator:^NSComparisonResult(NSDictionary *entry1, NSDictionary *entry2) {
+            return [entry1[KintoneFileCacheAccessedKey] compare:entry2[KintoneFileCacheAccessedKey]];
+        }];
+        for (NSString *fileKey in fileKeys) {
+            if (_currentSize <= _maxSize) {
+                break;
+            }
+            [self removeEntryForFileKey:fileKey];
+        }
+
+        [self scheduleSave];
+    });
+}
+
+// called on _queue
+- (void)scheduleSave
+{
+    if (_saveScheduled) {
+        return;
+    }
+    _saveScheduled = YES;
+
+    // accesses are frequent; they are written together
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(KintoneFileCacheSaveDelay * NSEC_PER_SEC)), _queue, ^{
+        _saveScheduled = NO;
+        [[NSFileManager defaultManager] createDirectoryAtURL:self.directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+        [_entries writeToURL:[self indexURL] atomically:YES];
+    });
+}
+
+- (void)loadIndex
+{
+    NSDictionary *index = [NSDictionary dictionaryWithContentsOfURL:[self indexURL]];
+    for (NSString *fileKey in index) {
+        NSDictionary *entry = index[fileKey];
+        NSString *hash = entry[KintoneFileCacheHashKey];
+        if (![hash isKindOfClass:[NSString class]] || [hash length] != CC_SHA256_DIGEST_LENGTH * 2) {
+            continue;
+        }
+
+        _entries[fileKey] = [entry mutableCopy];
+        if (_blobs[hash] == nil) {
+            _blobs[hash] = entry[KintoneFileCacheSizeKey];
+            _currentSize += [entry[KintoneFileCacheSizeKey] unsignedLongLongValue];
+        }
+    }
+
+    // files left behind by a store that did not finish
+    [[NSFileManager defaultManager] removeItemAtURL:[self.directoryURL URLByAppendingPathComponent:@"incoming"] error:nil];
+}
+
+@end
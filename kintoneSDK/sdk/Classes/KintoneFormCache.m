@@ -0,0 +1,226 @@
+//
+//  KintoneFormCache.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneFormCache.h"
+
+#import "KintoneAPI.h"
+#import "KintoneApplication.h"
+#import "KintoneField.h"
+#import "KintoneSite.h"
+
+NSString * const KintoneFormCacheDidChangeNotification = @"KintoneFormCacheDidChangeNotification";
+
+@interface KintoneFormCache ()
+
+@property (nonatomic, weak, readwrite) KintoneApplication *kintoneApplication;
+@property (nonatomic, readwrite) NSDictionary *fields;
+@property (nonatomic, readwrite) id formJSON;
+@property (nonatomic, readwrite) NSDate *fetchedDate;
+
+@end
+
+@implementation KintoneFormCache
+{
+    BOOL _loadedFromDisk;
+    BOOL _fetching;
+    NSMutableArray *_waitingBlocks;  // @[fields block, failure block] waiting for the first fetch
+}
+
+static const NSTimeInterval KintoneFormCacheDefaultTimeToLive = 300;
+
+- (KintoneFormCache *)initWithKintoneApplication:(KintoneApplication *)kintoneApplication
+{
+    assert(kintoneApplication != nil);
+
+    if (self = [super init]) {
+        self.kintoneApplication = kintoneApplication;
+        self.timeToLive = KintoneFormCacheDefaultTimeToLive;
+        _loadedFromDisk = NO;
+        _fetching = NO;
+        _waitingBlocks = [NSMutableArray array];
+    }
+
+    return self;
+}
+
+- (NSDictionary *)fields
+{
+    [self loadFromDiskIfNeeded];
+
+    return _fields;
+}
+
+- (id)formJSON
+{
+    [self loadFromDiskIfNeeded];
+
+    return _formJSON;
+}
+
+- (NSDate *)fetchedDate
+{
+    [self loadFromDiskIfNeeded];
+
+    return _fetchedDate;
+}
+
+- (void)fields:(KintoneFormCacheFieldsBlock)fields
+       failure:(CBNetworkingFailureBlockForJSONResponse)failure
+         queue:(NSOperationQueue *)queue
+{
+    if (self.fields) {
+        if (fields) {
+            fields(self.fields, self.formJSON);
+        }
+        if (-[self.fetchedDate timeIntervalSinceNow] >= self.timeToLive) {
+            [self revalidate:nil queue:queue];
+        }
+        return;
+    }
+
+    // no cache yet; wait for the form
+    [_waitingBlocks addObject:@[fields ? [fields copy] : [NSNull null], failure ? [failure copy] : [NSNull null]]];
+    [self revalidate:nil queue:queue];
+}
+
+- (void)revalidate:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue
+{
+    // a fetch already running answers this call too
+    if (failure) {
+        [_waitingBlocks addObject:@[[NSNull null], [failure copy]]];
+    }
+    if (_fetching) {
+        return;
+    }
+    _fetching = YES;
+
+    CBNetworkingSuccessBlockForJSONResponse successBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        _fetching = NO;
+
+        BOOL changed = [self isChanged:JSON];
+        if (changed) {
+            self.formJSON = JSON;
+            self.fields = [KintoneField fieldsFromJSON:JSON];
+        }
+        self.fetchedDate = [NSDate date];
+        [self saveToDisk];
+
+        NSArray *waitingBlocks = [_waitingBlocks copy];
+        [_waitingBlocks removeAllObjects];
+        for (NSArray *blocks in waitingBlocks) {
+            if (blocks[0] != [NSNull null]) {
+                ((KintoneFormCacheFieldsBlock)blocks[0])(self.fields, self.formJSON);
+            }
+        }
+
+        if (changed) {
+            [[NSNotificationCenter defaultCenter] postNotificationName:KintoneFormCacheDidChangeNotification
+                                                                object:self
+                                                              userInfo:@{@"fields" : self.fields}];
+        }
+    };
+    CBNetworkingFailureBlockForJSONResponse failureBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        _fetching = NO;
+
+        NSArray *waitingBlocks = [_waitingBlocks copy];
+        [_waitingBlocks removeAllObjects];
+        for (NSArray *blocks in waitingBlocks) {
+            if (blocks[1] != [NSNull null]) {
+                ((CBNetworkingFailureBlockForJSONResponse)blocks[1])(request, response, error, JSON);
+            }
+        }
+    };
+
+    [self.kintoneApplication.kintoneAPI form:successBlock failure:failureBlock queue:queue];
+}
+
+- (void)clear
+{
+    _fields = nil;
+    _formJSON = nil;
+    _fetchedDate = nil;
+    _loadedFromDisk = YES;
+
+    [[NSFileManager defaultManager] removeItemAtPath:[self cachePath] error:nil];
+}
+
+#pragma mark - private
+
+- (BOOL)isChanged:(id)JSON
+{
+    id cachedJSON = self.formJSON;
+    if (cachedJSON == nil) {
+        return YES;
+    }
+
+    // compare the revision if the response has one, otherwise the whole form
+    id revision = [JSON isKindOfClass:[NSDictionary class]] ? JSON[@"revision"] : nil;
+    id cachedRevision = [cachedJSON isKindOfClass:[NSDictionary class]] ? cachedJSON[@"revision"] : nil;
+    if (revision && cachedRevision) {
+        return ![[revision description] isEqualToString:[cachedRevision description]];
+    }
+
+    return ![JSON isEqual:cachedJSON];
+}
+
+- (NSString *)cachePath
+{
+    // Caches/kintone/forms/<domain>/<user>/<app id>.json
+    NSString *directory = [self.kintoneApplication.kintoneSite cacheDirectoryPath:@"forms"];
+
+    return [directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%d.json", self.kintoneApplication.appId]];
+}
+
+- (void)loadFromDiskIfNeeded
+{
+    if (_loadedFromDisk) {
+        return;
+    }
+    _loadedFromDisk = YES;
+
+    NSData *data = [NSData dataWithContentsOfFile:[self cachePath]];
+    if (data == nil) {
+        return;
+    }
+
+    NSDictionary *cache = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    if (![cache isKindOfClass:[NSDictionary class]] || cache[@"form"] == nil || cache[@"fetchedAt"] == nil) {
+        [CBLog sdkLogWarn:@"invalid form cache: %@", [self cachePath]];
+        return;
+    }
+
+    // the form is parsed only once per launch
+    _formJSON = cache[@"form"];
+    _fields = [KintoneField fieldsFromJSON:_formJSON];
+    _fetchedDate = [NSDate dateWithTimeIntervalSince1970:[cache[@"fetchedAt"] doubleValue]];
+}
+
+- (void)saveToDisk
+{
+    NSDictionary *cache = @{@"form"      : self.formJSON,
+                            @"fetchedAt" : @([self.fetchedDate timeIntervalSince1970])};
+    NSData *data = [NSJSONSerialization dataWithJSONObject:cache options:0 error:nil];
+
+    NSString *path = [self cachePath];
+    [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (![data writeToFile:path atomically:YES]) {
+        [CBLog sdkLogWarn:@"failed to write form cache: %@", path];
+    }
+}
+
+@end
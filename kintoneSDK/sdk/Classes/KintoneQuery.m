@@ -19,6 +19,8 @@
 #import "KintoneQuery.h"
 
 #import "KintoneField.h"
+#import "KintoneQueryParser.h"
+#import "KintoneRecord.h"
 
 /*
 typedef enum KintoneQueryOperatorType : NSUInteger {
@@ -73,6 +75,14 @@ typedef enum KintoneQueryOperatorType : NSUInteger {
     return self;
 }
 
+- (id)copyWithZone:(NSZone *)zone
+{
+    KintoneQuery *query = [[[self class] allocWithZone:zone] init];
+    query->_query = [_query mutableCopy];
+    
+    return query;
+}
+
 static NSDictionary *operatorTypeToStringDictionary()
 {
     static NSDictionary *dict = nil;
@@ -97,6 +107,11 @@ static NSDictionary *operatorTypeToStringDictionary()
     return operatorTypeToStringDictionary()[@(operatorType)];
 }
 
++ (KintoneQuery *)kintoneQueryWithString:(NSString *)string fields:(NSDictionary *)fields error:(CBError* __autoreleasing *)error
+{
+    return [[[KintoneQueryParser alloc] initWithString:string fields:fields] parse:error];
+}
+
 - (void)where:(NSArray *)query
 {
     _query[@"where"] = query;
@@ -117,6 +132,26 @@ static NSDictionary *operatorTypeToStringDictionary()
     _query[@"offset"] = [NSNumber numberWithInt:offset];
 }
 
+- (NSArray *)whereClause
+{
+    return _query[@"where"];
+}
+
+- (NSArray *)orderByClause
+{
+    return _query[@"orderBy"];
+}
+
+- (NSNumber *)limitClause
+{
+    return _query[@"limit"];
+}
+
+- (NSNumber *)offsetClause
+{
+    return _query[@"offset"];
+}
+
 - (NSArray *)and:(NSArray *)condition, ...
 {
     NSMutableArray *andArray = [NSMutableArray arrayWithObject:@"and"];
@@ -244,6 +279,61 @@ static NSDictionary *operatorTypeToStringDictionary()
     return query;
 }
 
+- (NSString *)canonicalKintoneQuery
+{
+    KintoneQuery *query = [self copy];
+    NSArray *where = [self canonicalWhere:_query[@"where"]];
+    if (where) {
+        query->_query[@"where"] = where;
+    }
+    else {
+        [query->_query removeObjectForKey:@"where"];
+    }
+
+    return [query kintoneQuery];
+}
+
+- (NSArray *)canonicalWhere:(NSArray *)where
+{
+    if (where == nil || where.count == 0) {
+        return nil;
+    }
+
+    id first = [where objectAtIndex:0];
+    if ([first isKindOfClass:[NSString class]] && ([first isEqualToString:@"and"] || [first isEqualToString:@"or"])) {
+        // flatten "a and (b and c)", then sort the operands by their query and drop duplicates
+        NSMutableDictionary *operands = [NSMutableDictionary dictionary];
+        for (NSUInteger i = 1; i < where.count; i++) {
+            NSArray *operand = [self canonicalWhere:where[i]];
+            if (operand == nil) {
+                continue;
+            }
+            BOOL sameOperator = [operand[0] isKindOfClass:[NSString class]] && [operand[0] isEqualToString:first];
+            for (NSArray *condition in sameOperator ? [operand subarrayWithRange:NSMakeRange(1, operand.count - 1)] : @[operand]) {
+                operands[[self whereKintoneQuery:condition]] = condition;
+            }
+        }
+
+        NSArray *queries = [[operands allKeys] sortedArrayUsingSelector:@selector(compare:)];
+        if (queries.count <= 1) {
+            return queries.count == 1 ? operands[queries[0]] : nil;
+        }
+        NSMutableArray *canonical = [NSMutableArray arrayWithObject:first];
+        for (NSString *query in queries) {
+            [canonical addObject:operands[query]];
+        }
+        return canonical;
+    }
+
+    // the values of "in" are a set
+    id value = where[2];
+    if ([value isKindOfClass:[NSArray class]]) {
+        value = [[[NSOrderedSet orderedSetWithArray:value] array] sortedArrayUsingSelector:@selector(compare:)];
+    }
+
+    return @[where[0], where[1], value];
+}
+
 - (NSString *)whereKintoneQuery:(NSArray *)where
 {
     NSString *query = nil;
@@ -297,4 +387,141 @@ static NSDictionary *operatorTypeToStringDictionary()
     return [NSString stringWithFormat:@" offset %d", offset];
 }
 
+#pragma mark - local evaluation
+
+static NSArray *whereWithLoginUser(NSArray *where, NSString *user, BOOL *found)
+{
+    id first = where[0];
+    if ([first isKindOfClass:[NSString class]] && ([first isEqualToString:@"and"] || [first isEqualToString:@"or"])) {
+        NSMutableArray *resolved = [NSMutableArray arrayWithObject:first];
+        for (NSUInteger i = 1; i < where.count; i++) {
+            [resolved addObject:whereWithLoginUser(where[i], user, found)];
+        }
+        return resolved;
+    }
+
+    // only the values of user fields are functions, the same text elsewhere is a string
+    KintoneField *field = (KintoneField *)where[1];
+    if (![where[2] isKindOfClass:[NSArray class]] || ![where[2] containsObject:@"LOGINUSER()"] ||
+        ![field isKindOfClass:[KintoneUserField class]]) {
+        return where;
+    }
+
+    *found = YES;
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:[where[2] count]];
+    for (id value in where[2]) {
+        [values addObject:[value isEqual:@"LOGINUSER()"] && user.length > 0 ? user : value];
+    }
+    return @[where[0], field, values];
+}
+
+- (KintoneQuery *)kintoneQueryWithLoginUser:(NSString *)user
+{
+    KintoneQuery *query = [self copy];
+    NSArray *where = _query[@"where"];
+    if (where == nil) {
+        return query;
+    }
+
+    BOOL found = NO;
+    query->_query[@"where"] = whereWithLoginUser(where, user, &found);
+    if (found && user.length == 0) {
+        return nil;
+    }
+
+    return query;
+}
+
+- (BOOL)matchesRecord:(KintoneRecord *)record
+{
+    NSArray *where = _query[@"where"];
+    if (where == nil || where.count == 0) {
+        return YES;
+    }
+
+    return [self record:record matchesWhere:where];
+}
+
+- (BOOL)record:(KintoneRecord *)record matchesWhere:(NSArray *)where
+{
+    id first = where[0];
+    if ([first isKindOfClass:[NSString class]] && ([first isEqualToString:@"and"] || [first isEqualToString:@"or"])) {
+        BOOL isAnd = [first isEqualToString:@"and"];
+        for (NSUInteger i = 1; i < where.count; i++) {
+            if ([self record:record matchesWhere:where[i]] != isAnd) {
+                return !isAnd;
+            }
+        }
+        return isAnd;
+    }
+
+    return [self record:record matchesCondition:where];
+}
+
+- (BOOL)record:(KintoneRecord *)record matchesCondition:(NSArray *)condition
+{
+    NSAssert(condition.count == 3, @"invalid query: %@", condition);
+
+    KintoneField *field = (KintoneField *)condition[1];
+    KintoneQueryOperatorType operatorType = [condition[0] intValue];
+    KintoneField *recordField = record.fields[field.code];
+    if (recordField != nil) {
+        return [field matchesCondition:operatorType value:condition[2] recordValue:recordField.value];
+    }
+
+    // the field may be in a subtable: any row matches, or every row for negative operators
+    BOOL negative = operatorType == KintoneNotEqualQueryOperatorType ||
+                    operatorType == KintoneNotInQueryOperatorType ||
+                    operatorType == KintoneNotLikeQueryOperatorType;
+    BOOL found = NO;
+    for (KintoneField *subtable in record.fields.objectEnumerator) {
+        if (subtable.type != KintoneSubtableFieldType) {
+            continue;
+        }
+        for (KintoneRecord *row in subtable.value) {
+            KintoneField *rowField = row.fields[field.code];
+            if (rowField == nil) {
+                continue;
+            }
+            found = YES;
+            if ([field matchesCondition:operatorType value:condition[2] recordValue:rowField.value] != negative) {
+                return !negative;
+            }
+        }
+    }
+
+    // a field in no row is empty
+    return found ? negative : [field matchesCondition:operatorType value:condition[2] recordValue:nil];
+}
+
+- (NSArray *)filterRecords:(NSArray *)records
+{
+    NSMutableArray *filtered = [NSMutableArray arrayWithCapacity:records.count];
+    for (KintoneRecord *record in records) {
+        if ([self matchesRecord:record]) {
+            [filtered addObject:record];
+        }
+    }
+
+    // order by, record number descending by default like the server
+    NSArray *orderBy = _query[@"orderBy"];
+    KintoneField *field = orderBy ? orderBy[0] : [[KintoneField alloc] initWithProperties:@{@"code" : @"$id", @"type" : [KintoneField fieldTypeNameForFieldType:KintoneRecordNumberFieldType]}];
+    BOOL asc = orderBy ? [orderBy[1] boolValue] : NO;
+    [filtered sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(KintoneRecord *record1, KintoneRecord *record2) {
+        KintoneField *field1 = record1.fields[field.code];
+        KintoneField *field2 = record2.fields[field.code];
+        NSComparisonResult result = [field compareRecordValue:field1.value toRecordValue:field2.value];
+        return asc ? result : (NSComparisonResult)-result;
+    }];
+
+    // offset and limit
+    NSUInteger offset = MIN(filtered.count, (NSUInteger)[_query[@"offset"] intValue]);
+    NSUInteger length = filtered.count - offset;
+    if (_query[@"limit"]) {
+        length = MIN(length, (NSUInteger)[_query[@"limit"] intValue]);
+    }
+
+    return [filtered subarrayWithRange:NSMakeRange(offset, length)];
+}
+
 @end
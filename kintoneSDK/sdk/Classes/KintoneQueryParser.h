@@ -0,0 +1,33 @@
+//
+//  KintoneQueryParser.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CBError;
+@class KintoneQuery;
+
+// Parses a kintone query string into the condition tree built by the KintoneQuery operator methods.
+// Field codes are resolved with the fields of the app, so that each condition gets the value types
+// and operators its [KintoneField conditionQuery:value:] accepts.
+@interface KintoneQueryParser : NSObject
+
+// fields: field code -> KintoneField, e.g. [KintoneFormCache fields]
+- (KintoneQueryParser *)initWithString:(NSString *)string fields:(NSDictionary *)fields;
+- (KintoneQuery *)parse:(CBError* __autoreleasing *)error;
+
+@end
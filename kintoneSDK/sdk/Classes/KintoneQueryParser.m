@@ -0,0 +1,609 @@
+//
+//  KintoneQueryParser.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneQueryParser.h"
+
+#import "CBError.h"
+#import "KintoneField.h"
+#import "KintoneQuery.h"
+#import "NSDate+Utility.h"
+
+static NSString * const RECORD_ID_CODE = @"$id";
+
+typedef NS_ENUM(NSUInteger, KintoneQueryTokenType) {
+    KintoneEndQueryTokenType,
+    KintoneWordQueryTokenType,          // field codes, keywords, numbers and function names
+    KintoneStringQueryTokenType,        // "..." without the quotes and escapes
+    KintoneOperatorQueryTokenType,      // = != > < >= <=
+    KintonePunctuationQueryTokenType,   // ( ) ,
+    KintoneFunctionQueryTokenType       // TODAY(), LOGINUSER(), ... made of a word and its arguments
+};
+
+@interface KintoneQueryToken : NSObject
+
+@property (nonatomic) KintoneQueryTokenType type;
+@property (nonatomic, copy) NSString *text;
+@property (nonatomic) NSUInteger location;
+
+@end
+
+@implementation KintoneQueryToken
+
++ (KintoneQueryToken *)tokenWithType:(KintoneQueryTokenType)type text:(NSString *)text location:(NSUInteger)location
+{
+    KintoneQueryToken *token = [KintoneQueryToken new];
+    token.type = type;
+    token.text = text;
+    token.location = location;
+
+    return token;
+}
+
+@end
+
+static BOOL isComparisonOperator(KintoneQueryOperatorType operatorType)
+{
+    return operatorType == KintoneEqualQueryOperatorType ||
+           operatorType == KintoneNotEqualQueryOperatorType ||
+           operatorType == KintoneGreaterThanQueryOperatorType ||
+           operatorType == KintoneLessThanQueryOperatorType ||
+           operatorType == KintoneGreaterThanOrEqualQueryOperatorType ||
+           operatorType == KintoneLessThanOrEqualQueryOperatorType;
+}
+
+static BOOL isSupportedOperator(KintoneFieldType fieldType, KintoneQueryOperatorType operatorType)
+{
+    // the operators each conditionQuery:value: accepts
+    BOOL isEquality = operatorType == KintoneEqualQueryOperatorType || operatorType == KintoneNotEqualQueryOperatorType;
+    BOOL isList = operatorType == KintoneInQueryOperatorType || operatorType == KintoneNotInQueryOperatorType;
+    BOOL isLike = operatorType == KintoneLikeQueryOperatorType || operatorType == KintoneNotLikeQueryOperatorType;
+
+    switch (fieldType) {
+        case KintoneSingleLineTextFieldType:
+        case KintoneLinkFieldType:
+            return isEquality || isList || isLike;
+        case KintoneMultiLineTextFieldType:
+        case KintoneRichTextFieldType:
+        case KintoneFileFieldType:
+            return isLike;
+        case KintoneNumberFieldType:
+        case KintoneRecordNumberFieldType:
+            return isComparisonOperator(operatorType) || isList;
+        case KintoneCheckBoxFieldType:
+        case KintoneRadioButtonFieldType:
+        case KintoneDropDownFieldType:
+        case KintoneMultiSelectFieldType:
+        case KintoneStatusFieldType:
+            return isEquality || isList;
+        case KintoneUserSelectFieldType:
+        case KintoneStatusAssigneeFieldType:
+        case KintoneCreatorFieldType:
+        case KintoneModifierFieldType:
+            return isList;
+        case KintoneDateFieldType:
+        case KintoneTimeFieldType:
+        case KintoneDatetimeFieldType:
+        case KintoneCreatedTimeFieldType:
+        case KintoneUpdatedTimeFieldType:
+            return isComparisonOperator(operatorType);
+        default:
+            return NO;
+    }
+}
+
+static BOOL isDateFunction(NSString *function)
+{
+    return [@"TODAY()" isEqualToString:function] || [@"THIS_MONTH()" isEqualToString:function] || [@"THIS_YEAR()" isEqualToString:function];
+}
+
+@implementation KintoneQueryParser
+{
+    NSString *_string;
+    NSDictionary *_fields;
+    NSArray *_tokens;
+    NSUInteger _position;
+    CBError *_error;
+}
+
+- (KintoneQueryParser *)initWithString:(NSString *)string fields:(NSDictionary *)fields
+{
+    if (self = [super init]) {
+        _string = [string copy] ?: @"";
+        _fields = fields ?: @{};
+        _position = 0;
+    }
+
+    return self;
+}
+
+- (KintoneQuery *)parse:(CBError* __autoreleasing *)error
+{
+    _error = nil;
+    KintoneQuery *query = [self parseQuery];
+    if (query == nil && error) {
+        *error = _error;
+    }
+
+    return query;
+}
+
+#pragma mark - grammar
+
+// query := [or] [order by <field> [asc|desc]] [limit <n>] [offset <n>]
+- (KintoneQuery *)parseQuery
+{
+    _tokens = [self tokenize];
+    if (_tokens == nil) {
+        return nil;
+    }
+    _position = 0;
+
+    KintoneQuery *query = [KintoneQuery new];
+
+    KintoneQueryToken *token = [self peek];
+    if (token.type != KintoneEndQueryTokenType &&
+        ![self isKeyword:@"order" token:token] && ![self isKeyword:@"limit" token:token] && ![self isKeyword:@"offset" token:token]) {
+        NSArray *where = [self parseOr];
+        if (where == nil) {
+            return nil;
+        }
+        [query where:where];
+    }
+
+    if ([self acceptKeyword:@"order"]) {
+        if (![self acceptKeyword:@"by"]) {
+            return [self failWithMessage:@"expected \"by\"" token:[self peek]];
+        }
+        KintoneField *field = [self parseField];
+        if (field == nil) {
+            return nil;
+        }
+        BOOL asc = ![self acceptKeyword:@"desc"];
+        if (asc) {
+            [self acceptKeyword:@"asc"];
+        }
+        if ([self isPunctuation:@"," token:[self peek]]) {
+            // KintoneQuery has a single order by field
+            return [self failWithMessage:@"multiple order by fields are not supported" token:[self peek]];
+        }
+        [query orderBy:field asc:asc];
+    }
+
+    if ([self acceptKeyword:@"limit"]) {
+        NSNumber *limit = [self parseIntegerWithMinimum:1];
+        if (limit == nil) {
+            return nil;
+        }
+        [query limit:limit.intValue];
+    }
+
+    if ([self acceptKeyword:@"offset"]) {
+        NSNumber *offset = [self parseIntegerWithMinimum:0];
+        if (offset == nil) {
+            return nil;
+        }
+        [query offset:offset.intValue];
+    }
+
+    if ([self peek].type != KintoneEndQueryTokenType) {
+        return [self failWithMessage:@"unexpected" token:[self peek]];
+    }
+
+    return query;
+}
+
+// or := and ("or" and)*
+- (NSArray *)parseOr
+{
+    return [self parseOperandsJoinedBy:@"or"];
+}
+
+// and := primary ("and" primary)*
+- (NSArray *)parseAnd
+{
+    return [self parseOperandsJoinedBy:@"and"];
+}
+
+- (NSArray *)parseOperandsJoinedBy:(NSString *)keyword
+{
+    // "and" binds tighter than "or"
+    BOOL isOr = [keyword isEqualToString:@"or"];
+    NSMutableArray *operands = [NSMutableArray arrayWithObject:keyword];
+    do {
+        NSArray *operand = isOr ? [self parseAnd] : [self parsePrimary];
+        if (operand == nil) {
+            return nil;
+        }
+        [operands addObject:operand];
+    } while ([self acceptKeyword:keyword]);
+
+    // the same array as [KintoneQuery and:] and [KintoneQuery or:]
+    return operands.count == 2 ? operands[1] : operands;
+}
+
+// primary := "(" or ")" | condition
+- (NSArray *)parsePrimary
+{
+    if ([self acceptPunctuation:@"("]) {
+        NSArray *where = [self parseOr];
+        if (where == nil) {
+            return nil;
+        }
+        if (![self acceptPunctuation:@")"]) {
+            return [self failWithMessage:@"expected \")\"" token:[self peek]];
+        }
+        return where;
+    }
+
+    return [self parseCondition];
+}
+
+// condition := <field> <operator> <value> | <field> ["not"] "in" "(" <value> ("," <value>)* ")"
+- (NSArray *)parseCondition
+{
+    KintoneQueryToken *fieldToken = [self peek];
+    KintoneField *field = [self parseField];
+    if (field == nil) {
+        return nil;
+    }
+
+    KintoneQueryToken *operatorToken = [self peek];
+    NSNumber *operator = [self parseOperator];
+    if (operator == nil) {
+        return nil;
+    }
+    KintoneQueryOperatorType operatorType = [operator intValue];
+    if (!isSupportedOperator(field.type, operatorType)) {
+        NSString *message = [NSString stringWithFormat:@"operator not supported by field \"%@\"", fieldToken.text];
+        return [self failWithMessage:message token:operatorToken];
+    }
+
+    id value;
+    if (operatorType == KintoneInQueryOperatorType || operatorType == KintoneNotInQueryOperatorType) {
+        if (![self acceptPunctuation:@"("]) {
+            return [self failWithMessage:@"expected \"(\"" token:[self peek]];
+        }
+        NSMutableArray *values = [NSMutableArray array];
+        do {
+            id val = [self parseValueForField:field];
+            if (val == nil) {
+                return nil;
+            }
+            [values addObject:val];
+        } while ([self acceptPunctuation:@","]);
+        if (![self acceptPunctuation:@")"]) {
+            return [self failWithMessage:@"expected \")\"" token:[self peek]];
+        }
+        value = values;
+    }
+    else {
+        value = [self parseValueForField:field];
+        if (value == nil) {
+            return nil;
+        }
+    }
+
+    // the same array as the operator methods of KintoneQuery
+    return @[operator, field, value];
+}
+
+- (KintoneField *)parseField
+{
+    KintoneQueryToken *token = [self next];
+    if (token.type != KintoneWordQueryTokenType) {
+        return [self failWithMessage:@"expected a field code" token:token];
+    }
+
+    KintoneField *field = _fields[token.text];
+    if (field == nil && [token.text isEqualToString:RECORD_ID_CODE]) {
+        field = [[KintoneField alloc] initWithProperties:@{@"code" : RECORD_ID_CODE,
+                                                           @"type" : [KintoneField fieldTypeNameForFieldType:KintoneRecordNumberFieldType]}];
+    }
+    if (field == nil) {
+        return [self failWithMessage:@"unknown field code" token:token];
+    }
+
+    return field;
+}
+
+- (NSNumber *)parseOperator
+{
+    KintoneQueryToken *token = [self next];
+    if (token.type == KintoneOperatorQueryTokenType) {
+        NSDictionary *operators = @{@"="  : @(KintoneEqualQueryOperatorType),
+                                    @"!=" : @(KintoneNotEqualQueryOperatorType),
+                                    @">"  : @(KintoneGreaterThanQueryOperatorType),
+                                    @"<"  : @(KintoneLessThanQueryOperatorType),
+                                    @">=" : @(KintoneGreaterThanOrEqualQueryOperatorType),
+                                    @"<=" : @(KintoneLessThanOrEqualQueryOperatorType)};
+        return [NSNumber numberWithInt:[operators[token.text] intValue]];
+    }
+    if ([self isKeyword:@"in" token:token]) {
+        return [NSNumber numberWithInt:KintoneInQueryOperatorType];
+    }
+    if ([self isKeyword:@"like" token:token]) {
+        return [NSNumber numberWithInt:KintoneLikeQueryOperatorType];
+    }
+    if ([self isKeyword:@"not" token:token]) {
+        if ([self acceptKeyword:@"in"]) {
+            return [NSNumber numberWithInt:KintoneNotInQueryOperatorType];
+        }
+        if ([self acceptKeyword:@"like"]) {
+            return [NSNumber numberWithInt:KintoneNotLikeQueryOperatorType];
+        }
+        return [self failWithMessage:@"expected \"in\" or \"like\"" token:[self peek]];
+    }
+
+    return [self failWithMessage:@"expected an operator" token:token];
+}
+
+// converts the value to the type conditionQuery:value: of the field takes
+- (id)parseValueForField:(KintoneField *)field
+{
+    KintoneQueryToken *token = [self parseValueToken];
+    if (token == nil) {
+        return nil;
+    }
+
+    BOOL isString = token.type == KintoneStringQueryTokenType;
+    BOOL isFunction = token.type == KintoneFunctionQueryTokenType;
+    id value = nil;
+    switch (field.type) {
+        case KintoneSingleLineTextFieldType:
+        case KintoneLinkFieldType:
+        case KintoneMultiLineTextFieldType:
+        case KintoneRichTextFieldType:
+        case KintoneFileFieldType:
+        case KintoneCheckBoxFieldType:
+        case KintoneRadioButtonFieldType:
+        case KintoneDropDownFieldType:
+        case KintoneMultiSelectFieldType:
+        case KintoneStatusFieldType:
+            value = isString ? token.text : nil;
+            break;
+        case KintoneNumberFieldType:
+        case KintoneRecordNumberFieldType:
+            value = (isString || token.type == KintoneWordQueryTokenType) ? [self decimalNumberFromString:token.text] : nil;
+            break;
+        case KintoneUserSelectFieldType:
+        case KintoneStatusAssigneeFieldType:
+        case KintoneCreatorFieldType:
+        case KintoneModifierFieldType:
+            if (isString || (isFunction && [@"LOGINUSER()" isEqualToString:token.text])) {
+                value = token.text;
+            }
+            break;
+        case KintoneDateFieldType:
+            value = isString ? [NSDate dateFromDateString:token.text] : (isFunction && isDateFunction(token.text) ? token.text : nil);
+            break;
+        case KintoneDatetimeFieldType:
+        case KintoneCreatedTimeFieldType:
+        case KintoneUpdatedTimeFieldType:
+            value = isString ? [NSDate dateFromRFC3339:token.text] : (isFunction && isDateFunction(token.text) ? token.text : nil);
+            break;
+        case KintoneTimeFieldType:
+            value = isString ? [NSDate dateFromTimeString:token.text] : nil;
+            break;
+        default:
+            break;
+    }
+
+    if (value == nil) {
+        NSString *message = [NSString stringWithFormat:@"invalid value for field \"%@\"", field.code];
+        return [self failWithMessage:message token:token];
+    }
+
+    return value;
+}
+
+// a string, a bare word such as a number, or a function call
+- (KintoneQueryToken *)parseValueToken
+{
+    KintoneQueryToken *token = [self next];
+    if (token.type == KintoneStringQueryTokenType) {
+        return token;
+    }
+    if (token.type != KintoneWordQueryTokenType) {
+        return [self failWithMessage:@"expected a value" token:token];
+    }
+    if (![self acceptPunctuation:@"("]) {
+        return token;
+    }
+
+    // the arguments of the function are kept as written
+    NSMutableArray *arguments = [NSMutableArray array];
+    while (![self acceptPunctuation:@")"]) {
+        KintoneQueryToken *argument = [self next];
+        if (argument.type == KintoneEndQueryTokenType) {
+            return [self failWithMessage:@"expected \")\"" token:argument];
+        }
+        if (![self isPunctuation:@"," token:argument]) {
+            [arguments addObject:argument.text];
+        }
+    }
+
+    NSString *function = [NSString stringWithFormat:@"%@(%@)", [token.text uppercaseString], [arguments componentsJoinedByString:@", "]];
+    return [KintoneQueryToken tokenWithType:KintoneFunctionQueryTokenType text:function location:token.location];
+}
+
+- (NSNumber *)parseIntegerWithMinimum:(int)minimum
+{
+    KintoneQueryToken *token = [self next];
+    NSScanner *scanner = [NSScanner scannerWithString:token.type == KintoneWordQueryTokenType ? token.text : @""];
+    int value;
+    if (![scanner scanInt:&value] || !scanner.isAtEnd || value < minimum) {
+        return [self failWithMessage:@"invalid number" token:token];
+    }
+
+    return [NSNumber numberWithInt:value];
+}
+
+- (NSDecimalNumber *)decimalNumberFromString:(NSString *)string
+{
+    // the whole string has to be a number
+    NSScanner *scanner = [NSScanner scannerWithString:string];
+    scanner.charactersToBeSkipped = nil;
+    scanner.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    NSDecimal decimal;
+    if (![scanner scanDecimal:&decimal] || !scanner.isAtEnd) {
+        return nil;
+    }
+
+    return [NSDecimalNumber decimalNumberWithDecimal:decimal];
+}
+
+#pragma mark - tokens
+
+- (NSArray *)tokenize
+{
+    NSCharacterSet *whitespaces = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    NSCharacterSet *delimiters = [NSCharacterSet characterSetWithCharactersInString:@"()\",=!<>"];
+
+    NSMutableArray *tokens = [NSMutableArray array];
+    NSUInteger length = _string.length;
+    NSUInteger i = 0;
+    while (i < length) {
+        unichar c = [_string characterAtIndex:i];
+        NSUInteger start = i;
+
+        if ([whitespaces characterIsMember:c]) {
+            i++;
+        }
+        else if (c == '"') {
+            // backslash escapes the next character
+            NSMutableString *text = [NSMutableString string];
+            NSUInteger segment = ++i;
+            BOOL closed = NO;
+            while (i < length) {
+                unichar d = [_string characterAtIndex:i];
+                if (d == '\\') {
+                    [text appendString:[_string substringWithRange:NSMakeRange(segment, i - segment)]];
+                    segment = i + 1;
+                    i += 2;
+                }
+                else if (d == '"') {
+                    [text appendString:[_string substringWithRange:NSMakeRange(segment, i - segment)]];
+                    closed = YES;
+                    i++;
+                    break;
+                }
+                else {
+                    i++;
+                }
+            }
+            if (!closed) {
+                return [self failWithMessage:@"unterminated string" location:start];
+            }
+            [tokens addObject:[KintoneQueryToken tokenWithType:KintoneStringQueryTokenType text:text location:start]];
+        }
+        else if (c == '(' || c == ')' || c == ',') {
+            i++;
+            [tokens addObject:[KintoneQueryToken tokenWithType:KintonePunctuationQueryTokenType
+                                                          text:[_string substringWithRange:NSMakeRange(start, 1)]
+                                                      location:start]];
+        }
+        else if (c == '=' || c == '!' || c == '<' || c == '>') {
+            i++;
+            if (c != '=' && i < length && [_string characterAtIndex:i] == '=') {
+                i++;
+            }
+            NSString *operator = [_string substringWithRange:NSMakeRange(start, i - start)];
+            if ([operator isEqualToString:@"!"]) {
+                return [self failWithMessage:@"expected \"!=\"" location:start];
+            }
+            [tokens addObject:[KintoneQueryToken tokenWithType:KintoneOperatorQueryTokenType text:operator location:start]];
+        }
+        else {
+            while (i < length && ![whitespaces characterIsMember:[_string characterAtIndex:i]] && ![delimiters characterIsMember:[_string characterAtIndex:i]]) {
+                i++;
+            }
+            [tokens addObject:[KintoneQueryToken tokenWithType:KintoneWordQueryTokenType
+                                                          text:[_string substringWithRange:NSMakeRange(start, i - start)]
+                                                      location:start]];
+        }
+    }
+    [tokens addObject:[KintoneQueryToken tokenWithType:KintoneEndQueryTokenType text:@"" location:length]];
+
+    return tokens;
+}
+
+- (KintoneQueryToken *)peek
+{
+    return _tokens[_position];
+}
+
+- (KintoneQueryToken *)next
+{
+    KintoneQueryToken *token = _tokens[_position];
+    if (token.type != KintoneEndQueryTokenType) {
+        _position++;
+    }
+
+    return token;
+}
+
+- (BOOL)isKeyword:(NSString *)keyword token:(KintoneQueryToken *)token
+{
+    return token.type == KintoneWordQueryTokenType && [token.text caseInsensitiveCompare:keyword] == NSOrderedSame;
+}
+
+- (BOOL)isPunctuation:(NSString *)punctuation token:(KintoneQueryToken *)token
+{
+    return token.type == KintonePunctuationQueryTokenType && [token.text isEqualToString:punctuation];
+}
+
+- (BOOL)acceptKeyword:(NSString *)keyword
+{
+    if (![self isKeyword:keyword token:[self peek]]) {
+        return NO;
+    }
+    [self next];
+
+    return YES;
+}
+
+- (BOOL)acceptPunctuation:(NSString *)punctuation
+{
+    if (![self isPunctuation:punctuation token:[self peek]]) {
+        return NO;
+    }
+    [self next];
+
+    return YES;
+}
+
+#pragma mark - errors
+
+- (id)failWithMessage:(NSString *)message token:(KintoneQueryToken *)token
+{
+    NSString *found = token.type == KintoneEndQueryTokenType ? @"end of query" : [NSString stringWithFormat:@"\"%@\"", token.text];
+    return [self failWithMessage:[NSString stringWithFormat:@"%@, found %@", message, found] location:token.location];
+}
+
+- (id)failWithMessage:(NSString *)message location:(NSUInteger)location
+{
+    // only the first error is reported
+    if (_error == nil) {
+        NSString *reason = [NSString stringWithFormat:@"%@ at %lu in %@", message, (unsigned long)location, _string];
+        _error = [CBError errorWithFormat:@"KintoneErrorInvalidQuery", reason];
+    }
+
+    return nil;
+}
+
+@end
@@ -0,0 +1,315 @@
+//
+//  KintoneRecordCursor.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneRecordCursor.h"
+
+#import "CBRequestHandle.h"
+#import "KintoneAPI.h"
+#import "KintoneField.h"
+#import "KintoneQuery.h"
+#import "KintoneRecord.h"
+#import "NSDate+Utility.h"
+
+#define RECORD_ID_CODE @"$id"
+
+@interface KintoneRecordCursor ()
+
+@property (nonatomic, readwrite) KintoneAPI *kintoneAPI;
+@property (nonatomic, readwrite) int count;
+@property (nonatomic, readwrite, getter = isFinished) BOOL finished;
+@property (nonatomic, readwrite) NSDate *serverDate;
+
+@end
+
+@implementation KintoneRecordCursor
+{
+    NSArray *_fields;
+    KintoneQuery *_query;
+    NSOperationQueue *_queue;
+
+    KintoneRecordCursorBatchBlock _batch;
+    KintoneRecordCursorCompletionBlock _completion;
+    CBNetworkingFailureBlockForJSONResponse _failure;
+
+    BOOL _started;
+    int _baseOffset;
+    int _limit;                   // -1: no limit
+    int _nextRequestPage;
+    int _nextDeliveryPage;
+    int _endPage;                 // first page that has no records, INT_MAX until a short page is received
+    int _inFlight;
+    NSMutableDictionary *_pages;  // page index -> JSON records
+    NSHashTable *_requestHandles; // page requests in flight
+
+    KintoneField *_recordIdField; // nil: a custom order, pages are requested by offset
+    BOOL _recordIdAsc;
+    NSNumber *_anchorRecordId;    // the last $id of a received page; later pages are requested after it
+    int _anchorPage;              // the first page after _anchorRecordId
+}
+
+static const int KintoneRecordCursorDefaultPageSize = 100;
+static const int KintoneRecordCursorMaxPageSize = 500;
+static const int KintoneRecordCursorDefaultPrefetchDepth = 2;
+
+- (KintoneRecordCursor *)initWithKintoneAPI:(KintoneAPI *)kintoneAPI fields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query
+{
+    assert(kintoneAPI != nil);
+
+    if (self = [super init]) {
+        self.kintoneAPI = kintoneAPI;
+        self.pageSize = KintoneRecordCursorDefaultPageSize;
+        self.prefetchDepth = KintoneRecordCursorDefaultPrefetchDepth;
+        self.count = 0;
+        self.finished = NO;
+        _fields = fields;
+        _query = query ? [query copy] : [KintoneQuery new];
+    }
+
+    return self;
+}
+
+- (void)fetch:(KintoneRecordCursorBatchBlock)batch
+   completion:(KintoneRecordCursorCompletionBlock)completion
+      failure:(CBNetworkingFailureBlockForJSONResponse)failure
+        queue:(NSOperationQueue *)queue
+{
+    assert(self.pageSize > 0 && self.pageSize <= KintoneRecordCursorMaxPageSize);
+    assert(self.prefetchDepth > 0);
+    assert(!_started);  // a cursor can be fetched only once
+
+    _started = YES;
+    _batch = batch;
+    _completion = completion;
+    _failure = failure;
+    _queue = queue;
+
+    _baseOffset = _query.offsetClause ? _query.offsetClause.intValue : 0;
+    _limit = _query.limitClause ? _query.limitClause.intValue : -1;
+    _nextRequestPage = 0;
+    _nextDeliveryPage = 0;
+    _endPage = INT_MAX;
+    _inFlight = 0;
+    _pages = [NSMutableDictionary dictionary];
+    _requestHandles = [NSHashTable weakObjectsHashTable];
+
+    // kintone rejects offsets over 10,000; in $id order, pages are requested after the last $id received instead
+    NSArray *orderBy = _query.orderByClause;
+    if (orderBy == nil || [[orderBy[0] code] isEqualToString:RECORD_ID_CODE]) {
+        _recordIdField = [[KintoneField alloc] initWithProperties:@{@"type" : [KintoneField fieldTypeNameForFieldType:KintoneRecordNumberFieldType],
+                                                                    @"code" : RECORD_ID_CODE}];
+        // without an order by, kintone returns the records in descending $id order
+        _recordIdAsc = orderBy ? [orderBy[1] boolValue] : NO;
+    }
+    _anchorRecordId = nil;
+    _anchorPage = 0;
+
+    if (_limit == 0) {
+        [self finishWithCompletion];
+        return;
+    }
+
+    [self requestPages];
+}
+
+- (void)cancel
+{
+    self.finished = YES;
+    [self releaseBlocks];
+}
+
+#pragma mark - private
+
+- (int)limitForPage:(int)page
+{
+    if (_limit < 0) {
+        return self.pageSize;
+    }
+
+    return MIN(self.pageSize, _limit - page * self.pageSize);
+}
+
+- (BOOL)hasPage:(int)page
+{
+    if (page >= _endPage) {
+        return NO;
+    }
+
+    return _limit < 0 || page * self.pageSize < _limit;
+}
+
+- (void)requestPages
+{
+    while (!self.finished && _inFlight < self.prefetchDepth && [self hasPage:_nextRequestPage]) {
+        [self requestPage:_nextRequestPage++];
+    }
+}
+
+- (NSArray *)pageFields
+{
+    if (_fields == nil || _recordIdField == nil) {
+        return _fields;
+    }
+
+    // the next pages need the $id of the last record
+    for (KintoneField *field in _fields) {
+        if ([field.code isEqualToString:RECORD_ID_CODE]) {
+            return _fields;
+        }
+    }
+
+    return [_fields arrayByAddingObject:_recordIdField];
+}
+
+- (KintoneQuery *)queryForPage:(int)page
+{
+    KintoneQuery *query = [_query copy];
+    [query limit:[self limitForPage:page]];
+    if (_recordIdField == nil || _anchorRecordId == nil) {
+        [query offset:_baseOffset + page * self.pageSize];
+        if (_recordIdField) {
+            [query orderBy:_recordIdField asc:_recordIdAsc];
+        }
+        return query;
+    }
+
+    // the offset only counts the prefetched pages after the anchor, so it stays small
+    NSArray *where = _query.whereClause;
+    NSArray *condition = _recordIdAsc ? [query greaterThan:_recordIdField value:_anchorRecordId] : [query lessThan:_recordIdField value:_anchorRecordId];
+    [query where:where ? [query and:where, condition, nil] : condition];
+    [query orderBy:_recordIdField asc:_recordIdAsc];
+    [query offset:(page - _anchorPage) * self.pageSize];
+
+    return query;
+}
+
+- (void)requestPage:(int)page
+{
+    KintoneQuery *query = [self queryForPage:page];
+
+    CBNetworkingSuccessBlockForJSONResponse success = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [self didReceiveResponse:response];
+        [self didReceivePage:page JSON:JSON];
+    };
+    CBNetworkingFailureBlockForJSONResponse failure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        _inFlight--;
+        if (self.finished) {
+            return;
+        }
+
+        CBNetworkingFailureBlockForJSONResponse failureBlock = _failure;
+        self.finished = YES;
+        [self releaseBlocks];
+
+        if (failureBlock) {
+            failureBlock(request, response, error, JSON);
+        }
+    };
+
+    _inFlight++;
+    [_requestHandles addObject:[self.kintoneAPI recordsWithFields:[self pageFields] kintoneQuery:query success:success failure:failure queue:_queue]];
+}
+
+- (void)didReceiveResponse:(NSHTTPURLResponse *)response
+{
+    // pages may arrive out of order; keep the earliest time
+    NSDate *date = [NSDate dateFromHTTPDate:response.allHeaderFields[@"Date"]];
+    if (date && (self.serverDate == nil || [date compare:self.serverDate] == NSOrderedAscending)) {
+        self.serverDate = date;
+    }
+}
+
+- (void)didReceivePage:(int)page JSON:(id)JSON
+{
+    _inFlight--;
+    if (self.finished || page >= _endPage) {
+        // cancelled, or prefetched beyond the last page
+        return;
+    }
+
+    NSArray *records = JSON[@"records"];
+    if ((int)records.count < [self limitForPage:page]) {
+        _endPage = page + 1;
+    }
+    _pages[@(page)] = records ? records : @[];
+
+    id lastRecordId = [records lastObject][RECORD_ID_CODE][@"value"];
+    if (_recordIdField && page >= _anchorPage && [lastRecordId respondsToSelector:@selector(intValue)]) {
+        _anchorRecordId = @([lastRecordId intValue]);
+        _anchorPage = page + 1;
+    }
+
+    // deliver pages in order; later pages stay in flight while the batch block runs
+    [self requestPages];
+    while (!self.finished && _pages[@(_nextDeliveryPage)] != nil) {
+        NSArray *jsonRecords = _pages[@(_nextDeliveryPage)];
+        [_pages removeObjectForKey:@(_nextDeliveryPage)];
+        _nextDeliveryPage++;
+
+        NSMutableArray *kintoneRecords = [NSMutableArray arrayWithCapacity:jsonRecords.count];
+        for (NSDictionary *record in jsonRecords) {
+            [kintoneRecords addObject:[KintoneRecord kintoneRecordFromDictionary:record]];
+        }
+        self.count += (int)kintoneRecords.count;
+
+        BOOL stop = NO;
+        if (_batch && kintoneRecords.count > 0) {
+            _batch(kintoneRecords, &stop);
+        }
+        if (stop) {
+            [self cancel];
+            return;
+        }
+    }
+
+    if (self.finished) {
+        return;
+    }
+    if (![self hasPage:_nextDeliveryPage]) {
+        [self finishWithCompletion];
+        return;
+    }
+
+    [self requestPages];
+}
+
+- (void)finishWithCompletion
+{
+    KintoneRecordCursorCompletionBlock completion = _completion;
+    self.finished = YES;
+    [self releaseBlocks];
+
+    if (completion) {
+        completion(self.count);
+    }
+}
+
+- (void)releaseBlocks
+{
+    // drop pages nobody will see, e.g. prefetched beyond a stop
+    for (CBRequestHandle *handle in [_requestHandles allObjects]) {
+        [handle cancel];
+    }
+
+    // break retain cycles between the cursor and the caller's blocks
+    _batch = nil;
+    _completion = nil;
+    _failure = nil;
+    _pages = nil;
+}
+
+@end
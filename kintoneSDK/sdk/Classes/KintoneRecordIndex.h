@@ -0,0 +1,50 @@
+//
+//  KintoneRecordIndex.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "KintoneQuery.h"
+
+@class KintoneField;
+
+// Secondary index of KintoneRecordStore over one top-level field.
+// Numbers, dates, datetimes and times are kept sorted by [KintoneField sortKeyOfRecordValue:] for range conditions;
+// options, statuses and users are hashed by each selected value for equality and in conditions.
+// The index answers with a superset of the matching record ids; the caller evaluates the query on the candidates.
+// A field found in the rows of a subtable is not indexed; the index then answers nothing and the caller scans.
+// Not thread safe, KintoneRecordStore uses it on its queue.
+@interface KintoneRecordIndex : NSObject
+
+@property (nonatomic, readonly) KintoneField *field;
+@property (nonatomic, readonly, getter = isSubtableColumn) BOOL subtableColumn;
+
++ (BOOL)canIndexField:(KintoneField *)field;
+
+- (KintoneRecordIndex *)initWithField:(KintoneField *)field;
+
+// records are dictionaries in the format of records.json, keyed by @(record id)
+- (void)rebuildWithRecords:(NSDictionary *)records;
+- (void)setRecord:(NSDictionary *)record forId:(NSNumber *)recordId;
+- (void)removeRecordWithId:(NSNumber *)recordId;
+- (void)removeAllRecords;
+
+// NSNotFound when the index cannot answer the condition
+- (NSUInteger)estimatedCountOfCondition:(KintoneQueryOperatorType)operatorType value:(id)value;
+// nil when the index cannot answer the condition
+- (NSSet *)recordIdsMatchingCondition:(KintoneQueryOperatorType)operatorType value:(id)value;
+
+@end
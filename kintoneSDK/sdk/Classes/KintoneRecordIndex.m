@@ -0,0 +1,440 @@
+//
+//  KintoneRecordIndex.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneRecordIndex.h"
+
+#import "CBLog.h"
+#import "KintoneField.h"
+
+static BOOL isSortedFieldType(KintoneFieldType type)
+{
+    switch (type) {
+        case KintoneNumberFieldType:
+        case KintoneDateFieldType:
+        case KintoneTimeFieldType:
+        case KintoneDatetimeFieldType:
+        case KintoneCreatedTimeFieldType:
+        case KintoneUpdatedTimeFieldType:
+        case KintoneRecordNumberFieldType:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+static BOOL isHashedFieldType(KintoneFieldType type)
+{
+    switch (type) {
+        case KintoneRadioButtonFieldType:
+        case KintoneDropDownFieldType:
+        case KintoneStatusFieldType:
+        case KintoneCheckBoxFieldType:
+        case KintoneMultiSelectFieldType:
+        case KintoneUserSelectFieldType:
+        case KintoneStatusAssigneeFieldType:
+        case KintoneCreatorFieldType:
+        case KintoneModifierFieldType:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+static NSArray *hashKeysOfRecordValue(id value)
+{
+    // multiple selections and users are arrays, users are dictionaries with a code
+    NSArray *values = [value isKindOfClass:[NSArray class]] ? value : (value ? @[value] : @[]);
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:values.count];
+    for (id val in values) {
+        id key = [val isKindOfClass:[NSDictionary class]] ? val[@"code"] : val;
+        if ([key isKindOfClass:[NSString class]] && [key length] > 0) {
+            [keys addObject:key];
+        }
+    }
+
+    return keys;
+}
+
+static BOOL isSubtableColumnOfRecord(NSDictionary *record, NSString *code)
+{
+    NSString *subtableTypeName = [KintoneField fieldTypeNameForFieldType:KintoneSubtableFieldType];
+    for (NSString *key in record) {
+        NSDictionary *field = record[key];
+        if (![field isKindOfClass:[NSDictionary class]] || ![subtableTypeName isEqual:field[@"type"]] ||
+            ![field[@"value"] isKindOfClass:[NSArray class]]) {
+            continue;
+        }
+        for (NSDictionary *row in field[@"value"]) {
+            if ([row isKindOfClass:[NSDictionary class]] && [row[@"value"] isKindOfClass:[NSDictionary class]] && row[@"value"][code] != nil) {
+                return YES;
+            }
+        }
+    }
+
+    return NO;
+}
+
+@interface KintoneRecordIndex ()
+
+@property (nonatomic, readwrite) KintoneField *field;
+@property (nonatomic, readwrite, getter = isSubtableColumn) BOOL subtableColumn;
+
+@end
+
+@implementation KintoneRecordIndex
+{
+    BOOL _sorted;
+    NSMutableDictionary *_keysById;     // @(record id) -> sort key, NSNull when empty, or NSArray of hash keys
+    NSMutableArray *_sortedKeys;        // ascending by key and record id, parallel to _sortedIds
+    NSMutableArray *_sortedIds;
+    NSMutableDictionary *_idsByKey;     // hash key -> NSMutableSet of @(record id)
+}
+
++ (BOOL)canIndexField:(KintoneField *)field
+{
+    // the form doesn't tell the columns of subtables apart, they are found when the records are indexed
+    return field.code.length > 0 && (isSortedFieldType(field.type) || isHashedFieldType(field.type));
+}
+
+- (KintoneRecordIndex *)initWithField:(KintoneField *)field
+{
+    assert([KintoneRecordIndex canIndexField:field]);
+
+    if (self = [super init]) {
+        self.field = field;
+        _sorted = isSortedFieldType(field.type);
+        _keysById = [NSMutableDictionary dictionary];
+        _sortedKeys = [NSMutableArray array];
+        _sortedIds = [NSMutableArray array];
+        _idsByKey = [NSMutableDictionary dictionary];
+    }
+
+    return self;
+}
+
+- (void)rebuildWithRecords:(NSDictionary *)records
+{
+    [self removeAllRecords];
+
+    if (!_sorted) {
+        for (NSNumber *recordId in records) {
+            [self setRecord:records[recordId] forId:recordId];
+        }
+        return;
+    }
+
+    // sort once instead of inserting one by one
+    NSMutableArray *entries = [NSMutableArray arrayWithCapacity:records.count];
+    for (NSNumber *recordId in records) {
+        if ([self detectSubtableColumnOfRecord:records[recordId]]) {
+            return;
+        }
+        id key = [self sortKeyOfRecord:records[recordId]];
+        _keysById[recordId] = key ?: [NSNull null];
+        if (key) {
+            [entries addObject:@[key, recordId]];
+        }
+    }
+    [entries sortUsingComparator:^NSComparisonResult(NSArray *entry1, NSArray *entry2) {
+        NSComparisonResult result = [entry1[0] compare:entry2[0]];
+        return result != NSOrderedSame ? result : [entry1[1] compare:entry2[1]];
+    }];
+    for (NSArray *entry in entries) {
+        [_sortedKeys addObject:entry[0]];
+        [_sortedIds addObject:entry[1]];
+    }
+}
+
+- (void)setRecord:(NSDictionary *)record forId:(NSNumber *)recordId
+{
+    [self removeRecordWithId:recordId];
+
+    if ([self detectSubtableColumnOfRecord:record]) {
+        return;
+    }
+
+    if (_sorted) {
+        id key = [self sortKeyOfRecord:record];
+        _keysById[recordId] = key ?: [NSNull null];
+        if (key) {
+            NSUInteger position = [self positionOfKey:key recordId:recordId after:NO];
+            [_sortedKeys insertObject:key atIndex:position];
+            [_sortedIds insertObject:recordId atIndex:position];
+        }
+        return;
+    }
+
+    NSArray *keys = hashKeysOfRecordValue([self valueOfRecord:record]);
+    _keysById[recordId] = keys;
+    for (NSString *key in keys) {
+        NSMutableSet *recordIds = _idsByKey[key];
+        if (recordIds == nil) {
+            recordIds = [NSMutableSet set];
+            _idsByKey[key] = recordIds;
+        }
+        [recordIds addObject:recordId];
+    }
+}
+
+- (void)removeRecordWithId:(NSNumber *)recordId
+{
+    id keys = _keysById[recordId];
+    if (keys == nil) {
+        return;
+    }
+    [_keysById removeObjectForKey:recordId];
+
+    if (_sorted) {
+        if (keys != [NSNull null]) {
+            NSUInteger position = [self positionOfKey:keys recordId:recordId after:NO];
+            if (position < _sortedIds.count && [_sortedIds[position] isEqualToNumber:recordId]) {
+                [_sortedKeys removeObjectAtIndex:position];
+                [_sortedIds removeObjectAtIndex:position];
+            }
+        }
+        return;
+    }
+
+    for (NSString *key in keys) {
+        NSMutableSet *recordIds = _idsByKey[key];
+        [recordIds removeObject:recordId];
+        if (recordIds.count == 0) {
+            [_idsByKey removeObjectForKey:key];
+        }
+    }
+}
+
+- (void)removeAllRecords
+{
+    [_keysById removeAllObjects];
+    [_sortedKeys removeAllObjects];
+    [_sortedIds removeAllObjects];
+    [_idsByKey removeAllObjects];
+}
+
+- (NSUInteger)estimatedCountOfCondition:(KintoneQueryOperatorType)operatorType value:(id)value
+{
+    if (self.subtableColumn) {
+        return NSNotFound;
+    }
+
+    BOOL negative;
+    KintoneQueryOperatorType positiveOperatorType = [self positiveOperatorType:operatorType negative:&negative];
+
+    NSUInteger count = 0;
+    if (_sorted) {
+        NSArray *ranges = [self rangesOfCondition:positiveOperatorType value:value];
+        if (ranges == nil) {
+            return NSNotFound;
+        }
+        for (NSValue *range in ranges) {
+            count += range.rangeValue.length;
+        }
+    }
+    else {
+        NSArray *keys = [self hashKeysOfCondition:positiveOperatorType value:value];
+        if (keys == nil) {
+            return NSNotFound;
+        }
+        for (NSString *key in keys) {
+            count += [_idsByKey[key] count];
+        }
+    }
+
+    count = MIN(count, _keysById.count);
+    return negative ? _keysById.count - count : count;
+}
+
+- (NSSet *)recordIdsMatchingCondition:(KintoneQueryOperatorType)operatorType value:(id)value
+{
+    if (self.subtableColumn) {
+        return nil;
+    }
+
+    BOOL negative;
+    KintoneQueryOperatorType positiveOperatorType = [self positiveOperatorType:operatorType negative:&negative];
+
+    NSMutableSet *recordIds = [NSMutableSet set];
+    if (_sorted) {
+        NSArray *ranges = [self rangesOfCondition:positiveOperatorType value:value];
+        if (ranges == nil) {
+            return nil;
+        }
+        for (NSValue *range in ranges) {
+            [recordIds addObjectsFromArray:[_sortedIds subarrayWithRange:range.rangeValue]];
+        }
+    }
+    else {
+        NSArray *keys = [self hashKeysOfCondition:positiveOperatorType value:value];
+        if (keys == nil) {
+            return nil;
+        }
+        for (NSString *key in keys) {
+            [recordIds unionSet:_idsByKey[key]];
+        }
+    }
+
+    if (!negative) {
+        return recordIds;
+    }
+
+    // empty values are in none of the keys and match the negative operators
+    NSMutableSet *complement = [NSMutableSet setWithArray:[_keysById allKeys]];
+    [complement minusSet:recordIds];
+    return complement;
+}
+
+#pragma mark - private
+
+// a subtable column has a value per row, which the index can't hold; once found, the index stays empty
+- (BOOL)detectSubtableColumnOfRecord:(NSDictionary *)record
+{
+    if (self.subtableColumn) {
+        return YES;
+    }
+    if (record[self.field.code] != nil || !isSubtableColumnOfRecord(record, self.field.code)) {
+        return NO;
+    }
+
+    [CBLog sdkLogVerbose:@"record index of %@ disabled, the field is in a subtable", self.field.code];
+    self.subtableColumn = YES;
+    [self removeAllRecords];
+    return YES;
+}
+
+- (id)valueOfRecord:(NSDictionary *)record
+{
+    id field = record[self.field.code];
+    return [field isKindOfClass:[NSDictionary class]] ? field[@"value"] : nil;
+}
+
+- (id)sortKeyOfRecord:(NSDictionary *)record
+{
+    return [self.field sortKeyOfRecordValue:[self valueOfRecord:record]];
+}
+
+- (KintoneQueryOperatorType)positiveOperatorType:(KintoneQueryOperatorType)operatorType negative:(BOOL *)negative
+{
+    *negative = YES;
+    switch (operatorType) {
+        case KintoneNotEqualQueryOperatorType:
+            return KintoneEqualQueryOperatorType;
+        case KintoneNotInQueryOperatorType:
+            return KintoneInQueryOperatorType;
+        case KintoneNotLikeQueryOperatorType:
+            return KintoneLikeQueryOperatorType;
+        default:
+            *negative = NO;
+            return operatorType;
+    }
+}
+
+// the first position not ordered before (key, recordId); without a record id, before or after all entries of the key
+- (NSUInteger)positionOfKey:(id)key recordId:(NSNumber *)recordId after:(BOOL)after
+{
+    NSUInteger low = 0;
+    NSUInteger high = _sortedKeys.count;
+    while (low < high) {
+        NSUInteger mid = low + (high - low) / 2;
+        NSComparisonResult result = [_sortedKeys[mid] compare:key];
+        if (result == NSOrderedSame) {
+            result = recordId ? [_sortedIds[mid] compare:recordId] : (after ? NSOrderedAscending : NSOrderedDescending);
+        }
+
+        if (result == NSOrderedAscending) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+// ranges of _sortedIds matching a positive operator, nil when the index cannot answer it
+- (NSArray *)rangesOfCondition:(KintoneQueryOperatorType)operatorType value:(id)value
+{
+    NSArray *values = @[value];
+    if (operatorType == KintoneInQueryOperatorType) {
+        if (![value isKindOfClass:[NSArray class]]) {
+            return nil;
+        }
+        values = value;
+    }
+
+    NSUInteger count = _sortedKeys.count;
+    NSMutableArray *ranges = [NSMutableArray arrayWithCapacity:values.count];
+    for (id val in values) {
+        // TODAY() and the like are left to a scan
+        if (![val isKindOfClass:[NSDate class]] && ![val isKindOfClass:[NSNumber class]]) {
+            return nil;
+        }
+        id key = [self.field sortKeyOfRecordValue:val];
+        if (key == nil) {
+            return nil;
+        }
+
+        NSUInteger lower = [self positionOfKey:key recordId:nil after:NO];
+        NSUInteger upper = [self positionOfKey:key recordId:nil after:YES];
+        NSRange range;
+        switch (operatorType) {
+            case KintoneEqualQueryOperatorType:
+            case KintoneInQueryOperatorType:
+                range = NSMakeRange(lower, upper - lower);
+                break;
+            case KintoneGreaterThanQueryOperatorType:
+                range = NSMakeRange(upper, count - upper);
+                break;
+            case KintoneGreaterThanOrEqualQueryOperatorType:
+                range = NSMakeRange(lower, count - lower);
+                break;
+            case KintoneLessThanQueryOperatorType:
+                range = NSMakeRange(0, lower);
+                break;
+            case KintoneLessThanOrEqualQueryOperatorType:
+                range = NSMakeRange(0, upper);
+                break;
+            default:
+                return nil;
+        }
+        [ranges addObject:[NSValue valueWithRange:range]];
+    }
+
+    return ranges;
+}
+
+// hash keys matching a positive operator, nil when the index cannot answer it
+- (NSArray *)hashKeysOfCondition:(KintoneQueryOperatorType)operatorType value:(id)value
+{
+    if (operatorType != KintoneEqualQueryOperatorType && operatorType != KintoneInQueryOperatorType) {
+        return nil;
+    }
+
+    NSArray *values = [value isKindOfClass:[NSArray class]] ? value : @[value];
+    for (id val in values) {
+        // empty values are not indexed
+        if (![val isKindOfClass:[NSString class]] || [val length] == 0) {
+            return nil;
+        }
+    }
+
+    return values;
+}
+
+@end
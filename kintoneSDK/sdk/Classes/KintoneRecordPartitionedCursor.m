@@ -0,0 +1,433 @@
+//
+//  KintoneRecordPartitionedCursor.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneRecordPartitionedCursor.h"
+
+#import "CBRequestHandle.h"
+#import "KintoneAPI.h"
+#import "KintoneField.h"
+#import "KintoneQuery.h"
+#import "KintoneRecord.h"
+#import "NSDate+Utility.h"
+
+#define RECORD_ID_CODE @"$id"
+#define REVISION_CODE @"$revision"
+
+@interface KintoneRecordPartitionedCursor ()
+
+@property (nonatomic, readwrite) KintoneAPI *kintoneAPI;
+@property (nonatomic, readwrite) int count;
+@property (nonatomic, readwrite, getter = isFinished) BOOL finished;
+@property (nonatomic, readwrite) NSDate *serverDate;
+
+@end
+
+@implementation KintoneRecordPartitionedCursor
+{
+    NSArray *_fields;
+    KintoneQuery *_query;
+    NSOperationQueue *_queue;
+    KintoneField *_recordIdField;
+
+    KintoneRecordCursorBatchBlock _batch;
+    KintoneRecordCursorCompletionBlock _completion;
+    CBNetworkingFailureBlockForJSONResponse _failure;
+
+    BOOL _started;
+    NSNumber *_minRecordId;         // nil until the bounds request returns
+    NSNumber *_maxRecordId;
+    KintoneField *_orderByField;    // nil: partitions are delivered as they arrive
+    BOOL _orderByAsc;
+    NSMutableArray *_cursors;       // KintoneRecordCursor per partition
+    NSMutableArray *_buffers;       // records waiting to be merged, per partition
+    NSMutableIndexSet *_finishedPartitions;
+    NSHashTable *_requestHandles;   // bounds requests in flight
+}
+
+static const int KintoneRecordPartitionedCursorDefaultPartitions = 4;
+static const int KintoneRecordPartitionedCursorDefaultPageSize = 100;
+
+- (KintoneRecordPartitionedCursor *)initWithKintoneAPI:(KintoneAPI *)kintoneAPI fields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query
+{
+    assert(kintoneAPI != nil);
+
+    if (self = [super init]) {
+        self.kintoneAPI = kintoneAPI;
+        self.partitions = KintoneRecordPartitionedCursorDefaultPartitions;
+        self.pageSize = KintoneRecordPartitionedCursorDefaultPageSize;
+        self.count = 0;
+        self.finished = NO;
+        _fields = fields;
+        _query = query ? [query copy] : [KintoneQuery new];
+        _recordIdField = [[KintoneField alloc] initWithProperties:@{@"type" : [KintoneField fieldTypeNameForFieldType:KintoneRecordNumberFieldType],
+                                                                    @"code" : RECORD_ID_CODE}];
+    }
+
+    return self;
+}
+
+- (void)fetch:(KintoneRecordCursorBatchBlock)batch
+   completion:(KintoneRecordCursorCompletionBlock)completion
+      failure:(CBNetworkingFailureBlockForJSONResponse)failure
+        queue:(NSOperationQueue *)queue
+{
+    assert(self.partitions > 0);
+    assert(!_started);  // a cursor can be fetched only once
+
+    _started = YES;
+    _requestHandles = [NSHashTable weakObjectsHashTable];
+    _batch = batch;
+    _completion = completion;
+    _failure = failure;
+    _queue = queue;
+
+    NSArray *orderBy = _query.orderByClause;
+    _orderByField = orderBy ? orderBy[0] : nil;
+    _orderByAsc = orderBy ? [orderBy[1] boolValue] : YES;
+
+    if (self.partitions == 1 || _query.limitClause != nil || _query.offsetClause != nil) {
+        // limit/offset apply to the whole result set, so it can't be split by id range
+        [self startPartitionsWithQueries:@[_query]];
+        return;
+    }
+
+    [self requestRecordIdBoundAsc:YES];
+    [self requestRecordIdBoundAsc:NO];
+}
+
+- (void)cancel
+{
+    self.finished = YES;
+    [self releaseBlocks];
+}
+
+#pragma mark - private
+
+- (void)requestRecordIdBoundAsc:(BOOL)asc
+{
+    KintoneQuery *query = [_query copy];
+    [query orderBy:_recordIdField asc:asc];
+    [query limit:1];
+
+    CBNetworkingSuccessBlockForJSONResponse success = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        if (self.finished) {
+            return;
+        }
+        [self didReceiveServerDate:[NSDate dateFromHTTPDate:response.allHeaderFields[@"Date"]]];
+
+        NSArray *records = JSON[@"records"];
+        if (records.count == 0) {
+            // no record matches the query
+            [self finishWithCompletion];
+            return;
+        }
+
+        NSNumber *recordId = [NSNumber numberWithInt:[records[0][RECORD_ID_CODE][@"value"] intValue]];
+        if (asc) {
+            _minRecordId = recordId;
+        }
+        else {
+            _maxRecordId = recordId;
+        }
+
+        if (_minRecordId && _maxRecordId) {
+            [self startPartitionsWithQueries:[self partitionQueries]];
+        }
+    };
+
+    [_requestHandles addObject:[self.kintoneAPI records:@[RECORD_ID_CODE] query:query.kintoneQuery success:success failure:[self failureBlock] queue:_queue]];
+}
+
+- (NSArray *)partitionQueries
+{
+    // split [min, max] into disjoint ranges of the same width
+    int minRecordId = _minRecordId.intValue;
+    int maxRecordId = MAX(_maxRecordId.intValue, minRecordId);
+    int range = maxRecordId - minRecordId + 1;
+    int partitions = MIN(self.partitions, range);
+    int width = (range + partitions - 1) / partitions;
+
+    NSMutableArray *queries = [NSMutableArray arrayWithCapacity:partitions];
+    for (int lower = minRecordId; lower <= maxRecordId; lower += width) {
+        int upper = MIN(lower + width - 1, maxRecordId);
+
+        KintoneQuery *query = [_query copy];
+        NSArray *where = _query.whereClause;
+        NSArray *lowerCondition = [query greaterThanOrEqual:_recordIdField value:@(lower)];
+        NSArray *upperCondition = [query lessThanOrEqual:_recordIdField value:@(upper)];
+        if (where) {
+            [query where:[query and:where, lowerCondition, upperCondition, nil]];
+        }
+        else {
+            [query where:[query and:lowerCondition, upperCondition, nil]];
+        }
+        [queries addObject:query];
+    }
+
+    return queries;
+}
+
+- (NSArray *)partitionFields
+{
+    if (_fields == nil || _orderByField == nil) {
+        return _fields;
+    }
+
+    // the merge needs the value of the order by field
+    for (KintoneField *field in _fields) {
+        if ([field.code isEqualToString:_orderByField.code]) {
+            return _fields;
+        }
+    }
+
+    return [_fields arrayByAddingObject:_orderByField];
+}
+
+- (void)startPartitionsWithQueries:(NSArray *)queries
+{
+    NSArray *fields = [self partitionFields];
+
+    _cursors = [NSMutableArray arrayWithCapacity:queries.count];
+    _buffers = [NSMutableArray arrayWithCapacity:queries.count];
+    _finishedPartitions = [NSMutableIndexSet indexSet];
+
+    for (KintoneQuery *query in queries) {
+        KintoneRecordCursor *cursor = [self.kintoneAPI recordCursorWithFields:fields kintoneQuery:query];
+        cursor.pageSize = self.pageSize;
+        if (queries.count > 1) {
+            // partitions already run in parallel; keep one page in flight per partition
+            cursor.prefetchDepth = 1;
+        }
+        [_cursors addObject:cursor];
+        [_buffers addObject:[NSMutableArray array]];
+    }
+
+    for (NSUInteger i = 0; i < _cursors.count; i++) {
+        KintoneRecordCursorBatchBlock batch = ^(NSArray *records, BOOL *stop) {
+            [self didReceiveServerDate:[_cursors[i] serverDate]];
+            [self didReceiveRecords:records partition:i];
+            *stop = self.finished;
+        };
+        KintoneRecordCursorCompletionBlock completion = ^(int count) {
+            [self didReceiveServerDate:[_cursors[i] serverDate]];
+            [self didFinishPartition:i];
+        };
+
+        [_cursors[i] fetch:batch completion:completion failure:[self failureBlock] queue:_queue];
+    }
+}
+
+- (void)didReceiveServerDate:(NSDate *)date
+{
+    // the bounds requests are sent first; partitions only matter without them
+    if (date && (self.serverDate == nil || [date compare:self.serverDate] == NSOrderedAscending)) {
+        self.serverDate = date;
+    }
+}
+
+- (CBNetworkingFailureBlockForJSONResponse)failureBlock
+{
+    return ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        if (self.finished) {
+            return;
+        }
+
+        CBNetworkingFailureBlockForJSONResponse failureBlock = _failure;
+        self.finished = YES;
+        [self releaseBlocks];
+
+        if (failureBlock) {
+            failureBlock(request, response, error, JSON);
+        }
+    };
+}
+
+- (void)didReceiveRecords:(NSArray *)records partition:(NSUInteger)partition
+{
+    if (self.finished) {
+        return;
+    }
+
+    if (_orderByField) {
+        [_buffers[partition] addObjectsFromArray:records];
+        [self mergePartitions];
+    }
+    else {
+        [self deliverRecords:records];
+    }
+}
+
+- (void)didFinishPartition:(NSUInteger)partition
+{
+    if (self.finished) {
+        return;
+    }
+
+    [_finishedPartitions addIndex:partition];
+    if (_orderByField) {
+        [self mergePartitions];
+    }
+
+    if (!self.finished && _finishedPartitions.count == _cursors.count) {
+        [self finishWithCompletion];
+    }
+}
+
+- (void)mergePartitions
+{
+    // k-way merge; stop as soon as an unfinished partition runs dry, its next record may come first
+    NSMutableArray *merged = [NSMutableArray array];
+    while (YES) {
+        NSInteger next = -1;
+        BOOL waiting = NO;
+        for (NSUInteger i = 0; i < _buffers.count; i++) {
+            NSMutableArray *buffer = _buffers[i];
+            if (buffer.count == 0) {
+                if (![_finishedPartitions containsIndex:i]) {
+                    waiting = YES;
+                    break;
+                }
+                continue;
+            }
+            if (next < 0 || [self compareRecord:buffer[0] toRecord:_buffers[next][0]] == NSOrderedAscending) {
+                next = i;
+            }
+        }
+        if (waiting || next < 0) {
+            break;
+        }
+
+        [merged addObject:_buffers[next][0]];
+        [_buffers[next] removeObjectAtIndex:0];
+    }
+
+    if (merged.count > 0) {
+        [self deliverRecords:merged];
+    }
+}
+
+static NSDecimalNumber *numberOfFieldValue(KintoneField *field, id value)
+{
+    switch (field.type) {
+        case KintoneNumberFieldType:
+        case KintoneCalcFieldType:
+            break;
+        case KintoneRecordNumberFieldType:
+            // the record number may be prefixed with the app code: "APP-12"
+            if ([value isKindOfClass:[NSString class]]) {
+                value = [[value componentsSeparatedByString:@"-"] lastObject];
+            }
+            break;
+
+        default:
+            // $id and $revision come with the types __ID__ and __REVISION__, which have no field type of their own
+            if (![field.code isEqualToString:RECORD_ID_CODE] && ![field.code isEqualToString:REVISION_CODE]) {
+                return nil;
+            }
+            break;
+    }
+
+    if ([value isKindOfClass:[NSNumber class]]) {
+        return [NSDecimalNumber decimalNumberWithDecimal:[value decimalValue]];
+    }
+    if (![value isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+
+    // the server returns numbers as strings
+    NSDecimalNumber *number = [NSDecimalNumber decimalNumberWithString:value locale:[NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"]];
+    return [number isEqualToNumber:[NSDecimalNumber notANumber]] ? nil : number;
+}
+
+static NSComparisonResult compareFieldValue(KintoneField *field1, KintoneField *field2)
+{
+    id value1 = field1.value;
+    id value2 = field2.value;
+
+    // empty values come first, as kintone does
+    BOOL empty1 = value1 == nil || value1 == [NSNull null] || ([value1 isKindOfClass:[NSString class]] && [value1 length] == 0);
+    BOOL empty2 = value2 == nil || value2 == [NSNull null] || ([value2 isKindOfClass:[NSString class]] && [value2 length] == 0);
+    if (empty1 || empty2) {
+        return empty1 == empty2 ? NSOrderedSame : (empty1 ? NSOrderedAscending : NSOrderedDescending);
+    }
+
+    // values of numeric fields are numeric strings, which must not be compared as strings
+    NSDecimalNumber *number1 = numberOfFieldValue(field1, value1);
+    NSDecimalNumber *number2 = numberOfFieldValue(field2, value2);
+    if (number1 && number2) {
+        return [number1 compare:number2];
+    }
+
+    if ([value1 isKindOfClass:[NSString class]] && [value2 isKindOfClass:[NSString class]]) {
+        return [value1 compare:value2];
+    }
+    if ([value1 isKindOfClass:[NSNumber class]] && [value2 isKindOfClass:[NSNumber class]]) {
+        return [value1 compare:value2];
+    }
+
+    return NSOrderedSame;
+}
+
+- (NSComparisonResult)compareRecord:(KintoneRecord *)record1 toRecord:(KintoneRecord *)record2
+{
+    NSComparisonResult result = compareFieldValue(record1.fields[_orderByField.code], record2.fields[_orderByField.code]);
+
+    return _orderByAsc ? result : (NSComparisonResult)-result;
+}
+
+- (void)deliverRecords:(NSArray *)records
+{
+    self.count += (int)records.count;
+
+    BOOL stop = NO;
+    if (_batch) {
+        _batch(records, &stop);
+    }
+    if (stop) {
+        [self cancel];
+    }
+}
+
+- (void)finishWithCompletion
+{
+    KintoneRecordCursorCompletionBlock completion = _completion;
+    self.finished = YES;
+    [self releaseBlocks];
+
+    if (completion) {
+        completion(self.count);
+    }
+}
+
+- (void)releaseBlocks
+{
+    // break retain cycles between the cursors and the caller's blocks
+    for (CBRequestHandle *handle in [_requestHandles allObjects]) {
+        [handle cancel];
+    }
+    for (KintoneRecordCursor *cursor in _cursors) {
+        [cursor cancel];
+    }
+    _cursors = nil;
+    _buffers = nil;
+    _batch = nil;
+    _completion = nil;
+    _failure = nil;
+}
+
+@end
@@ -0,0 +1,665 @@
+//
+//  KintoneRecordStore.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneRecordStore.h"
+
+#import "CBCredential.h"
+#import "CBError.h"
+#import "CBLog.h"
+#import "KintoneApplication.h"
+#import "KintoneField.h"
+#import "KintoneFormCache.h"
+#import "KintoneQuery.h"
+#import "KintoneRecord.h"
+#import "KintoneRecordIndex.h"
+#import "KintoneSite.h"
+
+NSString * const KintoneRecordStoreDidChangeNotification = @"KintoneRecordStoreDidChangeNotification";
+
+// the log is compacted when it has more than twice as many entries as records, plus this slack
+static const NSUInteger KintoneRecordStoreCompactionSlack = 1000;
+
+// an index is not used for a condition matching more than this fraction of the records; scanning them is cheaper
+static const double KintoneRecordStoreIndexMaxSelectivity = 0.3;
+
+static NSString * const KintoneRecordStoreIdKey = @"id";
+static NSString * const KintoneRecordStoreRecordKey = @"record";
+
+@interface KintoneRecordStore ()
+
+@property (nonatomic, weak, readwrite) KintoneApplication *kintoneApplication;
+
+@end
+
+@implementation KintoneRecordStore
+{
+    dispatch_queue_t _queue;        // guards the index
+    dispatch_queue_t _logQueue;     // appends to the log and compacts it, in order
+    NSMutableDictionary *_records;  // @(record id) -> record dictionary
+    NSMutableDictionary *_indexes;  // field code -> KintoneRecordIndex, maintained with _records
+    NSUInteger _logEntryCount;
+    BOOL _loaded;
+    BOOL _compactionScheduled;
+    NSString *_logPath;
+    NSFileHandle *_logHandle;       // used on _logQueue
+}
+
+- (KintoneRecordStore *)initWithKintoneApplication:(KintoneApplication *)kintoneApplication
+{
+    assert(kintoneApplication != nil);
+
+    if (self = [super init]) {
+        self.kintoneApplication = kintoneApplication;
+        _queue = dispatch_queue_create("KintoneRecordStore", DISPATCH_QUEUE_SERIAL);
+        _logQueue = dispatch_queue_create("KintoneRecordStore.log", DISPATCH_QUEUE_SERIAL);
+        _records = [NSMutableDictionary dictionary];
+        _indexes = [NSMutableDictionary dictionary];
+        _logEntryCount = 0;
+        _loaded = NO;
+        _compactionScheduled = NO;
+        _logPath = [self logPathForKintoneApplication:kintoneApplication];
+
+        // the log is parsed off the caller's thread; references before it has been loaded wait for it
+        dispatch_async(_queue, ^{
+            [self loadIfNeeded];
+        });
+    }
+
+    return self;
+}
+
+- (void)loadWithCompletion:(void (^)(void))completion
+{
+    dispatch_async(_queue, ^{
+        [self loadIfNeeded];
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), completion);
+        }
+    });
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{
+        [self loadIfNeeded];
+        count = _records.count;
+    });
+
+    return count;
+}
+
+- (KintoneRecord *)recordWithId:(int)recordId
+{
+    NSDictionary *record = [self recordDictionaryWithId:recordId];
+    return record ? [KintoneRecord kintoneRecordFromDictionary:record] : nil;
+}
+
+- (NSDictionary *)recordDictionaryWithId:(int)recordId
+{
+    __block NSDictionary *record;
+    dispatch_sync(_queue, ^{
+        [self loadIfNeeded];
+        record = _records[@(recordId)];
+    });
+
+    return record;
+}
+
+- (long long)revisionOfRecordWithId:(int)recordId
+{
+    return [self revisionOfRecord:[self recordDictionaryWithId:recordId]];
+}
+
+- (NSArray *)records
+{
+    __block NSDictionary *records;
+    dispatch_sync(_queue, ^{
+        [self loadIfNeeded];
+        records = [_records copy];
+    });
+    NSArray *recordIds = [self sortedRecordIds:[records allKeys]];
+
+    // records are decoded outside of the queue, the dictionaries are immutable
+    NSMutableArray *kintoneRecords = [NSMutableArray arrayWithCapacity:recordIds.count];
+    for (NSNumber *recordId in recordIds) {
+        [kintoneRecords addObject:[KintoneRecord kintoneRecordFromDictionary:records[recordId]]];
+    }
+
+    return kintoneRecords;
+}
+
+- (NSArray *)recordIds
+{
+    __block NSArray *recordIds;
+    dispatch_sync(_queue, ^{
+        [self loadIfNeeded];
+        recordIds = [_records allKeys];
+    });
+
+    return [self sortedRecordIds:recordIds];
+}
+
+- (NSArray *)recordsWithKintoneQuery:(KintoneQuery *)query
+{
+    if (query == nil) {
+        return [self records];
+    }
+
+    // LOGINUSER() is the user of the site
+    query = [query kintoneQueryWithLoginUser:self.kintoneApplication.kintoneSite.cbCredential.user];
+    if (query == nil) {
+        return nil;
+    }
+
+    __block NSArray *records;
+    dispatch_sync(_queue, ^{
+        [self loadIfNeeded];
+
+        NSSet *candidateIds = [self candidateIdsForWhere:[query whereClause]];
+        if (candidateIds) {
+            NSMutableArray *candidates = [NSMutableArray arrayWithCapacity:candidateIds.count];
+            for (NSNumber *recordId in candidateIds) {
+                [candidates addObject:_records[recordId]];
+            }
+            records = candidates;
+        }
+        else {
+            records = [_records allValues];
+        }
+        [CBLog sdkLogVerbose:@"record store query by %@: %lu of %lu records", (candidateIds ? @"index" : @"scan"),
+                             (unsigned long)records.count, (unsigned long)_records.count];
+    });
+
+    // the candidates are decoded outside of the queue, then evaluated, ordered and limited by the query
+    NSMutableArray *kintoneRecords = [NSMutableArray arrayWithCapacity:records.count];
+    for (NSDictionary *record in records) {
+        [kintoneRecords addObject:[KintoneRecord kintoneRecordFromDictionary:record]];
+    }
+
+    return [query filterRecords:kintoneRecords];
+}
+
+- (NSArray *)recordsWithQuery:(NSString *)query error:(CBError* __autoreleasing *)error
+{
+    NSDictionary *fields = self.kintoneApplication.formCache.fields;
+    KintoneQuery *kintoneQuery = [KintoneQuery kintoneQueryWithString:query fields:fields error:error];
+    if (kintoneQuery == nil) {
+        return nil;
+    }
+
+    NSArray *records = [self recordsWithKintoneQuery:kintoneQuery];
+    if (records == nil && error) {
+        *error = [CBError errorWithFormat:@"KintoneErrorInvalidQuery", @"LOGINUSER() without the user of the site"];
+    }
+
+    return records;
+}
+
+- (BOOL)addIndexForField:(KintoneField *)field
+{
+    if (![KintoneRecordIndex canIndexField:field]) {
+        return NO;
+    }
+
+    KintoneRecordIndex *index = [[KintoneRecordIndex alloc] initWithField:field];
+    dispatch_sync(_queue, ^{
+        // built when the log is loaded otherwise
+        if (_loaded) {
+            [index rebuildWithRecords:_records];
+        }
+        _indexes[field.code] = index;
+    });
+
+    return YES;
+}
+
+- (void)removeIndexForFieldCode:(NSString *)code
+{
+    dispatch_sync(_queue, ^{
+        [_indexes removeObjectForKey:code];
+    });
+}
+
+- (NSArray *)indexedFieldCodes
+{
+    __block NSArray *codes;
+    dispatch_sync(_queue, ^{
+        codes = [_indexes allKeys];
+    });
+
+    return codes;
+}
+
+- (void)storeRecordDictionaries:(NSArray *)records partial:(BOOL)partial
+{
+    if (records.count == 0) {
+        return;
+    }
+
+    NSMutableArray *entries = [NSMutableArray array];
+    dispatch_sync(_queue, ^{
+        [self loadIfNeeded];
+
+        for (NSDictionary *record in records) {
+            NSNumber *recordId = [self idOfRecord:record];
+            if (recordId == nil) {
+                continue;
+            }
+
+            NSDictionary *stored = _records[recordId];
+            long long revision = [self revisionOfRecord:record];
+            long long storedRevision = [self revisionOfRecord:stored];
+            if (stored && revision < storedRevision) {
+                // an older response arrived late
+                continue;
+            }
+
+            NSDictionary *newRecord;
+            if (partial) {
+                if (stored == nil) {
+                    continue;
+                }
+                if (revision < 0) {
+                    // without $revision, e.g. an $id only probe, nothing tells whether the stored record is current
+                    continue;
+                }
+                if (revision != storedRevision) {
+                    // the fields not in the response have changed too; do not keep them stale
+                    [_records removeObjectForKey:recordId];
+                    [self removeIndexedRecordWithId:recordId];
+                    [entries addObject:@{KintoneRecordStoreIdKey : recordId}];
+                    continue;
+                }
+
+                NSMutableDictionary *merged = [stored mutableCopy];
+                [merged addEntriesFromDictionary:record];
+                newRecord = [merged copy];
+            }
+            else {
+                newRecord = [record copy];
+            }
+
+            if ([newRecord isEqualToDictionary:stored]) {
+                continue;
+            }
+            _records[recordId] = newRecord;
+            [self indexRecord:newRecord forId:recordId];
+            [entries addObject:@{KintoneRecordStoreIdKey     : recordId,
+                                 KintoneRecordStoreRecordKey : newRecord}];
+        }
+
+        [self appendEntries:entries];
+    });
+
+    [self postChangeNotification:[entries valueForKey:KintoneRecordStoreIdKey]];
+}
+
+- (void)removeRecordsWithIds:(NSArray *)recordIds
+{
+    if (recordIds.count == 0) {
+        return;
+    }
+
+    NSMutableArray *entries = [NSMutableArray array];
+    dispatch_sync(_queue, ^{
+        [self loadIfNeeded];
+
+        for (id value in recordIds) {
+            NSNumber *recordId = @([value intValue]);
+            if (_records[recordId] == nil) {
+                continue;
+            }
+            [_records removeObjectForKey:recordId];
+            [self removeIndexedRecordWithId:recordId];
+            [entries addObject:@{KintoneRecordStoreIdKey : recordId}];
+        }
+
+        [self appendEntries:entries];
+    });
+
+    [self postChangeNotification:[entries valueForKey:KintoneRecordStoreIdKey]];
+}
+
+- (void)clear
+{
+    __block NSArray *recordIds;
+    dispatch_sync(_queue, ^{
+        recordIds = [_records allKeys];
+        [_records removeAllObjects];
+        for (KintoneRecordIndex *index in _indexes.objectEnumerator) {
+            [index removeAllRecords];
+        }
+        _logEntryCount = 0;
+        _loaded = YES;
+
+        dispatch_async(_logQueue, ^{
+            [self closeLog];
+            [[NSFileManager defaultManager] removeItemAtPath:_logPath error:nil];
+        });
+    });
+
+    [self postChangeNotification:recordIds];
+}
+
+#pragma mark - private
+
+- (NSString *)logPathForKintoneApplication:(KintoneApplication *)kintoneApplication
+{
+    // Caches/kintone/records/<domain>/<user>/<app id>.log
+    NSString *directory = [kintoneApplication.kintoneSite cacheDirectoryPath:@"records"];
+
+    return [directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%d.log", kintoneApplication.appId]];
+}
+
+- (NSNumber *)idOfRecord:(NSDictionary *)record
+{
+    id value = [record isKindOfClass:[NSDictionary class]] ? record[@"$id"] : nil;
+    value = [value isKindOfClass:[NSDictionary class]] ? value[@"value"] : nil;
+    if (![value respondsToSelector:@selector(intValue)]) {
+        return nil;
+    }
+
+    return @([value intValue]);
+}
+
+- (long long)revisionOfRecord:(NSDictionary *)record
+{
+    id value = [record isKindOfClass:[NSDictionary class]] ? record[@"$revision"] : nil;
+    value = [value isKindOfClass:[NSDictionary class]] ? value[@"value"] : nil;
+    if (![value respondsToSelector:@selector(longLongValue)]) {
+        return -1;
+    }
+
+    return [value longLongValue];
+}
+
+- (NSArray *)sortedRecordIds:(NSArray *)recordIds
+{
+    // newest first, as records.json returns them without an order by
+    return [recordIds sortedArrayUsingComparator:^NSComparisonResult(NSNumber *id1, NSNumber *id2) {
+        return [id2 compare:id1];
+    }];
+}
+
+- (void)postChangeNotification:(NSArray *)recordIds
+{
+    if (recordIds.count == 0) {
+        return;
+    }
+
+    dispatch_block_t post = ^{
+        [[NSNotificationCenter defaultCenter] postNotificationName:KintoneRecordStoreDidChangeNotification
+                                                            object:self
+                                                          userInfo:@{@"recordIds" : recordIds}];
+    };
+    if ([NSThread isMainThread]) {
+        post();
+    }
+    else {
+        dispatch_async(dispatch_get_main_queue(), post);
+    }
+}
+
+// called on _queue
+- (void)loadIfNeeded
+{
+    if (_loaded) {
+        return;
+    }
+    _loaded = YES;
+
+    NSData *data = [NSData dataWithContentsOfFile:_logPath options:NSDataReadingMappedIfSafe error:nil];
+    if (data == nil) {
+        return;
+    }
+
+    // one JSON object per line; later entries override earlier ones
+    const char *bytes = [data bytes];
+    NSUInteger length = [data length];
+    NSUInteger start = 0;
+    NSUInteger invalidLines = 0;
+    while (start < length) {
+        const char *newline = memchr(bytes + start, '\n', length - start);
+        if (newline == NULL) {
+            // torn by a crash while appending; compaction rewrites the log without it
+            invalidLines++;
+            break;
+        }
+        NSUInteger end = newline - bytes;
+
+        @autoreleasepool {
+            NSData *line = [data subdataWithRange:NSMakeRange(start, end - start)];
+            NSDictionary *entry = [NSJSONSerialization JSONObjectWithData:line options:0 error:nil];
+            id recordId = [entry isKindOfClass:[NSDictionary class]] ? entry[KintoneRecordStoreIdKey] : nil;
+            if ([recordId isKindOfClass:[NSNumber class]]) {
+                NSDictionary *record = entry[KintoneRecordStoreRecordKey];
+                if ([record isKindOfClass:[NSDictionary class]]) {
+                    _records[recordId] = record;
+                }
+                else {
+                    [_records removeObjectForKey:recordId];
+                }
+                _logEntryCount++;
+            }
+            else {
+                invalidLines++;
+            }
+        }
+
+        start = end + 1;
+    }
+
+    if (invalidLines > 0) {
+        [CBLog sdkLogWarn:@"skipped %lu invalid lines in record store: %@", (unsigned long)invalidLines, _logPath];
+        [self scheduleCompaction];
+    }
+
+    for (KintoneRecordIndex *index in _indexes.objectEnumerator) {
+        [index rebuildWithRecords:_records];
+    }
+}
+
+// called on _queue
+- (void)indexRecord:(NSDictionary *)record forId:(NSNumber *)recordId
+{
+    for (KintoneRecordIndex *index in _indexes.objectEnumerator) {
+        [index setRecord:record forId:recordId];
+    }
+}
+
+// called on _queue
+- (void)removeIndexedRecordWithId:(NSNumber *)recordId
+{
+    for (KintoneRecordIndex *index in _indexes.objectEnumerator) {
+        [index removeRecordWithId:recordId];
+    }
+}
+
+// called on _queue
+// record ids that may match the where clause, or nil when every record has to be scanned
+- (NSSet *)candidateIdsForWhere:(NSArray *)where
+{
+    if (where.count == 0) {
+        return nil;
+    }
+
+    id first = where[0];
+    if ([first isKindOfClass:[NSString class]] && ([first isEqualToString:@"and"] || [first isEqualToString:@"or"])) {
+        BOOL isAnd = [first isEqualToString:@"and"];
+        NSMutableArray *sets = [NSMutableArray arrayWithCapacity:where.count - 1];
+        for (NSUInteger i = 1; i < where.count; i++) {
+            NSSet *candidateIds = [self candidateIdsForWhere:where[i]];
+            if (candidateIds == nil) {
+                // a condition of "and" left to the scan only narrows the candidates further
+                if (isAnd) {
+                    continue;
+                }
+                return nil;
+            }
+            [sets addObject:candidateIds];
+        }
+        if (sets.count == 0) {
+            return nil;
+        }
+
+        // intersect from the smallest set
+        [sets sortUsingComparator:^NSComparisonResult(NSSet *set1, NSSet *set2) {
+            return [@(set1.count) compare:@(set2.count)];
+        }];
+        NSMutableSet *candidateIds = [sets[0] mutableCopy];
+        for (NSUInteger i = 1; i < sets.count; i++) {
+            if (isAnd) {
+                [candidateIds intersectSet:sets[i]];
+            }
+            else {
+                [candidateIds unionSet:sets[i]];
+            }
+        }
+        return candidateIds;
+    }
+
+    KintoneField *field = (KintoneField *)where[1];
+    KintoneRecordIndex *index = _indexes[field.code];
+    if (index == nil || index.field.type != field.type || index.isSubtableColumn) {
+        return nil;
+    }
+
+    KintoneQueryOperatorType operatorType = [where[0] intValue];
+    NSUInteger estimatedCount = [index estimatedCountOfCondition:operatorType value:where[2]];
+    if (estimatedCount == NSNotFound || estimatedCount > _records.count * KintoneRecordStoreIndexMaxSelectivity) {
+        return nil;
+    }
+
+    return [index recordIdsMatchingCondition:operatorType value:where[2]];
+}
+
+// called on _queue
+- (void)appendEntries:(NSArray *)entries
+{
+    if (entries.count == 0) {
+        return;
+    }
+
+    NSMutableData *data = [NSMutableData data];
+    for (NSDictionary *entry in entries) {
+        NSData *line = [NSJSONSerialization dataWithJSONObject:entry options:0 error:nil];
+        if (line == nil) {
+            continue;
+        }
+        // NSJSONSerialization escapes newlines in strings, so an entry is always a single line
+        [data appendData:line];
+        [data appendBytes:"\n" length:1];
+    }
+    _logEntryCount += entries.count;
+
+    dispatch_async(_logQueue, ^{
+        NSFileHandle *logHandle = [self logHandle];
+        @try {
+            [logHandle seekToEndOfFile];
+            [logHandle writeData:data];
+        }
+        @catch (NSException *exception) {
+            [CBLog sdkLogWarn:@"failed to write record store: %@ %@", _logPath, exception];
+            [self closeLog];
+        }
+    });
+
+    if (_logEntryCount > _records.count * 2 + KintoneRecordStoreCompactionSlack) {
+        [self scheduleCompaction];
+    }
+}
+
+// called on _queue
+- (void)scheduleCompaction
+{
+    if (_compactionScheduled) {
+        return;
+    }
+    _compactionScheduled = YES;
+
+    dispatch_async(_logQueue, ^{
+        // changes made after the snapshot are appended after the compacted log
+        __block NSDictionary *records;
+        dispatch_sync(_queue, ^{
+            _compactionScheduled = NO;
+            records = [_records copy];
+            _logEntryCount = records.count;
+        });
+
+        NSString *temporaryPath = [_logPath stringByAppendingPathExtension:@"tmp"];
+        [[NSFileManager defaultManager] createFileAtPath:temporaryPath contents:nil attributes:nil];
+        NSFileHandle *temporaryHandle = [NSFileHandle fileHandleForWritingAtPath:temporaryPath];
+        if (temporaryHandle == nil) {
+            [CBLog sdkLogWarn:@"failed to compact record store: %@", _logPath];
+            return;
+        }
+
+        @try {
+            NSMutableData *data = [NSMutableData data];
+            for (NSNumber *recordId in records) {
+                NSDictionary *entry = @{KintoneRecordStoreIdKey     : recordId,
+                                        KintoneRecordStoreRecordKey : records[recordId]};
+                [data appendData:[NSJSONSerialization dataWithJSONObject:entry options:0 error:nil]];
+                [data appendBytes:"\n" length:1];
+                if (data.length >= 1024 * 1024) {
+                    [temporaryHandle writeData:data];
+                    [data setLength:0];
+                }
+            }
+            [temporaryHandle writeData:data];
+            [temporaryHandle synchronizeFile];
+            [temporaryHandle closeFile];
+        }
+        @catch (NSException *exception) {
+            [CBLog sdkLogWarn:@"failed to compact record store: %@ %@", _logPath, exception];
+            [[NSFileManager defaultManager] removeItemAtPath:temporaryPath error:nil];
+            return;
+        }
+
+        [self closeLog];
+        if (rename([temporaryPath fileSystemRepresentation], [_logPath fileSystemRepresentation]) != 0) {
+            [CBLog sdkLogWarn:@"failed to compact record store: %@", _logPath];
+            [[NSFileManager defaultManager] removeItemAtPath:temporaryPath error:nil];
+        }
+    });
+}
+
+// called on _logQueue
+- (NSFileHandle *)logHandle
+{
+    if (_logHandle == nil) {
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        if (![fileManager fileExistsAtPath:_logPath]) {
+            [fileManager createDirectoryAtPath:[_logPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+            [fileManager createFileAtPath:_logPath contents:nil attributes:nil];
+        }
+        _logHandle = [NSFileHandle fileHandleForWritingAtPath:_logPath];
+    }
+
+    return _logHandle;
+}
+
+// called on _logQueue
+- (void)closeLog
+{
+    [_logHandle closeFile];
+    _logHandle = nil;
+}
+
+@end
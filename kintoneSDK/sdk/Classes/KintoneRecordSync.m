@@ -0,0 +1,474 @@
+//
+//  KintoneRecordSync.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneRecordSync.h"
+
+#import "CBLog.h"
+#import "CBRequestHandle.h"
+#import "KintoneAPI.h"
+#import "KintoneApplication.h"
+#import "KintoneChunkedRequest.h"
+#import "KintoneField.h"
+#import "KintoneFormCache.h"
+#import "KintoneQuery.h"
+#import "KintoneRecord.h"
+#import "KintoneRecordCursor.h"
+#import "KintoneRecordPartitionedCursor.h"
+#import "KintoneRecordStore.h"
+#import "KintoneSite.h"
+#import "NSDate+Utility.h"
+
+#define RECORD_ID_CODE @"$id"
+#define REVISION_CODE @"$revision"
+
+static const int KintoneRecordSyncDefaultPageSize = 500;
+static const NSTimeInterval KintoneRecordSyncDefaultDeletionScanInterval = 86400;
+static const int KintoneRecordSyncRefetchChunkSize = 100;
+static const int KintoneRecordSyncMaxConcurrentRefetches = 2;
+
+@interface KintoneRecordSync ()
+
+@property (nonatomic, weak, readwrite) KintoneApplication *kintoneApplication;
+@property (nonatomic, readwrite) NSDate *highWaterMark;
+@property (nonatomic, readwrite) NSDate *lastDeletionScanDate;
+
+@end
+
+@implementation KintoneRecordSync
+{
+    BOOL _loadedFromDisk;
+    KintoneField *_recordIdField;
+
+    CBRequestHandle *_handle;           // the sync in progress
+    NSMutableArray *_waitingBlocks;     // @[completion block, failure block] per caller
+    NSOperationQueue *_queue;
+    BOOL _deletionScan;
+    KintoneField *_updatedTimeField;    // nil: the form has no updated time field, every sync fetches all records
+    id _cursor;                         // KintoneRecordCursor or KintoneRecordPartitionedCursor in progress
+    NSMutableOrderedSet *_updatedRecordIds;
+    NSMutableArray *_deletedRecordIds;
+    NSDate *_fetchedHighWaterMark;
+    NSDate *_syncStartDate;             // server time the record fetch started at, truncated to the minute
+    NSDate *_scanStartDate;             // nil unless deleted records were detected
+}
+
+- (KintoneRecordSync *)initWithKintoneApplication:(KintoneApplication *)kintoneApplication
+{
+    assert(kintoneApplication != nil);
+
+    if (self = [super init]) {
+        self.kintoneApplication = kintoneApplication;
+        self.pageSize = KintoneRecordSyncDefaultPageSize;
+        self.deletionScanInterval = KintoneRecordSyncDefaultDeletionScanInterval;
+        _loadedFromDisk = NO;
+        _waitingBlocks = [NSMutableArray array];
+        _recordIdField = [[KintoneField alloc] initWithProperties:@{@"type" : [KintoneField fieldTypeNameForFieldType:KintoneRecordNumberFieldType],
+                                                                    @"code" : RECORD_ID_CODE}];
+    }
+
+    return self;
+}
+
+- (NSDate *)highWaterMark
+{
+    [self loadFromDiskIfNeeded];
+
+    return _highWaterMark;
+}
+
+- (NSDate *)lastDeletionScanDate
+{
+    [self loadFromDiskIfNeeded];
+
+    return _lastDeletionScanDate;
+}
+
+- (BOOL)isSyncing
+{
+    return _handle != nil;
+}
+
+- (CBRequestHandle *)sync:(KintoneRecordSyncCompletionBlock)completion
+                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                    queue:(NSOperationQueue *)queue
+{
+    return [self syncWithDeletionScan:NO completion:completion failure:failure queue:queue];
+}
+
+- (CBRequestHandle *)syncWithDeletionScan:(BOOL)deletionScan
+                               completion:(KintoneRecordSyncCompletionBlock)completion
+                                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                    queue:(NSOperationQueue *)queue
+{
+    [_waitingBlocks addObject:@[completion ? [completion copy] : [NSNull null], failure ? [failure copy] : [NSNull null]]];
+    if (_handle) {
+        // join the sync in progress
+        _deletionScan = _deletionScan || deletionScan;
+        return _handle;
+    }
+
+    NSDate *lastDeletionScanDate = self.lastDeletionScanDate;
+    CBRequestHandle *handle = [CBRequestHandle new];
+    _handle = handle;
+    _queue = queue;
+    _deletionScan = deletionScan || lastDeletionScanDate == nil || -[lastDeletionScanDate timeIntervalSinceNow] >= self.deletionScanInterval;
+    _updatedRecordIds = [NSMutableOrderedSet orderedSet];
+    _deletedRecordIds = [NSMutableArray array];
+    _fetchedHighWaterMark = nil;
+    _syncStartDate = nil;
+    _scanStartDate = nil;
+
+    [handle addCancellationHandler:^{
+        [self failWithRequest:nil response:nil error:[CBRequestHandle cancelledError] JSON:nil];
+    }];
+
+    // the updated time field has a code of the app's own
+    KintoneFormCacheFieldsBlock fields = ^(NSDictionary *fields, id formJSON) {
+        if (_handle != handle) {
+            return;
+        }
+
+        _updatedTimeField = nil;
+        for (KintoneField *field in [fields allValues]) {
+            if (field.type == KintoneUpdatedTimeFieldType) {
+                _updatedTimeField = field;
+                break;
+            }
+        }
+
+        [self fetchUpdatedRecords];
+    };
+    [self.kintoneApplication.formCache fields:fields failure:[self failureBlock] queue:queue];
+
+    return handle;
+}
+
+- (void)reset
+{
+    _highWaterMark = nil;
+    _lastDeletionScanDate = nil;
+    _loadedFromDisk = YES;
+
+    [[NSFileManager defaultManager] removeItemAtPath:[self statePath] error:nil];
+}
+
+#pragma mark - private
+
+- (void)fetchUpdatedRecords
+{
+    NSDate *highWaterMark = self.highWaterMark;
+    if (_updatedTimeField == nil || highWaterMark == nil || self.kintoneApplication.recordStore.count == 0) {
+        [self fetchAllRecords];
+        return;
+    }
+
+    // ordered by id, records updated during the sync keep their places in the pages
+    KintoneQuery *query = [KintoneQuery new];
+    [query where:[query greaterThanOrEqual:_updatedTimeField value:highWaterMark]];
+    [query orderBy:_recordIdField asc:YES];
+
+    KintoneRecordCursor *cursor = [self.kintoneApplication.kintoneAPI recordCursorWithFields:nil kintoneQuery:query];
+    cursor.pageSize = self.pageSize;
+    _cursor = cursor;
+
+    NSDate *localStartDate = [NSDate date];
+    KintoneRecordCursorCompletionBlock completion = ^(int count) {
+        [self setSyncStartDate:[_cursor serverDate] localStartDate:localStartDate];
+        _cursor = nil;
+        if (_deletionScan) {
+            [self scanRecordIds];
+        }
+        else {
+            [self finishWithCompletion];
+        }
+    };
+    [cursor fetch:[self batchBlock] completion:completion failure:[self failureBlock] queue:_queue];
+}
+
+- (void)fetchAllRecords
+{
+    // every record is fetched, so the ones not fetched have been deleted
+    KintoneRecordStore *recordStore = self.kintoneApplication.recordStore;
+    NSSet *storedRecordIds = [NSSet setWithArray:[recordStore recordIds]];
+    NSDate *scanStartDate = [NSDate date];
+
+    KintoneRecordPartitionedCursor *cursor = [self.kintoneApplication.kintoneAPI recordPartitionedCursorWithFields:nil kintoneQuery:nil];
+    cursor.pageSize = self.pageSize;
+    _cursor = cursor;
+
+    KintoneRecordCursorCompletionBlock completion = ^(int count) {
+        [self setSyncStartDate:[_cursor serverDate] localStartDate:scanStartDate];
+        _cursor = nil;
+        NSMutableSet *deletedRecordIds = [storedRecordIds mutableCopy];
+        [deletedRecordIds minusSet:[_updatedRecordIds set]];
+        [self removeDeletedRecords:[deletedRecordIds allObjects]];
+
+        _scanStartDate = scanStartDate;
+        [self finishWithCompletion];
+    };
+    [cursor fetch:[self batchBlock] completion:completion failure:[self failureBlock] queue:_queue];
+}
+
+- (void)scanRecordIds
+{
+    KintoneRecordStore *recordStore = self.kintoneApplication.recordStore;
+    NSSet *storedRecordIds = [NSSet setWithArray:[recordStore recordIds]];
+    NSDate *scanStartDate = [NSDate date];
+
+    // the store drops a record whose revision differs from the scanned one
+    KintoneField *revisionField = [[KintoneField alloc] initWithProperties:@{@"type" : @"__REVISION__",
+                                                                             @"code" : REVISION_CODE}];
+    KintoneRecordPartitionedCursor *cursor = [self.kintoneApplication.kintoneAPI recordPartitionedCursorWithFields:@[_recordIdField, revisionField] kintoneQuery:nil];
+    cursor.pageSize = self.pageSize;
+    _cursor = cursor;
+
+    NSMutableSet *scannedRecordIds = [NSMutableSet setWithCapacity:storedRecordIds.count];
+    NSMutableArray *missingRecordIds = [NSMutableArray array];
+    KintoneRecordCursorBatchBlock batch = ^(NSArray *records, BOOL *stop) {
+        for (KintoneRecord *record in records) {
+            NSNumber *recordId = [self recordIdOfRecord:record];
+            if (recordId == nil) {
+                continue;
+            }
+            [scannedRecordIds addObject:recordId];
+            if ([recordStore revisionOfRecordWithId:[recordId intValue]] < 0) {
+                [missingRecordIds addObject:recordId];
+            }
+        }
+    };
+    KintoneRecordCursorCompletionBlock completion = ^(int count) {
+        _cursor = nil;
+        NSMutableSet *deletedRecordIds = [storedRecordIds mutableCopy];
+        [deletedRecordIds minusSet:scannedRecordIds];
+        [self removeDeletedRecords:[deletedRecordIds allObjects]];
+
+        _scanStartDate = scanStartDate;
+        [self refetchRecords:missingRecordIds];
+    };
+    [cursor fetch:batch completion:completion failure:[self failureBlock] queue:_queue];
+}
+
+- (void)refetchRecords:(NSArray *)recordIds
+{
+    // changed records missed by the updated time, and records dropped from the store
+    KintoneChunkedRequestSendBlock send = ^(NSArray *chunk, CBNetworkingSuccessBlockForJSONResponse chunkSuccess, CBNetworkingFailureBlockForJSONResponse chunkFailure) {
+        KintoneQuery *query = [KintoneQuery new];
+        [query where:[query in:_recordIdField value:chunk]];
+        [query limit:(int)chunk.count];
+
+        CBNetworkingSuccessBlockForJSONResponse success = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+            for (KintoneRecord *record in [KintoneRecord kintoneRecordsFromJSON:JSON]) {
+                [self didFetchRecord:record];
+            }
+            chunkSuccess(request, response, JSON);
+        };
+        return [self.kintoneApplication.kintoneAPI records:nil query:query.kintoneQuery success:success failure:chunkFailure queue:_queue];
+    };
+
+    CBNetworkingSuccessBlockForJSONResponse success = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        [self finishWithCompletion];
+    };
+    CBNetworkingFailureBlockForJSONResponse failure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        [self failWithRequest:request response:response error:error JSON:JSON];
+    };
+
+    KintoneChunkedRequest *chunkedRequest = [[KintoneChunkedRequest alloc] initWithItems:recordIds chunkSize:KintoneRecordSyncRefetchChunkSize maxConcurrentChunks:KintoneRecordSyncMaxConcurrentRefetches];
+    [_handle addChild:[chunkedRequest send:send success:success failure:failure]];
+}
+
+- (void)removeDeletedRecords:(NSArray *)recordIds
+{
+    [self.kintoneApplication.recordStore removeRecordsWithIds:recordIds];
+    [_deletedRecordIds addObjectsFromArray:recordIds];
+}
+
+- (KintoneRecordCursorBatchBlock)batchBlock
+{
+    // the records are already stored by KintoneAPI
+    return ^(NSArray *records, BOOL *stop) {
+        for (KintoneRecord *record in records) {
+            [self didFetchRecord:record];
+        }
+    };
+}
+
+- (void)didFetchRecord:(KintoneRecord *)record
+{
+    NSNumber *recordId = [self recordIdOfRecord:record];
+    if (recordId) {
+        [_updatedRecordIds addObject:recordId];
+    }
+
+    id updatedTime = _updatedTimeField ? [record.fields[_updatedTimeField.code] value] : nil;
+    if (![updatedTime isKindOfClass:[NSString class]]) {
+        return;
+    }
+    NSDate *updatedDate = [NSDate dateFromRFC3339:updatedTime];
+    if (updatedDate && (_fetchedHighWaterMark == nil || [updatedDate compare:_fetchedHighWaterMark] == NSOrderedDescending)) {
+        _fetchedHighWaterMark = updatedDate;
+    }
+}
+
+- (void)setSyncStartDate:(NSDate *)serverDate localStartDate:(NSDate *)localStartDate
+{
+    // the server clock decides the updated times; the device clock is only a fallback without a Date header
+    NSDate *date = serverDate ? serverDate : localStartDate;
+    NSTimeInterval minutes = floor([date timeIntervalSince1970] / 60);
+    _syncStartDate = [NSDate dateWithTimeIntervalSince1970:minutes * 60];
+}
+
+- (NSNumber *)recordIdOfRecord:(KintoneRecord *)record
+{
+    id value = [record.fields[RECORD_ID_CODE] value];
+    if (![value respondsToSelector:@selector(intValue)]) {
+        return nil;
+    }
+
+    return @([value intValue]);
+}
+
+- (CBNetworkingFailureBlockForJSONResponse)failureBlock
+{
+    CBRequestHandle *handle = _handle;
+    return ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+        if (_handle == handle) {
+            [self failWithRequest:request response:response error:error JSON:JSON];
+        }
+    };
+}
+
+- (void)finishWithCompletion
+{
+    if (_handle == nil) {
+        return;
+    }
+
+    // the updated times are in minutes; the next sync fetches the last minute again.
+    // pages passed by a record updated during the sync don't return it, so the mark stays at the start of the fetch
+    NSDate *fetchedHighWaterMark = _fetchedHighWaterMark;
+    if (fetchedHighWaterMark && _syncStartDate && [fetchedHighWaterMark compare:_syncStartDate] == NSOrderedDescending) {
+        fetchedHighWaterMark = _syncStartDate;
+    }
+    NSDate *highWaterMark = self.highWaterMark;
+    if (fetchedHighWaterMark && (highWaterMark == nil || [fetchedHighWaterMark compare:highWaterMark] == NSOrderedDescending)) {
+        self.highWaterMark = fetchedHighWaterMark;
+    }
+    if (_scanStartDate) {
+        self.lastDeletionScanDate = _scanStartDate;
+    }
+    [self saveToDisk];
+
+    NSArray *updatedRecordIds = [_updatedRecordIds array];
+    NSArray *deletedRecordIds = [_deletedRecordIds copy];
+    NSArray *waitingBlocks = [_waitingBlocks copy];
+    CBRequestHandle *handle = _handle;
+    [self releaseState];
+
+    for (NSArray *blocks in waitingBlocks) {
+        if (blocks[0] != [NSNull null]) {
+            ((KintoneRecordSyncCompletionBlock)blocks[0])(updatedRecordIds, deletedRecordIds);
+        }
+    }
+    [handle finish];
+}
+
+- (void)failWithRequest:(NSURLRequest *)request response:(NSHTTPURLResponse *)response error:(CBError *)error JSON:(id)JSON
+{
+    if (_handle == nil) {
+        return;
+    }
+
+    // the high-water mark is kept; the records fetched so far stay in the store
+    [_cursor cancel];
+
+    NSArray *waitingBlocks = [_waitingBlocks copy];
+    CBRequestHandle *handle = _handle;
+    [self releaseState];
+
+    for (NSArray *blocks in waitingBlocks) {
+        if (blocks[1] != [NSNull null]) {
+            ((CBNetworkingFailureBlockForJSONResponse)blocks[1])(request, response, error, JSON);
+        }
+    }
+    [handle finish];
+}
+
+- (void)releaseState
+{
+    // break the retain cycle between the handle and the cancellation handler
+    _handle = nil;
+    _cursor = nil;
+    _queue = nil;
+    [_waitingBlocks removeAllObjects];
+    _updatedRecordIds = nil;
+    _deletedRecordIds = nil;
+}
+
+- (NSString *)statePath
+{
+    // Caches/kintone/records/<domain>/<user>/<app id>.sync.json, next to the log of the record store
+    NSString *directory = [self.kintoneApplication.kintoneSite cacheDirectoryPath:@"records"];
+
+    return [directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%d.sync.json", self.kintoneApplication.appId]];
+}
+
+- (void)loadFromDiskIfNeeded
+{
+    if (_loadedFromDisk) {
+        return;
+    }
+    _loadedFromDisk = YES;
+
+    NSData *data = [NSData dataWithContentsOfFile:[self statePath]];
+    if (data == nil) {
+        return;
+    }
+
+    NSDictionary *state = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    if (![state isKindOfClass:[NSDictionary class]]) {
+        [CBLog sdkLogWarn:@"invalid sync state: %@", [self statePath]];
+        return;
+    }
+
+    if ([state[@"highWaterMark"] isKindOfClass:[NSString class]]) {
+        _highWaterMark = [NSDate dateFromRFC3339:state[@"highWaterMark"]];
+    }
+    if ([state[@"lastDeletionScan"] isKindOfClass:[NSNumber class]]) {
+        _lastDeletionScanDate = [NSDate dateWithTimeIntervalSince1970:[state[@"lastDeletionScan"] doubleValue]];
+    }
+}
+
+- (void)saveToDisk
+{
+    NSMutableDictionary *state = [NSMutableDictionary dictionary];
+    if (self.highWaterMark) {
+        state[@"highWaterMark"] = [NSDate rfc3339StringFromDate:self.highWaterMark];
+    }
+    if (self.lastDeletionScanDate) {
+        state[@"lastDeletionScan"] = @([self.lastDeletionScanDate timeIntervalSince1970]);
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:state options:0 error:nil];
+
+    NSString *path = [self statePath];
+    [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (![data writeToFile:path atomically:YES]) {
+        [CBLog sdkLogWarn:@"failed to write sync state: %@", path];
+    }
+}
+
+@end
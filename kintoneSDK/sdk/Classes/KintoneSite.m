@@ -18,8 +18,12 @@
 
 #import "KintoneSite.h"
 
+#import <CommonCrypto/CommonDigest.h>
 #import "CBCredential.h"
 #import "KintoneApplication.h"
+#import "KintoneFileCache.h"
+#import "KintoneUploadCache.h"
+#import "NSString+Utility.h"
 
 @implementation KintoneSite
 {
@@ -27,6 +31,8 @@
 }
 
 @synthesize cbCredential;
+@synthesize fileCache = _fileCache;
+@synthesize uploadCache = _uploadCache;
 
 - (KintoneSite *)initWithCredential:(CBCredential *)credential
 {
@@ -40,6 +46,29 @@
     return self;
 }
 
+- (KintoneFileCache *)fileCache
+{
+    @synchronized(self) {
+        if (_fileCache == nil) {
+            NSString *directory = [self cacheDirectoryPath:@"files"];
+            _fileCache = [[KintoneFileCache alloc] initWithDirectoryURL:[NSURL fileURLWithPath:directory]];
+        }
+
+        return _fileCache;
+    }
+}
+
+- (KintoneUploadCache *)uploadCache
+{
+    @synchronized(self) {
+        if (_uploadCache == nil) {
+            _uploadCache = [KintoneUploadCache new];
+        }
+
+        return _uploadCache;
+    }
+}
+
 - (KintoneApplication *)kintoneApplication:(int)appId
 {
     assert(appId >= 0);
@@ -55,4 +84,18 @@
     return kintoneApplication;
 }
 
+- (NSString *)cacheDirectoryPath:(NSString *)name
+{
+    // Caches/kintone/<name>/<domain>/<SHA-256 of the user>; the login name itself is not written to the disk
+    NSData *user = [self.cbCredential.user ?: @"" dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256([user bytes], (CC_LONG)[user length], digest);
+
+    NSString *cachesPath = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES)[0];
+    NSString *directory = [[cachesPath stringByAppendingPathComponent:@"kintone"] stringByAppendingPathComponent:name];
+    directory = [directory stringByAppendingPathComponent:self.cbCredential.domain];
+
+    return [directory stringByAppendingPathComponent:[NSString hexStringWithBytes:digest length:CC_SHA256_DIGEST_LENGTH]];
+}
+
 @end
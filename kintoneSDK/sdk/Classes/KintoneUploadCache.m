@@ -0,0 +1,195 @@
+//
+//  KintoneUploadCache.m
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import "KintoneUploadCache.h"
+
+static const NSTimeInterval KintoneUploadCacheDefaultTimeToLive = 3600;
+static const NSUInteger KintoneUploadCacheDefaultMaxCount = 1000;
+
+static NSString * const KintoneUploadCacheFileKeyKey = @"fileKey";
+static NSString * const KintoneUploadCacheHashKey = @"hash";
+static NSString * const KintoneUploadCacheDateKey = @"date";
+static NSString * const KintoneUploadCacheSizeKey = @"size";
+static NSString * const KintoneUploadCacheModificationDateKey = @"modificationDate";
+
+@implementation KintoneUploadCache
+{
+    NSMutableDictionary *_fileKeys;     // hash -> {fileKey, date}
+    NSMutableDictionary *_files;        // path -> {hash, size, modificationDate}
+    NSMapTable *_data;                  // NSData, weak and by identity -> hash
+}
+
+- (KintoneUploadCache *)init
+{
+    if (self = [super init]) {
+        _timeToLive = KintoneUploadCacheDefaultTimeToLive;
+        _maxCount = KintoneUploadCacheDefaultMaxCount;
+        _fileKeys = [NSMutableDictionary dictionary];
+        _files = [NSMutableDictionary dictionary];
+        _data = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                      valueOptions:NSPointerFunctionsStrongMemory];
+    }
+
+    return self;
+}
+
+- (NSString *)fileKeyForHash:(NSString *)hash
+{
+    if (hash == nil) {
+        return nil;
+    }
+
+    @synchronized(self) {
+        NSDictionary *entry = _fileKeys[hash];
+        if (entry == nil) {
+            return nil;
+        }
+
+        if ([entry[KintoneUploadCacheDateKey] timeIntervalSinceNow] < -self.timeToLive) {
+            // the fileKey may no longer be valid on the server
+            [_fileKeys removeObjectForKey:hash];
+            return nil;
+        }
+
+        return entry[KintoneUploadCacheFileKeyKey];
+    }
+}
+
+- (NSString *)fileKeyForFileAtURL:(NSURL *)fileURL
+{
+    NSString *path = [fileURL path];
+    if (path == nil) {
+        return nil;
+    }
+
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+    NSString *hash = nil;
+    @synchronized(self) {
+        NSDictionary *file = _files[path];
+        if (![file[KintoneUploadCacheSizeKey] isEqual:attributes[NSFileSize]] ||
+            ![file[KintoneUploadCacheModificationDateKey] isEqual:attributes[NSFileModificationDate]]) {
+            // the file has been changed since it was uploaded
+            [_files removeObjectForKey:path];
+            return nil;
+        }
+        hash = file[KintoneUploadCacheHashKey];
+    }
+
+    return [self fileKeyForHash:hash];
+}
+
+- (NSString *)fileKeyForData:(NSData *)data
+{
+    if (data == nil) {
+        return nil;
+    }
+
+    NSString *hash = nil;
+    @synchronized(self) {
+        hash = [_data objectForKey:data];
+    }
+
+    return [self fileKeyForHash:hash];
+}
+
+- (void)setFileKey:(NSString *)fileKey forHash:(NSString *)hash fileURL:(NSURL *)fileURL
+{
+    assert(fileKey != nil && hash != nil);
+
+    NSDictionary *attributes = fileURL ? [[NSFileManager defaultManager] attributesOfItemAtPath:[fileURL path] error:nil] : nil;
+    @synchronized(self) {
+        _fileKeys[hash] = @{KintoneUploadCacheFileKeyKey : fileKey, KintoneUploadCacheDateKey : [NSDate date]};
+        if (attributes[NSFileSize] != nil && attributes[NSFileModificationDate] != nil) {
+            _files[[fileURL path]] = @{KintoneUploadCacheHashKey : hash,
+                                      KintoneUploadCacheSizeKey : attributes[NSFileSize],
+                                      KintoneUploadCacheModificationDateKey : attributes[NSFileModificationDate]};
+        }
+        [self prune];
+    }
+}
+
+- (void)setFileKey:(NSString *)fileKey forHash:(NSString *)hash data:(NSData *)data
+{
+    assert(fileKey != nil && hash != nil);
+
+    @synchronized(self) {
+        _fileKeys[hash] = @{KintoneUploadCacheFileKeyKey : fileKey, KintoneUploadCacheDateKey : [NSDate date]};
+        if (data != nil && ![data isKindOfClass:[NSMutableData class]]) {
+            // immutable data keeps its content, so the same object is the same file
+            [_data setObject:hash forKey:data];
+        }
+        [self prune];
+    }
+}
+
+- (void)removeFileKey:(NSString *)fileKey
+{
+    @synchronized(self) {
+        for (NSString *hash in [_fileKeys allKeys]) {
+            if ([_fileKeys[hash][KintoneUploadCacheFileKeyKey] isEqualToString:fileKey]) {
+                [_fileKeys removeObjectForKey:hash];
+            }
+        }
+    }
+}
+
+- (void)clear
+{
+    @synchronized(self) {
+        [_fileKeys removeAllObjects];
+        [_files removeAllObjects];
+        [_data removeAllObjects];
+    }
+}
+
+#pragma mark - private
+
+// called in @synchronized(self)
+- (void)prune
+{
+    // expired fileKeys are dropped, then the oldest ones beyond maxCount
+    NSMutableArray *hashes = [NSMutableArray arrayWithCapacity:_fileKeys.count];
+    for (NSString *hash in [_fileKeys allKeys]) {
+        if ([_fileKeys[hash][KintoneUploadCacheDateKey] timeIntervalSinceNow] < -self.timeToLive) {
+            [_fileKeys removeObjectForKey:hash];
+        }
+        else {
+            [hashes addObject:hash];
+        }
+    }
+    if (hashes.count > self.maxCount) {
+        [hashes sortUsingComparator:^NSComparisonResult(NSString *hash1, NSString *hash2) {
+            return [_fileKeys[hash1][KintoneUploadCacheDateKey] compare:_fileKeys[hash2][KintoneUploadCacheDateKey]];
+        }];
+        [_fileKeys removeObjectsForKeys:[hashes subarrayWithRange:NSMakeRange(0, hashes.count - self.maxCount)]];
+    }
+
+    // a file is only remembered for its fileKey
+    for (NSString *path in [_files allKeys]) {
+        if (_fileKeys[_files[path][KintoneUploadCacheHashKey]] == nil) {
+            [_files removeObjectForKey:path];
+        }
+    }
+    for (NSData *data in [[_data keyEnumerator] allObjects]) {
+        if (_fileKeys[[_data objectForKey:data]] == nil) {
+            [_data removeObjectForKey:data];
+        }
+    }
+}
+
+@end
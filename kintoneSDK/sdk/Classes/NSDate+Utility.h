@@ -21,8 +21,12 @@
 @interface NSDate (Utility)
 
 + (NSDate *)dateFromRFC3339:(NSString *)rfc3339DateTimeString;
++ (NSDate *)dateFromDateString:(NSString *)dateString;
++ (NSDate *)dateFromTimeString:(NSString *)timeString;
++ (NSDate *)dateFromHTTPDate:(NSString *)httpDateString;
 + (NSString *)rfc3339StringFromDate:(NSDate *)date;
 + (NSString *)dateStringFromDate:(NSDate *)date;
++ (NSString *)localDateStringFromDate:(NSDate *)date;
 + (NSString *)timeStringFromDate:(NSDate *)date;
 
 @end
@@ -34,6 +34,20 @@ static NSDateFormatter *sRFC3339DateFormatter()
     return formatter;
 }
 
+static NSDateFormatter *sRFC3339OffsetDateFormatter()
+{
+    static NSDateFormatter *formatter = nil;
+    if (formatter == nil) {
+        formatter = [NSDateFormatter new];
+        [formatter setTimeStyle:NSDateFormatterFullStyle];
+        [formatter setCalendar:[[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar]];
+        [formatter setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ssZZZZZ"];
+        [formatter setTimeZone:[NSTimeZone timeZoneWithName:@"UTC"]];
+    }
+    
+    return formatter;
+}
+
 static NSDateFormatter *sDateFormatter()
 {
     static NSDateFormatter *formatter = nil;
@@ -48,6 +62,19 @@ static NSDateFormatter *sDateFormatter()
     return formatter;
 }
 
+static NSDateFormatter *sLocalDateFormatter()
+{
+    static NSDateFormatter *formatter = nil;
+    if (formatter == nil) {
+        formatter = [NSDateFormatter new];
+        [formatter setTimeStyle:NSDateFormatterFullStyle];
+        [formatter setCalendar:[[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar]];
+        [formatter setDateFormat:@"yyyy'-'MM'-'dd"];
+    }
+    
+    return formatter;
+}
+
 static NSDateFormatter *sTimeFormatter()
 {
     static NSDateFormatter *formatter = nil;
@@ -62,6 +89,20 @@ static NSDateFormatter *sTimeFormatter()
     return formatter;
 }
 
+static NSDateFormatter *sHTTPDateFormatter()
+{
+    static NSDateFormatter *formatter = nil;
+    if (formatter == nil) {
+        formatter = [NSDateFormatter new];
+        [formatter setLocale:[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"]];
+        [formatter setCalendar:[[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar]];
+        [formatter setDateFormat:@"EEE',' dd MMM yyyy HH':'mm':'ss 'GMT'"];
+        [formatter setTimeZone:[NSTimeZone timeZoneWithName:@"UTC"]];
+    }
+
+    return formatter;
+}
+
 + (NSDate *)dateFromRFC3339:(NSString *)rfc3339DateTimeString
 {
     // See https://developer.apple.com/library/mac/#documentation/Cocoa/Conceptual/DataFormatting/Articles/dfDateFormatting10_4.html
@@ -80,7 +121,29 @@ static NSDateFormatter *sTimeFormatter()
      */
     
     // Convert the RFC 3339 date time string to an NSDate.
-    return [sRFC3339DateFormatter() dateFromString:rfc3339DateTimeString];
+    NSDate *date = [sRFC3339DateFormatter() dateFromString:rfc3339DateTimeString];
+    if (date == nil) {
+        // queries may have a time zone offset such as "+09:00"
+        date = [sRFC3339OffsetDateFormatter() dateFromString:rfc3339DateTimeString];
+    }
+
+    return date;
+}
+
++ (NSDate *)dateFromDateString:(NSString *)dateString
+{
+    return [sDateFormatter() dateFromString:dateString];
+}
+
++ (NSDate *)dateFromTimeString:(NSString *)timeString
+{
+    return [sTimeFormatter() dateFromString:timeString];
+}
+
++ (NSDate *)dateFromHTTPDate:(NSString *)httpDateString
+{
+    // the Date header of a response, e.g. "Tue, 15 Nov 1994 08:12:31 GMT"
+    return [sHTTPDateFormatter() dateFromString:httpDateString];
 }
 
 + (NSString *)rfc3339StringFromDate:(NSDate *)date
@@ -93,6 +156,12 @@ static NSDateFormatter *sTimeFormatter()
     return [sDateFormatter() stringFromDate:date];
 }
 
++ (NSString *)localDateStringFromDate:(NSDate *)date
+{
+    // the date in the time zone of the device
+    return [sLocalDateFormatter() stringFromDate:date];
+}
+
 + (NSString *)timeStringFromDate:(NSDate *)date
 {
     return [sTimeFormatter() stringFromDate:date];
@@ -22,4 +22,7 @@
 
 + (BOOL)isNilOrEmpty:(NSString *)string;
 
+// lowercase hexadecimal digits of the bytes, e.g. of a digest
++ (NSString *)hexStringWithBytes:(const unsigned char *)bytes length:(NSUInteger)length;
+
 @end
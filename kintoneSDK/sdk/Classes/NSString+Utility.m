@@ -28,4 +28,14 @@
     return NO;
 }
 
++ (NSString *)hexStringWithBytes:(const unsigned char *)bytes length:(NSUInteger)length
+{
+    NSMutableString *string = [NSMutableString stringWithCapacity:length * 2];
+    for (NSUInteger i = 0; i < length; i++) {
+        [string appendFormat:@"%02x", bytes[i]];
+    }
+
+    return string;
+}
+
 @end
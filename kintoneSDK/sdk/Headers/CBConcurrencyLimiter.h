@@ -0,0 +1,130 @@
+//
+//  CBConcurrencyLimiter.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ ドメイン毎の同時リクエスト数を、サーバの応答に応じて自動調整するクラスです。
+
+ `CBNetworking` は送信するリクエストをドメイン毎の `CBConcurrencyLimiter` で制限します。送信枠はリクエストが `NSOperationQueue` から開始された時点で要求され、同時リクエスト数が `currentLimit` に達している場合は、先に送信したリクエストの完了を待ちます。待機中のリクエストも `cancelAllOperations` 等でキャンセルできます。
+
+ `currentLimit` は AIMD (加算増加/乗算減少) により調整されます。
+
+ - 上限まで使い切った状態でリクエストが成功すると、1 往復あたり 1 ずつ増加します。
+ - レスポンスステータスが 429 もしくは 503 の場合は半分に減少します。
+ - レスポンス時間が最短のレスポンス時間の `latencyTolerance` 倍を超える場合は増加を止め、1 割減少します。
+
+ レスポンス時間は、送信枠を確保して接続を開始してからレスポンスヘッダを受信するまでの時間です。キューでの待ち時間やレスポンスボディの受信時間は含みません。
+
+ 減少は 1 往復の時間内に 1 度までです。
+
+ 例:
+
+    CBConcurrencyLimiter *limiter = [CBConcurrencyLimiter limiterForDomain:credential.domain];
+    limiter.maxLimit = 8;
+    [CBLog logInfo:@"limit: %d, in flight: %d", limiter.currentLimit, limiter.inFlightCount];
+ */
+@interface CBConcurrencyLimiter : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ 同時リクエスト数の下限です。デフォルトは 1 です。
+ */
+@property (nonatomic) int minLimit;
+
+/**
+ 同時リクエスト数の上限です。デフォルトは 16 です。
+ */
+@property (nonatomic) int maxLimit;
+
+/**
+ 増加を止めるレスポンス時間の倍率です。デフォルトは 2.0 です。
+ */
+@property (nonatomic) double latencyTolerance;
+
+/**
+ 現在の同時リクエスト数の上限です。初期値は 4 です。
+ */
+@property (nonatomic, readonly) int currentLimit;
+
+/**
+ 送信中のリクエスト数です。
+ */
+@property (nonatomic, readonly) int inFlightCount;
+
+/**
+ 送信を待っているリクエスト数です。
+ */
+@property (nonatomic, readonly) int waitingCount;
+
+/**
+ 成功レスポンスのレスポンス時間(秒)の移動平均です。
+ */
+@property (nonatomic, readonly) NSTimeInterval latency;
+
+/// ---------------------------------
+/// @name インスタンス取得
+/// ---------------------------------
+
+/**
+ ドメインの `CBConcurrencyLimiter` を返します。
+
+ @param domain ドメイン。例: `example.cybozu.com`
+
+ @return ドメイン毎にシングルトンの `CBConcurrencyLimiter`
+ */
++ (CBConcurrencyLimiter *)limiterForDomain:(NSString *)domain;
+
+/// ---------------------------------
+/// @name リクエストの制限
+/// ---------------------------------
+
+/**
+ リクエストの送信枠を要求します。
+
+ 送信枠が空いている場合は granted Block を直ちに、それ以外の場合は他のリクエストの完了時に実行します。
+
+ @param granted 送信枠を確保した時点で実行される Block
+
+ @return `finish:statusCode:` に渡すトークン
+ */
+- (id)acquire:(void (^)(void))granted;
+
+/**
+ レスポンスの受信を通知します。
+
+ 送信枠を確保してからこの時点までをレスポンス時間とします。通知されなかった場合は `finish:statusCode:` までをレスポンス時間とします。
+
+ @param token `acquire:` が返したトークン
+ */
+- (void)didReceiveResponse:(id)token;
+
+/**
+ リクエストの完了を通知し、送信枠を解放します。
+
+ 送信枠を確保する前に呼ばれた場合は、要求を取り消します。
+
+ @param token `acquire:` が返したトークン
+ @param statusCode レスポンスステータス。通信エラーの場合は 0
+ */
+- (void)finish:(id)token statusCode:(NSInteger)statusCode;
+
+@end
@@ -0,0 +1,89 @@
+//
+//  CBKeyedOperationQueue.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "CBOperationQueue.h"
+
+/**
+ 同じキーの operation を追加した順に 1 つずつ実行し、異なるキーの operation を並行に実行する `NSOperationQueue` です。
+
+ `[CBOperationQueue sharedNonConcurrentQueue]` は全ての operation を直列に実行するため、複数の kintone アプリを同期するような場合に、関係のない operation の完了まで待つことになります。`CBKeyedOperationQueue` では、kintone アプリやレコード等のキー毎に順序を保証しながら、異なるキーの operation を同時に実行できます。
+
+ `queueForKey:` が返す queue に追加した operation は、同じキーの直前の operation の完了後に、この queue で実行されます。キー毎の queue の `cancelAllOperations` は、そのキーの operation のみをキャンセルします。
+
+ 親のキーを指定したキー (子のキー) の operation は、先に親のキーに追加された operation の完了も待ちます。親のキーの operation は、先に子のキーに追加された operation の完了を待ちます。子のキー同士は並行に実行されます。kintone アプリをキーとする一括更新と、レコードをキーとする更新の順序の保証に利用されます。
+
+ `[KintoneApplication defaultQueue]`, `[KintoneApplication queueForRecord:]` は `sharedQueue` のキー毎の queue です。
+
+ 例:
+
+    // the update is sent after the insert has completed, while other apps are synced in parallel
+    NSOperationQueue *queue = kintoneApplication.defaultQueue;
+    [kintoneApplication.kintoneAPI insert:fieldJSON success:success failure:failure queue:queue];
+    [kintoneApplication.kintoneAPI update:recordId fieldJSON:otherFieldJSON success:success failure:failure queue:queue];
+ */
+@interface CBKeyedOperationQueue : CBOperationQueue
+
+/**
+ シングルトンの `CBKeyedOperationQueue` を返します。
+
+ @return `CBKeyedOperationQueue`
+ */
++ (CBKeyedOperationQueue *)sharedQueue;
+
+/**
+ キーの operation を追加します。
+
+ @param operation `NSOperation`
+ @param key キー
+ */
+- (void)addOperation:(NSOperation *)operation key:(id<NSCopying>)key;
+
+/**
+ 親のキーを指定してキーの operation を追加します。
+
+ @param operation `NSOperation`
+ @param key キー
+ @param parentKey 親のキー。`nil` の場合は `addOperation:key:` と同じです。
+ */
+- (void)addOperation:(NSOperation *)operation key:(id<NSCopying>)key parentKey:(id<NSCopying>)parentKey;
+
+/**
+ キー毎の queue を返します。
+
+ 返される queue に追加した operation は、`addOperation:key:` で追加されます。
+
+ @param key キー
+
+ @return キー毎の `NSOperationQueue`
+ */
+- (NSOperationQueue *)queueForKey:(id<NSCopying>)key;
+
+/**
+ 親のキーを指定したキー毎の queue を返します。
+
+ 返される queue に追加した operation は、`addOperation:key:parentKey:` で追加されます。
+
+ @param key キー
+ @param parentKey 親のキー
+
+ @return キー毎の `NSOperationQueue`
+ */
+- (NSOperationQueue *)queueForKey:(id<NSCopying>)key parentKey:(id<NSCopying>)parentKey;
+
+@end
@@ -20,9 +20,12 @@
 
 @class CBCredential;
 @class CBError;
+@class CBRequestHandle;
+@class CBRetryPolicy;
 
 typedef void (^CBNetworkingSuccessBlockForJSONResponse)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON);
 typedef void (^CBNetworkingFailureBlockForJSONResponse)(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON);
+typedef void (^CBNetworkingElementBlockForJSONResponse)(id JSON);
 typedef void (^CBNetworkingSuccessBlockForHTTPResponse)(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject);
 typedef void (^CBNetworkingFailureBlockForHTTPResponse)(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error);
 typedef void (^CBNetworkingDownloadProgressBlock)(NSUInteger bytesRead , long long totalBytesRead , long long totalBytesExpectedToRead);
@@ -43,6 +46,8 @@ typedef void (^CBNetworkingUploadProgressBlock)(NSUInteger bytesWritten , long l
     typedef void (^CBNetworkingSuccessBlockForJSONResponse)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON);
     // json での失敗レスポンス用 Block
     typedef void (^CBNetworkingFailureBlockForJSONResponse)(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON);
+    // json の配列要素を逐次受け取る Block
+    typedef void (^CBNetworkingElementBlockForJSONResponse)(id JSON);
     // 一般的な HTTP 成功レスポンス用 Block
     typedef void (^CBNetworkingSuccessBlockForHTTPResponse)(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject);
     // 一般的な HTTP 失敗レスポンス用 Block
@@ -56,6 +61,10 @@ typedef void (^CBNetworkingUploadProgressBlock)(NSUInteger bytesWritten , long l
  
  レスポンスステータス 401 は BASIC 認証エラーとして解釈され、C_ERROR_00003 の 'CBError' を返します。cybozu.com の返す json 形式のエラーの場合、エラーコードを json レスポンスの code、message を recoverySuggestion として 'CBError' を返します。それ以外のエラーの場合、`NSError` をラップした形で `CBError` が返されます。
  
+ ## 同時リクエスト数
+
+ 送信中のリクエスト数は、ドメイン毎の `CBConcurrencyLimiter` によりサーバの応答に応じて自動調整されます。上限を超えるリクエストは `NSOperationQueue` 内で送信を待ちます。
+
  ## ログ
  
  リクエスト、レスポンスのログは、`CBSdkLogLevelVerbose' レベルで出力されます。リクエストヘッダの `X-Cybozu-Authorization` 値、レスポンスヘッダで Set-Cookie される JSESSIONID、CB_OPENAUTH は '*****' で伏せた状態で出力されます。
@@ -64,18 +73,70 @@ typedef void (^CBNetworkingUploadProgressBlock)(NSUInteger bytesWritten , long l
 
 /**
  json レスポンスを受け取ることを想定した HTTP リクエストメソッドです。
+
+ 同じ認証情報で同じ URL への GET リクエストが既に送信中の場合、新たなリクエストは送信せずに送信中のリクエストの完了を待ち、同じレスポンスで success / failure Block を実行します。この場合、`queue` は最初のリクエストに指定されたものが利用されます。待っているリクエストをキャンセルした場合は、そのリクエストの failure Block のみが直ちに実行されます。送信中のリクエストは、待っている全てのリクエストがキャンセルされた場合に中断されます。`maxConcurrentOperationCount` が 1 の queue (`[KintoneApplication defaultQueue]` 等のキー毎の queue を含む) に追加するリクエストは、先に追加された更新の後に送信する必要があるため、送信中のリクエストを待たずに送信されます。
+ 
+ @param request リクエスト
+ @param credential 認証情報
+ @param success 成功レスポンス時に実行される block
+ @param failure 失敗レスポンス時に実行される block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+ 
+ @return リクエストの `CBRequestHandle`
+ */
++ (CBRequestHandle *)sendRequestForJSONResponse:(NSURLRequest *)request
+                                     credential:(CBCredential *)credential
+                                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                          queue:(NSOperationQueue *)queue;
+
+/**
+ 失敗時の再送方針を指定して、json レスポンスを受け取ることを想定した HTTP リクエストメソッドです。
+
+ `retryPolicy` で再送可能と判定されたリクエストは、通信エラーや一時的なエラーレスポンスの場合に待ち時間を置いて同じ `queue` で再送されます。failure Block は再送を諦めた時点で 1 度だけ実行されます。リクエスト毎の再送の回数と待ち時間は `CBRequestHandle` の `retryCount`, `retryDelay` で、全体の累計は `CBRetryPolicy` の `totalRetryCount`, `totalDelay` で確認できます。
+
+ 同じ GET リクエストが送信中の場合の動作は `sendRequestForJSONResponse:credential:success:failure:queue:` と同様で、再送も最初のリクエストの `retryPolicy` に従います。
+
+ @param request リクエスト
+ @param credential 認証情報
+ @param retryPolicy 再送方針。`nil` の場合は再送しません
+ @param success 成功レスポンス時に実行される block
+ @param failure 失敗レスポンス時に実行される block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
  
+ @return リクエストの `CBRequestHandle`
+*/
++ (CBRequestHandle *)sendRequestForJSONResponse:(NSURLRequest *)request
+                                     credential:(CBCredential *)credential
+                                    retryPolicy:(CBRetryPolicy *)retryPolicy
+                                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                          queue:(NSOperationQueue *)queue;
+
+/**
+ json レスポンスを逐次解析することを想定した HTTP リクエストメソッドです。
+
+ レスポンス全体を受信してから解析する `sendRequestForJSONResponse:credential:success:failure:queue:` と異なり、トップレベルのオブジェクトの `arrayKey` で指定した配列の要素(オブジェクト)を受信しながら解析し、要素の受信が完了する度に element Block を実行します。メモリ使用量は配列全体ではなく 1 要素分に抑えられ、最初の要素を受け取るまでの時間も短縮されます。
+
+ element Block は、受信した順にメインスレッドで実行されます。success Block に渡される json は、`arrayKey` の配列を空にしたものとなります。失敗レスポンス時の json は `sendRequestForJSONResponse:credential:success:failure:queue:` と同様です。通信途中で失敗した場合、それまでに受信した要素の element Block が実行された後に failure Block が実行されます。
+
  @param request リクエスト
  @param credential 認証情報
+ @param arrayKey 逐次解析する配列のキー
+ @param element 配列の要素毎に実行される block
  @param success 成功レスポンス時に実行される block
  @param failure 失敗レスポンス時に実行される block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+ 
+ @return リクエストの `CBRequestHandle`
  */
-+ (void)sendRequestForJSONResponse:(NSURLRequest *)request
-         credential:(CBCredential *)credential
-            success:(CBNetworkingSuccessBlockForJSONResponse)success
-            failure:(CBNetworkingFailureBlockForJSONResponse)failure
-              queue:(NSOperationQueue *)queue;
++ (CBRequestHandle *)sendRequestForJSONStreamResponse:(NSURLRequest *)request
+                                           credential:(CBCredential *)credential
+                                             arrayKey:(NSString *)arrayKey
+                                              element:(CBNetworkingElementBlockForJSONResponse)element
+                                              success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                              failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                                queue:(NSOperationQueue *)queue;
 
 /**
  バイナリデータダウンロードを想定した HTTP リクエストメソッドです。
@@ -87,13 +148,92 @@ typedef void (^CBNetworkingUploadProgressBlock)(NSUInteger bytesWritten , long l
  @param download ダウンロードの進捗を管理する block
  @param output ダウンロードしたデータを処理する 'NSOutputStream'。ダウンロードしたデータの保存はこの引数で管理します。
  @param queue リクエスト処理に利用される `NSOperationQueue`
+ 
+ @return リクエストの `CBRequestHandle`
+ */
++ (CBRequestHandle *)sendRequestForDownload:(NSURLRequest *)request
+                                 credential:(CBCredential *)credential
+                                    success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                    failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                   download:(CBNetworkingDownloadProgressBlock)download
+                                     output:(NSOutputStream *)output
+                                      queue:(NSOperationQueue *)queue;
+
+/**
+ ファイルへのダウンロードを、中断した位置から再開できる HTTP リクエストメソッドです。
+ 
+ 受信したデータは `partialFileURL` のファイルに直接書き込まれ、ファイル全体の長さと `ETag` (または `Last-Modified`) が `partialFileURL` に拡張子 `plist` を付けたファイルに保存されます。通信が失敗した場合やアプリが終了した場合も、同じ `partialFileURL` で再度呼び出すことにより、`Range` ヘッダで受信済みの位置からダウンロードを再開します。サーバ上のファイルが変更されていた場合は、先頭からダウンロードし直します。
+ 
+ `retryPolicy` を指定した場合、一時的なエラーでは `retryPolicy` に従って自動的に再開します。データを受信できた場合、再送回数と期限はリセットされます。
+ 
+ 全体を受信すると、`partialFileURL` のファイルは `destinationURL` へアトミックにリネームされます。success Block の responseObject は `destinationURL` です。download Block には、再開前に受信済みのデータを含むファイル全体の進捗が渡されます。
+ 
+ 同じ `partialFileURL` のダウンロードを同時に実行しないでください。
+ 
+ @param request リクエスト
+ @param credential 認証情報
+ @param retryPolicy 再送の方針。`nil` の場合、自動的に再開しません
+ @param partialFileURL 受信途中のデータを保存するファイルの URL
+ @param destinationURL ダウンロードしたファイルの保存先の URL。同じパスのファイルは置き換えられます
+ @param success 成功レスポンス時に実行される block
+ @param failure 失敗レスポンス時に実行される block
+ @param download ダウンロードの進捗を管理する block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+ 
+ @return リクエストの `CBRequestHandle`
+ */
++ (CBRequestHandle *)sendRequestForResumableDownload:(NSURLRequest *)request
+                                          credential:(CBCredential *)credential
+                                         retryPolicy:(CBRetryPolicy *)retryPolicy
+                                      partialFileURL:(NSURL *)partialFileURL
+                                      destinationURL:(NSURL *)destinationURL
+                                             success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                             failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                            download:(CBNetworkingDownloadProgressBlock)download
+                                               queue:(NSOperationQueue *)queue;
+
+/**
+ ファイルを複数の範囲に分けて並行にダウンロードする HTTP リクエストメソッドです。
+ 
+ `length` バイトのファイルを最大 `rangeCount` 個の範囲(1 範囲は最小 1MB)に分け、`Range` ヘッダを指定したリクエストで並行に取得します。各範囲は `length` に確保した `partialFileURL` のファイルのそれぞれの位置に直接書き込まれます。1 接続あたりのスループットが制限される遅延の大きい回線で、ダウンロード時間を短縮できます。
+ 
+ 最初の範囲のレスポンスでサーバが `Range` に対応していることを確認してから、残りの範囲を要求します。サーバが `Range` を無視した場合は、最初のリクエストがそのまま 1 本の接続でファイル全体を受信します。サーバ上のファイルサイズが `length` と異なる場合は、`sendRequestForResumableDownload:credential:retryPolicy:partialFileURL:destinationURL:success:failure:download:queue:` によるダウンロードに切り替えます。
+ 
+ 範囲毎のリクエストが一時的なエラーで失敗した場合、`retryPolicy` に従ってその範囲の受信済みの位置から再開します。全ての範囲を受信すると、ファイルサイズが `length` と一致することを確認し、`destinationURL` へアトミックにリネームします。success Block の responseObject は `destinationURL` です。
+ 
+ `rangeCount` が 1 の場合や、ファイルが小さく分割されない場合は `sendRequestForResumableDownload:credential:retryPolicy:partialFileURL:destinationURL:success:failure:download:queue:` と同等です。分割した場合の受信途中のデータは、失敗時に削除され、再開には利用されません。
+
+ `request` の URL は kintone に限らず、`Range` ヘッダに対応した任意のサーバを指定できます。`[KintoneAPI fileDownloadWithFile:toURL:rangeCount:success:failure:download:queue:]` を経由せず、テスト用のローカルサーバなどに対して分割ダウンロードを検証する場合は、このメソッドを直接呼び出してください。
+
+    // ranges of a file served by a local test server, without a kintone credential
+    NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"http://localhost:8080/file.bin"]];
+    [CBNetworking sendRequestForRangedDownload:request credential:nil retryPolicy:nil length:length rangeCount:4
+                                partialFileURL:partialFileURL destinationURL:destinationURL success:success failure:failure download:nil queue:queue];
+ 
+ @param request リクエスト
+ @param credential 認証情報。kintone 以外のサーバへのリクエストの場合は `nil`
+ @param retryPolicy 再送の方針。`nil` の場合、再送しません
+ @param length ファイルのサイズ(バイト)
+ @param rangeCount 同時に要求する範囲の最大数
+ @param partialFileURL 受信途中のデータを保存するファイルの URL
+ @param destinationURL ダウンロードしたファイルの保存先の URL。同じパスのファイルは置き換えられます
+ @param success 成功レスポンス時に実行される block
+ @param failure 失敗レスポンス時に実行される block
+ @param download ダウンロードの進捗を管理する block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+ 
+ @return リクエストの `CBRequestHandle`
  */
-+ (void)sendRequestForDownload:(NSURLRequest *)request
-                    credential:(CBCredential *)credential
-                       success:(CBNetworkingSuccessBlockForHTTPResponse)success
-                       failure:(CBNetworkingFailureBlockForHTTPResponse)failure
-                      download:(CBNetworkingDownloadProgressBlock)download
-                        output:(NSOutputStream *)output
-                         queue:(NSOperationQueue *)queue;
++ (CBRequestHandle *)sendRequestForRangedDownload:(NSURLRequest *)request
+                                       credential:(CBCredential *)credential
+                                      retryPolicy:(CBRetryPolicy *)retryPolicy
+                                           length:(unsigned long long)length
+                                       rangeCount:(NSUInteger)rangeCount
+                                   partialFileURL:(NSURL *)partialFileURL
+                                   destinationURL:(NSURL *)destinationURL
+                                          success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                          failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                         download:(CBNetworkingDownloadProgressBlock)download
+                                            queue:(NSOperationQueue *)queue;
 
 @end
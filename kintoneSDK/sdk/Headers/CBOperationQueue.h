@@ -18,11 +18,44 @@
 
 #import <Foundation/Foundation.h>
 
+typedef NS_ENUM(NSUInteger, CBOperationQueueLane) {
+    CBOperationQueueLaneInteractive = 0,
+    CBOperationQueueLaneDefault,
+    CBOperationQueueLaneBackground,
+    CBOperationQueueLaneBulk
+};
+
 /**
  シングルトンの `NSOperationQueue` を提供するクラスです。
+
+ ## 優先度レーン
+
+ `sharedQueueForLane:` は、優先度の異なる 4 つのレーンの queue を返します。レーンの queue は同時実行 operation 数 `maxConcurrentLaneOperationCount` を共有し、上位のレーンのために枠を予約します。
+
+    typedef NS_ENUM(NSUInteger, CBOperationQueueLane) {
+        CBOperationQueueLaneInteractive = 0,  // ユーザ操作への応答。全ての枠を利用できます
+        CBOperationQueueLaneDefault,          // 1 枠を Interactive に残します
+        CBOperationQueueLaneBackground,       // 2 枠を上位のレーンに残します
+        CBOperationQueueLaneBulk              // 3 枠を上位のレーンに残します
+    };
+
+ 枠が空くと、最も上位のレーンで最も古い operation から実行されます。下位のレーンが実行されなくなることを防ぐため、operation は `laneAgingInterval` 秒待つ毎に 1 つ上位のレーンとして扱われます。ただし Interactive 以外のレーンの operation は Default より上位にはならず、Interactive のための 1 枠は常に残ります。
+
+ 他の operation に依存している operation は、依存先が全て完了するまで枠を使わずに待ちます。依存関係は queue に追加する前に設定してください。
+
+ `KintoneAPI` のメソッドにレーンの queue を指定することで、API 呼び出しのレーンを選択できます。レーンの queue 毎に `cancelAllOperations` できます。
+
+    // the tap on a record is not blocked by the sync running in the bulk lane
+    [kintoneAPI record:recordId success:success failure:failure queue:[CBOperationQueue sharedQueueForLane:CBOperationQueueLaneInteractive]];
+    [kintoneAPI bulkUpdate:records success:success failure:failure queue:[CBOperationQueue sharedQueueForLane:CBOperationQueueLaneBulk]];
  */
 @interface CBOperationQueue : NSOperationQueue
 
+/**
+ レーンの queue の場合、そのレーンです。`sharedQueueForLane:` 以外の queue では意味を持ちません。
+ */
+@property (nonatomic, readonly) CBOperationQueueLane lane;
+
 /**
  シングルトンのデフォルト設定 `NSOperationQueue` を返します。
  
@@ -39,4 +72,41 @@
  */
 + (CBOperationQueue *)sharedNonConcurrentQueue;
 
+/**
+ 優先度レーンのシングルトン `NSOperationQueue` を返します。
+
+ @param lane レーン
+
+ @return レーン毎にシングルトンの `CBOperationQueue`
+ */
++ (CBOperationQueue *)sharedQueueForLane:(CBOperationQueueLane)lane;
+
+/**
+ レーンの queue 全体での同時実行 operation 数です。デフォルトは 6 です。
+
+ @return 同時実行 operation 数
+ */
++ (NSInteger)maxConcurrentLaneOperationCount;
+
+/**
+ レーンの queue 全体での同時実行 operation 数を設定します。
+
+ @param count 同時実行 operation 数。4 以上を指定してください
+ */
++ (void)setMaxConcurrentLaneOperationCount:(NSInteger)count;
+
+/**
+ 待っている operation を 1 つ上位のレーンとして扱うまでの秒数です。デフォルトは 2 秒です。
+
+ @return 秒数
+ */
++ (NSTimeInterval)laneAgingInterval;
+
+/**
+ 待っている operation を 1 つ上位のレーンとして扱うまでの秒数を設定します。
+
+ @param interval 秒数
+ */
++ (void)setLaneAgingInterval:(NSTimeInterval)interval;
+
 @end
@@ -0,0 +1,163 @@
+//
+//  CBRequestHandle.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CBError;
+@class CBRequestHandle;
+
+typedef void (^CBRequestHandleCompletionBlock)(CBRequestHandle *handle);
+
+/**
+ 送信したリクエストを操作するためのクラスです。
+
+ `CBNetworking` および `KintoneAPI` のリクエストメソッドが返します。`NSOperationQueue` の `cancelAllOperations` と異なり、個別のリクエストをキャンセルしたり、優先度を変更したりできます。複数のリクエストからなる処理(一括処理の分割、再送等)の場合も、1 つの `CBRequestHandle` でまとめて操作できます。
+
+ キャンセルしたリクエストの success Block は実行されません。failure Block は `cancelledError` で実行されます。受信途中のレスポンスは解析されず、failure Block の json は `nil` となります。
+
+ 例:
+
+    CBRequestHandle *handle = [kintoneAPI record:recordId success:success failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
+    [handle addCompletionObserver:^(CBRequestHandle *handle) {
+        [self.activityIndicator stopAnimating];
+    }];
+
+    // the cell scrolled out of the screen
+    [handle cancel];
+ */
+@interface CBRequestHandle : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ キャンセルされた場合 YES です。
+ */
+@property (nonatomic, readonly, getter = isCancelled) BOOL cancelled;
+
+/**
+ success / failure Block の実行が完了した場合 YES です。
+ */
+@property (nonatomic, readonly, getter = isFinished) BOOL finished;
+
+/**
+ リクエストの `NSOperation` の `queuePriority` です。デフォルトは `NSOperationQueuePriorityNormal` です。
+
+ 送信を待っているリクエストと、以降に送信されるリクエストに適用されます。
+ */
+@property (nonatomic) NSOperationQueuePriority priority;
+
+/**
+ このリクエストを再送した回数です。
+
+ 子の `CBRequestHandle` の再送も含みます。`CBRetryPolicy` の `totalRetryCount` と異なり、このリクエストのみの回数です。
+ */
+@property (nonatomic, readonly) int retryCount;
+
+/**
+ このリクエストの再送までに待機した時間(秒)の合計です。
+ */
+@property (nonatomic, readonly) NSTimeInterval retryDelay;
+
+/**
+ リクエストメソッドの呼び出しから完了までの時間(秒)です。
+
+ キューでの待ち時間と再送を含みます。完了前の場合は現在までの時間です。
+
+    [handle addCompletionObserver:^(CBRequestHandle *handle) {
+        [CBLog logInfo:@"%.2fs, %d retries", handle.latency, handle.retryCount];
+    }];
+ */
+@property (nonatomic, readonly) NSTimeInterval latency;
+
+/// ---------------------------------
+/// @name リクエストの操作
+/// ---------------------------------
+
+/**
+ リクエストをキャンセルします。
+
+ 送信中の通信は中断され、送信を待っているリクエストは送信されません。完了済みの場合は何もしません。
+ */
+- (void)cancel;
+
+/**
+ 完了時に実行される Block を追加します。
+
+ Block は success / failure Block の後にメインスレッドで実行されます。完了済みの場合は直ちに実行されます。
+
+ @param observer 完了時に実行される Block
+ */
+- (void)addCompletionObserver:(CBRequestHandleCompletionBlock)observer;
+
+/**
+ キャンセル時に failure Block に渡される `CBError` を返します。
+
+ @return `NSURLErrorCancelled` をラップした `CBError`
+ */
++ (CBError *)cancelledError;
+
+/// ---------------------------------
+/// @name SDK 内部での利用
+/// ---------------------------------
+
+/**
+ リクエストの `NSOperation` を追加します。
+
+ キャンセル済みの場合は直ちにキャンセルします。SDK 内部からの利用を想定しています。
+
+ @param operation `NSOperation`
+ */
+- (void)addOperation:(NSOperation *)operation;
+
+/**
+ 子の `CBRequestHandle` を追加します。キャンセル、優先度の変更は子にも適用されます。
+
+ SDK 内部からの利用を想定しています。
+
+ @param child 子の `CBRequestHandle`
+ */
+- (void)addChild:(CBRequestHandle *)child;
+
+/**
+ キャンセル時に実行される Block を追加します。キャンセル済みの場合は直ちに実行されます。
+
+ SDK 内部からの利用を想定しています。
+
+ @param handler キャンセル時に実行される Block
+ */
+- (void)addCancellationHandler:(void (^)(void))handler;
+
+/**
+ 再送を記録します。親の `CBRequestHandle` にも記録されます。
+
+ 再送を待つ直前に呼び出します。SDK 内部からの利用を想定しています。
+
+ @param delay 再送までの待ち時間(秒)
+ */
+- (void)didRetryWithDelay:(NSTimeInterval)delay;
+
+/**
+ 完了を記録し、完了時の Block を実行します。
+
+ success / failure Block の実行後に 1 度だけ呼び出します。SDK 内部からの利用を想定しています。
+ */
+- (void)finish;
+
+@end
@@ -0,0 +1,139 @@
+//
+//  CBRetryPolicy.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef void (^CBRetryPolicyRetryBlock)(NSURLRequest *request, int retryCount, NSTimeInterval delay, NSError *error);
+
+/**
+ 一時的なエラーで失敗したリクエストの再送方針を表すクラスです。
+
+ `[CBNetworking sendRequestForJSONResponse:credential:retryPolicy:success:failure:queue:]` にリクエスト毎に指定するか、`KintoneSite` の `retryPolicy` に指定することで、その `KintoneSite` の全ての API に適用されます。
+
+ 再送するのは、複数回実行しても結果が変わらないリクエストのみです。
+
+ - `GET`, `HEAD`
+ - `DELETE` (kintone の削除 API はレコード ID を指定するため)
+ - json の `revision` が指定された `PUT` (一括更新の場合は全レコードに `revision` が指定されたもの)
+
+ 通信エラー(タイムアウト、接続断等)、およびレスポンスステータスが `retryableStatusCodes` に含まれる場合に、指数関数的に増加する待ち時間にジッタを加えて再送します。レスポンスに `Retry-After` ヘッダが含まれる場合は、その値を優先します。最初のリクエストから `deadline` 秒を超える場合は再送しません。
+
+ 例:
+
+    CBRetryPolicy *retryPolicy = [CBRetryPolicy new];
+    retryPolicy.maxRetryCount = 5;
+    retryPolicy.retryBlock = ^(NSURLRequest *request, int retryCount, NSTimeInterval delay, NSError *error) {
+        [CBLog logInfo:@"retry %d after %.1fs: %@", retryCount, delay, request.URL];
+    };
+    kintoneSite.retryPolicy = retryPolicy;
+ */
+@interface CBRetryPolicy : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ 1 リクエストあたりの最大再送回数です。デフォルトは 3 です。
+ */
+@property (nonatomic) int maxRetryCount;
+
+/**
+ 1 回目の再送までの基準となる待ち時間(秒)です。デフォルトは 0.5 秒です。
+
+ n 回目の再送の待ち時間は `baseDelay * 2^(n-1)` を上限とする乱数となります。
+ */
+@property (nonatomic) NSTimeInterval baseDelay;
+
+/**
+ 再送までの待ち時間の上限(秒)です。デフォルトは 30 秒です。
+ */
+@property (nonatomic) NSTimeInterval maxDelay;
+
+/**
+ 最初のリクエストからの制限時間(秒)です。デフォルトは 60 秒です。
+
+ 再送までの待ち時間を加えて制限時間を超える場合は再送しません。
+ */
+@property (nonatomic) NSTimeInterval deadline;
+
+/**
+ 再送の対象となるレスポンスステータスです。デフォルトは 429, 500, 502, 503, 504 です。
+ */
+@property (nonatomic, copy) NSIndexSet *retryableStatusCodes;
+
+/**
+ 再送の直前に実行される Block です。メインスレッドで実行されます。
+ */
+@property (nonatomic, copy) CBRetryPolicyRetryBlock retryBlock;
+
+/**
+ このポリシーにより再送した回数の累計です。
+
+ リクエスト毎の回数は `[CBRequestHandle retryCount]` で確認できます。
+ */
+@property (nonatomic, readonly) int totalRetryCount;
+
+/**
+ このポリシーにより再送までに待機した時間(秒)の累計です。
+ */
+@property (nonatomic, readonly) NSTimeInterval totalDelay;
+
+/// ---------------------------------
+/// @name 再送の判定
+/// ---------------------------------
+
+/**
+ リクエストが再送可能かどうかを返します。
+
+ @param request リクエスト
+
+ @return 複数回実行しても結果が変わらないリクエストの場合 YES
+ */
+- (BOOL)isRetryableRequest:(NSURLRequest *)request;
+
+/**
+ 失敗したリクエストを再送するまでの待ち時間を返します。
+
+ @param request リクエスト
+ @param response レスポンス。通信エラーの場合は `nil`
+ @param error エラー
+ @param retryCount これから行う再送が何回目か
+ @param startDate 最初のリクエストの送信日時
+
+ @return 待ち時間(秒)。再送しない場合は負の値
+ */
+- (NSTimeInterval)delayForRequest:(NSURLRequest *)request
+                         response:(NSHTTPURLResponse *)response
+                            error:(NSError *)error
+                       retryCount:(int)retryCount
+                        startDate:(NSDate *)startDate;
+
+/**
+ 再送を記録し、`retryBlock` を実行します。
+
+ `CBNetworking` から呼ばれることを想定しています。
+
+ @param request リクエスト
+ @param retryCount 何回目の再送か
+ @param delay 再送までの待ち時間(秒)
+ @param error 再送の原因となったエラー
+ */
+- (void)didRetryRequest:(NSURLRequest *)request retryCount:(int)retryCount delay:(NSTimeInterval)delay error:(NSError *)error;
+
+@end
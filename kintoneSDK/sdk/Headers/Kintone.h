@@ -21,18 +21,30 @@
 #import <UIKit/UIKit.h>
 #import <Security/Security.h>
 
+#import <kintone/CBConcurrencyLimiter.h>
 #import <kintone/CBCredential.h>
 #import <kintone/CBError.h>
+#import <kintone/CBKeyedOperationQueue.h>
 #import <kintone/CBLog.h>
 #import <kintone/CBNetworking.h>
 #import <kintone/CBOperationQueue.h>
+#import <kintone/CBRequestHandle.h>
+#import <kintone/CBRetryPolicy.h>
 
 #import <kintone/KintoneAPI.h>
 #import <kintone/KintoneApplication.h>
 #import <kintone/KintoneBaseAppDelegate.h>
+#import <kintone/KintoneBulkRequest.h>
 #import <kintone/KintoneBundle.h>
 #import <kintone/KintoneField.h>
 #import <kintone/KintoneFile.h>
+#import <kintone/KintoneFileCache.h>
+#import <kintone/KintoneFormCache.h>
 #import <kintone/KintoneQuery.h>
 #import <kintone/KintoneRecord.h>
+#import <kintone/KintoneRecordCursor.h>
+#import <kintone/KintoneRecordPartitionedCursor.h>
+#import <kintone/KintoneRecordStore.h>
+#import <kintone/KintoneRecordSync.h>
 #import <kintone/KintoneSite.h>
+#import <kintone/KintoneUploadCache.h>
@@ -21,12 +21,17 @@
 #import "CBNetworking.h"
 
 @class KintoneApplication;
+@class KintoneBulkRequest;
 @class KintoneFile;
 @class KintoneQuery;
 @class KintoneRecord;
+@class KintoneRecordCursor;
+@class KintoneRecordPartitionedCursor;
 @class CBCredential;
 @class CBError;
 
+typedef void (^KintoneAPIRecordBlock)(KintoneRecord *record);
+
 /**
  kintone の API をコールするクラスです。
  
@@ -55,7 +60,25 @@
  
  ファイルのダウンロード、アップロードを行うような場合、複数の API を直列に実行することになります。`KintoneAPI` では複数の API の呼び出しをまとめる `NSOperationQueue` を引数として渡すようにしています。kintone SDK では、同時実行 operation 数を 1 にし、確実に１つずつの operation しか動作しないシングルトンの queue を [CBOperationQueue sharedNonConcurrentQueue] として用意しています。この queue を利用することにより、複数の API を直列に実行することが可能となります。
  
+ 画面の操作に応答する API と、同期処理のように時間のかかる API を並行して呼び出す場合は、`[CBOperationQueue sharedQueueForLane:]` で優先度の異なるレーンの queue を指定できます。ユーザ操作の API には `CBOperationQueueLaneInteractive`、一括処理には `CBOperationQueueLaneBulk` を指定することで、一括処理の実行中でも画面の操作への応答が遅れなくなります。
+
+ 複数の kintone アプリを同期するような場合、`sharedNonConcurrentQueue` では全ての kintone アプリの API が直列に実行されます。`[KintoneApplication defaultQueue]` は kintone アプリ毎に API を順に実行し、異なる kintone アプリの API を並行に実行します。レコード単位で順序を保証すれば十分な場合は `[KintoneApplication queueForRecord:]` を利用できます。queue に `nil` を渡した場合、1 件のレコードの更新は `[KintoneApplication queueForRecord:]`、レコードの登録と一括登録/更新/削除、`bulkRequest:success:failure:queue:` は `[KintoneApplication defaultQueue]` で順に実行され、取得とファイルのアップロード/ダウンロードは `[CBOperationQueue sharedConcurrentQueue]` で並行に実行されます。レコード毎の queue の operation は、先に `defaultQueue` に追加された operation の完了を待ち、`defaultQueue` の operation は、先に追加されたレコード毎の operation の完了を待つため、一括更新の後に追加した 1 件の更新が一括更新より先に送信されることはありません。
+
+ 直列の queue に追加したリクエストは、再送される場合も queue 内の位置を保ったまま、完了するまで後続のリクエストを待たせます。一括処理やカーソルのように複数のリクエストを並行に送信する API に直列の queue を指定すると、リクエストは 1 件ずつ送信されます。
+
  但し、API 成功/失敗レスポンス後に動作する success / failure Block はこの queue とは独立して動作します。これら Block の処理の完了後に次の API を呼び出したい場合、Block の中で次の API を呼び出すことにより、連続した処理が可能となります。`fileDownload:success:failure:download:output:queue:` に実装例があるので、参考にしてください。
+
+ ## 一括処理の分割
+
+ kintone は 1 リクエストで一括登録/更新/削除できるレコード数を 100 件に制限しています。`bulkInsert:success:failure:queue:`, `bulkUpdate:success:failure:queue:`, `bulkDelete:success:failure:queue:` および各 `...WithRecords:` メソッドは、100 件を超えるレコードが指定された場合、100 件ずつのリクエストに分割し、最大 `maxConcurrentBulkRequests` 件を同時に送信します。
+
+ 全リクエストの完了後、各レスポンスの `ids`, `revisions` 等の配列を指定したレコードの順に連結した json で success / failure Block を 1 度だけ実行します。いずれかのリクエストが失敗した場合は failure Block が実行されます。失敗したリクエストに含まれるレコードの位置には `NSNull` がセットされ、json の `errors` に失敗したリクエスト毎の `offset` (先頭レコードの位置), `count` (レコード数), `error` (`CBError`), `JSON` (失敗レスポンス) が含まれます。failure Block の `error` は、最初に失敗したリクエストのものです。
+
+ 分割されたリクエストは互いに独立しているため、一部のリクエストのみが成功することがあります。
+
+ ## リクエストのキャンセル
+
+ API を呼び出すメソッドは `CBRequestHandle` を返します。`[CBRequestHandle cancel]` で、他のリクエストに影響を与えずにその API 呼び出しのみをキャンセルできます。一括処理を分割した場合は、未送信のリクエストも含めて全てキャンセルされます。
  */
 
 @interface KintoneAPI : NSObject
@@ -90,6 +113,20 @@
  */
 @property (nonatomic) NSString *userAgent;
 
+/**
+ 一括処理を分割した場合に、同時に送信するリクエスト数です。
+
+ デフォルトは 4 です。リクエストは API に指定した `NSOperationQueue` で処理されるため、`[CBOperationQueue sharedNonConcurrentQueue]` のような直列の queue を指定した場合は 1 件ずつ送信されます。`nil` の場合は `[KintoneApplication defaultQueue]` で 1 件ずつ送信されます。並行に送信する場合は `[CBOperationQueue sharedConcurrentQueue]` を指定してください。
+ */
+@property (nonatomic) int maxConcurrentBulkRequests;
+
+/**
+ `saveRecord:success:failure:queue:` でファイルをアップロードする場合に、同時に送信するリクエスト数です。
+
+ デフォルトは 4 です。
+ */
+@property (nonatomic) int maxConcurrentFileUploads;
+
 - (KintoneAPI *)initWithKintoneApplication:(KintoneApplication *)kintoneApplication;
 
 /// ---------------------------------
@@ -113,14 +150,18 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)form:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)form:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリの指定したレコード番号のデータを取得します。
  
  受信した json データは `[KintoneRecord kintoneRecordFromJSON:]` により `KintoneRecord` オブジェクトとして取得できます。各フィールド値は `[KintoneRecord fields]` にセットされた `KintoneField` から取得できます。
  
+ 取得したレコードは `[KintoneApplication recordStore]` に保存されます。
+ 
  例:
  
     CBNetworkingSuccessBlockForJSONResponse success = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
@@ -143,8 +184,10 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)record:(int)recordId success:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)record:(int)recordId success:(CBNetworkingSuccessBlockForJSONResponse)success failure:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリからレコードを一括取得します。
@@ -156,12 +199,14 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)records:(NSArray *)fields
-          query:(NSString *)query
-        success:(CBNetworkingSuccessBlockForJSONResponse)success
-        failure:(CBNetworkingFailureBlockForJSONResponse)failure
-          queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)records:(NSArray *)fields
+                       query:(NSString *)query
+                     success:(CBNetworkingSuccessBlockForJSONResponse)success
+                     failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                       queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリからレコードを一括取得します。
@@ -173,18 +218,22 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)recordsWithFields:(NSArray *)fields
-                    query:(NSString *)query
-                  success:(CBNetworkingSuccessBlockForJSONResponse)success
-                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                    queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)recordsWithFields:(NSArray *)fields
+                                 query:(NSString *)query
+                               success:(CBNetworkingSuccessBlockForJSONResponse)success
+                               failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                 queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリからレコードを一括取得します。
  
  受信した json データは `[KintoneRecord kintoneRecordsFromJSON:]` により、`KintoneRecord` の `NSArray` として取得できます。
  
+ 取得したレコードは `[KintoneApplication recordStore]` に保存されます。
+ 
  例:
  
     // single line text field
@@ -215,19 +264,78 @@
         //
     };
  
-    [kintoneApplication.kintoneAPI recordsWithFields:@[field1] kintoneQuery:q success:success failure:failure queue:[CBOperationQueue sharedNonConcurrentQueue]];
+    [kintoneApplication.kintoneAPI recordsWithFields:@[field1] kintoneQuery:q success:success failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
  
  @param fields レスポンスとして取得したいフィールドを `KintoneField` として指定
  @param query 検索クエリ
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)recordsWithFields:(NSArray *)fields
+                          kintoneQuery:(KintoneQuery *)query
+                               success:(CBNetworkingSuccessBlockForJSONResponse)success
+                               failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                 queue:(NSOperationQueue *)queue;
+
+/**
+ kintone アプリからレコードを一括取得し、受信したレコードを 1 件ずつ `KintoneRecord` として record Block に渡します。
+
+ レスポンス全体を受信してから解析する `recordsWithFields:kintoneQuery:success:failure:queue:` と異なり、レスポンスを受信しながら逐次解析するため、メモリ使用量はレコード 1 件分に抑えられ、最初のレコードを受け取るまでの時間も短縮されます。
+
+ record Block は受信した順にメインスレッドで実行され、全レコードの record Block の実行後に success Block が実行されます。success Block に渡される json の `records` は空の配列となります。
+
+ 受信したレコードは 100 件毎に `[KintoneApplication recordStore]` に保存されます。
+
+ 例:
+
+    KintoneAPIRecordBlock record = ^(KintoneRecord *record) {
+        [objects addObject:record];
+    };
+
+    [kintoneApplication.kintoneAPI recordsWithFields:nil kintoneQuery:q record:record success:success failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
+
+ @param fields レスポンスとして取得したいフィールドを `KintoneField` として指定
+ @param query 検索クエリ
+ @param record レコード毎に実行される Block
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)recordsWithFields:(NSArray *)fields
-             kintoneQuery:(KintoneQuery *)query
-                  success:(CBNetworkingSuccessBlockForJSONResponse)success
-                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                    queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)recordsWithFields:(NSArray *)fields
+                          kintoneQuery:(KintoneQuery *)query
+                                record:(KintoneAPIRecordBlock)record
+                               success:(CBNetworkingSuccessBlockForJSONResponse)success
+                               failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                 queue:(NSOperationQueue *)queue;
+
+/**
+ kintone アプリからレコードをページ単位で順に取得する `KintoneRecordCursor` を生成します。
+
+ 1 回のリクエストで取得できる件数を超えるレコードを取得する場合に利用します。詳細は `KintoneRecordCursor` を参照してください。
+
+ @param fields レスポンスとして取得したいフィールドを `KintoneField` として指定
+ @param query 検索クエリ。`limit` / `offset` が設定されている場合は、その範囲内のレコードのみを取得します。
+
+ @return `KintoneRecordCursor` インスタンス
+ */
+- (KintoneRecordCursor *)recordCursorWithFields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query;
+
+/**
+ kintone アプリからレコードをレコード ID の範囲で分割して並行に取得する `KintoneRecordPartitionedCursor` を生成します。
+
+ 大量のレコードを取得する場合に利用します。詳細は `KintoneRecordPartitionedCursor` を参照してください。
+
+ @param fields レスポンスとして取得したいフィールドを `KintoneField` として指定
+ @param query 検索クエリ。`orderBy` が設定されている場合は、ソート順を保ったままレコードを取得します。
+
+ @return `KintoneRecordPartitionedCursor` インスタンス
+ */
+- (KintoneRecordPartitionedCursor *)recordPartitionedCursorWithFields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query;
 
 /**
  kintone アプリへレコードを登録します。
@@ -238,11 +346,13 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)insert:(NSDictionary *)fieldJSON
-       success:(CBNetworkingSuccessBlockForJSONResponse)success
-       failure:(CBNetworkingFailureBlockForJSONResponse)failure
-         queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)insert:(NSDictionary *)fieldJSON
+                    success:(CBNetworkingSuccessBlockForJSONResponse)success
+                    failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                      queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリへレコードを登録します。
@@ -288,26 +398,32 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)insertWithRecord:(KintoneRecord *)record
-                 success:(CBNetworkingSuccessBlockForJSONResponse)success
-                 failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                   queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)insertWithRecord:(KintoneRecord *)record
+                              success:(CBNetworkingSuccessBlockForJSONResponse)success
+                              failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリへレコードを一括登録します。
  
  `insert:success:failure:queue:` とほぼ同等です。登録するレコードを json 形式の `NSArray` として指定します。
+ 
+ 100 件を超えるレコードは自動的に分割して送信されます。詳細は「一括処理の分割」を参照してください。
 
  @param fieldJSON json 形式の登録レコード
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)bulkInsert:(NSArray *)fieldJSON
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)bulkInsert:(NSArray *)fieldJSON
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリへレコードを一括登録します。
@@ -316,17 +432,19 @@
  
  例:
  
-    [kintoneApplication.kintoneAPI bulkInsertWithRecords:@[record1, record2] success:success failure:failure queue:[CBOperationQueue sharedNonConcurrentQueue]];
+    [kintoneApplication.kintoneAPI bulkInsertWithRecords:@[record1, record2] success:success failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
  
  @param records `KintoneRecord` 形式の登録レコード
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)bulkInsertWithRecords:(NSArray *)records
-                      success:(CBNetworkingSuccessBlockForJSONResponse)success
-                      failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                        queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)bulkInsertWithRecords:(NSArray *)records
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリの指定されたレコードを更新します。
@@ -338,12 +456,14 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)update:(int)recordId
-     fieldJSON:(NSDictionary *)fieldJSON
-       success:(CBNetworkingSuccessBlockForJSONResponse)success
-       failure:(CBNetworkingFailureBlockForJSONResponse)failure
-         queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)update:(int)recordId
+                  fieldJSON:(NSDictionary *)fieldJSON
+                    success:(CBNetworkingSuccessBlockForJSONResponse)success
+                    failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                      queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリの指定されたレコードを更新します。
@@ -355,27 +475,62 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)update:(int)recordId
-        record:(KintoneRecord *)record
-       success:(CBNetworkingSuccessBlockForJSONResponse)success
-       failure:(CBNetworkingFailureBlockForJSONResponse)failure
-         queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)update:(int)recordId
+                     record:(KintoneRecord *)record
+                    success:(CBNetworkingSuccessBlockForJSONResponse)success
+                    failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                      queue:(NSOperationQueue *)queue;
+
+/**
+ レコードに追加したファイルをアップロードし、kintone アプリへレコードを登録/更新します。
+
+ レコードのファイルフィールド (サブテーブル内のものを含む) から、fileKey のない `KintoneFile` を探してアップロードし、`[KintoneFile setFileKeyWithJSONDictionary:]` で fileKey をセットします。アップロードは最大 `maxConcurrentFileUploads` 件を同時に送信し、全てのアップロードの完了後、直ちにレコードを登録します。`[KintoneRecord recordNumber]` がある場合は `update:record:success:failure:queue:`、ない場合は `insertWithRecord:success:failure:queue:` と同等です。
+
+ アップロードのいずれかが失敗した場合、レコードは登録されず、failure Block が実行されます。json の `errors` には、失敗したファイル毎に `offset` (アップロード対象のファイルの位置) が含まれます。アップロードに成功したファイルには fileKey がセットされているため、再度呼び出すと残りのファイルのみをアップロードします。
+
+ `queue` が `nil` の場合、アップロードは `[CBOperationQueue sharedConcurrentQueue]` で処理されます。直列の queue を指定した場合、アップロードは 1 件ずつ送信されます。
+
+ 例:
+
+    KintoneFileField *field = (KintoneFileField *)record.fields[@"Attachment"];
+    [field addFile:[[KintoneFile alloc] initWithFileURL:photoURL name:nil contentType:@"image/jpeg"]];
+    [field addFile:[[KintoneFile alloc] initWithData:pdfData name:@"report.pdf" contentType:@"application/pdf"]];
+
+    [kintoneApplication.kintoneAPI saveRecord:record success:success failure:failure queue:nil];
+
+ @param record 登録/更新するレコード
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)saveRecord:(KintoneRecord *)record
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリの指定されたレコードを一括更新します。
  
  `update:fieldJSON:success:failure:queue:` とほぼ同様です。更新する `fieldJSON` にレコード番号を含めた json 形式のデータを指定する必要があります。
  
+ 100 件を超えるレコードは自動的に分割して送信されます。詳細は「一括処理の分割」を参照してください。
+ 
  @param fieldJSON 更新対象のレコード番号が含まれた json 形式データ
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)bulkUpdate:(NSArray *)fieldJSON
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)bulkUpdate:(NSArray *)fieldJSON
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue;
 
 /**
  kintone アプリの指定されたレコードを一括更新します。
@@ -413,33 +568,39 @@
             //
         };
  
-        [kintoneApplication.kintoneAPI bulkUpdateWithRecords:@[record1, record2] success:success failure:failure queue:[CBOperationQueue sharedNonConcurrentQueue]];
+        [kintoneApplication.kintoneAPI bulkUpdateWithRecords:@[record1, record2] success:success failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
     }
  
  @param records 更新対象のレコード番号フィールド `KintoneRecordNumberField` がセットされた `KintoneRecord`
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)bulkUpdateWithRecords:(NSArray *)records
-                      success:(CBNetworkingSuccessBlockForJSONResponse)success
-                      failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                        queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)bulkUpdateWithRecords:(NSArray *)records
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue;
 
 /**
  指定されたレコードを kintone アプリより一括削除します。
  
  削除対象をレコード番号を `NSArray` として指定する点を除き、`bulkDeleteWithRecords:success:failure:queue:` と同様です。
  
+ 100 件を超えるレコードは自動的に分割して送信されます。詳細は「一括処理の分割」を参照してください。
+ 
  @param recordIds 削除対象のレコード番号 'NSNumber'
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)bulkDelete:(NSArray *)recordIds
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)bulkDelete:(NSArray *)recordIds
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue;
 
 /**
  指定されたレコードを kintone アプリより一括削除します。
@@ -473,18 +634,46 @@
             //
         };
  
-        [kintoneApplication.kintoneAPI bulkDeleteWithRecords:@[record1, record2] success:success failure:failure queue:[CBOperationQueue sharedNonConcurrentQueue]];
+        [kintoneApplication.kintoneAPI bulkDeleteWithRecords:@[record1, record2] success:success failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
     }
 
  @param records 削除対象のレコード番号フィールド `KintoneRecordNumberField` がセットされた `KintoneRecord`
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)bulkDeleteWithRecords:(NSArray *)records
-                      success:(CBNetworkingSuccessBlockForJSONResponse)success
-                      failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                        queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)bulkDeleteWithRecords:(NSArray *)records
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue;
+
+/**
+ 複数の API を 1 回のリクエストで実行します。
+
+ `requests` には `method`, `api`, `payload` をキーに持つ `NSDictionary` を最大 20 件指定します。通常は `bulkRequest` で取得する `KintoneBulkRequest` を利用してください。
+
+ @param requests 実行する API の `NSArray`
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)bulkRequest:(NSArray *)requests
+                         success:(CBNetworkingSuccessBlockForJSONResponse)success
+                         failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                           queue:(NSOperationQueue *)queue;
+
+/**
+ 複数のレコード登録/更新/削除を 1 回のリクエストで実行する `KintoneBulkRequest` を生成します。
+
+ 詳細は `KintoneBulkRequest` を参照してください。
+
+ @return `KintoneBulkRequest` インスタンス
+ */
+- (KintoneBulkRequest *)bulkRequest;
 
 /**
  kintone アプリ上の指定されたファイルをダウンロードします。
@@ -537,13 +726,98 @@
  @param download ダウンロードの進捗を管理する Block
  @param output ダウンロードしたデータを管理する `NSOutputStream`
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)fileDownload:(NSString *)fileKey
+                          success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                          failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                         download:(CBNetworkingDownloadProgressBlock)download
+                           output:(NSOutputStream *)output
+                            queue:(NSOperationQueue *)queue;
+
+/**
+ kintone アプリ上の指定されたファイルを、中断した位置から再開できる方法でファイルへダウンロードします。
+ 
+ 受信したデータはメモリに保持されず、一時ファイルへ直接書き込まれます。一時ファイルと進捗は `fileKey` 毎に Caches ディレクトリに保存され、通信が失敗した場合やアプリが再起動した場合も、同じ `fileKey` で再度呼び出すことにより受信済みの位置から再開します。一時的なエラーでは `[KintoneSite retryPolicy]` に従って自動的に再開します。
+ 
+ 全体を受信すると、一時ファイルは `destinationURL` へアトミックにリネームされ、success Block の responseObject として `destinationURL` が渡されます。詳細は `[CBNetworking sendRequestForResumableDownload:credential:retryPolicy:partialFileURL:destinationURL:success:failure:download:queue:]` を参照してください。
+ 
+ 例:
+ 
+    NSURL *documents = [[NSFileManager defaultManager] URLsForDirectory:NSDocumentDirectory inDomains:NSUserDomainMask][0];
+    NSURL *destinationURL = [documents URLByAppendingPathComponent:file.name];
+ 
+    [kintoneApplication.kintoneAPI fileDownload:file.fileKey
+                                          toURL:destinationURL
+                                        success:^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+                                            [self showFileAtURL:responseObject];
+                                        }
+                                        failure:failure
+                                       download:nil
+                                          queue:[CBOperationQueue sharedQueueForLane:CBOperationQueueLaneBackground]];
+ 
+ @param fileKey ダウンロードする fileKey
+ @param destinationURL ダウンロードしたファイルの保存先の URL。同じパスのファイルは置き換えられます
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param download ダウンロードの進捗を管理する Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)fileDownload:(NSString *)fileKey
+                            toURL:(NSURL *)destinationURL
+                          success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                          failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                         download:(CBNetworkingDownloadProgressBlock)download
+                            queue:(NSOperationQueue *)queue;
+
+/**
+ kintone アプリ上の指定されたファイルを、複数の範囲に分けて並行にファイルへダウンロードします。
+ 
+ `[KintoneFile size]` のファイルを最大 `rangeCount` 個の範囲に分け、並行に取得します。大きなファイルを遅延の大きい回線でダウンロードする場合に有効です。ダウンロードしたファイルのサイズは `[KintoneFile size]` と照合されます。サーバが範囲の指定に対応していない場合は 1 本の接続でダウンロードします。範囲毎のリクエストは `queue` に追加されるため、`[CBOperationQueue sharedNonConcurrentQueue]` や `[KintoneApplication defaultQueue]` のような直列の queue では並行に実行されません。
+ 
+ `rangeCount` が 1 の場合は `fileDownload:toURL:success:failure:download:queue:` と同等です。詳細は `[CBNetworking sendRequestForRangedDownload:credential:retryPolicy:length:rangeCount:partialFileURL:destinationURL:success:failure:download:queue:]` を参照してください。
+ 
+ @param file ダウンロードする `KintoneFile`
+ @param destinationURL ダウンロードしたファイルの保存先の URL。同じパスのファイルは置き換えられます
+ @param rangeCount 同時に要求する範囲の最大数
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param download ダウンロードの進捗を管理する Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)fileDownload:(NSString *)fileKey
-             success:(CBNetworkingSuccessBlockForHTTPResponse)success
-             failure:(CBNetworkingFailureBlockForHTTPResponse)failure
-            download:(CBNetworkingDownloadProgressBlock)download
-              output:(NSOutputStream *)output
-               queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)fileDownloadWithFile:(KintoneFile *)file
+                                    toURL:(NSURL *)destinationURL
+                               rangeCount:(NSUInteger)rangeCount
+                                  success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                  failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                 download:(CBNetworkingDownloadProgressBlock)download
+                                    queue:(NSOperationQueue *)queue;
+
+/**
+ kintone アプリ上の指定されたファイルを、`[KintoneSite fileCache]` を利用してダウンロードします。
+ 
+ ファイルがキャッシュにある場合は通信せず、ない場合は `fileDownload:toURL:success:failure:download:queue:` と同様にダウンロードしてキャッシュに保存します。いずれの場合も、success Block の responseObject としてキャッシュされたファイルの URL が渡されます。このファイルは変更しないでください。`NSDataReadingMappedIfSafe` で読み込むと、ファイルの内容はメモリにコピーされません。
+ 
+ キャッシュにあるファイルは、他のダウンロードメソッドでも通信せずに取得されます。詳細は `KintoneFileCache` を参照してください。
+ 
+ @param fileKey ダウンロードする fileKey
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param download ダウンロードの進捗を管理する Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)fileDownloadWithCache:(NSString *)fileKey
+                                   success:(CBNetworkingSuccessBlockForHTTPResponse)success
+                                   failure:(CBNetworkingFailureBlockForHTTPResponse)failure
+                                  download:(CBNetworkingDownloadProgressBlock)download
+                                     queue:(NSOperationQueue *)queue;
 
 /**
  ファイルを kintone アプリへアップロードします。
@@ -556,19 +830,50 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)fileUpload:(NSData *)fileData
+                       fileName:(NSString *)fileName
+                    contentType:(NSString *)contentType
+                        success:(CBNetworkingSuccessBlockForJSONResponse)success
+                        failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                          queue:(NSOperationQueue *)queue;
+
+/**
+ ディスク上のファイルを kintone アプリへアップロードします。
+ 
+ `fileUpload:fileName:contentType:success:failure:queue:` と同等です。ファイルの内容はメモリに読み込まれず、multipart のリクエストボディとしてディスクから読み込みながら送信されます。大きなファイルも一定のメモリ使用量でアップロードできます。
+ 
+ ファイルの SHA-256 は送信中に計算され、fileKey とともに `[KintoneSite uploadCache]` に保持されます。
+ 
+ ファイルを読み込めない場合、リクエストは送信されず、failure Block が実行されます。
+ 
+ @param fileURL アップロードするファイルの URL
+ @param fileName アップロードするファイル名。`nil` の場合、`fileURL` の最後のパス要素となります。
+ @param contentType アップロードするファイルの mime type
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)fileUpload:(NSData *)fileData
-          fileName:(NSString *)fileName
-       contentType:(NSString *)contentType
-           success:(CBNetworkingSuccessBlockForJSONResponse)success
-           failure:(CBNetworkingFailureBlockForJSONResponse)failure
-             queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)fileUploadWithFileURL:(NSURL *)fileURL
+                                  fileName:(NSString *)fileName
+                               contentType:(NSString *)contentType
+                                   success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                     queue:(NSOperationQueue *)queue;
 
 /**
  ファイルを kintone アプリへアップロードします。
  
  アップロードするデータをセットした `KintoneFile` を指定し、レスポンス `JSON` を `[KintoneFile setFileKeyWithJSONDictionary:]` に渡すことにより、`fileKey` のセットされた `KintoneFile` を取得できます。この `KintoneFile` をセットした `KintoneFileField` を含む `KintoneRecord` を kintone アプリへ登録/更新することでファイルのアップロードが可能となります。
  
+ `[KintoneFile initWithFileURL:name:contentType:]` で生成した `KintoneFile` の場合、`fileUploadWithFileURL:fileName:contentType:success:failure:queue:` と同様にディスクから読み込みながら送信します。
+ 
+ 同じファイルを `[KintoneUploadCache timeToLive]` 秒以内にアップロードし、その fileKey をまだレコードに添付していない場合は、通信せずに `[KintoneSite uploadCache]` が保持している fileKey をレスポンス `JSON` として success Block に渡します。この場合、request と response は `nil` です。
+ 
  例：
  
     // "Documents/sample.png" をアップロード
@@ -607,10 +912,48 @@
  @param success 成功レスポンス時に実行される Block
  @param failure 失敗レスポンス時に実行される Block
  @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)fileUploadWithFile:(KintoneFile *)file
+                                success:(CBNetworkingSuccessBlockForJSONResponse)success
+                                failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                  queue:(NSOperationQueue *)queue;
+
+/**
+ kintone アプリ上のファイルを、他の kintone アプリへコピーします。
+
+ ダウンロードしたデータはそのままアップロードのリクエストボディとして送信されます。ダウンロードとアップロードは並行に進み、どちらの通信スレッドも相手を待って止まることはありません。アップロードが追いつかない分は 1MB までメモリに、それを超える分は一時ファイルに保持されるため、ファイルの大きさに関わらず一定のメモリ使用量でコピーできます。受信したデータが `[KintoneFile size]` と一致しない場合は失敗します。
+
+ success Block には、コピー先にアップロードしたファイルのレスポンス `JSON` が渡されます。`fileUploadWithFile:success:failure:queue:` と同様に、`[KintoneFile setFileKeyWithJSONDictionary:]` で新しい `KintoneFile` に fileKey をセットし、コピー先のレコードに添付してください。いずれかのリクエストが失敗した場合は、もう一方もキャンセルされ、failure Block が実行されます。
+
+ データは一度しか流れないため、`[KintoneSite retryPolicy]` による再送は行いません。ダウンロードとアップロードは同時に実行される必要があるため、`[KintoneFile size]` が不明な場合、もしくは直列の queue (`[CBOperationQueue sharedNonConcurrentQueue]`、`[KintoneApplication defaultQueue]` 等) を指定した場合は、Caches ディレクトリの一時ファイルを経由してコピーします。`queue` が `nil` の場合は `[CBOperationQueue sharedConcurrentQueue]` で処理されます。
+
+ 例:
+
+    KintoneFile *file = [sourceField fileWithIndex:0];
+    [sourceApplication.kintoneAPI fileCopyWithFile:file
+                                      toKintoneAPI:destinationApplication.kintoneAPI
+                                           success:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+                                               KintoneFile *copy = [[KintoneFile alloc] initWithProperties:@{@"name" : file.name, @"contentType" : file.contentType}];
+                                               [copy setFileKeyWithJSONDictionary:JSON];
+                                               [destinationField addFile:copy];
+                                           }
+                                           failure:failure
+                                             queue:nil];
+
+ @param file コピーする `KintoneFile`。fileKey がない場合、`assert` で失敗します。
+ @param destination コピー先の kintone アプリの `KintoneAPI`。`nil` の場合は同じ kintone アプリにアップロードします
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
  */
-- (void)fileUploadWithFile:(KintoneFile *)file
-                   success:(CBNetworkingSuccessBlockForJSONResponse)success
-                   failure:(CBNetworkingFailureBlockForJSONResponse)failure
-                     queue:(NSOperationQueue *)queue;
+- (CBRequestHandle *)fileCopyWithFile:(KintoneFile *)file
+                         toKintoneAPI:(KintoneAPI *)destination
+                              success:(CBNetworkingSuccessBlockForJSONResponse)success
+                              failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                queue:(NSOperationQueue *)queue;
 
 @end
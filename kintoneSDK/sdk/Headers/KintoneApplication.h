@@ -20,6 +20,9 @@
 
 @class KintoneSite;
 @class KintoneAPI;
+@class KintoneFormCache;
+@class KintoneRecordStore;
+@class KintoneRecordSync;
 
 /**
  kintone アプリクラスです。
@@ -47,6 +50,41 @@
  */
 @property (nonatomic, readonly) KintoneAPI *kintoneAPI;
 
+/**
+ kintone アプリのフォーム定義のキャッシュを取得します。
+ */
+@property (nonatomic, readonly) KintoneFormCache *formCache;
+
+/**
+ kintone アプリのレコードを端末に保存するレコードストアを取得します。
+ */
+@property (nonatomic, readonly) KintoneRecordStore *recordStore;
+
+/**
+ `recordStore` を差分で同期する `KintoneRecordSync` を取得します。
+ */
+@property (nonatomic, readonly) KintoneRecordSync *recordSync;
+
+/**
+ kintone アプリのデフォルトの queue です。
+
+ `[CBKeyedOperationQueue sharedQueue]` の kintone アプリ毎の queue です。追加した operation は同じ kintone アプリの operation の順に 1 つずつ実行され、異なる kintone アプリの operation とは並行に実行されます。`KintoneAPI` のレコードの登録、一括登録/更新/削除に `nil` の queue を渡した場合、この queue が使われます。
+
+ 再送されるリクエストは queue 内の位置を保ち、再送が完了するまで後続の operation は実行されません。
+ */
+@property (nonatomic, readonly) NSOperationQueue *defaultQueue;
+
 - (KintoneApplication *)initWithAppId:(int)newAppId kintoneSite:(KintoneSite *)newKintoneSite;
 
+/**
+ レコード毎の queue を返します。
+
+ `[CBKeyedOperationQueue sharedQueue]` のレコード毎の queue です。同じレコードの operation の順序が保証され、同じ kintone アプリの異なるレコードの operation は並行に実行されます。`defaultQueue` を親のキーとするため、先に `defaultQueue` に追加された operation (一括更新等) の完了を待ってから実行され、後から `defaultQueue` に追加された operation はこの queue の operation の完了を待ちます。`KintoneAPI` のレコードの更新に `nil` の queue を渡した場合、この queue が使われます。
+
+ @param recordId レコード ID
+
+ @return レコード毎の `NSOperationQueue`
+ */
+- (NSOperationQueue *)queueForRecord:(int)recordId;
+
 @end
@@ -0,0 +1,170 @@
+//
+//  KintoneBulkRequest.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "CBNetworking.h"
+
+@class KintoneAPI;
+@class KintoneRecord;
+@class CBError;
+
+typedef void (^KintoneBulkRequestCompletionBlock)(id JSON, CBError *error);
+
+/**
+ 複数のレコード登録/更新/削除を 1 回のリクエストで実行するクラスです。
+
+ 追加した操作は `send:failure:queue:` で kintone の `bulkRequest.json` API として 1 リクエストで送信されます。同じ `KintoneSite` であれば、異なる kintone アプリへの操作を混在できます。操作はいずれかが失敗すると全てロールバックされます。
+
+ 各操作の結果は、操作の追加時に指定した completion Block に渡されます。成功時は各操作に対応するレスポンスの json が、失敗時は json と `CBError` が渡されます。失敗した操作以外の completion Block には、リクエスト全体の `CBError` が渡されます。
+
+ 1 回のリクエストで送信できる操作は 20 件までです。
+
+ 例:
+
+    KintoneBulkRequest *bulkRequest = [kintoneApplication.kintoneAPI bulkRequest];
+    [bulkRequest insertWithRecord:record app:kintoneApplication.appId completion:^(id JSON, CBError *error) {
+        // JSON: {"id":"1", "revision":"1"}
+    }];
+    [bulkRequest updateStatus:2 action:@"処理開始" assignee:nil app:kintoneApplication.appId completion:nil];
+    [bulkRequest update:3 record:relatedRecord app:relatedAppId completion:nil];
+
+    [bulkRequest send:success failure:failure queue:[CBOperationQueue sharedNonConcurrentQueue]];
+ */
+@interface KintoneBulkRequest : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ リクエストに利用する `KintoneAPI` です。
+ */
+@property (nonatomic, readonly) KintoneAPI *kintoneAPI;
+
+/**
+ 追加された操作の数です。
+ */
+@property (nonatomic, readonly) int count;
+
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ `KintoneBulkRequest` インスタンスを生成します。
+
+ `[KintoneAPI bulkRequest]` からの利用を想定しています。
+
+ @param kintoneAPI リクエストに利用する `KintoneAPI`
+
+ @return `KintoneBulkRequest` インスタンス
+ */
+- (KintoneBulkRequest *)initWithKintoneAPI:(KintoneAPI *)kintoneAPI;
+
+/// ---------------------------------
+/// @name 操作の追加
+/// ---------------------------------
+
+/**
+ 任意の API の呼び出しを追加します。
+
+ @param method HTTP メソッド (`POST`, `PUT`, `DELETE`)
+ @param api API のパス。例: `/k/v1/record.json`
+ @param payload API に渡す json 形式のパラメータ
+ @param completion 結果を受け取る Block
+ */
+- (void)addRequest:(NSString *)method api:(NSString *)api payload:(NSDictionary *)payload completion:(KintoneBulkRequestCompletionBlock)completion;
+
+/**
+ レコードの登録を追加します。
+
+ @param fieldJSON json 形式の登録レコード
+ @param appId 登録先の kintone アプリ ID
+ @param completion 結果を受け取る Block
+ */
+- (void)insert:(NSDictionary *)fieldJSON app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion;
+
+/**
+ レコードの登録を追加します。
+
+ @param record `KintoneRecord` 形式の登録レコード
+ @param appId 登録先の kintone アプリ ID
+ @param completion 結果を受け取る Block
+ */
+- (void)insertWithRecord:(KintoneRecord *)record app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion;
+
+/**
+ レコードの更新を追加します。
+
+ @param recordId 更新対象レコード番号
+ @param fieldJSON json 形式の更新レコード
+ @param appId 更新対象の kintone アプリ ID
+ @param completion 結果を受け取る Block
+ */
+- (void)update:(int)recordId fieldJSON:(NSDictionary *)fieldJSON app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion;
+
+/**
+ レコードの更新を追加します。
+
+ @param recordId 更新対象レコード番号
+ @param record `KintoneRecord` 形式の更新レコード
+ @param appId 更新対象の kintone アプリ ID
+ @param completion 結果を受け取る Block
+ */
+- (void)update:(int)recordId record:(KintoneRecord *)record app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion;
+
+/**
+ レコードのステータス変更を追加します。
+
+ @param recordId 対象レコード番号
+ @param action 実行するアクション名
+ @param assignee 次の作業者のログイン名。不要な場合は `nil`
+ @param appId 対象の kintone アプリ ID
+ @param completion 結果を受け取る Block
+ */
+- (void)updateStatus:(int)recordId action:(NSString *)action assignee:(NSString *)assignee app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion;
+
+/**
+ レコードの削除を追加します。
+
+ @param recordIds 削除対象のレコード番号 'NSNumber'
+ @param appId 削除対象の kintone アプリ ID
+ @param completion 結果を受け取る Block
+ */
+- (void)bulkDelete:(NSArray *)recordIds app:(int)appId completion:(KintoneBulkRequestCompletionBlock)completion;
+
+/// ---------------------------------
+/// @name 送信
+/// ---------------------------------
+
+/**
+ 追加された操作を 1 回のリクエストで送信します。
+
+ 各操作の completion Block は、success / failure Block の前に追加した順に実行されます。操作が 1 件も追加されていない場合、もしくは 20 件を超える場合は assert で失敗します。
+
+ @param success 成功レスポンス時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return リクエストの `CBRequestHandle`
+ */
+- (CBRequestHandle *)send:(CBNetworkingSuccessBlockForJSONResponse)success
+                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                    queue:(NSOperationQueue *)queue;
+
+@end
@@ -287,6 +287,50 @@ typedef NS_ENUM(NSUInteger, KintoneFieldType) {
  */
 - (NSString *)conditionQuery:(KintoneQueryOperatorType)operator value:(id)value;
 
+/**
+ レコードのフィールド値が、指定された演算子と値の条件に一致するか判定します。
+
+ 本メソッドは主に `[KintoneQuery matchesRecord:]` から呼ばれることを想定しています。`conditionQuery:value:` と同じ演算子と値を受け付け、フィールドタイプ毎にサーバと同じ規則で比較します。
+
+ - 文字列の `like` は大文字と小文字、全角と半角を区別しない部分一致です。
+ - 数値は 10 進数として比較します。
+ - 日時は分単位で比較します。`TODAY()`, `THIS_MONTH()`, `THIS_YEAR()` は端末のタイムゾーンの期間と比較します。
+ - 値が空のフィールドは、文字列の空文字列との比較を除き、`!=`, `not in`, `not like` のみ一致します。
+ - `LOGINUSER()` は端末では評価できないため、いずれのユーザーとも一致しません。
+
+ 条件を生成できないフィールドタイプの場合は `NO` を返します。
+
+ @param operatorType kintone クエリ演算子
+ @param value 条件の値
+ @param recordValue レコードのフィールド値
+ 
+ @return 条件に一致する場合は YES
+ */
+- (BOOL)matchesCondition:(KintoneQueryOperatorType)operatorType value:(id)value recordValue:(id)recordValue;
+
+/**
+ レコードのフィールド値を `order by` の順に比較します。
+
+ 空の値は最も小さい値として扱います。
+
+ @param recordValue1 レコードのフィールド値
+ @param recordValue2 レコードのフィールド値
+ 
+ @return 比較結果
+ */
+- (NSComparisonResult)compareRecordValue:(id)recordValue1 toRecordValue:(id)recordValue2;
+
+/**
+ レコードのフィールド値を、`compareRecordValue:toRecordValue:` と同じ順序で比較できるキーに変換します。
+
+ 数値は `NSDecimalNumber`、日付と時刻は文字列、日時は分単位の `NSNumber` に変換されます。条件の値の `NSDate` や `NSNumber` も同じキーに変換できます。
+
+ @param recordValue レコードのフィールド値
+ 
+ @return `compare:` で比較できるキー。値が空もしくは変換できない場合は `nil`
+ */
+- (id)sortKeyOfRecordValue:(id)recordValue;
+
 /**
  フィールドに値をセットします。
  
@@ -1224,9 +1268,21 @@ typedef NS_ENUM(NSUInteger, KintoneFieldType) {
 
 /**
  kintone アプリ レコード番号フィールドです。
+
+ フィールドコードに `$id` を指定すると、レコード ID を条件とするクエリに利用できます。
  */
 @interface KintoneRecordNumberField : KintoneField
 
+/**
+ 指定された演算子と値で、kintone クエリの条件文を生成します。
+
+ @param operatorType クエリ演算子。`KintoneEqualQueryOperatorType` (=), `KintoneNotEqualQueryOperatorType` (!=), `KintoneGreaterThanQueryOperatorType` (>), `KintoneLessThanQueryOperatorType` (<), `KintoneGreaterThanOrEqualQueryOperatorType` (>=), `KintoneLessThanOrEqualQueryOperatorType` (<=), `KintoneInQueryOperatorType` (in), `KintoneNotInQueryOperatorType` (not in) 以外は assert で失敗します。
+ @param value フィールド値。`KintoneInQueryOperatorType`, `KintoneNotInQueryOperatorType` に関しては `NSNumber` の `NSArray` 以外が指定されると、assert で失敗します。それ以外の `operatorType` の場合、`NSNumber` 以外で失敗します。
+
+ @return 指定された演算子と値で生成された kintone クエリ条件文
+ */
+- (NSString *)conditionQuery:(KintoneQueryOperatorType)operatorType value:(id)value;
+
 @end
 
 /**
@@ -18,6 +18,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class CBError;
+
 /**
  kintone ファイルクラスです。
  
@@ -45,15 +47,24 @@
 @property (nonatomic, copy, readonly) NSString *name;
 
 /**
- ファイルサイズです。
+ ファイルサイズ(バイト)です。2GB を超えるファイルも扱えるよう 64 ビットです。
  */
-@property (nonatomic, readonly) int size;
+@property (nonatomic, readonly) long long size;
 
 /**
  ファイルデータです。
+ 
+ `initWithFileURL:name:contentType:` で生成した場合は `nil` です。
  */
 @property (nonatomic, readonly) NSData *data;
 
+/**
+ ファイルの URL です。
+ 
+ `initWithFileURL:name:contentType:`, `initWithMappedFileURL:name:contentType:error:` で生成した場合にセットされます。アップロード時はこのファイルをディスクから読み込みながら送信します。
+ */
+@property (nonatomic, readonly) NSURL *fileURL;
+
 /**
  削除対象ファイルフラグです。YES の場合、削除対象となります。
  */
@@ -68,6 +79,8 @@
 /**
  新規作成された `KintoneFile` インスタンスを返します。
  
+ `NSDataReadingMappedIfSafe` で読み込んだ `NSData` もコピーされずに送信されます。`initWithMappedFileURL:name:contentType:error:` を参照してください。
+ 
  @param data ファイルデータ
  @param name ファイル名
  @param contentType ファイルの mime type
@@ -76,6 +89,37 @@
  */
 - (KintoneFile *)initWithData:(NSData *)data name:(NSString *)name contentType:(NSString *)contentType;
 
+/**
+ ディスク上のファイルをメモリマップした `KintoneFile` インスタンスを返します。
+ 
+ ファイルは `NSDataReadingMappedIfSafe` で `data` にマップされ、メモリにコピーされません。参照されたページはファイルから読み込まれ、メモリが不足した場合はシステムが破棄できます。`fileURL` もセットされるため、アップロード時は `initWithFileURL:name:contentType:` と同様にファイルをディスクから読み込みながら送信されます。ファイルをマップできないボリュームの場合は、通常どおり読み込まれます。
+ 
+ アップロードするだけの場合は、`initWithFileURL:name:contentType:` を利用してください。アップロード前に `data` を参照する場合(画像の表示等)に有効です。
+ 
+ マップ中のファイルを変更、削除しないでください。
+ 
+ @param fileURL ファイルの URL。ファイル URL でない場合、`assert` で失敗します。
+ @param name ファイル名。`nil` の場合、`fileURL` の最後のパス要素となります。
+ @param contentType ファイルの mime type
+ @param error ファイルを読み込めない場合のエラー
+ 
+ @return 'KintoneFile` インスタンス。ファイルを読み込めない場合は `nil`
+ */
+- (KintoneFile *)initWithMappedFileURL:(NSURL *)fileURL name:(NSString *)name contentType:(NSString *)contentType error:(CBError* __autoreleasing *)error;
+
+/**
+ ディスク上のファイルを参照する `KintoneFile` インスタンスを返します。
+ 
+ ファイルの内容はメモリに読み込まれず、`[KintoneAPI fileUploadWithFile:success:failure:queue:]` でアップロードする際にディスクから読み込みながら送信されます。大きなファイルも一定のメモリ使用量でアップロードできます。
+ 
+ @param fileURL ファイルの URL。ファイル URL でない場合、`assert` で失敗します。
+ @param name ファイル名。`nil` の場合、`fileURL` の最後のパス要素となります。
+ @param contentType ファイルの mime type
+ 
+ @return 'KintoneFile` インスタンス
+ */
+- (KintoneFile *)initWithFileURL:(NSURL *)fileURL name:(NSString *)name contentType:(NSString *)contentType;
+
 /// ---------------------------------
 /// @name その他メソッド
 /// ---------------------------------
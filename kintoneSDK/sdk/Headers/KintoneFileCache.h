@@ -0,0 +1,150 @@
+//
+//  KintoneFileCache.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CBError;
+
+/**
+ ダウンロードした添付ファイルのディスクキャッシュクラスです。
+
+ `[KintoneSite fileCache]` よりインスタンスを取得できます。
+
+ ファイルは内容の SHA-256 をファイル名として Caches ディレクトリに保存され、`fileKey` から内容のハッシュへの索引で参照されます。同じ内容のファイルは、`fileKey` が異なっても 1 つだけ保存されます。キャッシュはアプリの再起動後も利用できます。
+
+ 合計サイズが `maxSize` を超えると、最後に参照されてから最も時間の経ったファイルからバックグラウンドで削除されます。
+
+ `[KintoneAPI fileDownloadWithCache:success:failure:download:queue:]` はキャッシュにあるファイルを通信せずに返し、ないファイルをダウンロードしてキャッシュに保存します。
+
+ 例:
+
+    [kintoneApplication.kintoneAPI fileDownloadWithCache:file.fileKey
+                                                 success:^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
+                                                     // memory-mapped, the file is not read into memory
+                                                     NSData *data = [NSData dataWithContentsOfURL:responseObject options:NSDataReadingMappedIfSafe error:nil];
+                                                     imageView.image = [UIImage imageWithData:data];
+                                                 }
+                                                 failure:failure
+                                                download:nil
+                                                   queue:[CBOperationQueue sharedConcurrentQueue]];
+ */
+@interface KintoneFileCache : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ キャッシュのディレクトリです。
+ */
+@property (nonatomic, readonly) NSURL *directoryURL;
+
+/**
+ キャッシュの最大サイズ(バイト)です。
+
+ デフォルトは 100MB です。
+ */
+@property (nonatomic) unsigned long long maxSize;
+
+/**
+ キャッシュされたファイルの合計サイズ(バイト)です。
+ */
+@property (nonatomic, readonly) unsigned long long currentSize;
+
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ `KintoneFileCache` インスタンスを生成します。
+
+ 同じディレクトリを使う `KintoneFileCache` を複数生成しないでください。
+
+ @param directoryURL キャッシュのディレクトリ
+
+ @return `KintoneFileCache` インスタンス
+ */
+- (KintoneFileCache *)initWithDirectoryURL:(NSURL *)directoryURL;
+
+/// ---------------------------------
+/// @name キャッシュの参照
+/// ---------------------------------
+
+/**
+ キャッシュされたファイルの URL を返します。
+
+ 返されたファイルは変更しないでください。ファイルはキャッシュから削除されるまで有効です。
+
+ @param fileKey fileKey
+
+ @return ファイルの URL。キャッシュにない場合は `nil`
+ */
+- (NSURL *)fileURLForFileKey:(NSString *)fileKey;
+
+/**
+ キャッシュされたファイルの内容を返します。
+
+ ファイルはメモリマップされ、参照された部分だけが読み込まれます。
+
+ @param fileKey fileKey
+
+ @return ファイルの内容。キャッシュにない場合は `nil`
+ */
+- (NSData *)dataForFileKey:(NSString *)fileKey;
+
+/// ---------------------------------
+/// @name キャッシュの更新
+/// ---------------------------------
+
+/**
+ ファイルをキャッシュに移動します。
+
+ `fileURL` のファイルはキャッシュのディレクトリに移動されます。`fileURL` は同じボリューム上にある必要があります。
+
+ @param fileURL キャッシュするファイルの URL
+ @param fileKey fileKey
+ @param error ファイルを移動できない場合のエラー
+
+ @return キャッシュされたファイルの URL。失敗した場合は `nil`
+ */
+- (NSURL *)storeFileAtURL:(NSURL *)fileURL fileKey:(NSString *)fileKey error:(CBError* __autoreleasing *)error;
+
+/**
+ データをキャッシュに保存します。
+
+ @param data キャッシュするデータ
+ @param fileKey fileKey
+ @param error ファイルを保存できない場合のエラー
+
+ @return キャッシュされたファイルの URL。失敗した場合は `nil`
+ */
+- (NSURL *)storeData:(NSData *)data fileKey:(NSString *)fileKey error:(CBError* __autoreleasing *)error;
+
+/**
+ ファイルをキャッシュから削除します。
+
+ @param fileKey fileKey
+ */
+- (void)removeFileForFileKey:(NSString *)fileKey;
+
+/**
+ 全てのファイルをキャッシュから削除します。
+ */
+- (void)removeAllFiles;
+
+@end
@@ -0,0 +1,131 @@
+//
+//  KintoneFormCache.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "CBNetworking.h"
+
+@class KintoneApplication;
+
+/**
+ フォーム定義が変更された場合に通知される `NSNotification` の名前です。
+
+ `object` は `KintoneFormCache`、`userInfo` の `fields` に新しい `KintoneField` の `NSDictionary` が含まれます。
+ */
+extern NSString * const KintoneFormCacheDidChangeNotification;
+
+typedef void (^KintoneFormCacheFieldsBlock)(NSDictionary *fields, id formJSON);
+
+/**
+ kintone アプリのフォーム定義のキャッシュクラスです。
+
+ `[KintoneApplication formCache]` よりインスタンスを取得できます。
+
+ フォーム定義は、解析済みの `KintoneField` の `NSDictionary` としてメモリに、`form.json` のレスポンスとして Caches ディレクトリに保存されます。メモリにキャッシュがない場合はディスクから読み込むため、アプリの起動直後でも通信せずにフォーム定義を取得できます。
+
+ キャッシュの取得から `timeToLive` 秒が経過している場合は、キャッシュを返した後にバックグラウンドで `form.json` を再取得します。レスポンスに `revision` が含まれる場合はリビジョンで、それ以外の場合は内容で変更を判定し、変更があった場合のみキャッシュを更新して `KintoneFormCacheDidChangeNotification` を通知します。
+
+ 例:
+
+    KintoneFormCacheFieldsBlock fields = ^(NSDictionary *fields, id formJSON) {
+        self.fields = fields;
+        [self.tableView reloadData];
+    };
+
+    [kintoneApplication.formCache fields:fields failure:failure queue:[CBOperationQueue sharedNonConcurrentQueue]];
+ */
+@interface KintoneFormCache : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ 紐付けられた kintone アプリです。
+ */
+@property (nonatomic, weak, readonly) KintoneApplication *kintoneApplication;
+
+/**
+ キャッシュを再検証するまでの秒数です。
+
+ デフォルトは 300 秒です。
+ */
+@property (nonatomic) NSTimeInterval timeToLive;
+
+/**
+ キャッシュされた `KintoneField` の `NSDictionary` です。キーはフィールドコードです。
+
+ メモリにキャッシュがない場合はディスクから読み込みます。キャッシュがない場合は `nil` です。通信は行いません。
+ */
+@property (nonatomic, readonly) NSDictionary *fields;
+
+/**
+ キャッシュされた `form.json` のレスポンスです。キャッシュがない場合は `nil` です。
+ */
+@property (nonatomic, readonly) id formJSON;
+
+/**
+ キャッシュを取得(もしくは再検証)した日時です。キャッシュがない場合は `nil` です。
+ */
+@property (nonatomic, readonly) NSDate *fetchedDate;
+
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ `KintoneFormCache` インスタンスを生成します。
+
+ @param kintoneApplication kintone アプリ
+
+ @return `KintoneFormCache` インスタンス
+ */
+- (KintoneFormCache *)initWithKintoneApplication:(KintoneApplication *)kintoneApplication;
+
+/// ---------------------------------
+/// @name フォーム定義の取得
+/// ---------------------------------
+
+/**
+ フォーム定義を取得します。
+
+ キャッシュがある場合は、fields Block を直ちに実行します。キャッシュが `timeToLive` を過ぎている場合は、その後バックグラウンドで再検証します。キャッシュがない場合は `form.json` を取得し、完了後に fields Block を実行します。
+
+ @param fields フォーム定義を受け取る Block
+ @param failure キャッシュがなく、取得に失敗した場合に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+ */
+- (void)fields:(KintoneFormCacheFieldsBlock)fields
+       failure:(CBNetworkingFailureBlockForJSONResponse)failure
+         queue:(NSOperationQueue *)queue;
+
+/**
+ `timeToLive` に関わらず、フォーム定義を再検証します。
+
+ 変更があった場合は `KintoneFormCacheDidChangeNotification` を通知します。既に取得中の場合は新たに通信せず、その結果を待ちます。
+
+ @param failure 失敗レスポンス時に実行される Block。取得中の通信が失敗した場合も実行されます
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+ */
+- (void)revalidate:(CBNetworkingFailureBlockForJSONResponse)failure queue:(NSOperationQueue *)queue;
+
+/**
+ メモリとディスクのキャッシュを削除します。
+ */
+- (void)clear;
+
+@end
@@ -18,7 +18,9 @@
 
 #import <Foundation/Foundation.h>
 
+@class CBError;
 @class KintoneField;
+@class KintoneRecord;
 
 typedef NS_ENUM(NSUInteger, KintoneQueryOperatorType) {
     KintoneEqualQueryOperatorType              = NSEqualToPredicateOperatorType,
@@ -74,10 +76,40 @@ typedef NS_ENUM(NSUInteger, KintoneQueryOperatorType) {
  
  詳しくは [cybozu.com developers - レコード取得](http://developers.cybozu.com/ja/kintone/apprec-readapi.html) を参照。
  */
-@interface KintoneQuery : NSObject
+@interface KintoneQuery : NSObject <NSCopying>
 
 + (NSString *)operatorTypeToString:(KintoneQueryOperatorType)operatorType;
 
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ クエリ文字列を解析して `KintoneQuery` インスタンスを生成します。
+
+ 条件、`and` / `or` と括弧、`TODAY()`, `THIS_MONTH()`, `THIS_YEAR()`, `LOGINUSER()` 関数、`order by`, `limit`, `offset` を解析し、演算子メソッドで生成した場合と同じ where 句を設定します。`and` は `or` より優先されます。条件の値はフィールドタイプ毎に演算子メソッドと同じ型 (`NSString`, `NSDecimalNumber`, `NSDate`) に変換されます。
+
+ 生成したインスタンスは `kintoneQuery` による再生成や `filterRecords:` による端末上での評価に利用できます。
+
+ - フィールドコードは `fields` から検索します。`$id` はレコード番号として扱います。
+ - `order by` は 1 つのフィールドのみ指定できます。`asc` / `desc` を省略した場合は昇順です。
+ - 上記以外の関数や、フィールドタイプが受け付けない演算子と値はエラーとなります。
+
+ 例:
+
+    CBError *error;
+    KintoneQuery *query = [KintoneQuery kintoneQueryWithString:@"優先度 in (\"A\", \"B\") and 期限 <= TODAY() order by 期限 asc"
+                                                        fields:kintoneApplication.formCache.fields
+                                                         error:&error];
+
+ @param string クエリ文字列
+ @param fields フィールドコードをキー、`KintoneField` を値とする `NSDictionary`。`[KintoneFormCache fields]` より取得可能。
+ @param error エラー
+ 
+ @return `KintoneQuery` インスタンス。解析できない場合は `nil`
+ */
++ (KintoneQuery *)kintoneQueryWithString:(NSString *)string fields:(NSDictionary *)fields error:(CBError* __autoreleasing *)error;
+
 /// ---------------------------------
 /// @name 句
 /// ---------------------------------
@@ -239,6 +271,38 @@ typedef NS_ENUM(NSUInteger, KintoneQueryOperatorType) {
  */
 - (NSArray *)notLike:(KintoneField *)field value:(NSString *)value;
 
+/// ---------------------------------
+/// @name 句の取得
+/// ---------------------------------
+
+/**
+ 設定されている where 句です。
+ 
+ @return `where:` で設定した `NSArray`。設定されていない場合は `nil`
+ */
+- (NSArray *)whereClause;
+
+/**
+ 設定されている order by 句です。
+ 
+ @return ソート対象フィールドと昇順/降順を表す `NSNumber` の `NSArray`。設定されていない場合は `nil`
+ */
+- (NSArray *)orderByClause;
+
+/**
+ 設定されている limit 値です。
+ 
+ @return limit 値。設定されていない場合は `nil`
+ */
+- (NSNumber *)limitClause;
+
+/**
+ 設定されている offset 値です。
+ 
+ @return offset 値。設定されていない場合は `nil`
+ */
+- (NSNumber *)offsetClause;
+
 /// ---------------------------------
 /// @name クエリ文字列
 /// ---------------------------------
@@ -252,4 +316,59 @@ typedef NS_ENUM(NSUInteger, KintoneQueryOperatorType) {
  */
 - (NSString *)kintoneQuery;
 
+/**
+ 正規化されたクエリ文字列を生成します。
+
+ 意味の同じクエリが同じ文字列となるように、入れ子の `and` / `or` を平坦化し、条件と `in` の値を並べ替えて重複を除きます。クエリ文字列をキーとするキャッシュなどに利用できます。
+
+ @return 正規化されたクエリ文字列
+ */
+- (NSString *)canonicalKintoneQuery;
+
+/// ---------------------------------
+/// @name 端末上での評価
+/// ---------------------------------
+
+/**
+ where 句の `LOGINUSER()` をユーザーのログイン名に置き換えた `KintoneQuery` を返します。
+
+ 端末上では `LOGINUSER()` を評価できないため、`LOGINUSER()` を含むクエリは `matchesRecord:`, `filterRecords:` の前に置き換えてください。`[KintoneRecordStore recordsWithKintoneQuery:]` は `[KintoneSite cbCredential]` のユーザーで置き換えます。
+
+ 例:
+
+    NSArray *records = [[query kintoneQueryWithLoginUser:kintoneSite.cbCredential.user] filterRecords:records];
+
+ @param user ログイン名
+
+ @return 置き換えた `KintoneQuery`。`LOGINUSER()` を含み、`user` が `nil` もしくは空文字の場合は `nil`
+ */
+- (KintoneQuery *)kintoneQueryWithLoginUser:(NSString *)user;
+
+/**
+ レコードが where 句の条件に一致するか判定します。
+
+ 通信せずに端末上で評価します。条件の評価は各フィールドの `[KintoneField matchesCondition:value:recordValue:]` で行います。テーブル内のフィールドの条件は、いずれかの行が一致する場合に一致します。ただし `!=`, `not in`, `not like` は全ての行が一致する場合に一致します。 `LOGINUSER()` を含む場合は `kintoneQueryWithLoginUser:` で置き換えてから評価してください。
+
+ @param record `KintoneRecord` インスタンス
+ 
+ @return 一致する場合は `YES`。where 句が設定されていない場合は常に `YES`
+ */
+- (BOOL)matchesRecord:(KintoneRecord *)record;
+
+/**
+ レコードを where 句、order by 句、limit 句、offset 句に従って絞り込みます。
+
+ 通信せずに端末上で評価します。order by 句が設定されていない場合はレコード番号の降順に並べます。limit 句が設定されていない場合、サーバーと異なり件数は制限されません。
+ 
+ 例:
+ 
+    // 保存されたレコードから検索する
+    NSArray *records = [query filterRecords:[kintoneApplication.recordStore records]];
+
+ @param records `KintoneRecord` の `NSArray`
+ 
+ @return 条件に一致した `KintoneRecord` の `NSArray`
+ */
+- (NSArray *)filterRecords:(NSArray *)records;
+
 @end
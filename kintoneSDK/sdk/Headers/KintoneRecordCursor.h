@@ -0,0 +1,139 @@
+//
+//  KintoneRecordCursor.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "CBNetworking.h"
+
+@class KintoneAPI;
+@class KintoneQuery;
+
+typedef void (^KintoneRecordCursorBatchBlock)(NSArray *records, BOOL *stop);
+typedef void (^KintoneRecordCursorCompletionBlock)(int count);
+
+/**
+ `KintoneQuery` に一致するレコードをページ単位で順に取得するカーソルクラスです。
+
+ `[KintoneAPI recordsWithFields:kintoneQuery:success:failure:queue:]` は 1 回のリクエストでサーバが返す 1 ページ分のレコードしか取得できません。`KintoneRecordCursor` は `limit` / `offset` を自動的に設定しながらページを順に取得し、`KintoneRecord` の `NSArray` として batch Block に渡します。
+
+ kintone は 10,000 を超える `offset` を受け付けません。`KintoneQuery` に order by がない場合、もしくは `$id` の order by の場合は、受信した最後のレコードの `$id` より後 (`$id < 最後の $id order by $id desc` 等) をページの条件とするため、レコード数によらず全てのページを取得できます。この場合、`offset` は先行して取得するページ分のみとなり、`fields` に `$id` がなくても `$id` が取得されます。その他のフィールドの order by の場合は `offset` でページを指定します。
+
+ ページ N を batch Block で処理している間も、後続のページのリクエストを `prefetchDepth` 件まで先行して送信します。batch Block はページ順に、メインスレッドで実行されます。
+
+ `KintoneQuery` に `limit` / `offset` が設定されている場合は、その範囲内のレコードのみを取得します。
+
+ 例:
+
+    KintoneRecordCursor *cursor = [kintoneApplication.kintoneAPI recordCursorWithFields:nil kintoneQuery:q];
+    cursor.pageSize = 500;
+    cursor.prefetchDepth = 3;
+
+    KintoneRecordCursorBatchBlock batch = ^(NSArray *records, BOOL *stop) {
+        [objects addObjectsFromArray:records];
+    };
+    KintoneRecordCursorCompletionBlock completion = ^(int count) {
+        [CBLog logVerbose:@"fetched %d records", count];
+    };
+
+    [cursor fetch:batch completion:completion failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
+ */
+@interface KintoneRecordCursor : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ リクエストに利用する `KintoneAPI` です。
+ */
+@property (nonatomic, readonly) KintoneAPI *kintoneAPI;
+
+/**
+ 1 リクエストで取得するレコード数です。
+
+ デフォルトは 100 です。kintone の上限である 500 を超える値は指定できません。
+ */
+@property (nonatomic) int pageSize;
+
+/**
+ 同時にリクエストするページ数です。
+
+ デフォルトは 2 で、ページ N の処理中にページ N+1 を取得します。1 を指定すると、ページを 1 つずつ直列に取得します。
+ */
+@property (nonatomic) int prefetchDepth;
+
+/**
+ batch Block に渡したレコード数です。
+ */
+@property (nonatomic, readonly) int count;
+
+/**
+ 全ページの取得が完了したか、失敗もしくはキャンセルされた場合に `YES` となります。
+ */
+@property (nonatomic, readonly, getter = isFinished) BOOL finished;
+
+/**
+ 受信したレスポンスのうち、最も早い `Date` ヘッダが示すサーバの日時です。
+
+ 取得中に更新されたレコードを次回の差分取得で取りこぼさないよう、取得開始時点のサーバ時刻の目安として利用できます。レスポンスを受信するまでは `nil` です。
+ */
+@property (nonatomic, readonly) NSDate *serverDate;
+
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ `KintoneRecordCursor` インスタンスを生成します。
+
+ `[KintoneAPI recordCursorWithFields:kintoneQuery:]` からの利用を想定しています。
+
+ @param kintoneAPI リクエストに利用する `KintoneAPI`
+ @param fields レスポンスとして取得したいフィールドを `KintoneField` として指定
+ @param query 検索クエリ。`nil` の場合は全レコードが対象となります。
+
+ @return `KintoneRecordCursor` インスタンス
+ */
+- (KintoneRecordCursor *)initWithKintoneAPI:(KintoneAPI *)kintoneAPI fields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query;
+
+/// ---------------------------------
+/// @name レコードの取得
+/// ---------------------------------
+
+/**
+ レコードの取得を開始します。
+
+ batch Block の `stop` に `YES` をセットすると、以降のページの取得を中止します。この場合 completion Block は実行されません。
+
+ @param batch ページ毎に `KintoneRecord` の `NSArray` を受け取る Block
+ @param completion 全ページの取得完了時に実行される Block。引数は取得したレコード数です。
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`。ページを並行して取得するため `[CBOperationQueue sharedConcurrentQueue]` の利用を推奨します。
+ */
+- (void)fetch:(KintoneRecordCursorBatchBlock)batch
+   completion:(KintoneRecordCursorCompletionBlock)completion
+      failure:(CBNetworkingFailureBlockForJSONResponse)failure
+        queue:(NSOperationQueue *)queue;
+
+/**
+ レコードの取得を中止します。
+
+ 以降、各 Block は実行されません。
+ */
+- (void)cancel;
+
+@end
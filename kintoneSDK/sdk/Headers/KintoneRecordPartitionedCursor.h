@@ -0,0 +1,128 @@
+//
+//  KintoneRecordPartitionedCursor.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "CBNetworking.h"
+#import "KintoneRecordCursor.h"
+
+@class KintoneAPI;
+@class KintoneQuery;
+
+/**
+ `KintoneQuery` に一致するレコードを、レコード ID (`$id`) の範囲で分割して並行に取得するカーソルクラスです。
+
+ 最初に検索条件に一致するレコード ID の最小値と最大値を取得し、その範囲を `partitions` 個の重複しない範囲に分割します。各範囲は `KintoneRecordCursor` により並行して取得されるため、全レコードの取得にかかる時間を概ね `partitions` 分の 1 に短縮できます。
+
+ `KintoneQuery` に `orderBy` が設定されている場合、各範囲の結果をマージし、ソート順を保ったまま batch Block に渡します。`orderBy` が設定されていない場合は、各範囲から受信した順に batch Block に渡すため、レコードの順序は保証されません。
+
+ `KintoneQuery` に `limit` / `offset` が設定されている場合は範囲を分割できないため、`KintoneRecordCursor` と同様に 1 つのカーソルで取得します。
+
+ 例:
+
+    KintoneRecordPartitionedCursor *cursor = [kintoneApplication.kintoneAPI recordPartitionedCursorWithFields:nil kintoneQuery:q];
+    cursor.partitions = 8;
+    cursor.pageSize = 500;
+
+    [cursor fetch:batch completion:completion failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
+ */
+@interface KintoneRecordPartitionedCursor : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ リクエストに利用する `KintoneAPI` です。
+ */
+@property (nonatomic, readonly) KintoneAPI *kintoneAPI;
+
+/**
+ レコード ID の範囲の分割数です。
+
+ デフォルトは 4 です。分割数だけのリクエストが同時に送信されます。
+ */
+@property (nonatomic) int partitions;
+
+/**
+ 各範囲で 1 リクエストで取得するレコード数です。
+
+ デフォルトは 100 です。kintone の上限である 500 を超える値は指定できません。
+ */
+@property (nonatomic) int pageSize;
+
+/**
+ batch Block に渡したレコード数です。
+ */
+@property (nonatomic, readonly) int count;
+
+/**
+ 全範囲の取得が完了したか、失敗もしくはキャンセルされた場合に `YES` となります。
+ */
+@property (nonatomic, readonly, getter = isFinished) BOOL finished;
+
+/**
+ 受信したレスポンスのうち、最も早い `Date` ヘッダが示すサーバの日時です。
+
+ `[KintoneRecordCursor serverDate]` と同様に、取得開始時点のサーバ時刻の目安として利用できます。レスポンスを受信するまでは `nil` です。
+ */
+@property (nonatomic, readonly) NSDate *serverDate;
+
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ `KintoneRecordPartitionedCursor` インスタンスを生成します。
+
+ `[KintoneAPI recordPartitionedCursorWithFields:kintoneQuery:]` からの利用を想定しています。
+
+ @param kintoneAPI リクエストに利用する `KintoneAPI`
+ @param fields レスポンスとして取得したいフィールドを `KintoneField` として指定。`orderBy` に指定したフィールドが含まれていない場合は、マージのために追加されます。
+ @param query 検索クエリ。`nil` の場合は全レコードが対象となります。
+
+ @return `KintoneRecordPartitionedCursor` インスタンス
+ */
+- (KintoneRecordPartitionedCursor *)initWithKintoneAPI:(KintoneAPI *)kintoneAPI fields:(NSArray *)fields kintoneQuery:(KintoneQuery *)query;
+
+/// ---------------------------------
+/// @name レコードの取得
+/// ---------------------------------
+
+/**
+ レコードの取得を開始します。
+
+ batch Block の `stop` に `YES` をセットすると、全範囲の取得を中止します。この場合 completion Block は実行されません。いずれかの範囲で失敗した場合も、残りの範囲の取得を中止し、failure Block を 1 度だけ実行します。
+
+ @param batch `KintoneRecord` の `NSArray` を受け取る Block
+ @param completion 全範囲の取得完了時に実行される Block。引数は取得したレコード数です。
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`。範囲を並行して取得するため `[CBOperationQueue sharedConcurrentQueue]` を指定してください。
+ */
+- (void)fetch:(KintoneRecordCursorBatchBlock)batch
+   completion:(KintoneRecordCursorCompletionBlock)completion
+      failure:(CBNetworkingFailureBlockForJSONResponse)failure
+        queue:(NSOperationQueue *)queue;
+
+/**
+ レコードの取得を中止します。
+
+ 以降、各 Block は実行されません。
+ */
+- (void)cancel;
+
+@end
@@ -0,0 +1,233 @@
+//
+//  KintoneRecordStore.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CBError;
+@class KintoneApplication;
+@class KintoneField;
+@class KintoneQuery;
+@class KintoneRecord;
+
+/**
+ レコードストアが変更された場合に通知される `NSNotification` の名前です。
+
+ `object` は `KintoneRecordStore`、`userInfo` の `recordIds` に変更もしくは削除されたレコード ID の `NSNumber` の `NSArray` が含まれます。通知はメインスレッドで行われます。
+ */
+extern NSString * const KintoneRecordStoreDidChangeNotification;
+
+/**
+ kintone アプリのレコードを端末に保存するクラスです。
+
+ `[KintoneApplication recordStore]` よりインスタンスを取得できます。
+
+ レコードはレコード ID (`$id`) をキーに、`records.json` のレスポンスの形式のまま保存されます。変更は Caches ディレクトリのログファイルに追記され、ログが大きくなるとバックグラウンドで圧縮されます。ログはインスタンスの生成時にバックグラウンドで一度だけ読み込まれ、以降の参照はメモリ上の索引から通信せずに返されます。読み込みの完了前の参照は完了を待つため、メインスレッドを止めたくない場合は `loadWithCompletion:` の完了後に参照してください。
+
+ `KintoneAPI` のレコード取得メソッドは、`$id` と `$revision` を含むレコードを自動的に保存します。
+
+ - フィールドを指定せずに取得したレコードは、保存されたレコードを置き換えます。
+ - フィールドを指定して取得したレコードは、保存されたレコードと `$revision` が同じ場合のみ併合されます。`$revision` が異なる場合、保存されたレコードは削除されます。`$revision` を含まない場合は何もしません。
+ - 保存されたレコードより `$revision` が古いレコードは保存されません。
+ - レコードを更新もしくは削除した場合、保存されたレコードは削除されます。
+
+ 例:
+
+    // 保存されたレコードを直ちに表示し、通信の完了後に更新する
+    self.records = [kintoneApplication.recordStore records];
+    [self.tableView reloadData];
+
+    [kintoneApplication.kintoneAPI recordsWithFields:nil kintoneQuery:nil success:success failure:failure queue:nil];
+ */
+@interface KintoneRecordStore : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ 紐付けられた kintone アプリです。
+ */
+@property (nonatomic, weak, readonly) KintoneApplication *kintoneApplication;
+
+/**
+ 保存されたレコードの数です。
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ `KintoneRecordStore` インスタンスを生成します。
+
+ 同じ kintone アプリの `KintoneRecordStore` を複数生成しないでください。
+
+ @param kintoneApplication kintone アプリ
+
+ @return `KintoneRecordStore` インスタンス
+ */
+- (KintoneRecordStore *)initWithKintoneApplication:(KintoneApplication *)kintoneApplication;
+
+/// ---------------------------------
+/// @name レコードの参照
+/// ---------------------------------
+
+/**
+ ログの読み込みの完了後に Block を実行します。
+
+ Block はメインスレッドで実行されます。読み込み済みの場合も非同期に実行されます。
+
+ @param completion 読み込みの完了後に実行される Block
+ */
+- (void)loadWithCompletion:(void (^)(void))completion;
+
+/**
+ 保存されたレコードを返します。
+
+ @param recordId レコード ID
+
+ @return `KintoneRecord` インスタンス。保存されていない場合は `nil`
+ */
+- (KintoneRecord *)recordWithId:(int)recordId;
+
+/**
+ 保存されたレコードを `records.json` のレスポンスの形式で返します。
+
+ `KintoneRecord` を生成しないため、`recordWithId:` より高速です。
+
+ @param recordId レコード ID
+
+ @return レコードの `NSDictionary`。保存されていない場合は `nil`
+ */
+- (NSDictionary *)recordDictionaryWithId:(int)recordId;
+
+/**
+ 保存されたレコードのリビジョンを返します。
+
+ @param recordId レコード ID
+
+ @return `$revision` の値。保存されていない場合は -1
+ */
+- (long long)revisionOfRecordWithId:(int)recordId;
+
+/**
+ 保存された全てのレコードを返します。
+
+ @return レコード ID の降順の `KintoneRecord` の `NSArray`
+ */
+- (NSArray *)records;
+
+/**
+ 保存された全てのレコードのレコード ID を返します。
+
+ @return 降順のレコード ID の `NSNumber` の `NSArray`
+ */
+- (NSArray *)recordIds;
+
+/**
+ 保存されたレコードからクエリに一致するレコードを返します。
+
+ 通信せずに `[KintoneQuery filterRecords:]` で評価します。where 句の条件のフィールドにインデックスがある場合は、インデックスで絞り込んだレコードのみを評価します。条件に一致するレコードが多い場合や、インデックスで評価できない条件は全てのレコードを評価します。
+
+ `LOGINUSER()` は `[KintoneSite cbCredential]` のユーザーとして評価します。
+
+ @param query `KintoneQuery` インスタンス。`nil` の場合は全てのレコードを返します。
+
+ @return `KintoneRecord` の `NSArray`。クエリが `LOGINUSER()` を含み、ユーザーが設定されていない場合は `nil`
+ */
+- (NSArray *)recordsWithKintoneQuery:(KintoneQuery *)query;
+
+/**
+ 保存されたレコードからクエリ文字列に一致するレコードを返します。
+
+ クエリ文字列を `[KintoneQuery kintoneQueryWithString:fields:error:]` で解析し、`recordsWithKintoneQuery:` で評価します。フィールドコードは `[KintoneApplication formCache]` のフィールドから検索するため、事前にフォームを取得してください。
+
+ @param query クエリ文字列
+ @param error エラー
+ 
+ @return `KintoneRecord` の `NSArray`。クエリ文字列を解析できない場合、`LOGINUSER()` を評価できない場合は `nil`
+ */
+- (NSArray *)recordsWithQuery:(NSString *)query error:(CBError* __autoreleasing *)error;
+
+/// ---------------------------------
+/// @name インデックス
+/// ---------------------------------
+
+/**
+ フィールドのインデックスを作成します。
+
+ インデックスは `recordsWithKintoneQuery:` の where 句の評価に利用され、レコードの保存と削除に合わせて更新されます。インデックスは保存されないため、アプリの起動毎に作成してください。
+
+ - 数値、日付、時刻、日時、作成日時、更新日時、レコード番号のフィールドは、値の順に並べたインデックスを作成し、`=`, `!=`, `>`, `<`, `>=`, `<=`, `in`, `not in` の条件に利用します。
+ - ラジオボタン、ドロップダウン、ステータス、チェックボックス、複数選択、ユーザー選択、作業者、作成者、更新者のフィールドは、選択された値毎のインデックスを作成し、`=`, `!=`, `in`, `not in` の条件に利用します。
+
+ 同じフィールドコードのインデックスが既にある場合は置き換えます。
+
+ 例:
+
+    [kintoneApplication.recordStore addIndexForField:fields[@"優先度"]];
+    [kintoneApplication.recordStore addIndexForField:fields[@"期限"]];
+
+ @param field インデックスを作成するフィールド。テーブル内のフィールドを指定した場合、インデックスは作成されますが利用されず、条件は全てのレコードを走査して評価されます。
+
+ @return インデックスを作成できないフィールドタイプの場合は `NO`
+ */
+- (BOOL)addIndexForField:(KintoneField *)field;
+
+/**
+ フィールドのインデックスを削除します。
+
+ @param code フィールドコード
+ */
+- (void)removeIndexForFieldCode:(NSString *)code;
+
+/**
+ インデックスを作成したフィールドのフィールドコードを返します。
+
+ @return フィールドコードの `NSArray`
+ */
+- (NSArray *)indexedFieldCodes;
+
+/// ---------------------------------
+/// @name レコードの保存
+/// ---------------------------------
+
+/**
+ レコードを保存します。
+
+ `$id` を含まないレコードは無視されます。
+
+ @param records `records.json` のレスポンスの形式のレコードの `NSArray`
+ @param partial フィールドを指定して取得したレコードの場合は `YES`
+ */
+- (void)storeRecordDictionaries:(NSArray *)records partial:(BOOL)partial;
+
+/**
+ レコードを削除します。
+
+ @param recordIds レコード ID の `NSNumber` の `NSArray`
+ */
+- (void)removeRecordsWithIds:(NSArray *)recordIds;
+
+/**
+ 全てのレコードを削除します。
+ */
+- (void)clear;
+
+@end
@@ -0,0 +1,141 @@
+//
+//  KintoneRecordSync.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "CBNetworking.h"
+
+@class CBRequestHandle;
+@class KintoneApplication;
+
+typedef void (^KintoneRecordSyncCompletionBlock)(NSArray *updatedRecordIds, NSArray *deletedRecordIds);
+
+/**
+ `[KintoneApplication recordStore]` を kintone アプリのレコードと差分で同期するクラスです。
+
+ `[KintoneApplication recordSync]` よりインスタンスを取得できます。
+
+ 前回の同期で取得したレコードの更新日時 (`KintoneUpdatedTimeField`) の最大値を `highWaterMark` として保存し、以降の同期ではそれ以降に更新されたレコードのみを `KintoneRecordCursor` でページ単位に先行取得します。更新日時は分単位のため、`highWaterMark` と同じ分に更新されたレコードは再度取得されます。
+
+ 削除されたレコードは、`deletionScanInterval` 毎に `$id` と `$revision` のみを全件取得し、保存されたレコード ID と比較して検出します。この時 `$revision` が異なるレコードや、保存されていないレコードも再取得されます。
+
+ 初回の同期もしくはレコードストアが空の場合は、`KintoneRecordPartitionedCursor` で全件を取得します。
+
+ 例:
+
+    KintoneRecordSyncCompletionBlock completion = ^(NSArray *updatedRecordIds, NSArray *deletedRecordIds) {
+        self.records = [kintoneApplication.recordStore records];
+        [self.tableView reloadData];
+    };
+
+    [kintoneApplication.recordSync sync:completion failure:failure queue:[CBOperationQueue sharedConcurrentQueue]];
+ */
+@interface KintoneRecordSync : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ 紐付けられた kintone アプリです。
+ */
+@property (nonatomic, weak, readonly) KintoneApplication *kintoneApplication;
+
+/**
+ 1 リクエストで取得するレコード数です。
+
+ デフォルトは 500 です。
+ */
+@property (nonatomic) int pageSize;
+
+/**
+ 削除されたレコードを検出する間隔(秒)です。
+
+ デフォルトは 86400 秒です。
+ */
+@property (nonatomic) NSTimeInterval deletionScanInterval;
+
+/**
+ 同期済みのレコードの更新日時の最大値です。同期していない場合は `nil` です。
+ */
+@property (nonatomic, readonly) NSDate *highWaterMark;
+
+/**
+ 最後に削除されたレコードを検出した日時です。検出していない場合は `nil` です。
+ */
+@property (nonatomic, readonly) NSDate *lastDeletionScanDate;
+
+/**
+ 同期中の場合は `YES` です。
+ */
+@property (nonatomic, readonly, getter = isSyncing) BOOL syncing;
+
+/// ---------------------------------
+/// @name インスタンス生成
+/// ---------------------------------
+
+/**
+ `KintoneRecordSync` インスタンスを生成します。
+
+ @param kintoneApplication kintone アプリ
+
+ @return `KintoneRecordSync` インスタンス
+ */
+- (KintoneRecordSync *)initWithKintoneApplication:(KintoneApplication *)kintoneApplication;
+
+/// ---------------------------------
+/// @name 同期
+/// ---------------------------------
+
+/**
+ レコードを同期します。
+
+ 前回の削除の検出から `deletionScanInterval` 秒が経過している場合は、削除されたレコードも検出します。同期中に呼び出した場合は、実行中の同期の完了時に各 Block を実行します。
+
+ @param completion 同期の完了時に実行される Block。引数は取得したレコードと削除したレコードのレコード ID の `NSNumber` の `NSArray` です。
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`。ページを並行して取得するため `[CBOperationQueue sharedConcurrentQueue]` の利用を推奨します。
+
+ @return 同期の `CBRequestHandle`
+ */
+- (CBRequestHandle *)sync:(KintoneRecordSyncCompletionBlock)completion
+                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                    queue:(NSOperationQueue *)queue;
+
+/**
+ レコードを同期します。
+
+ `deletionScan` に `YES` を指定した場合は、`deletionScanInterval` に関わらず削除されたレコードを検出します。
+
+ @param deletionScan 削除されたレコードを検出する場合は `YES`
+ @param completion 同期の完了時に実行される Block
+ @param failure 失敗レスポンス時に実行される Block
+ @param queue リクエスト処理に利用される `NSOperationQueue`
+
+ @return 同期の `CBRequestHandle`
+ */
+- (CBRequestHandle *)syncWithDeletionScan:(BOOL)deletionScan
+                               completion:(KintoneRecordSyncCompletionBlock)completion
+                                  failure:(CBNetworkingFailureBlockForJSONResponse)failure
+                                    queue:(NSOperationQueue *)queue;
+
+/**
+ 同期の状態を削除します。次回の同期では全件を取得します。
+ */
+- (void)reset;
+
+@end
@@ -19,7 +19,10 @@
 #import <Foundation/Foundation.h>
 
 @class CBCredential;
+@class CBRetryPolicy;
 @class KintoneApplication;
+@class KintoneFileCache;
+@class KintoneUploadCache;
 
 /**
  cybozu.com ドメインを表すクラスです。
@@ -37,6 +40,25 @@
  */
 @property (nonatomic) CBCredential *cbCredential;
 
+/**
+ `KintoneSite` 配下の kintone API に適用される再送方針です。
+
+ デフォルトは `nil` で、再送しません。`NSOutputStream` へのファイルのダウンロード、およびレコードの逐次取得は再送の対象外です。
+ */
+@property (nonatomic) CBRetryPolicy *retryPolicy;
+
+/**
+ `KintoneSite` 配下の kintone アプリからダウンロードした添付ファイルのキャッシュです。
+
+ `cacheDirectoryPath:` の `files` ディレクトリに保存されます。
+ */
+@property (nonatomic, readonly) KintoneFileCache *fileCache;
+
+/**
+ `KintoneSite` 配下の kintone アプリへアップロードしたファイルの fileKey を保持し、同じ内容のファイルの再送を省くためのキャッシュです。
+ */
+@property (nonatomic, readonly) KintoneUploadCache *uploadCache;
+
 /// ---------------------------------
 /// @name インスタンス生成
 /// ---------------------------------
@@ -63,4 +85,19 @@
  */
 - (KintoneApplication *)kintoneApplication:(int)appId;
 
+/// ---------------------------------
+/// @name キャッシュ
+/// ---------------------------------
+
+/**
+ `KintoneSite` のキャッシュを保存するディレクトリのパスを返します。
+
+ Caches ディレクトリの `kintone/<name>/<ドメイン>/<ユーザ>` です。ユーザはログイン名の SHA-256 で表されます。同じ端末で同じドメインの異なるユーザがログインしても、キャッシュは共有されません。
+
+ @param name キャッシュの種類 (`records`、`forms` 等)
+
+ @return ディレクトリのパス
+ */
+- (NSString *)cacheDirectoryPath:(NSString *)name;
+
 @end
@@ -0,0 +1,127 @@
+//
+//  KintoneUploadCache.h
+//
+//  Copyright 2013 Cybozu
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+//  use this file except in compliance with the License.  You may obtain a copy
+//  of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+//  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+//  License for the specific language governing permissions and limitations under
+//  the License.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ アップロードしたファイルの fileKey を、内容のハッシュ毎に一定時間保持するクラスです。
+
+ `[KintoneSite uploadCache]` よりインスタンスを取得できます。
+
+ `[KintoneAPI fileUploadWithFile:success:failure:queue:]` などのアップロードメソッドは、同じ内容のファイルを `timeToLive` 秒以内にアップロードしていた場合、通信せずに保持している fileKey を success Block に渡します。
+
+ ファイルの SHA-256 は、ディスク上のファイル、メモリ上のデータともにアップロードの送信中に計算されます。同じパスのファイルは、サイズと更新日時が変わっていなければ同じ内容とみなされます。メモリ上のデータは、同じ `NSData` オブジェクトであれば同じ内容とみなされます (`NSMutableData` は除きます)。
+
+ kintone は fileKey をレコードに添付した時点で消費するため、`KintoneAPI` のレコードの登録/更新で fileKey を含むリクエストが成功した場合、そのリクエストがサーバに拒否された場合 (ステータスコード 400) は、その fileKey を破棄します。
+
+ 保持する内容はメモリ上のみで、アプリを終了すると破棄されます。fileKey を保持する際に `timeToLive` を過ぎたものを破棄し、`maxCount` を超える場合は古いものから破棄します。
+ */
+@interface KintoneUploadCache : NSObject
+
+/// ---------------------------------
+/// @name プロパティ
+/// ---------------------------------
+
+/**
+ fileKey を再利用する秒数です。
+
+ デフォルトは 3600 秒です。レコードに添付されていない fileKey はサーバ上で一定期間の経過後に無効となるため、その期間より短く設定してください。0 の場合、fileKey を再利用しません。
+ */
+@property (nonatomic) NSTimeInterval timeToLive;
+
+/**
+ 保持する fileKey の最大数です。
+
+ デフォルトは 1000 です。
+ */
+@property (nonatomic) NSUInteger maxCount;
+
+/// ---------------------------------
+/// @name fileKey の参照
+/// ---------------------------------
+
+/**
+ 指定された内容のファイルの fileKey を返します。
+
+ @param hash ファイルの内容の SHA-256 (小文字の 16 進数)
+
+ @return fileKey。保持していない場合、もしくは `timeToLive` を過ぎている場合は `nil`
+ */
+- (NSString *)fileKeyForHash:(NSString *)hash;
+
+/**
+ 指定されたディスク上のファイルの fileKey を返します。
+
+ ファイルのサイズか更新日時がアップロード時から変わっている場合は `nil` を返します。
+
+ @param fileURL ファイルの URL
+
+ @return fileKey。保持していない場合、もしくは `timeToLive` を過ぎている場合は `nil`
+ */
+- (NSString *)fileKeyForFileAtURL:(NSURL *)fileURL;
+
+/**
+ 指定されたメモリ上のデータの fileKey を返します。
+
+ `setFileKey:forHash:data:` で保持した `NSData` オブジェクトと同一の場合のみ fileKey を返します。内容の比較は行いません。
+
+ @param data ファイルデータ
+
+ @return fileKey。保持していない場合、もしくは `timeToLive` を過ぎている場合は `nil`
+ */
+- (NSString *)fileKeyForData:(NSData *)data;
+
+/// ---------------------------------
+/// @name fileKey の更新
+/// ---------------------------------
+
+/**
+ アップロードしたファイルの fileKey を保持します。
+
+ @param fileKey アップロードで得られた fileKey
+ @param hash ファイルの内容の SHA-256 (小文字の 16 進数)
+ @param fileURL アップロードしたファイルの URL。メモリ上のデータの場合は `nil`
+ */
+- (void)setFileKey:(NSString *)fileKey forHash:(NSString *)hash fileURL:(NSURL *)fileURL;
+
+/**
+ アップロードしたメモリ上のデータの fileKey を保持します。
+
+ `data` は弱参照で保持され、解放されると破棄されます。
+
+ @param fileKey アップロードで得られた fileKey
+ @param hash ファイルの内容の SHA-256 (小文字の 16 進数)
+ @param data アップロードしたファイルデータ
+ */
+- (void)setFileKey:(NSString *)fileKey forHash:(NSString *)hash data:(NSData *)data;
+
+/**
+ fileKey を破棄します。
+
+ fileKey が無効となったことが分かった場合に呼び出してください。
+
+ @param fileKey fileKey
+ */
+- (void)removeFileKey:(NSString *)fileKey;
+
+/**
+ 全ての fileKey を破棄します。
+ */
+- (void)clear;
+
+@end
@@ -117,10 +117,10 @@
     [imageView addSubview:indicator];
     [indicator startAnimating];
     
-    NSOutputStream *output = [NSOutputStream outputStreamToMemory];
-    
+    // the file is kept in the disk cache; only the decoded image is kept in memory
     CBNetworkingSuccessBlockForHTTPResponse success = ^(NSURLRequest *request, NSHTTPURLResponse *response, id responseObject) {
-        UIImage *image = [UIImage imageWithData:[output propertyForKey:NSStreamDataWrittenToMemoryStreamKey]];
+        NSData *data = [NSData dataWithContentsOfURL:responseObject options:NSDataReadingMappedIfSafe error:nil];
+        UIImage *image = [UIImage imageWithData:data];
         imageView.image = [KintoneFileFieldCell thumnailImage:image];
         [[KintoneFileFieldCell sharedImageCache] setObject:image forKey:file.fileKey];
         
@@ -130,12 +130,11 @@
         [indicator stopAnimating];
     };
 
-    [self.appDelegate.kintoneApplication.kintoneAPI fileDownload:file.fileKey
-                                                         success:success
-                                                         failure:failure
-                                                        download:nil
-                                                          output:output
-                                                           queue:[CBOperationQueue sharedConcurrentQueue]];
+    [self.appDelegate.kintoneApplication.kintoneAPI fileDownloadWithCache:file.fileKey
+                                                                  success:success
+                                                                  failure:failure
+                                                                 download:nil
+                                                                    queue:[CBOperationQueue sharedConcurrentQueue]];
 }
 
 - (UIImageView *)imageView:(KintoneFile *)file placeholderImage:(UIImage *)placeholderImage
@@ -168,7 +167,7 @@
 {
     UILabel *label = [UILabel new];
     label.font = [UIFont systemFontOfSize:18];
-    label.text = [NSString stringWithFormat:@"%@ (%d bytes)", file.name, file.size];
+    label.text = [NSString stringWithFormat:@"%@ (%lld bytes)", file.name, file.size];
     [label sizeToFit];
     
     return label;
@@ -216,17 +216,36 @@
     return nil;
 }
 
+- (void)reloadStoredRecords
+{
+    // the log is read and the records are decoded in the background, then shown on the main thread
+    KintoneRecordStore *recordStore = _appDelegate.kintoneApplication.recordStore;
+    [recordStore loadWithCompletion:^{
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            NSArray *storedRecords = [recordStore records];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                _objects = [NSMutableArray arrayWithArray:storedRecords];
+                [self.tableView reloadData];
+            });
+        });
+    }];
+}
+
 - (void)fetchRecords
 {
+    // show the stored records at once, the sync below fetches only the changes
+    [self reloadStoredRecords];
+    
     [_indicator startAnimating];
     
-    CBNetworkingSuccessBlockForJSONResponse recordsSuccess = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
-        _objects = [NSMutableArray arrayWithArray:[KintoneRecord kintoneRecordsFromJSON:JSON]];
-        [self.tableView reloadData];
+    KintoneRecordSyncCompletionBlock syncCompletion = ^(NSArray *updatedRecordIds, NSArray *deletedRecordIds) {
+        if (updatedRecordIds.count > 0 || deletedRecordIds.count > 0) {
+            [self reloadStoredRecords];
+        }
         
         [_indicator stopAnimating];
     };
-    CBNetworkingFailureBlockForJSONResponse recordsFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
+    CBNetworkingFailureBlockForJSONResponse syncFailure = ^(NSURLRequest *request, NSHTTPURLResponse *response, CBError *error, id JSON) {
         [_indicator stopAnimating];
         
         // show error dialog if failure
@@ -234,11 +253,9 @@
         [alert show];
     };
     
-    [_appDelegate.kintoneApplication.kintoneAPI recordsWithFields:nil
-                                                     kintoneQuery:nil
-                                                          success:recordsSuccess
-                                                          failure:recordsFailure
-                                                            queue:[CBOperationQueue sharedNonConcurrentQueue]];
+    [_appDelegate.kintoneApplication.recordSync sync:syncCompletion
+                                             failure:syncFailure
+                                               queue:[CBOperationQueue sharedConcurrentQueue]];
 }
 
 - (void)onRefresh:(id)sender